@@ -0,0 +1,11 @@
+#!/usr/bin/env sh
+
+TOOLS=./build/tools
+
+# calibrate on the 100 test batches, then score the float and int8 nets on them
+$TOOLS/caffe quantize \
+  --model=examples/cifar10/cifar10_quick_train_test.prototxt \
+  --weights=examples/cifar10/cifar10_quick_iter_5000.caffemodel \
+  --quantized_model=examples/cifar10/cifar10_quick_int8_train_test.prototxt \
+  --quantized_weights=examples/cifar10/cifar10_quick_int8_iter_5000.caffemodel \
+  --iterations=100
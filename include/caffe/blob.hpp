@@ -134,6 +134,33 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make data_ a view of the count() elements of the data_ of Blob
+   *        other starting at element offset, e.g. to have a Layer write its
+   *        output straight into a range of a larger Blob.
+   *
+   * The view holds on to the memory of other, and stays valid until this
+   * Blob is reshaped to a larger count, which allocates its own memory again.
+   * Does nothing if data_ already is that view.
+   */
+  void ShareData(const Blob& other, int offset);
+  /// @brief Make diff_ a view of the diff_ of Blob other, as for ShareData.
+  void ShareDiff(const Blob& other, int offset);
+  /**
+   * @brief Give data_ and diff_ new memory of count() elements, dropping
+   *        their contents.
+   *
+   * Views of the old memory (see ShareData) keep it, but no longer alias this
+   * Blob; nor does this Blob alias the memory it was a view of.
+   */
+  void Reallocate();
+
+  /**
+   * @brief Charge the memory of data_ and diff_, and of any memory allocated
+   *        by later reshapes, to the given accounts (see MemoryAccount).
+   */
+  void set_memory_accounts(const shared_ptr<MemoryAccount>& data_account,
+      const shared_ptr<MemoryAccount>& diff_account);
 
  protected:
   shared_ptr<SyncedMemory> data_;
@@ -144,6 +171,8 @@ class Blob {
   int width_;
   int count_;
   int capacity_;
+  shared_ptr<MemoryAccount> data_account_;
+  shared_ptr<MemoryAccount> diff_account_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
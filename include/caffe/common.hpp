@@ -88,6 +88,8 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
+class ThreadPool;
+
 // A global initialization function that you should call in your main function.
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
@@ -148,6 +150,12 @@ class Caffe {
   static void SetDevice(const int device_id);
   // Prints the current GPU status.
   static void DeviceQuery();
+  // Sets the number of threads used to parallelize CPU computation, e.g. the
+  // images of a batch in convolution (1, the default, disables it).
+  static void set_num_threads(const int num_threads);
+  static int num_threads();
+  // The pool of num_threads() threads that CPU computation is spread over.
+  static ThreadPool& thread_pool();
 
  protected:
 #ifndef CPU_ONLY
@@ -155,6 +163,7 @@ class Caffe {
   curandGenerator_t curand_generator_;
 #endif
   shared_ptr<RNG> random_generator_;
+  shared_ptr<ThreadPool> thread_pool_;
 
   Brew mode_;
   static shared_ptr<Caffe> singleton_;
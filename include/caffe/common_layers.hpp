@@ -12,6 +12,8 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -35,6 +37,10 @@ class ArgMaxLayer : public Layer<Dtype> {
    *     the number @f$ K @f$ of maximal items to output.
    *   - out_max_val (\b optional bool, default false).
    *     if set, output a vector of pairs (max_ind, max_val) for each image.
+   *   - axis (\b optional int).
+   *     if set, the axis to maximise along, with the output the shape of the
+   *     input but for @f$ K @f$ along axis (the max_val only with
+   *     out_max_val).
    */
   explicit ArgMaxLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
@@ -66,8 +72,20 @@ class ArgMaxLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
     NOT_IMPLEMENTED;
   }
+  // The top_k of the rows that thread thread_id of num_threads is
+  // responsible for.
+  void forward_cpu_rows(const Dtype* bottom_data, Dtype* top_data,
+      int num_threads, int thread_id);
+
   bool out_max_val_;
   size_t top_k_;
+  bool has_axis_;
+  int axis_;
+  // The input is outer_num_ x axis_dim_ x inner_num_ values, with a row of
+  // axis_dim_ values inner_num_ apart for each of the others.
+  int outer_num_;
+  int axis_dim_;
+  int inner_num_;
 };
 
 /**
@@ -137,6 +155,11 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief With share_bottoms, make the bottoms views of their ranges of the
+  ///        top once they have been copied, so that later passes copy nothing.
+  void ShareBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   Blob<Dtype> col_bob_;
   int count_;
   int num_;
@@ -144,6 +167,9 @@ class ConcatLayer : public Layer<Dtype> {
   int height_;
   int width_;
   int concat_dim_;
+  bool share_bottoms_;
+  // Whether ShareBottoms has made the bottoms views of the top.
+  bool bottoms_shared_;
 };
 
 /**
@@ -176,9 +202,18 @@ class EltwiseLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The values of the chunk of the output that thread thread_id of
+  // num_threads is responsible for, from all of bottom_data_ in one pass.
+  void forward_cpu_chunk(Dtype* top_data, int* mask, int num_threads,
+      int thread_id);
+
   EltwiseParameter_EltwiseOp op_;
   vector<Dtype> coeffs_;
+  // The input to reach the maximum of each output, for the gradient (so the
+  // CPU leaves it alone in the TEST phase).
   Blob<int> max_idx_;
+  vector<const Dtype*> bottom_data_;
+  int count_;
 
   bool stable_prod_grad_;
 };
@@ -246,11 +281,13 @@ template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), packed_version_(0),
+        float_weights_dropped_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void ToProto(LayerParameter* param, bool write_diff = false);
 
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return -1; }
@@ -266,11 +303,70 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // In the TEST phase, batches of up to kMaxPanelBatch inputs are multiplied
+  // by a copy of the weights packed into panels (see caffe_cpu_pack_panels),
+  // in half precision with half_weights, which is made on the first such
+  // forward pass and again whenever the weights have been written since.
+  // Two limits:
+  // - The float copy is a second full copy of the weights (e.g. 151 MB for
+  //   the fc6 of CaffeNet), on top of blobs_[0], which larger batches, the
+  //   GPU, the solvers and Net::ToProto keep using.
+  // - "Written" means handed out by mutable_cpu_data (or mutable_gpu_data),
+  //   which bumps SyncedMemory::version.  Writes through a pointer obtained
+  //   before the last forward pass, such as a pycaffe ndarray kept across
+  //   forward passes, do not bump it and leave the copy stale.  Fetch the
+  //   pointer again (e.g. net.params[...][0].data) before each write.
+  // With half_weights, the half precision panels replace blobs_[0] when no
+  // other blob shares its memory (as a solver's test net does with the train
+  // net): its memory is freed once packed, and refilled from the panels
+  // (rounded to half precision) by the other paths and ToProto.  Until then,
+  // reading blobs_[0] directly, e.g. from pycaffe, sees zeros, and writing
+  // only part of it loses the rest.
+  static const int kMaxPanelBatch = 4;
+  void forward_cpu_packed(const Dtype* bottom_data, Dtype* top_data);
+  void drop_float_weights();
+  void restore_float_weights();
+  // The outputs of the panels that thread thread_id of num_threads is
+  // responsible for.
+  void forward_cpu_panels(const Dtype* bottom_data, Dtype* top_data,
+      int num_threads, int thread_id);
+  // In the TEST phase, a layer with a quantization_param computes in int8
+  // instead (see caffe/util/quantize.hpp), spreading its outputs over the
+  // threads.
+  void forward_cpu_int8(const Dtype* bottom_data, Dtype* top_data);
+  void forward_cpu_int8_outputs(const uint8_t* inputs, int32_t* sums,
+      Dtype* top_data, int num_threads, int thread_id);
+
+  // In the TEST phase, a layer whose weights are sparse enough multiplies by
+  // the nonzeros only (see caffe/util/sparse.hpp), spreading its outputs over
+  // the threads.
+  void forward_cpu_sparse(const Dtype* bottom_data, Dtype* top_data);
+  void forward_cpu_sparse_outputs(const Dtype* inputs, Dtype* outputs,
+      Dtype* top_data, int num_threads, int thread_id);
+
   int M_;
   int K_;
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  bool half_weights_;
+  Blob<Dtype> packed_weight_;
+  shared_ptr<SyncedMemory> packed_half_weight_;
+  // The weight memory the panels were packed from, and its version then.
+  shared_ptr<SyncedMemory> packed_memory_;
+  size_t packed_version_;
+  // Whether blobs_[0] was freed in favor of the half precision panels.
+  bool float_weights_dropped_;
+  bool quantize_;
+  Dtype int8_input_scale_;
+  int int8_zero_point_;
+  QuantizedWeights<Dtype> int8_weights_;
+  // The quantized inputs and their int32 outputs.
+  shared_ptr<SyncedMemory> int8_buffer_;
+  float sparse_threshold_;
+  SparseWeights<Dtype> sparse_weights_;
+  // The inputs and outputs of a batch, transposed.
+  Blob<Dtype> sparse_buffer_;
 };
 
 /**
@@ -300,9 +396,23 @@ class MVNLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The CPU passes over the rows (the images, or the channels of each image,
+  // that are normalized on their own) that thread thread_id of num_threads
+  // is responsible for: the statistics of a row and its normalization, or
+  // its gradient.
+  void forward_cpu_rows(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* mean, Dtype* variance, int num_threads, int thread_id);
+  void backward_cpu_rows(const Dtype* top_data, const Dtype* top_diff,
+      const Dtype* variance, Dtype* bottom_diff, int num_threads,
+      int thread_id);
+
+  // The mean of each row and, with normalize_variance, its standard
+  // deviation plus eps.
   Blob<Dtype> mean_, variance_, temp_;
+  int num_rows_, row_dim_;
 
   /// sum_multiplier is used to carry out sum using BLAS
+  /// (temp_ and sum_multiplier_ are only used by the GPU)
   Blob<Dtype> sum_multiplier_;
 };
 
@@ -362,10 +472,20 @@ class SoftmaxLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The CPU passes over the tiles of the images that thread thread_id of
+  // num_threads is responsible for; see caffe_cpu_softmax.
+  void forward_cpu_tiles(const Dtype* bottom_data, Dtype* top_data,
+      int num_threads, int thread_id);
+  void backward_cpu_tiles(const Dtype* top_data, const Dtype* top_diff,
+      Dtype* bottom_diff, int num_threads, int thread_id);
+
   /// sum_multiplier is used to carry out sum using BLAS
   Blob<Dtype> sum_multiplier_;
   /// scale is an intermediate Blob to hold temporary results.
   Blob<Dtype> scale_;
+  int num_;
+  int channels_;
+  int spatial_dim_;
 };
 
 #ifdef USE_CUDNN
@@ -458,6 +578,12 @@ class SliceLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief With share_tops, make the tops views of their ranges of the
+  ///        bottom once they have been copied, so that later passes copy
+  ///        nothing.
+  void ShareTops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   Blob<Dtype> col_bob_;
   int count_;
   int num_;
@@ -466,6 +592,9 @@ class SliceLayer : public Layer<Dtype> {
   int width_;
   int slice_dim_;
   vector<int> slice_point_;
+  bool share_tops_;
+  // Whether ShareTops has made the tops views of the bottom.
+  bool tops_shared_;
 };
 
 }  // namespace caffe
@@ -78,10 +78,23 @@ class AccuracyLayer : public Layer<Dtype> {
     }
   }
 
+  // Whether class j of an input is left out of its ranking (as if it scored
+  // -9999) for the ignore_label and ignore_mode of the loss_param.
+  inline bool ignored_class(int j) const {
+    return has_ignore_label_ && ((ignore_mode_ == 1 && j > ignore_label_) ||
+        (ignore_mode_ == 2 && j == ignore_label_) ||
+        (ignore_mode_ == 3 && j < ignore_label_));
+  }
+  // Counts the inputs that thread thread_id of num_threads is responsible for
+  // whose label is in their top_k into correct_[thread_id].
+  void forward_cpu_inputs(const Dtype* bottom_data, const Dtype* bottom_label,
+      const int num, const int dim, int num_threads, int thread_id);
+
   bool has_ignore_label_;
   int top_k_;
   int ignore_label_;
   int ignore_mode_;
+  vector<int> correct_;
 };
 
 /**
@@ -742,6 +755,18 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
 
+  // The CPU passes over the tiles of the images that thread thread_id of
+  // num_threads is responsible for, which compute the softmax and the loss
+  // together.  The forward pass stores the loss and the number of labels not
+  // ignored of the thread in losses[thread_id] and counts[thread_id].
+  void forward_cpu_tiles(const Dtype* bottom_data, const Dtype* label,
+      Dtype* prob_data, Dtype* losses, int* counts, int num_threads,
+      int thread_id);
+  void backward_cpu_tiles(const Dtype* prob_data, const Dtype* label,
+      Dtype scale, Dtype* bottom_diff, int num_threads, int thread_id);
+  /// The channel a label selects, or -1 if the label is to be ignored.
+  int label_channel(Dtype label) const;
+
   /// The internal SoftmaxLayer used to map predictions to a distribution.
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
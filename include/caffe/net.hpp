@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/weight_map.hpp"
 
 namespace caffe {
 
@@ -23,6 +24,12 @@ namespace caffe {
 template <typename Dtype>
 class Net {
  public:
+  /// @brief The categories of memory attributed to each layer.
+  enum MemoryCategory {
+    TOP_DATA, TOP_DIFF, PARAM_DATA, PARAM_DIFF, INTERNAL,
+    NUM_MEMORY_CATEGORIES
+  };
+
   explicit Net(const NetParameter& param);
   explicit Net(const string& param_file, Phase phase);
   virtual ~Net() {}
@@ -98,6 +105,15 @@ class Net {
    */
   void CopyTrainedLayersFrom(const NetParameter& param);
   void CopyTrainedLayersFrom(const string trained_filename);
+  /**
+   * @brief For an already initialized net, points the parameter blobs of the
+   *        layers found in a weight map file (see caffe/util/weight_map.hpp)
+   *        directly at the memory-mapped file instead of copying them.
+   *
+   * The mapping is owned by the net and released with it.
+   * CopyTrainedLayersFrom(filename) calls this for weight map files.
+   */
+  void MapTrainedLayersFrom(const string& weight_map_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
 
@@ -107,6 +123,14 @@ class Net {
   inline const vector<string>& layer_names() const { return layer_names_; }
   /// @brief returns the blob names
   inline const vector<string>& blob_names() const { return blob_names_; }
+  /**
+   * @brief returns the names of the blobs the net computes in place (see
+   *        NetParameter.plan_in_place), mapped to the names in blob_names()
+   *        of the blobs holding their data
+   */
+  inline const map<string, string>& blob_aliases() const {
+    return blob_aliases_;
+  }
   /// @brief returns the blobs
   inline const vector<shared_ptr<Blob<Dtype> > >& blobs() const {
     return blobs_;
@@ -172,6 +196,34 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief returns the account of all memory held by the net's blobs.
+   *
+   * It is the parent of the per-layer accounts; memory of the net input
+   * blobs is charged to it directly.
+   */
+  inline const shared_ptr<MemoryAccount>& memory_account() const {
+    return memory_account_;
+  }
+  /// @brief returns the account of all memory attributed to each layer
+  inline const vector<shared_ptr<MemoryAccount> >&
+      layer_memory_accounts() const {
+    return layer_memory_accounts_;
+  }
+  /**
+   * @brief returns the accounts of each layer, indexed by MemoryCategory.
+   *
+   * Top blobs are attributed to the layer producing them, and blobs a layer
+   * reshapes itself during setup, reshape, forward or backward (such as
+   * col_buffer_ or max_idx_) to its INTERNAL category.
+   */
+  inline const vector<vector<shared_ptr<MemoryAccount> > >&
+      category_memory_accounts() const {
+    return category_memory_accounts_;
+  }
+  /// @brief Logs the current and peak memory usage per layer and category.
+  void LogMemoryUsage() const;
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -192,7 +244,8 @@ class Net {
   /// @brief Append a new bottom blob to the net.
   int AppendBottom(const NetParameter& param, const int layer_id,
                    const int bottom_id, set<string>* available_blobs,
-                   map<string, int>* blob_name_to_idx);
+                   map<string, int>* blob_name_to_idx,
+                   map<string, int>* blob_reads_left);
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
@@ -208,6 +261,8 @@ class Net {
 
   /// @brief Get misc parameters, e.g. the LR multiplier and weight decay.
   void GetLearningRateAndWeightDecay();
+  /// @brief Create the memory accounts of a newly appended layer.
+  void AppendMemoryAccounts(const string& layer_name);
 
   /// @brief The network name
   string name_;
@@ -222,6 +277,7 @@ class Net {
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
   map<string, int> blob_names_index_;
+  map<string, string> blob_aliases_;
   vector<bool> blob_need_backward_;
   /// bottom_vecs stores the vectors containing the input for each layer.
   /// They don't actually host the blobs (blobs_ does), so we simply store
@@ -253,8 +309,16 @@ class Net {
   vector<float> params_weight_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Accounts of the memory allocated by the blobs of this net
+  shared_ptr<MemoryAccount> memory_account_;
+  vector<shared_ptr<MemoryAccount> > layer_memory_accounts_;
+  vector<vector<shared_ptr<MemoryAccount> > > category_memory_accounts_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether Init logs the net setup (i.e. INFO messages are not dropped).
+  bool log_init_;
+  /// The weight map files the parameter blobs may point into.
+  vector<shared_ptr<WeightMap> > weight_maps_;
 
   DISABLE_COPY_AND_ASSIGN(Net);
 };
@@ -106,6 +106,13 @@ class AbsValLayer : public NeuronLayer<Dtype> {
 template <typename Dtype>
 class BNLLLayer : public NeuronLayer<Dtype> {
  public:
+  /**
+   * @param param provides BNLLParameter bnll_param,
+   *     with BNLLLayer options:
+   *   - fast_math (\b optional, default false).
+   *     whether the CPU computes vectorized approximations of
+   *     exp and log, float only.
+   */
   explicit BNLLLayer(const LayerParameter& param)
       : NeuronLayer<Dtype>(param) {}
 
@@ -197,8 +204,22 @@ class DropoutLayer : public NeuronLayer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Draw and apply the mask of the thread_id-th of num_threads
+  ///        ranges of words of mask_bits_.
+  void forward_cpu_words(const Dtype* bottom_data, unsigned int* mask,
+      Dtype* top_data, unsigned int key0, unsigned int key1, int num_threads,
+      int thread_id);
+  void backward_cpu_words(const Dtype* top_diff, const unsigned int* mask,
+      Dtype* bottom_diff, int num_threads, int thread_id);
+  /// The number of threads to split count elements over.
+  int cpu_threads() const;
+
   /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
+  /// (GPU only)
   Blob<unsigned int> rand_vec_;
+  /// the CPU mask, one bit per input, set for the inputs kept
+  Blob<unsigned int> mask_bits_;
+  int count_;
   /// the probability @f$ p @f$ of dropping any input
   Dtype threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
@@ -456,6 +477,13 @@ class CuDNNReLULayer : public ReLULayer<Dtype> {
 template <typename Dtype>
 class SigmoidLayer : public NeuronLayer<Dtype> {
  public:
+  /**
+   * @param param provides SigmoidParameter sigmoid_param,
+   *     with SigmoidLayer options:
+   *   - fast_math (\b optional, default false).
+   *     whether the CPU computes vectorized approximations of
+   *     exp in the forward pass, float only.
+   */
   explicit SigmoidLayer(const LayerParameter& param)
       : NeuronLayer<Dtype>(param) {}
 
@@ -539,6 +567,13 @@ class CuDNNSigmoidLayer : public SigmoidLayer<Dtype> {
 template <typename Dtype>
 class TanHLayer : public NeuronLayer<Dtype> {
  public:
+  /**
+   * @param param provides TanHParameter tanh_param,
+   *     with TanHLayer options:
+   *   - fast_math (\b optional, default false).
+   *     whether the CPU computes vectorized approximations of
+   *     tanh in the forward pass, float only.
+   */
   explicit TanHLayer(const LayerParameter& param)
       : NeuronLayer<Dtype>(param) {}
 
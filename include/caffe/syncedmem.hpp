@@ -6,6 +6,9 @@
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 
+// Forward declare boost::mutex as in thread_pool.hpp.
+namespace boost { class mutex; }
+
 namespace caffe {
 
 // Theoretically, CaffeMallocHost and CaffeFreeHost should simply call the
@@ -31,6 +34,56 @@ inline void CaffeFreeHost(void* ptr) {
   free(ptr);
 }
 
+/**
+ * @brief Counts the host and device bytes currently allocated by the
+ *        SyncedMemory instances charged to it, and their high-water mark.
+ *
+ * Net keeps one account per (layer, category), see Net::MemoryCategory.
+ * A SyncedMemory is charged to the account that is current on the thread
+ * constructing it, unless it is explicitly moved with
+ * SyncedMemory::set_account.  Its memory may be allocated on another thread,
+ * e.g. by a data prefetch thread: each account guards its own counters.
+ * Charges also apply to the parent account, if any, so that e.g. the peak of
+ * a whole layer is exact rather than the sum of its categories' peaks.
+ */
+class MemoryAccount {
+ public:
+  MemoryAccount(const string& owner, const string& category,
+      const shared_ptr<MemoryAccount>& parent = shared_ptr<MemoryAccount>());
+
+  inline const string& owner() const { return owner_; }
+  inline const string& category() const { return category_; }
+  inline const shared_ptr<MemoryAccount>& parent() const { return parent_; }
+  size_t cpu_bytes() const;
+  size_t gpu_bytes() const;
+  size_t peak_cpu_bytes() const;
+  size_t peak_gpu_bytes() const;
+  /// @brief Lower the high-water marks to the current usage.
+  void ResetPeak();
+
+  void Allocate(size_t cpu_bytes, size_t gpu_bytes);
+  void Free(size_t cpu_bytes, size_t gpu_bytes);
+
+  /// @brief The account SyncedMemory newly constructed by the calling thread
+  ///        is charged to.
+  static shared_ptr<MemoryAccount> current();
+  /// @brief Set the current account of the calling thread; NULL (the
+  ///        default of every thread) disables the accounting.
+  static void set_current(const shared_ptr<MemoryAccount>& account);
+
+ private:
+  string owner_;
+  string category_;
+  shared_ptr<MemoryAccount> parent_;
+  size_t cpu_bytes_;
+  size_t gpu_bytes_;
+  size_t peak_cpu_bytes_;
+  size_t peak_gpu_bytes_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(MemoryAccount);
+};
+
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
@@ -42,10 +95,16 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false) {}
+        own_cpu_data_(false), account_(MemoryAccount::current()),
+        offset_(0), version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false) {}
+        own_cpu_data_(false), account_(MemoryAccount::current()),
+        offset_(0), version_(0) {}
+  /// @brief A view of the size bytes of base starting at byte offset, which
+  ///        allocates nothing and shares the head of base.
+  SyncedMemory(const shared_ptr<SyncedMemory>& base, size_t offset,
+      size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -53,17 +112,38 @@ class SyncedMemory {
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
-  SyncedHead head() { return head_; }
+  SyncedHead head() { return base_ ? base_->head() : head_; }
   size_t size() { return size_; }
+  inline bool is_view() const { return base_.get() != NULL; }
+  /// @brief Whether this is a view of the size() bytes of base starting at
+  ///        byte offset.
+  bool is_view_of(const SyncedMemory& base, size_t offset) const;
+  /// @brief Charge this memory, including what is already allocated, to
+  ///        another account (which may be NULL).
+  void set_account(const shared_ptr<MemoryAccount>& account);
+  inline const shared_ptr<MemoryAccount>& account() const { return account_; }
+  /// @brief The number of times the memory (or, for a view, its base) has
+  ///        been handed out for writing, by which e.g. a layer can tell
+  ///        whether what it derived from the memory is still current.
+  inline size_t version() const {
+    return base_ ? base_->version_ : version_;
+  }
 
  private:
   void to_cpu();
   void to_gpu();
+  inline size_t cpu_bytes() const { return own_cpu_data_ ? size_ : 0; }
+  inline size_t gpu_bytes() const { return gpu_ptr_ ? size_ : 0; }
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
+  shared_ptr<MemoryAccount> account_;
+  // The memory viewed, which is never a view itself, if any.
+  shared_ptr<SyncedMemory> base_;
+  size_t offset_;
+  size_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,18 @@
+#ifndef _CAFFE_UTIL_FUSE_ACTIVATIONS_HPP_
+#define _CAFFE_UTIL_FUSE_ACTIVATIONS_HPP_
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters (after PlanInPlace) folding every ReLU or Threshold
+// layer that directly follows a Convolution and computes in place on its only
+// top into the convolution, as its fused_activation.  Nothing is fused unless
+// the net state explicitly sets the TEST phase and force_backward is off, as
+// fused convolutions have no backward pass for the activation.
+void FuseActivations(const NetParameter& param, NetParameter* param_fused);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_FUSE_ACTIVATIONS_HPP_
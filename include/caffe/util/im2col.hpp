@@ -1,6 +1,8 @@
 #ifndef _CAFFE_UTIL_IM2COL_HPP_
 #define _CAFFE_UTIL_IM2COL_HPP_
 
+#include <stdint.h>
+
 namespace caffe {
 
 template <typename Dtype>
@@ -15,6 +17,28 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, Dtype* data_im);
 
+// The transposed convolution of each of the channels of data_in by a
+// kernel_h x kernel_w kernel of its own (kernels, channel by channel), into
+// the height x width channels of data_out: col2im_cpu of the products of the
+// input and kernel values, without the column buffer.  data_in has the shape
+// of the column buffer rows of data_out.
+template <typename Dtype>
+void deconv_channelwise_cpu(const Dtype* data_in, const Dtype* kernels,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, Dtype* data_out);
+
+// The patches of an image of quantized values stored pixel by pixel, each
+// pixel of channels values pixel_stride bytes apart: row p (the output pixel
+// h * width_col + w) of data_patches, ldp bytes long, holds the kernel_h x
+// kernel_w pixels of the patch, with pad_value where it falls into the
+// padding, and then zeros.
+void im2patches_cpu(const uint8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int pixel_stride, const uint8_t pad_value,
+    const int ldp, uint8_t* data_patches);
+
 template <typename Dtype>
 void im2col_gpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
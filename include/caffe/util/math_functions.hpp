@@ -72,6 +72,10 @@ unsigned int caffe_rng_rand();
 template <typename Dtype>
 Dtype caffe_nextafter(const Dtype b);
 
+// Uniform numbers a + (b - a) u, with u in [0, 1) of 24 random bits for
+// float and 32 random bits for double: the range is [a, b), although
+// rounding may still yield b.  (The former boost::uniform_real draws were in
+// [a, nextafter(b)), and had all the precision of a double.)
 template <typename Dtype>
 void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r);
 
@@ -105,6 +109,15 @@ int caffe_cpu_hamming_distance(const int n, const Dtype* x, const Dtype* y);
 template <typename Dtype>
 Dtype caffe_cpu_asum(const int n, const Dtype* x);
 
+// The k largest of the n values x[i * incx] and their indices i, from the
+// largest down, with equal values ordered by decreasing index (as
+// std::partial_sort with std::greater on (value, index) pairs orders them).
+// Selects with a heap of k values kept in values and indices, so it needs
+// no memory of its own.
+template <typename Dtype>
+void caffe_cpu_top_k(const int n, const Dtype* x, const int incx, const int k,
+    Dtype* values, int* indices);
+
 // the branchless, type-safe version from
 // http://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 template<typename Dtype>
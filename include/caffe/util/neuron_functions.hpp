@@ -0,0 +1,242 @@
+#ifndef CAFFE_UTIL_NEURON_FUNCTIONS_H_
+#define CAFFE_UTIL_NEURON_FUNCTIONS_H_
+
+#include <stdint.h>
+
+namespace caffe {
+
+// The element-wise CPU functions of the neuron layers.  The float versions
+// run SSE2 or AVX2 kernels, selected at runtime by what the CPU supports; the
+// double versions are plain loops.
+//
+// With fast_math, sigmoid, tanh, BNLL and exp use vectorized polynomial
+// approximations of exp, log and tanh (relative error within a few float ulp)
+// instead of calling libm for every element.  fast_math has no effect on
+// doubles.
+
+// The instruction sets the float kernels can run with.
+enum SimdLevel {
+  SIMD_NONE = 0,
+  SIMD_SSE2 = 1,
+  SIMD_AVX2 = 2
+};
+
+// The best instruction set supported by both the CPU and the build.
+SimdLevel caffe_cpu_max_simd_level();
+// The instruction set the float kernels currently run with.
+SimdLevel caffe_cpu_simd_level();
+// Restricts the float kernels to the given instruction set (at most
+// caffe_cpu_max_simd_level()), e.g. to compare the kernels against each other.
+void caffe_set_cpu_simd_level(const SimdLevel level);
+
+// y = max(x, 0) + negative_slope * min(x, 0)
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype* x, const Dtype negative_slope,
+    Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype* x, const Dtype* dy,
+    const Dtype negative_slope, Dtype* dx);
+
+// y = 1 / (1 + exp(-x))
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math);
+
+// Takes the sigmoid output y rather than the input.
+template <typename Dtype>
+void caffe_cpu_sigmoid_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx);
+
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math);
+
+// Takes the tanh output y rather than the input.
+template <typename Dtype>
+void caffe_cpu_tanh_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx);
+
+// y = log(1 + exp(x))
+template <typename Dtype>
+void caffe_cpu_bnll(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_bnll_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx, const bool fast_math);
+
+// y = (x > threshold) ? 1 : 0
+template <typename Dtype>
+void caffe_cpu_threshold(const int n, const Dtype* x, const Dtype threshold,
+    Dtype* y);
+
+// y = |x|
+template <typename Dtype>
+void caffe_cpu_absval(const int n, const Dtype* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_cpu_absval_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx);
+
+// y = exp(x), as used by the softmax.  The fast_math approximation clamps x
+// to [-87.3, 88], the range of normal float results.
+template <typename Dtype>
+void caffe_cpu_exp(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math);
+
+// The dropout mask of elements [start, start + n) of the random stream keyed
+// by (key0, key1), packed into bits: bit i % 32 of mask[i / 32] is set, i.e.
+// element start + i is kept, where the counter-based random number of start + i
+// is above threshold, with probability 1 - threshold / 2^32.  start must be a
+// multiple of 32.  The stream is the same whatever the instruction set and
+// however it is split.
+void caffe_cpu_dropout_mask(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1,
+    const unsigned int threshold, unsigned int* mask);
+
+// y = x * scale where the bit of mask (as above) is set, and 0 elsewhere
+template <typename Dtype>
+void caffe_cpu_dropout(const int n, const Dtype* x, const unsigned int* mask,
+    const Dtype scale, Dtype* y);
+
+// Elements [start, start + n) of the bulk random streams keyed by (key0, key1),
+// from the same counter-based random numbers as the dropout mask, so that they
+// too can be drawn in parallel chunks.  The float versions run the SIMD
+// kernels, the double ones scalar code over the same random numbers (with the
+// resolution of their 32 bits).
+//
+// Uniform numbers in [a, b), see caffe_rng_uniform.
+template <typename Dtype>
+void caffe_cpu_rng_uniform(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const Dtype a,
+    const Dtype b, Dtype* r);
+
+// Normal numbers with mean mu and standard deviation sigma, by the Box-Muller
+// transform.  The transforms fill blocks of 16 elements, so start must be a
+// multiple of 16.
+template <typename Dtype>
+void caffe_cpu_rng_gaussian(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const Dtype mu,
+    const Dtype sigma, Dtype* r);
+
+// 1 where the random number is below threshold, i.e. with probability
+// threshold / 2^32, and 0 elsewhere.
+void caffe_cpu_rng_bernoulli(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1,
+    const unsigned int threshold, unsigned int* r);
+
+// The rows of a panel of caffe_cpu_pack_panels.
+const int kCpuPanelRows = 8;
+
+// Packs the n x k row-major matrix w into panels of kCpuPanelRows rows, each
+// stored column by column: element (j, i) goes to
+// panels[(j / kCpuPanelRows) * kCpuPanelRows * k + i * kCpuPanelRows +
+// j % kCpuPanelRows], and the rows of a partial last panel are zero.  panels
+// holds caffe_cpu_panels_count(n, k) elements.
+template <typename Dtype>
+void caffe_cpu_pack_panels(const int n, const int k, const Dtype* w,
+    Dtype* panels);
+
+inline int caffe_cpu_panels_count(const int n, const int k) {
+  return (n + kCpuPanelRows - 1) / kCpuPanelRows * kCpuPanelRows * k;
+}
+
+// y = x w^T + bias (if not NULL) for the m x k matrix x and the n x k matrix
+// w packed into panels, with the rows of y ldy apart.  Each panel is read
+// once for every 4 rows of x, and its outputs are summed as vectors, so that
+// for small m this beats a GEMM (or a GEMV) on w.
+template <typename Dtype>
+void caffe_cpu_panel_inner_product(const int m, const int n, const int k,
+    const Dtype* panels, const Dtype* x, const Dtype* bias, Dtype* y,
+    const int ldy);
+
+// Converts to and from IEEE half precision, rounding to nearest even.
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, uint16_t* h);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* h, Dtype* y);
+
+// caffe_cpu_pack_panels into panels of half precision weights, which take
+// half the memory, and half the bandwidth to read.
+template <typename Dtype>
+void caffe_cpu_pack_half_panels(const int n, const int k, const Dtype* w,
+    uint16_t* panels);
+
+// The n x k row-major matrix of the panels of caffe_cpu_pack_half_panels,
+// i.e. the packed matrix rounded to half precision.
+template <typename Dtype>
+void caffe_cpu_unpack_half_panels(const int n, const int k,
+    const uint16_t* panels, Dtype* w);
+
+// caffe_cpu_panel_inner_product over the panels of
+// caffe_cpu_pack_half_panels, converting the weights to float as it reads
+// them.
+template <typename Dtype>
+void caffe_cpu_half_panel_inner_product(const int m, const int n,
+    const int k, const uint16_t* panels, const Dtype* x, const Dtype* bias,
+    Dtype* y, const int ldy);
+
+// y = sum_j coeffs[j] x[j], element-wise over the n values of the k inputs
+// x[j], in a single pass.
+template <typename Dtype>
+void caffe_cpu_eltwise_sum(const int n, const int k, const Dtype* const* x,
+    const Dtype* coeffs, Dtype* y);
+
+// y = prod_j x[j], element-wise over the n values of the k >= 2 inputs x[j].
+template <typename Dtype>
+void caffe_cpu_eltwise_prod(const int n, const int k, const Dtype* const* x,
+    Dtype* y);
+
+// y = max_j x[j], element-wise over the n values of the k >= 2 inputs x[j],
+// and, unless mask is NULL, the index of the first input to reach it (but
+// for ties between x[0] and x[1], which go to 1, as EltwiseLayer had it).
+template <typename Dtype>
+void caffe_cpu_eltwise_max(const int n, const int k, const Dtype* const* x,
+    Dtype* y, int* mask);
+
+// c = a b for the sparse m x k matrix a in compressed sparse row form and the
+// dense k x n matrix b, with the rows of b ldb apart and those of c ldc
+// apart.  The nonzeros of row r of a are values[p] in columns col_idx[p] for
+// p from row_ptr[r] to row_ptr[r + 1] - 1.
+template <typename Dtype>
+void caffe_cpu_csrmm(const int m, const int n, const int* row_ptr,
+    const int* col_idx, const Dtype* values, const Dtype* b, const int ldb,
+    Dtype* c, const int ldc);
+
+// The mean and (biased) variance of the n values of x, in one pass that
+// keeps the squared deviations from a running mean rather than the squares
+// (after Welford), so that the variance does not cancel for large means.
+template <typename Dtype>
+void caffe_cpu_mean_variance(const int n, const Dtype* x, Dtype* mean,
+    Dtype* variance);
+
+// y = (x - mean) * scale
+template <typename Dtype>
+void caffe_cpu_normalize(const int n, const Dtype* x, const Dtype mean,
+    const Dtype scale, Dtype* y);
+
+// The gradient of caffe_cpu_normalize with the mean and the scale (the
+// reciprocal of the standard deviation) taken from x itself, from its output
+// y: dx = (dy - mean(dy) - y * mean(y * dy)) * scale, in two passes.
+template <typename Dtype>
+void caffe_cpu_normalize_backward(const int n, const Dtype* y,
+    const Dtype* dy, const Dtype scale, Dtype* dx);
+
+// The multiple of kCpuInt8Block that caffe_cpu_int8_gemm takes for k.
+const int kCpuInt8Block = 32;
+
+inline int caffe_cpu_int8_padded(const int k) {
+  return (k + kCpuInt8Block - 1) / kCpuInt8Block * kCpuInt8Block;
+}
+
+// c = a b^T for the m x k matrix a of values in [0, 127] and the n x k matrix
+// b of values in [-127, 127] (both row-major), with exact int32 sums and the
+// rows of c ldc apart.
+void caffe_cpu_int8_gemm(const int m, const int n, const int k,
+    const uint8_t* a, const int8_t* b, int32_t* c, const int ldc);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NEURON_FUNCTIONS_H_
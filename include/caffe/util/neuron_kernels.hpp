@@ -0,0 +1,1044 @@
+#ifndef CAFFE_UTIL_NEURON_KERNELS_H_
+#define CAFFE_UTIL_NEURON_KERNELS_H_
+
+#include <stdint.h>
+
+#include <cstring>
+
+// The float kernels behind caffe/util/neuron_functions.hpp, written once over
+// an instruction set Isa and instantiated for each of them.  Each translation
+// unit instantiates them only for its own Isa types (defined in an unnamed
+// namespace), so that e.g. the AVX2 kernels, compiled with -mavx2, never
+// replace those run on CPUs without AVX2.
+//
+// An Isa provides a vector type V of kWidth floats and an integer vector type
+// I, with element-wise operations on them.  Comparisons return masks: vectors
+// whose elements have all bits set where the comparison holds, and are zero
+// elsewhere.  The integer operations (prefixed with i) treat the elements of I
+// as unsigned 32-bit integers, except for idot_u8s8, which adds the products
+// of 4 * kWidth unsigned and signed bytes to the signed elements of I (each
+// element gets some of them), and ihsum, which sums the signed elements.
+// load_half and store_half convert kWidth IEEE half precision values to and
+// from V, rounding to nearest even.
+//
+// Nothing but the kernels belongs in here: this header is compiled with the
+// flags of every instruction set.  Its helpers live in an unnamed namespace and
+// it instantiates no std templates, so that the linker never merges a copy
+// compiled with -mavx2 into the code of the other instruction sets.
+
+namespace caffe {
+
+// The kernels of one instruction set.
+struct NeuronKernels {
+  void (*relu)(int n, const float* x, float negative_slope, float* y);
+  void (*relu_backward)(int n, const float* x, const float* dy,
+      float negative_slope, float* dx);
+  // The fast_math approximations.
+  void (*sigmoid)(int n, const float* x, float* y);
+  void (*sigmoid_backward)(int n, const float* y, const float* dy, float* dx);
+  // The fast_math approximations.
+  void (*tanh)(int n, const float* x, float* y);
+  void (*tanh_backward)(int n, const float* y, const float* dy, float* dx);
+  // The fast_math approximations.
+  void (*bnll)(int n, const float* x, float* y);
+  void (*bnll_backward)(int n, const float* x, const float* dy, float* dx);
+  void (*threshold)(int n, const float* x, float threshold, float* y);
+  void (*absval)(int n, const float* x, float* y);
+  void (*absval_backward)(int n, const float* x, const float* dy, float* dx);
+  // The fast_math approximation.
+  void (*exp)(int n, const float* x, float* y);
+  void (*dropout_mask)(int n, uint32_t start, uint32_t key0, uint32_t key1,
+      uint32_t threshold, uint32_t* mask);
+  void (*dropout)(int n, const float* x, const uint32_t* mask, float scale,
+      float* y);
+  // The bulk random numbers of caffe_cpu_rng_uniform, caffe_cpu_rng_gaussian
+  // and caffe_cpu_rng_bernoulli.
+  void (*rng_uniform)(int n, uint32_t start, uint32_t key0, uint32_t key1,
+      float a, float b, float* r);
+  void (*rng_gaussian)(int n, uint32_t start, uint32_t key0, uint32_t key1,
+      float mu, float sigma, float* r);
+  void (*rng_bernoulli)(int n, uint32_t start, uint32_t key0, uint32_t key1,
+      uint32_t threshold, uint32_t* r);
+  // The small batch inner product of caffe_cpu_panel_inner_product.
+  void (*panel_inner_product)(int m, int n, int k, const float* panels,
+      const float* x, const float* bias, float* y, int ldy);
+  // The same over panels of half precision weights.
+  void (*half_panel_inner_product)(int m, int n, int k,
+      const uint16_t* panels, const float* x, const float* bias, float* y,
+      int ldy);
+  // The conversions of caffe_cpu_to_half and caffe_cpu_from_half.
+  void (*to_half)(int n, const float* x, uint16_t* h);
+  void (*from_half)(int n, const uint16_t* h, float* y);
+  // The quantized matrix product of caffe_cpu_int8_gemm.
+  void (*int8_gemm)(int m, int n, int k, const uint8_t* a, const int8_t* b,
+      int32_t* c, int ldc);
+  // The element-wise operations of k inputs of caffe_cpu_eltwise_sum,
+  // caffe_cpu_eltwise_prod and caffe_cpu_eltwise_max.
+  void (*eltwise_sum)(int n, int k, const float* const* x,
+      const float* coeffs, float* y);
+  void (*eltwise_prod)(int n, int k, const float* const* x, float* y);
+  void (*eltwise_max)(int n, int k, const float* const* x, float* y,
+      int* mask);
+  // The sparse matrix product of caffe_cpu_csrmm.
+  void (*csrmm)(int m, int n, const int* row_ptr, const int* col_idx,
+      const float* values, const float* b, int ldb, float* c, int ldc);
+  // The statistics and normalization of caffe_cpu_mean_variance,
+  // caffe_cpu_normalize and caffe_cpu_normalize_backward.
+  void (*mean_variance)(int n, const float* x, float* mean, float* variance);
+  void (*normalize)(int n, const float* x, float mean, float scale, float* y);
+  void (*normalize_backward)(int n, const float* y, const float* dy,
+      float scale, float* dx);
+};
+
+// The kernels of each instruction set, or NULL if the build does not include
+// them.
+const NeuronKernels* scalar_neuron_kernels();
+const NeuronKernels* sse2_neuron_kernels();
+const NeuronKernels* avx2_neuron_kernels();
+
+namespace neuron_kernels {
+namespace {  // NOLINT(build/namespaces)
+
+inline int MinInt(int a, int b) { return a < b ? a : b; }
+inline int MaxInt(int a, int b) { return a > b ? a : b; }
+
+// Applies op to the kWidth-float vectors of x (and b), and then to the tail of
+// fewer than kWidth floats, padded with zeros.
+template <typename Isa, typename Op>
+inline void Map(const Op& op, int n, const float* x, float* y) {
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    Isa::storeu(y + i, op(Isa::loadu(x + i)));
+  }
+  if (i < n) {
+    float x_tail[Isa::kWidth] = { 0 };
+    float y_tail[Isa::kWidth];
+    memcpy(x_tail, x + i, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    Isa::storeu(y_tail, op(Isa::loadu(x_tail)));
+    memcpy(y + i, y_tail, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+  }
+}
+
+template <typename Isa, typename Op>
+inline void Map(const Op& op, int n, const float* x, const float* b,
+    float* y) {
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    Isa::storeu(y + i, op(Isa::loadu(x + i), Isa::loadu(b + i)));
+  }
+  if (i < n) {
+    float x_tail[Isa::kWidth] = { 0 };
+    float b_tail[Isa::kWidth] = { 0 };
+    float y_tail[Isa::kWidth];
+    memcpy(x_tail, x + i, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    memcpy(b_tail, b + i, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    Isa::storeu(y_tail, op(Isa::loadu(x_tail), Isa::loadu(b_tail)));
+    memcpy(y + i, y_tail, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+  }
+}
+
+template <typename Isa>
+void ToHalf(int n, const float* x, uint16_t* h) {
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    Isa::store_half(h + i, Isa::loadu(x + i));
+  }
+  if (i < n) {
+    float x_tail[Isa::kWidth] = { 0 };
+    uint16_t h_tail[Isa::kWidth];
+    memcpy(x_tail, x + i, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    Isa::store_half(h_tail, Isa::loadu(x_tail));
+    memcpy(h + i, h_tail, sizeof(uint16_t) * (n - i));  // NOLINT(caffe/alt_fn)
+  }
+}
+
+template <typename Isa>
+void FromHalf(int n, const uint16_t* h, float* y) {
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    Isa::storeu(y + i, Isa::load_half(h + i));
+  }
+  if (i < n) {
+    uint16_t h_tail[Isa::kWidth] = { 0 };
+    float y_tail[Isa::kWidth];
+    memcpy(h_tail, h + i, sizeof(uint16_t) * (n - i));  // NOLINT(caffe/alt_fn)
+    Isa::storeu(y_tail, Isa::load_half(h_tail));
+    memcpy(y + i, y_tail, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+  }
+}
+
+// exp(x), after Cephes' expf: x = n log(2) + r with |r| <= log(2) / 2, and
+// exp(r) by a polynomial.  x is clamped to [log(FLT_MIN), 88] so that 2^n is
+// a normal float.
+template <typename Isa>
+inline typename Isa::V Exp(typename Isa::V x) {
+  typedef typename Isa::V V;
+  x = Isa::min(x, Isa::set1(88.0f));
+  x = Isa::max(x, Isa::set1(-87.33654475f));
+  const typename Isa::I n = Isa::round(Isa::mul(x,
+      Isa::set1(1.44269504088896341f)));
+  const V fn = Isa::to_float(n);
+  x = Isa::sub(x, Isa::mul(fn, Isa::set1(0.693359375f)));
+  x = Isa::sub(x, Isa::mul(fn, Isa::set1(-2.12194440e-4f)));
+  V y = Isa::set1(1.9875691500e-4f);
+  y = Isa::madd(y, x, Isa::set1(1.3981999507e-3f));
+  y = Isa::madd(y, x, Isa::set1(8.3334519073e-3f));
+  y = Isa::madd(y, x, Isa::set1(4.1665795894e-2f));
+  y = Isa::madd(y, x, Isa::set1(1.6666665459e-1f));
+  y = Isa::madd(y, x, Isa::set1(5.0000001201e-1f));
+  y = Isa::madd(y, Isa::mul(x, x), Isa::add(x, Isa::set1(1.0f)));
+  return Isa::mul(y, Isa::pow2(n));
+}
+
+// log(x) for positive normal x, after Cephes' logf: x = 2^e m with m in
+// [sqrt(1/2), sqrt(2)), and log(m) by a polynomial.
+template <typename Isa>
+inline typename Isa::V Log(typename Isa::V x) {
+  typedef typename Isa::V V;
+  const V one = Isa::set1(1.0f);
+  // m in [1/2, 1), e the exponent of x + 1.
+  V e = Isa::add(Isa::exponent(x), one);
+  V m = Isa::or_(Isa::and_(x, Isa::from_bits(0x807fffff)),
+      Isa::from_bits(0x3f000000));
+  const V small = Isa::lt(m, Isa::set1(0.707106781186547524f));
+  e = Isa::sub(e, Isa::and_(small, one));
+  m = Isa::add(Isa::sub(m, one), Isa::and_(small, m));
+  const V z = Isa::mul(m, m);
+  V y = Isa::set1(7.0376836292e-2f);
+  y = Isa::madd(y, m, Isa::set1(-1.1514610310e-1f));
+  y = Isa::madd(y, m, Isa::set1(1.1676998740e-1f));
+  y = Isa::madd(y, m, Isa::set1(-1.2420140846e-1f));
+  y = Isa::madd(y, m, Isa::set1(1.4249322787e-1f));
+  y = Isa::madd(y, m, Isa::set1(-1.6668057665e-1f));
+  y = Isa::madd(y, m, Isa::set1(2.0000714765e-1f));
+  y = Isa::madd(y, m, Isa::set1(-2.4999993993e-1f));
+  y = Isa::madd(y, m, Isa::set1(3.3333331174e-1f));
+  y = Isa::mul(Isa::mul(y, m), z);
+  y = Isa::madd(e, Isa::set1(-2.12194440e-4f), y);
+  y = Isa::madd(z, Isa::set1(-0.5f), y);
+  m = Isa::add(m, y);
+  return Isa::madd(e, Isa::set1(0.693359375f), m);
+}
+
+// tanh(x) by a rational approximation on [-7.9, 7.9] (as in Eigen), beyond
+// which tanh(x) rounds to +-1.
+template <typename Isa>
+inline typename Isa::V Tanh(typename Isa::V x) {
+  typedef typename Isa::V V;
+  const V abs_x = Isa::and_(x, Isa::from_bits(0x7fffffff));
+  const V tiny = Isa::lt(abs_x, Isa::set1(4e-4f));
+  const V bound = Isa::set1(7.90531110763549805f);
+  const V clamped = Isa::max(Isa::min(x, bound), Isa::sub(Isa::zero(), bound));
+  const V x2 = Isa::mul(clamped, clamped);
+  V p = Isa::set1(-2.76076847742355e-16f);
+  p = Isa::madd(p, x2, Isa::set1(2.00018790482477e-13f));
+  p = Isa::madd(p, x2, Isa::set1(-8.60467152213735e-11f));
+  p = Isa::madd(p, x2, Isa::set1(5.12229709037114e-08f));
+  p = Isa::madd(p, x2, Isa::set1(1.48572235717979e-05f));
+  p = Isa::madd(p, x2, Isa::set1(6.37261928875436e-04f));
+  p = Isa::madd(p, x2, Isa::set1(4.89352455891786e-03f));
+  p = Isa::mul(p, clamped);
+  V q = Isa::set1(1.19825839466702e-06f);
+  q = Isa::madd(q, x2, Isa::set1(1.18534705686654e-04f));
+  q = Isa::madd(q, x2, Isa::set1(2.26843463243900e-03f));
+  q = Isa::madd(q, x2, Isa::set1(4.89352518554385e-03f));
+  return Isa::select(tiny, x, Isa::div(p, q));
+}
+
+// The MurmurHash3 finalizer, a bijection whose every output bit depends on
+// every input bit.
+template <typename Isa>
+inline typename Isa::I Mix(typename Isa::I x) {
+  x = Isa::imul(Isa::ixor(x, Isa::isrl(x, 16)), Isa::iset1(0x85ebca6b));
+  x = Isa::imul(Isa::ixor(x, Isa::isrl(x, 13)), Isa::iset1(0xc2b2ae35));
+  return Isa::ixor(x, Isa::isrl(x, 16));
+}
+
+// The random numbers of the counters i of the stream keyed by (key0, key1):
+// two keyed rounds of Mix over a Weyl sequence, as in SplitMix.  Being a pure
+// function of the counter, the stream can be drawn in any order and split
+// across threads.
+template <typename Isa>
+inline typename Isa::I Random(typename Isa::I i, typename Isa::I key0,
+    typename Isa::I key1) {
+  const typename Isa::I x =
+      Mix<Isa>(Isa::iadd(Isa::imul(i, Isa::iset1(0x9e3779b9)), key0));
+  return Mix<Isa>(Isa::ixor(x, key1));
+}
+
+// The uniform floats in [0, 1) of the top 24 bits of random numbers x.
+template <typename Isa>
+inline typename Isa::V Uniform(typename Isa::I x) {
+  return Isa::mul(Isa::to_float(Isa::isrl(x, 8)), Isa::set1(1.0f / (1 << 24)));
+}
+
+// Two independent standard normal numbers z0 and z1 from the random numbers
+// x0 and x1, by the Box-Muller transform: a radius sqrt(-2 log(u0)) with u0 in
+// (0, 1], and an angle of u1 turns, whose sine and cosine are polynomials
+// (after Cephes' sinf and cosf) around the nearest quarter turn.
+template <typename Isa>
+inline void BoxMuller(typename Isa::I x0, typename Isa::I x1,
+    typename Isa::V* z0, typename Isa::V* z1) {
+  typedef typename Isa::V V;
+  typedef typename Isa::I I;
+  const V u0 = Isa::add(Uniform<Isa>(x0), Isa::set1(1.0f / (1 << 24)));
+  const V radius = Isa::sqrt(Isa::mul(Isa::set1(-2.0f), Log<Isa>(u0)));
+  // The angle is q quarter turns and r radians, with |r| <= pi / 4.
+  const V quarters = Isa::mul(Uniform<Isa>(x1), Isa::set1(4.0f));
+  const I q = Isa::round(quarters);
+  const V r = Isa::mul(Isa::sub(quarters, Isa::to_float(q)),
+      Isa::set1(1.57079632679489662f));
+  const V r2 = Isa::mul(r, r);
+  V sin_r = Isa::set1(-1.9515295891e-4f);
+  sin_r = Isa::madd(sin_r, r2, Isa::set1(8.3321608736e-3f));
+  sin_r = Isa::madd(sin_r, r2, Isa::set1(-1.6666654611e-1f));
+  sin_r = Isa::madd(Isa::mul(sin_r, r2), r, r);
+  V cos_r = Isa::set1(2.443315711809948e-5f);
+  cos_r = Isa::madd(cos_r, r2, Isa::set1(-1.388731625493765e-3f));
+  cos_r = Isa::madd(cos_r, r2, Isa::set1(4.166664568298827e-2f));
+  cos_r = Isa::madd(Isa::mul(cos_r, r2), r2,
+      Isa::madd(r2, Isa::set1(-0.5f), Isa::set1(1.0f)));
+  // Rotate (cos(r), sin(r)) by q quarter turns.
+  const V zero = Isa::zero();
+  const V odd = Isa::gt(Isa::to_float(Isa::iand(q, Isa::iset1(1))), zero);
+  const V negate_cos = Isa::gt(Isa::to_float(
+      Isa::iand(Isa::iadd(q, Isa::iset1(1)), Isa::iset1(2))), zero);
+  const V negate_sin = Isa::gt(Isa::to_float(Isa::iand(q, Isa::iset1(2))),
+      zero);
+  const V c = Isa::select(odd, sin_r, cos_r);
+  const V s = Isa::select(odd, cos_r, sin_r);
+  *z0 = Isa::mul(radius, Isa::select(negate_cos, Isa::sub(zero, c), c));
+  *z1 = Isa::mul(radius, Isa::select(negate_sin, Isa::sub(zero, s), s));
+}
+
+template <typename Isa>
+struct ExpOp {
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    return Exp<Isa>(x);
+  }
+};
+
+template <typename Isa>
+struct ReLUOp {
+  typename Isa::V negative_slope;
+  explicit ReLUOp(float negative_slope)
+      : negative_slope(Isa::set1(negative_slope)) {}
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    const typename Isa::V zero = Isa::zero();
+    return Isa::add(Isa::max(x, zero),
+        Isa::mul(negative_slope, Isa::min(x, zero)));
+  }
+};
+
+template <typename Isa>
+struct ReLUBackwardOp {
+  typename Isa::V negative_slope;
+  explicit ReLUBackwardOp(float negative_slope)
+      : negative_slope(Isa::set1(negative_slope)) {}
+  inline typename Isa::V operator()(typename Isa::V x,
+      typename Isa::V dy) const {
+    const typename Isa::V zero = Isa::zero();
+    return Isa::add(Isa::and_(Isa::gt(x, zero), dy),
+        Isa::and_(Isa::le(x, zero), Isa::mul(dy, negative_slope)));
+  }
+};
+
+template <typename Isa>
+struct SigmoidOp {
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    const typename Isa::V one = Isa::set1(1.0f);
+    return Isa::div(one, Isa::add(one, Exp<Isa>(Isa::sub(Isa::zero(), x))));
+  }
+};
+
+template <typename Isa>
+struct SigmoidBackwardOp {
+  inline typename Isa::V operator()(typename Isa::V y,
+      typename Isa::V dy) const {
+    return Isa::mul(Isa::mul(dy, y), Isa::sub(Isa::set1(1.0f), y));
+  }
+};
+
+template <typename Isa>
+struct TanHOp {
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    return Tanh<Isa>(x);
+  }
+};
+
+template <typename Isa>
+struct TanHBackwardOp {
+  inline typename Isa::V operator()(typename Isa::V y,
+      typename Isa::V dy) const {
+    return Isa::mul(dy, Isa::sub(Isa::set1(1.0f), Isa::mul(y, y)));
+  }
+};
+
+// max(x, 0) + log(1 + exp(-|x|)), as BNLLLayer computes it.
+template <typename Isa>
+struct BNLLOp {
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    const typename Isa::V neg_abs_x =
+        Isa::or_(x, Isa::from_bits(0x80000000));
+    return Isa::add(Isa::max(x, Isa::zero()),
+        Log<Isa>(Isa::add(Isa::set1(1.0f), Exp<Isa>(neg_abs_x))));
+  }
+};
+
+template <typename Isa>
+struct BNLLBackwardOp {
+  inline typename Isa::V operator()(typename Isa::V x,
+      typename Isa::V dy) const {
+    const typename Isa::V e =
+        Exp<Isa>(Isa::min(x, Isa::set1(50.0f)));  // NOLINT
+    return Isa::div(Isa::mul(dy, e), Isa::add(e, Isa::set1(1.0f)));
+  }
+};
+
+template <typename Isa>
+struct ThresholdOp {
+  typename Isa::V threshold;
+  explicit ThresholdOp(float threshold) : threshold(Isa::set1(threshold)) {}
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    return Isa::and_(Isa::gt(x, threshold), Isa::set1(1.0f));
+  }
+};
+
+template <typename Isa>
+struct AbsValOp {
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    return Isa::and_(x, Isa::from_bits(0x7fffffff));
+  }
+};
+
+template <typename Isa>
+struct AbsValBackwardOp {
+  inline typename Isa::V operator()(typename Isa::V x,
+      typename Isa::V dy) const {
+    const typename Isa::V zero = Isa::zero();
+    return Isa::sub(Isa::and_(Isa::gt(x, zero), dy),
+        Isa::and_(Isa::lt(x, zero), dy));
+  }
+};
+
+template <typename Isa>
+void ReLU(int n, const float* x, float negative_slope, float* y) {
+  Map<Isa>(ReLUOp<Isa>(negative_slope), n, x, y);
+}
+
+template <typename Isa>
+void ReLUBackward(int n, const float* x, const float* dy,
+    float negative_slope, float* dx) {
+  Map<Isa>(ReLUBackwardOp<Isa>(negative_slope), n, x, dy, dx);
+}
+
+template <typename Isa, template <typename> class Op>
+void Unary(int n, const float* x, float* y) {
+  Map<Isa>(Op<Isa>(), n, x, y);
+}
+
+template <typename Isa, template <typename> class Op>
+void Binary(int n, const float* x, const float* b, float* y) {
+  Map<Isa>(Op<Isa>(), n, x, b, y);
+}
+
+template <typename Isa>
+void Threshold(int n, const float* x, float threshold, float* y) {
+  Map<Isa>(ThresholdOp<Isa>(threshold), n, x, y);
+}
+
+template <typename Isa>
+void DropoutMask(int n, uint32_t start, uint32_t key0, uint32_t key1,
+    uint32_t threshold, uint32_t* mask) {
+  typedef typename Isa::I I;
+  const int w = Isa::kWidth;
+  const I k0 = Isa::iset1(key0);
+  const I k1 = Isa::iset1(key1);
+  const I t = Isa::iset1(threshold);
+  const I step = Isa::iset1(w);
+  I counter = Isa::iramp(start);
+  for (int i = 0; i < n; i += 32) {
+    uint32_t bits = 0;
+    for (int b = 0; b < 32; b += w) {
+      bits |= static_cast<uint32_t>(
+          Isa::igt_bits(Random<Isa>(counter, k0, k1), t)) << b;
+      counter = Isa::iadd(counter, step);
+    }
+    // Clear the bits past the end.
+    if (n - i < 32) { bits &= (1u << (n - i)) - 1; }
+    mask[i / 32] = bits;
+  }
+}
+
+// kWidth divides 32, so that no vector spans two words of the mask.
+template <typename Isa>
+void Dropout(int n, const float* x, const uint32_t* mask, float scale,
+    float* y) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  const V s = Isa::set1(scale);
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    const V keep = Isa::lane_mask(mask[i / 32] >> (i % 32));
+    Isa::storeu(y + i, Isa::and_(keep, Isa::mul(Isa::loadu(x + i), s)));
+  }
+  if (i < n) {
+    float x_tail[Isa::kWidth] = { 0 };
+    float y_tail[Isa::kWidth];
+    memcpy(x_tail, x + i, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    const V keep = Isa::lane_mask(mask[i / 32] >> (i % 32));
+    Isa::storeu(y_tail, Isa::and_(keep, Isa::mul(Isa::loadu(x_tail), s)));
+    memcpy(y + i, y_tail, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+  }
+}
+
+template <typename Isa>
+void RngUniform(int n, uint32_t start, uint32_t key0, uint32_t key1, float a,
+    float b, float* r) {
+  typedef typename Isa::I I;
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  const I k0 = Isa::iset1(key0);
+  const I k1 = Isa::iset1(key1);
+  const I step = Isa::iset1(w);
+  const V lower = Isa::set1(a);
+  const V range = Isa::set1(b - a);
+  I counter = Isa::iramp(start);
+  for (int i = 0; i < n; i += w) {
+    const V y = Isa::madd(Uniform<Isa>(Random<Isa>(counter, k0, k1)), range,
+        lower);
+    if (i + w <= n) {
+      Isa::storeu(r + i, y);
+    } else {
+      float y_tail[Isa::kWidth];
+      Isa::storeu(y_tail, y);
+      memcpy(r + i, y_tail, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    }
+    counter = Isa::iadd(counter, step);
+  }
+}
+
+// The normal numbers come in blocks of 16, the first 8 z0 and the last 8 z1
+// of the Box-Muller transforms of pairs 8 k to 8 k + 7 (of counters 2 j and
+// 2 j + 1) for block k, so that kWidth divides the halves of a block.
+template <typename Isa>
+void RngGaussian(int n, uint32_t start, uint32_t key0, uint32_t key1,
+    float mu, float sigma, float* r) {
+  typedef typename Isa::I I;
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  const I k0 = Isa::iset1(key0);
+  const I k1 = Isa::iset1(key1);
+  const I one = Isa::iset1(1);
+  const I step = Isa::iset1(w);
+  const V mean = Isa::set1(mu);
+  const V scale = Isa::set1(sigma);
+  I pair = Isa::iramp(start / 2);
+  for (int i = 0; i < n; i += 16) {
+    float block[16];
+    float* y = i + 16 <= n ? r + i : block;
+    for (int j = 0; j < 8; j += w) {
+      const I counter = Isa::iadd(pair, pair);
+      V z0, z1;
+      BoxMuller<Isa>(Random<Isa>(counter, k0, k1),
+          Random<Isa>(Isa::iadd(counter, one), k0, k1), &z0, &z1);
+      Isa::storeu(y + j, Isa::madd(z0, scale, mean));
+      Isa::storeu(y + 8 + j, Isa::madd(z1, scale, mean));
+      pair = Isa::iadd(pair, step);
+    }
+    if (y == block) {
+      memcpy(r + i, block, sizeof(float) * (n - i));  // NOLINT(caffe/alt_fn)
+    }
+  }
+}
+
+template <typename Isa>
+void RngBernoulli(int n, uint32_t start, uint32_t key0, uint32_t key1,
+    uint32_t threshold, uint32_t* r) {
+  typedef typename Isa::I I;
+  const int w = Isa::kWidth;
+  const I k0 = Isa::iset1(key0);
+  const I k1 = Isa::iset1(key1);
+  const I t = Isa::iset1(threshold);
+  const I step = Isa::iset1(w);
+  I counter = Isa::iramp(start);
+  for (int i = 0; i < n; i += w) {
+    const int bits = Isa::igt_bits(t, Random<Isa>(counter, k0, k1));
+    for (int j = 0; j < w && i + j < n; ++j) {
+      r[i + j] = (bits >> j) & 1;
+    }
+    counter = Isa::iadd(counter, step);
+  }
+}
+
+// Rows of one panel of caffe_cpu_pack_panels: kWidth divides it.
+const int kPanelRows = 8;
+
+// kWidth weights of a panel of float or half precision weights.
+template <typename Isa>
+inline typename Isa::V LoadWeights(const float* p) { return Isa::loadu(p); }
+template <typename Isa>
+inline typename Isa::V LoadWeights(const uint16_t* p) {
+  return Isa::load_half(p);
+}
+
+// The outputs of the batch of M rows of x for the rows of one panel of
+// weights W, with U independent sums over the columns to hide the latency of
+// the additions.
+template <typename Isa, int M, int U, typename W>
+inline void InnerProductPanel(int k, const W* panel, const float* x,
+    const float* bias, float* y, int ldy, int rows) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  const int p = kPanelRows / Isa::kWidth;
+  V sum[U][M][kPanelRows / Isa::kWidth];
+  for (int u = 0; u < U; ++u) {
+    for (int b = 0; b < M; ++b) {
+      for (int j = 0; j < p; ++j) {
+        sum[u][b][j] = u == 0 && bias ? Isa::loadu(bias + j * w) : Isa::zero();
+      }
+    }
+  }
+  int i = 0;
+  for (; i + U <= k; i += U) {
+    for (int u = 0; u < U; ++u) {
+      const W* column = panel + (i + u) * kPanelRows;
+      for (int b = 0; b < M; ++b) {
+        const V x_bi = Isa::set1(x[b * k + i + u]);
+        for (int j = 0; j < p; ++j) {
+          sum[u][b][j] = Isa::madd(LoadWeights<Isa>(column + j * w), x_bi,
+              sum[u][b][j]);
+        }
+      }
+    }
+  }
+  for (; i < k; ++i) {
+    const W* column = panel + i * kPanelRows;
+    for (int b = 0; b < M; ++b) {
+      const V x_bi = Isa::set1(x[b * k + i]);
+      for (int j = 0; j < p; ++j) {
+        sum[0][b][j] = Isa::madd(LoadWeights<Isa>(column + j * w), x_bi,
+            sum[0][b][j]);
+      }
+    }
+  }
+  for (int b = 0; b < M; ++b) {
+    float out[kPanelRows];
+    for (int j = 0; j < p; ++j) {
+      V total = sum[0][b][j];
+      for (int u = 1; u < U; ++u) { total = Isa::add(total, sum[u][b][j]); }
+      Isa::storeu(out + j * w, total);
+    }
+    memcpy(y + b * ldy, out, sizeof(float) * rows);  // NOLINT(caffe/alt_fn)
+  }
+}
+
+template <typename Isa, int M, typename W>
+void InnerProductPanels(int n, int k, const W* panels, const float* x,
+    const float* bias, float* y, int ldy) {
+  // A partial last panel has zero rows, which only take no bias.
+  float last_bias[kPanelRows] = { 0 };
+  for (int j = 0; j < n; j += kPanelRows) {
+    const int rows = MinInt(kPanelRows, n - j);
+    const float* panel_bias = bias ? bias + j : NULL;
+    if (bias && rows < kPanelRows) {
+      for (int r = 0; r < rows; ++r) { last_bias[r] = bias[j + r]; }
+      panel_bias = last_bias;
+    }
+    InnerProductPanel<Isa, M, (M < 4 ? 4 / M : 1)>(k, panels + j * k, x,
+        panel_bias, y + j, ldy, rows);
+  }
+}
+
+template <typename Isa, typename W>
+void PanelInnerProduct(int m, int n, int k, const W* panels,
+    const float* x, const float* bias, float* y, int ldy) {
+  for (int b = 0; b < m; b += 4) {
+    const float* x_b = x + b * k;
+    float* y_b = y + b * ldy;
+    switch (MinInt(4, m - b)) {
+    case 1:
+      InnerProductPanels<Isa, 1>(n, k, panels, x_b, bias, y_b, ldy);
+      break;
+    case 2:
+      InnerProductPanels<Isa, 2>(n, k, panels, x_b, bias, y_b, ldy);
+      break;
+    case 3:
+      InnerProductPanels<Isa, 3>(n, k, panels, x_b, bias, y_b, ldy);
+      break;
+    default:
+      InnerProductPanels<Isa, 4>(n, k, panels, x_b, bias, y_b, ldy);
+    }
+  }
+}
+
+// The columns of the int8 GEMM of caffe_cpu_int8_gemm: 4 * kWidth divides it.
+const int kInt8Block = 32;
+// The bytes of b that Int8Gemm multiplies all the rows of a by at a time.
+const int kInt8CacheBytes = 1 << 17;
+
+// The dot products of MA rows of a with MB rows of b.
+template <typename Isa, int MA, int MB>
+inline void Int8Block(int k, const uint8_t* a, const int8_t* b, int32_t* c,
+    int ldc) {
+  typedef typename Isa::I I;
+  const int w = 4 * Isa::kWidth;
+  I sum[MA][MB];
+  for (int i = 0; i < MA; ++i) {
+    for (int j = 0; j < MB; ++j) { sum[i][j] = Isa::iset1(0); }
+  }
+  for (int t = 0; t < k; t += w) {
+    for (int i = 0; i < MA; ++i) {
+      for (int j = 0; j < MB; ++j) {
+        sum[i][j] = Isa::idot_u8s8(sum[i][j], a + i * k + t, b + j * k + t);
+      }
+    }
+  }
+  for (int i = 0; i < MA; ++i) {
+    for (int j = 0; j < MB; ++j) { c[i * ldc + j] = Isa::ihsum(sum[i][j]); }
+  }
+}
+
+template <typename Isa, int MA>
+void Int8Rows(int n, int k, const uint8_t* a, const int8_t* b, int32_t* c,
+    int ldc) {
+  int j = 0;
+  for (; j + 4 <= n; j += 4) {
+    Int8Block<Isa, MA, 4>(k, a, b + j * k, c + j, ldc);
+  }
+  switch (n - j) {
+  case 1:
+    Int8Block<Isa, MA, 1>(k, a, b + j * k, c + j, ldc);
+    break;
+  case 2:
+    Int8Block<Isa, MA, 2>(k, a, b + j * k, c + j, ldc);
+    break;
+  case 3:
+    Int8Block<Isa, MA, 3>(k, a, b + j * k, c + j, ldc);
+    break;
+  }
+}
+
+template <typename Isa>
+void Int8Gemm(int m, int n, int k, const uint8_t* a, const int8_t* b,
+    int32_t* c, int ldc) {
+  const int block = MaxInt(4, kInt8CacheBytes / k / 4 * 4);
+  for (int j = 0; j < n; j += block) {
+    const int cols = MinInt(block, n - j);
+    int i = 0;
+    for (; i + 2 <= m; i += 2) {
+      Int8Rows<Isa, 2>(cols, k, a + i * k, b + j * k, c + i * ldc + j, ldc);
+    }
+    if (i < m) {
+      Int8Rows<Isa, 1>(cols, k, a + i * k, b + j * k, c + i * ldc + j, ldc);
+    }
+  }
+}
+
+template <typename Isa>
+void EltwiseSum(int n, int k, const float* const* x, const float* coeffs,
+    float* y) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    V sum = Isa::mul(Isa::loadu(x[0] + i), Isa::set1(coeffs[0]));
+    for (int j = 1; j < k; ++j) {
+      sum = Isa::madd(Isa::loadu(x[j] + i), Isa::set1(coeffs[j]), sum);
+    }
+    Isa::storeu(y + i, sum);
+  }
+  for (; i < n; ++i) {
+    float sum = x[0][i] * coeffs[0];
+    for (int j = 1; j < k; ++j) { sum += x[j][i] * coeffs[j]; }
+    y[i] = sum;
+  }
+}
+
+template <typename Isa>
+void EltwiseProd(int n, int k, const float* const* x, float* y) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    V prod = Isa::loadu(x[0] + i);
+    for (int j = 1; j < k; ++j) {
+      prod = Isa::mul(prod, Isa::loadu(x[j] + i));
+    }
+    Isa::storeu(y + i, prod);
+  }
+  for (; i < n; ++i) {
+    float prod = x[0][i];
+    for (int j = 1; j < k; ++j) { prod *= x[j][i]; }
+    y[i] = prod;
+  }
+}
+
+// The maximum of the k inputs and, with kMask, the first input to reach it
+// (but for ties between the first two inputs, which go to the second).
+template <typename Isa, bool kMask>
+void EltwiseMaxMask(int n, int k, const float* const* x, float* y,
+    int* mask) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  int i = 0;
+  for (; i + w <= n; i += w) {
+    const V a = Isa::loadu(x[0] + i);
+    const V b = Isa::loadu(x[1] + i);
+    V m = Isa::gt(a, b);
+    V max = Isa::select(m, a, b);
+    // The indices are exact as floats.
+    V index;
+    if (kMask) { index = Isa::select(m, Isa::zero(), Isa::set1(1.0f)); }
+    for (int j = 2; j < k; ++j) {
+      const V c = Isa::loadu(x[j] + i);
+      m = Isa::gt(c, max);
+      max = Isa::select(m, c, max);
+      if (kMask) { index = Isa::select(m, Isa::set1(j), index); }
+    }
+    Isa::storeu(y + i, max);
+    if (kMask) {
+      float index_lanes[Isa::kWidth];
+      Isa::storeu(index_lanes, index);
+      for (int l = 0; l < w; ++l) {
+        mask[i + l] = static_cast<int>(index_lanes[l]);
+      }
+    }
+  }
+  for (; i < n; ++i) {
+    int index = x[0][i] > x[1][i] ? 0 : 1;
+    float max = x[index][i];
+    for (int j = 2; j < k; ++j) {
+      if (x[j][i] > max) {
+        max = x[j][i];
+        index = j;
+      }
+    }
+    y[i] = max;
+    if (kMask) { mask[i] = index; }
+  }
+}
+
+template <typename Isa>
+void EltwiseMax(int n, int k, const float* const* x, float* y, int* mask) {
+  if (mask) {
+    EltwiseMaxMask<Isa, true>(n, k, x, y, mask);
+  } else {
+    EltwiseMaxMask<Isa, false>(n, k, x, y, mask);
+  }
+}
+
+// U vectors of a row of the product of caffe_cpu_csrmm, from the nonzeros
+// begin to end of the row of the sparse matrix, summed in registers.
+template <typename Isa, int U>
+inline void CsrRowBlock(int begin, int end, const int* col_idx,
+    const float* values, const float* b, int ldb, float* c) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  V sum[U];
+  for (int u = 0; u < U; ++u) { sum[u] = Isa::zero(); }
+  for (int p = begin; p < end; ++p) {
+    const V value = Isa::set1(values[p]);
+    const float* b_row = b + col_idx[p] * ldb;
+    for (int u = 0; u < U; ++u) {
+      sum[u] = Isa::madd(Isa::loadu(b_row + u * w), value, sum[u]);
+    }
+  }
+  for (int u = 0; u < U; ++u) { Isa::storeu(c + u * w, sum[u]); }
+}
+
+template <typename Isa>
+void Csrmm(int m, int n, const int* row_ptr, const int* col_idx,
+    const float* values, const float* b, int ldb, float* c, int ldc) {
+  const int w = Isa::kWidth;
+  for (int r = 0; r < m; ++r) {
+    const int begin = row_ptr[r];
+    const int end = row_ptr[r + 1];
+    float* c_r = c + r * ldc;
+    int j = 0;
+    for (; j + 4 * w <= n; j += 4 * w) {
+      CsrRowBlock<Isa, 4>(begin, end, col_idx, values, b + j, ldb, c_r + j);
+    }
+    for (; j + w <= n; j += w) {
+      CsrRowBlock<Isa, 1>(begin, end, col_idx, values, b + j, ldb, c_r + j);
+    }
+    // The columns left, one at a time, with two sums to hide the latency of
+    // the additions.
+    for (; j < n; ++j) {
+      float sum[2] = { 0, 0 };
+      int p = begin;
+      for (; p + 2 <= end; p += 2) {
+        sum[0] += values[p] * b[col_idx[p] * ldb + j];
+        sum[1] += values[p + 1] * b[col_idx[p + 1] * ldb + j];
+      }
+      if (p < end) { sum[0] += values[p] * b[col_idx[p] * ldb + j]; }
+      c_r[j] = sum[0] + sum[1];
+    }
+  }
+}
+
+// The sum of the elements of a vector.
+template <typename Isa>
+inline float HorizontalSum(typename Isa::V a) {
+  float lanes[Isa::kWidth];
+  Isa::storeu(lanes, a);
+  float sum = lanes[0];
+  for (int l = 1; l < Isa::kWidth; ++l) { sum += lanes[l]; }
+  return sum;
+}
+
+// The sums of x (and, unless b is NULL, of x times b) over n floats, in two
+// vectors each to hide the latency of the additions.
+template <typename Isa>
+inline void Sums(int n, const float* x, const float* b, float* sum,
+    float* dot) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  V s[2] = { Isa::zero(), Isa::zero() };
+  V d[2] = { Isa::zero(), Isa::zero() };
+  int i = 0;
+  for (; i + 2 * w <= n; i += 2 * w) {
+    for (int u = 0; u < 2; ++u) {
+      const V a = Isa::loadu(x + i + u * w);
+      s[u] = Isa::add(s[u], a);
+      if (b) { d[u] = Isa::madd(a, Isa::loadu(b + i + u * w), d[u]); }
+    }
+  }
+  *sum = HorizontalSum<Isa>(Isa::add(s[0], s[1]));
+  if (b) { *dot = HorizontalSum<Isa>(Isa::add(d[0], d[1])); }
+  for (; i < n; ++i) {
+    *sum += x[i];
+    if (b) { *dot += x[i] * b[i]; }
+  }
+}
+
+// The floats of a row that MeanVariance takes the moments of at a time: few
+// enough to stay in L1 between the two passes over them.
+const int kMomentsBlock = 1024;
+
+// The mean and variance of x by Welford's method over blocks: the mean of a
+// block, then the sum of its squared deviations from that mean (which, unlike
+// the sum of squares, does not cancel for large means), merged into those of
+// the blocks before it as Chan et al. do.
+template <typename Isa>
+void MeanVariance(int n, const float* x, float* mean, float* variance) {
+  typedef typename Isa::V V;
+  const int w = Isa::kWidth;
+  float row_mean = 0;
+  float row_squares = 0;
+  for (int begin = 0; begin < n; begin += kMomentsBlock) {
+    const int m = MinInt(kMomentsBlock, n - begin);
+    const float* block = x + begin;
+    float sum;
+    Sums<Isa>(m, block, static_cast<const float*>(NULL), &sum,
+        static_cast<float*>(NULL));
+    const float block_mean = sum / m;
+    const V block_mean_v = Isa::set1(block_mean);
+    V s[2] = { Isa::zero(), Isa::zero() };
+    int i = 0;
+    for (; i + 2 * w <= m; i += 2 * w) {
+      for (int u = 0; u < 2; ++u) {
+        const V d = Isa::sub(Isa::loadu(block + i + u * w), block_mean_v);
+        s[u] = Isa::madd(d, d, s[u]);
+      }
+    }
+    float squares = HorizontalSum<Isa>(Isa::add(s[0], s[1]));
+    for (; i < m; ++i) {
+      const float d = block[i] - block_mean;
+      squares += d * d;
+    }
+    const float delta = block_mean - row_mean;
+    const float total = begin + m;
+    row_mean += delta * (m / total);
+    row_squares += squares + delta * delta * (begin * (m / total));
+  }
+  *mean = row_mean;
+  *variance = n > 0 ? row_squares / n : 0;
+}
+
+template <typename Isa>
+struct NormalizeOp {
+  typename Isa::V mean;
+  typename Isa::V scale;
+  NormalizeOp(float mean, float scale)
+      : mean(Isa::set1(mean)), scale(Isa::set1(scale)) {}
+  inline typename Isa::V operator()(typename Isa::V x) const {
+    return Isa::mul(Isa::sub(x, mean), scale);
+  }
+};
+
+template <typename Isa>
+void Normalize(int n, const float* x, float mean, float scale, float* y) {
+  Map<Isa>(NormalizeOp<Isa>(mean, scale), n, x, y);
+}
+
+template <typename Isa>
+struct NormalizeBackwardOp {
+  typename Isa::V mean_dy;
+  typename Isa::V mean_y_dy;
+  typename Isa::V scale;
+  NormalizeBackwardOp(float mean_dy, float mean_y_dy, float scale)
+      : mean_dy(Isa::set1(mean_dy)), mean_y_dy(Isa::set1(mean_y_dy)),
+        scale(Isa::set1(scale)) {}
+  inline typename Isa::V operator()(typename Isa::V y,
+      typename Isa::V dy) const {
+    return Isa::mul(Isa::sub(Isa::sub(dy, mean_dy), Isa::mul(y, mean_y_dy)),
+        scale);
+  }
+};
+
+template <typename Isa>
+void NormalizeBackward(int n, const float* y, const float* dy, float scale,
+    float* dx) {
+  float sum_dy = 0;
+  float sum_y_dy = 0;
+  Sums<Isa>(n, dy, y, &sum_dy, &sum_y_dy);
+  Map<Isa>(NormalizeBackwardOp<Isa>(sum_dy / n, sum_y_dy / n, scale), n, y,
+      dy, dx);
+}
+
+template <typename Isa>
+NeuronKernels MakeNeuronKernels() {
+  NeuronKernels kernels;
+  kernels.relu = &ReLU<Isa>;
+  kernels.relu_backward = &ReLUBackward<Isa>;
+  kernels.sigmoid = &Unary<Isa, SigmoidOp>;
+  kernels.sigmoid_backward = &Binary<Isa, SigmoidBackwardOp>;
+  kernels.tanh = &Unary<Isa, TanHOp>;
+  kernels.tanh_backward = &Binary<Isa, TanHBackwardOp>;
+  kernels.bnll = &Unary<Isa, BNLLOp>;
+  kernels.bnll_backward = &Binary<Isa, BNLLBackwardOp>;
+  kernels.threshold = &Threshold<Isa>;
+  kernels.absval = &Unary<Isa, AbsValOp>;
+  kernels.absval_backward = &Binary<Isa, AbsValBackwardOp>;
+  kernels.exp = &Unary<Isa, ExpOp>;
+  kernels.dropout_mask = &DropoutMask<Isa>;
+  kernels.dropout = &Dropout<Isa>;
+  kernels.rng_uniform = &RngUniform<Isa>;
+  kernels.rng_gaussian = &RngGaussian<Isa>;
+  kernels.rng_bernoulli = &RngBernoulli<Isa>;
+  kernels.panel_inner_product = &PanelInnerProduct<Isa, float>;
+  kernels.half_panel_inner_product = &PanelInnerProduct<Isa, uint16_t>;
+  kernels.to_half = &ToHalf<Isa>;
+  kernels.from_half = &FromHalf<Isa>;
+  kernels.int8_gemm = &Int8Gemm<Isa>;
+  kernels.eltwise_sum = &EltwiseSum<Isa>;
+  kernels.eltwise_prod = &EltwiseProd<Isa>;
+  kernels.eltwise_max = &EltwiseMax<Isa>;
+  kernels.csrmm = &Csrmm<Isa>;
+  kernels.mean_variance = &MeanVariance<Isa>;
+  kernels.normalize = &Normalize<Isa>;
+  kernels.normalize_backward = &NormalizeBackward<Isa>;
+  return kernels;
+}
+
+}  // namespace
+}  // namespace neuron_kernels
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NEURON_KERNELS_H_
@@ -0,0 +1,26 @@
+#ifndef _CAFFE_UTIL_PLAN_IN_PLACE_HPP_
+#define _CAFFE_UTIL_PLAN_IN_PLACE_HPP_
+
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters (after InsertSplits) rewriting element-wise layers whose
+// bottom blob has no other consumer to compute in place.  When the net state
+// explicitly sets the TEST phase and force_backward is off, Split layers are
+// also removed and their consumers read the split blob directly.
+// blob_aliases maps the name of every top blob that was renamed away to the
+// name of the blob now holding its data.
+void PlanInPlace(const NetParameter& param, NetParameter* param_in_place,
+    map<string, string>* blob_aliases);
+
+// Whether a layer of the given type may compute with bottom == top.
+bool LayerSupportsInPlace(const string& type);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PLAN_IN_PLACE_HPP_
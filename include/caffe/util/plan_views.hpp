@@ -0,0 +1,20 @@
+#ifndef _CAFFE_UTIL_PLAN_VIEWS_HPP_
+#define _CAFFE_UTIL_PLAN_VIEWS_HPP_
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters (after PlanInPlace) setting share_bottoms on every Concat
+// layer whose bottoms are each written by a layer that owns its top memory
+// and read by the Concat layer only, and share_tops on every Slice layer none
+// of whose tops is written in place.  Unless the net state explicitly sets
+// the TEST phase and force_backward is off, a Concat layer whose top is
+// written in place does not share its bottoms either, as the backward passes
+// of their producers may still read them.
+void PlanViews(const NetParameter& param, NetParameter* param_views);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_PLAN_VIEWS_HPP_
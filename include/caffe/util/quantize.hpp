@@ -0,0 +1,117 @@
+#ifndef CAFFE_UTIL_QUANTIZE_H_
+#define CAFFE_UTIL_QUANTIZE_H_
+
+#include <stdint.h>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class Net;
+
+// The int8 inference of the Convolution and InnerProduct layers that have a
+// quantization_param, in the TEST phase.  An input x maps onto the 7-bit code
+// round(x / scale) + zero_point, clamped to [0, 127], and a weight w of an
+// output onto round(w / row_scale), with row_scale = max |w| / 127 over the
+// weights of the output.  The layers sum the products of the codes in int32
+// (caffe_cpu_int8_gemm) and map the sums back with caffe_cpu_dequantize.
+
+// The scale and zero point of the inputs of a layer with param.
+template <typename Dtype>
+void GetInputQuantization(const QuantizationParameter& param, Dtype* scale,
+    int* zero_point);
+
+// The codes of the n inputs x.
+template <typename Dtype>
+void caffe_cpu_quantize_inputs(const int n, const Dtype* x, const Dtype scale,
+    const int zero_point, uint8_t* q);
+
+// The codes of the channels x spatial_dim inputs x of an image, pixel by
+// pixel: q[i * channels + c] is the code of x[c * spatial_dim + i].
+template <typename Dtype>
+void caffe_cpu_quantize_image(const int channels, const int spatial_dim,
+    const Dtype* x, const Dtype scale, const int zero_point, uint8_t* q);
+
+// The codes of the rows x cols weights w, each row stored ldq apart and
+// padded with zeros, and the scale of each row.
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* w,
+    const int ldq, int8_t* q, Dtype* scales);
+
+// y[i * ldy + j * incy] = (c[i * ldc + j] - zero_point * sums[j]) * scale *
+// scales[j] + bias[j] (unless bias is NULL) for the m x n dot products c of
+// input codes with the rows of weight codes whose sums are sums.
+template <typename Dtype>
+void caffe_cpu_dequantize(const int m, const int n, const int32_t* c,
+    const int ldc, const int zero_point, const Dtype scale, const int* sums,
+    const Dtype* scales, const Dtype* bias, Dtype* y, const int ldy,
+    const int incy);
+
+// The weights of a layer quantized row by row, each row padded to
+// caffe_cpu_int8_padded of its length.
+template <typename Dtype>
+class QuantizedWeights {
+ public:
+  QuantizedWeights()
+      : rows_(0), cols_(0), padded_cols_(0), channels_(0), version_(0) {}
+
+  // Quantizes weights as rows of weights.count() / rows values, unless they
+  // are the weights last quantized and have not been written since.  Each
+  // row, taken as channels x taps values, is stored as taps x channels, the
+  // order of the values of a patch of im2patches_cpu.
+  void Update(const Blob<Dtype>& weights, const int rows,
+      const int channels = 1);
+
+  inline int padded_cols() const { return padded_cols_; }
+  inline const int8_t* data() const {
+    return static_cast<const int8_t*>(data_->cpu_data());
+  }
+  inline const Dtype* scales() const { return scales_.cpu_data(); }
+  // The sum of the codes of each row.
+  inline const int* sums() const { return sums_.cpu_data(); }
+
+ private:
+  int rows_;
+  int cols_;
+  int padded_cols_;
+  int channels_;
+  shared_ptr<SyncedMemory> data_;
+  Blob<Dtype> scales_;
+  Blob<int> sums_;
+  // The weight memory last quantized, and its version then.
+  shared_ptr<SyncedMemory> memory_;
+  size_t version_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+// Replaces the data of proto, the weights of rows outputs, by their codes and
+// row scales, which Blob::FromProto maps back onto weights that quantize to
+// the same codes.
+void QuantizeBlobProto(const int rows, BlobProto* proto);
+
+// Quantizes the weights of every Convolution and InnerProduct layer of the
+// trained net param.
+void QuantizeNetWeights(NetParameter* param);
+
+// Replaces the data of proto by its half_data, which Blob::FromProto converts
+// back.
+void ConvertBlobProtoToHalf(BlobProto* proto);
+
+// Converts the data of every blob of the trained net param to half precision.
+void ConvertNetWeightsToHalf(NetParameter* param);
+
+// Runs iterations forward passes of net, and sets the quantization_param of
+// every Convolution and InnerProduct layer of param (from which net was made)
+// to the range of the inputs the layer took over them.
+template <typename Dtype>
+void CalibrateQuantization(Net<Dtype>* net, const int iterations,
+    NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_H_
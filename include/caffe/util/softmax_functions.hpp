@@ -0,0 +1,33 @@
+#ifndef CAFFE_UTIL_SOFTMAX_FUNCTIONS_H_
+#define CAFFE_UTIL_SOFTMAX_FUNCTIONS_H_
+
+namespace caffe {
+
+// The CPU softmax of SoftmaxLayer and SoftmaxWithLossLayer, over the channels
+// of n columns of a block whose rows are stride apart: element (c, k) is at
+// c * stride + k.  Every pass runs along rows of n contiguous columns, so
+// callers split the spatial dimension into tiles of at most kSoftmaxTile
+// columns, which stay in cache from the first pass to the last.
+const int kSoftmaxTile = 512;
+
+// The number of tiles that cover spatial_dim columns.
+inline int caffe_softmax_num_tiles(const int spatial_dim) {
+  return (spatial_dim + kSoftmaxTile - 1) / kSoftmaxTile;
+}
+
+// y = exp(x - max(x)) / sum(exp(x - max(x))) along the channels, with scratch
+// space for 2 * n elements.  y may be x.  fast_math is as for caffe_cpu_exp.
+template <typename Dtype>
+void caffe_cpu_softmax(const int channels, const int n, const int stride,
+    const Dtype* x, Dtype* y, Dtype* scratch, const bool fast_math);
+
+// dx = (dy - dot(dy, y)) * y along the channels, given the softmax output y,
+// with scratch space for n elements.  dx may be dy.
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int channels, const int n,
+    const int stride, const Dtype* y, const Dtype* dy, Dtype* dx,
+    Dtype* scratch);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOFTMAX_FUNCTIONS_H_
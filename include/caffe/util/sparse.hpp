@@ -0,0 +1,64 @@
+#ifndef CAFFE_UTIL_SPARSE_H_
+#define CAFFE_UTIL_SPARSE_H_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+// The sparse inference of the Convolution and InnerProduct layers whose
+// weights are pruned: in the TEST phase, a layer whose share of zero weights
+// reaches its sparse_threshold keeps its weights in compressed sparse row
+// form and takes its products with caffe_cpu_csrmm, which skips the zeros.
+
+// The weights of a layer in compressed sparse row form, each row the weights
+// of an output.
+template <typename Dtype>
+class SparseWeights {
+ public:
+  SparseWeights() : rows_(0), threshold_(0), sparse_(false), version_(0) {}
+
+  // Stores weights as rows of weights.count() / rows values if at least
+  // threshold of them are zero, unless they are the weights last seen, with
+  // the same rows and threshold, and have not been written since.  Returns
+  // whether the weights are stored.
+  bool Update(const Blob<Dtype>& weights, const int rows,
+      const float threshold);
+  // Lets go of the weight memory last seen, so that it may be freed; the next
+  // Update stores the weights again.
+  inline void Forget() { memory_.reset(); }
+
+  inline bool sparse() const { return sparse_; }
+  // The nonzeros of row r are values()[p] in columns col_idx()[p] for p from
+  // row_ptr()[r] to row_ptr()[r + 1] - 1.
+  inline const int* row_ptr() const { return row_ptr_.cpu_data(); }
+  inline const int* col_idx() const { return col_idx_.cpu_data(); }
+  inline const Dtype* values() const { return values_.cpu_data(); }
+
+ private:
+  int rows_;
+  float threshold_;
+  bool sparse_;
+  Blob<int> row_ptr_;
+  Blob<int> col_idx_;
+  Blob<Dtype> values_;
+  // The weight memory last seen, and its version then.
+  shared_ptr<SyncedMemory> memory_;
+  size_t version_;
+
+  DISABLE_COPY_AND_ASSIGN(SparseWeights);
+};
+
+// Sets the sparsity share of the data of proto with the smallest magnitudes
+// to zero.
+void PruneBlobProto(const float sparsity, BlobProto* proto);
+
+// Prunes the weights of every Convolution and InnerProduct layer of the
+// trained net param to sparsity, leaving the biases.
+void PruneNetWeights(const float sparsity, NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_H_
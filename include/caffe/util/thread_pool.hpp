@@ -0,0 +1,79 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread and friends instead of including
+ boost/thread.hpp to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost {
+class thread;
+class mutex;
+class condition_variable;
+}
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads that run the tasks of one parallel
+ *        region at a time, used to parallelize CPU computation.
+ *
+ * A pool of num_threads threads starts num_threads - 1 workers: the thread
+ * calling Run takes tasks as well.  Run may be called from within a task (or
+ * from another thread while the pool is busy), in which case it runs all its
+ * tasks serially on the calling thread instead of waiting for the pool.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+  /**
+   * @brief Calls task(i) for every i in [0, num_tasks) on the threads of the
+   *        pool, and returns once all calls have returned.
+   */
+  void Run(int num_tasks, const boost::function<void(int)>& task);
+
+ private:
+  void WorkerEntry();
+  // Takes and runs tasks of the current region until there are none left.
+  void RunTasks();
+
+  const int num_threads_;
+  vector<shared_ptr<boost::thread> > workers_;
+  // Guards all of the state below.
+  shared_ptr<boost::mutex> mutex_;
+  // Held for the whole of a parallel region, so that regions never nest.
+  shared_ptr<boost::mutex> region_mutex_;
+  shared_ptr<boost::condition_variable> task_available_;
+  shared_ptr<boost::condition_variable> region_done_;
+  boost::function<void(int)> task_;
+  int num_tasks_;
+  int next_task_;
+  int tasks_running_;
+  // Incremented for every region, so that workers notice new tasks.
+  int region_;
+  bool shutdown_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/// @brief The fewest values worth a thread of Caffe::thread_pool() of their
+///        own, so that small loops do not pay for waking the pool.
+const int kValuesPerThread = 1 << 14;
+
+/**
+ * @brief The number of threads of Caffe::thread_pool() to spread count values
+ *        over, split into at most max_tasks tasks (e.g. one per row).
+ */
+int NumParallelThreads(int count, int max_tasks);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,57 @@
+#ifndef CAFFE_UTIL_WEIGHT_MAP_HPP_
+#define CAFFE_UTIL_WEIGHT_MAP_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Every blob in a weight map file starts on a multiple of this many bytes.
+const size_t kWeightMapAlignment = 64;
+
+/**
+ * @brief A memory-mapped, flat weight file that parameter blobs can point
+ *        into directly instead of parsing and copying a binary NetParameter.
+ *
+ * The file starts with a fixed-size header holding the magic string, the
+ * offset of a serialized WeightMapIndex and its size. The float data of each
+ * parameter blob follows, each aligned to kWeightMapAlignment bytes, and the
+ * index is stored last.
+ *
+ * The file is mapped privately: pages are shared by every process mapping
+ * the same file until one of them writes to a blob (e.g. a solver update),
+ * in which case that process transparently gets its own copy of the page.
+ */
+class WeightMap {
+ public:
+  explicit WeightMap(const string& filename);
+  ~WeightMap();
+
+  inline const WeightMapIndex& index() const { return index_; }
+  inline const string& filename() const { return filename_; }
+  /// @brief Returns the (writable, copy-on-write) data of an index entry.
+  float* mutable_data(const WeightMapEntry& entry) const;
+
+ private:
+  string filename_;
+  void* addr_;
+  size_t size_;
+  WeightMapIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightMap);
+};
+
+/// @brief Returns true if filename starts with the weight map magic string.
+bool IsWeightMapFile(const string& filename);
+
+/**
+ * @brief Writes the blobs of a (trained) NetParameter, such as a caffemodel,
+ *        to a weight map file.
+ */
+void WriteWeightMap(const NetParameter& param, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WEIGHT_MAP_HPP_
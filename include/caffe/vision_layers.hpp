@@ -13,6 +13,8 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -38,14 +40,25 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
   // we just called weight_cpu_gemm with the same input.
+  // The CPU helpers take the id of the calling thread when the images of a
+  // batch are spread over threads (see prepare_cpu_threads), so that each
+  // thread uses its own column buffer.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, int thread_id = 0);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Adds bias (unless NULL) to output and applies the fused activation, if
+  // any, in a single pass over output.
+  void forward_cpu_bias_activation(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, int thread_id = 0);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, int thread_id = 0);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Returns the number of threads of Caffe::thread_pool() to spread the num_
+  // images of a batch over (at most one per image), and sets up a column
+  // buffer for each of them (and, with quantize_, an int8 buffer and the
+  // quantized weights, or with sparse_inference_, the sparse weights).
+  int prepare_cpu_threads();
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -75,8 +88,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int height_out_, width_out_;
   bool bias_term_;
   bool is_1x1_;
+  // The activation folded into this layer by Net (see FuseActivations).
+  ConvolutionParameter_Activation fused_activation_;
+  Dtype negative_slope_;
+  Dtype threshold_;
+  // Whether forward_cpu_gemm computes in int8 (in the TEST phase, with a
+  // quantization_param; see caffe/util/quantize.hpp).
+  bool quantize_;
+  Dtype int8_input_scale_;
+  int int8_zero_point_;
+  QuantizedWeights<Dtype> int8_weights_;
+  // Whether forward_cpu_gemm multiplies by the nonzero weights only when
+  // enough of them are zero (in the TEST phase of convolution; see
+  // caffe/util/sparse.hpp).
+  bool sparse_inference_;
+  float sparse_threshold_;
+  SparseWeights<Dtype> sparse_weights_;
 
  private:
+  // forward_cpu_gemm with quantize_.
+  void forward_cpu_int8(const Dtype* input, Dtype* output, int thread_id);
+
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
   inline void conv_im2col_cpu(const Dtype* data, Dtype* col_buff) {
     im2col_cpu(data, conv_in_channels_, conv_in_height_, conv_in_width_,
@@ -107,7 +139,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int col_offset_;
   int output_offset_;
 
+  inline Blob<Dtype>* col_buffer(int thread_id) {
+    return thread_id == 0 ? &col_buffer_ : col_buffers_[thread_id - 1].get();
+  }
+
   Blob<Dtype> col_buffer_;
+  // The column buffers of threads other than the first one.
+  vector<shared_ptr<Blob<Dtype> > > col_buffers_;
+  // The quantized image, its patches and their int32 outputs of each thread.
+  vector<shared_ptr<SyncedMemory> > int8_buffers_;
   Blob<Dtype> bias_multiplier_;
 };
 
@@ -155,8 +195,9 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism) and WINOGRAD (CPU Winograd transforms
+   *    for 3x3 filters, see WinogradConvolutionLayer) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
@@ -174,6 +215,77 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // The CPU passes over the images of one bottom/top pair that thread
+  // thread_id of num_threads is responsible for.
+  void forward_cpu_images(const Dtype* bottom_data, const Dtype* weight,
+      Dtype* top_data, int num_threads, int thread_id);
+  void backward_cpu_images(const Dtype* top_diff, const Dtype* bottom_data,
+      Dtype* bottom_diff, const Dtype* weight, int num_threads,
+      int thread_id);
+  // Applies the fused activation, if any, to the count values of top_data.
+  void forward_gpu_activation(Dtype* top_data, int count);
+
+  // The weight and bias gradients of threads other than the first one, which
+  // are summed into the parameter diffs after each backward pass.
+  vector<shared_ptr<Blob<Dtype> > > weight_diff_buffers_;
+  vector<shared_ptr<Blob<Dtype> > > bias_diff_buffers_;
+};
+
+/**
+ * @brief Winograd F(2x2, 3x3) CPU implementation of ConvolutionLayer.
+ *        Falls back to ConvolutionLayer for unsupported shapes, for the
+ *        backward pass and for GPU mode.
+ *
+ * For a 3x3 stride 1 convolution im2col copies every input value 9 times
+ * into the column buffer before the GEMM reads it again. The WINOGRAD
+ * engine instead transforms each overlapping 4x4 input tile (about 4 values
+ * per input value) and each filter, multiplies the transforms with one GEMM
+ * per tile element, and transforms the products back into 2x2 output tiles.
+ * This needs 16 instead of 36 multiplications per output tile and input
+ * channel, at the cost of slightly larger rounding errors.
+ *
+ * The Winograd path handles 3x3 stride 1 convolutions with any padding and
+ * group. 1x1 stride 1 convolutions without padding already skip im2col in
+ * ConvolutionLayer and keep using its GEMM; other shapes use im2col + GEMM.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), transformed_version_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // Whether Forward_cpu takes the Winograd path for the current shape.
+  bool use_winograd() const;
+  // Sets up the buffers of the first num_threads threads.
+  void prepare_buffers(int num_threads);
+  // Computes transformed_weight_ from the current filters, unless they have
+  // not changed since the last time.
+  void transform_weights();
+  void forward_cpu_winograd_images(const Dtype* bottom_data, Dtype* top_data,
+      int num_threads, int thread_id);
+  // Convolves a single image (all groups) with the buffers of thread_id.
+  void forward_cpu_winograd(const Dtype* input, Dtype* output, int thread_id);
+
+  int tiles_h_, tiles_w_;
+  int padded_height_, padded_width_;
+  // group x 16 x (num_output / group) x (channels / group) filter transforms.
+  Blob<Dtype> transformed_weight_;
+  // The filter memory transformed_weight_ was computed from, and its version
+  // then.
+  shared_ptr<SyncedMemory> transformed_memory_;
+  size_t transformed_version_;
+  // Per thread: the zero-padded image, and the 16 x channels x tiles input
+  // and 16 x outputs x tiles output transforms of one group.
+  vector<shared_ptr<Blob<Dtype> > > padded_inputs_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_inputs_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_outputs_;
 };
 
 /**
@@ -209,6 +321,19 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return true; }
   virtual void compute_output_shape();
+
+  // The CPU forward pass over the images of one bottom/top pair that thread
+  // thread_id of num_threads is responsible for.
+  void forward_cpu_images(const Dtype* bottom_data, const Dtype* weight,
+      Dtype* top_data, int num_threads, int thread_id);
+  // Whether each output channel is the upsampling of one input channel by a
+  // kernel of its own (as in bilinear upsampling), which the CPU computes
+  // directly (see deconv_channelwise_cpu) instead of through the column
+  // buffer.
+  inline bool channelwise() const {
+    return this->group_ == this->channels_ &&
+        this->num_output_ == this->channels_;
+  }
 };
 
 #ifdef USE_CUDNN
@@ -337,6 +462,34 @@ class LRNLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void WithinChannelForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void WithinChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // The CPU passes over the pixel blocks of the images (ACROSS_CHANNELS) or
+  // the channel planes (WITHIN_CHANNEL) that thread thread_id of num_threads
+  // is responsible for.  The forward passes compute the scale and the output
+  // together, skipping the output if top_data is NULL and keeping the scale
+  // only if scale_data is not.
+  void cross_channel_forward_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* scale_data, int num_threads, int thread_id);
+  void cross_channel_backward_cpu(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data,
+      const Dtype* scale_data, Dtype* bottom_diff, int num_threads,
+      int thread_id);
+  void within_channel_forward_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* scale_data, int num_threads, int thread_id);
+  void within_channel_backward_cpu(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data,
+      const Dtype* scale_data, Dtype* bottom_diff, int num_threads,
+      int thread_id);
+  // The number of blocks the pixels of each image are split into for
+  // num_threads threads.
+  int cpu_pixel_blocks(int num_threads) const;
+  // Sets up the sub-layers that normalize WITHIN_CHANNEL on the GPU.
+  void SetUpWithinChannelLayers(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   int size_;
   int pre_pad_;
@@ -348,11 +501,14 @@ class LRNLayer : public Layer<Dtype> {
   int height_;
   int width_;
 
-  // Fields used for normalization ACROSS_CHANNELS
   // scale_ stores the intermediate summing results
   Blob<Dtype> scale_;
+  // Whether scale_ holds the scale of the last CPU forward pass, which the
+  // TEST phase does not keep.
+  bool scale_valid_;
 
-  // Fields used for normalization WITHIN_CHANNEL
+  // Fields used for normalization WITHIN_CHANNEL on the GPU, set up on first
+  // use
   shared_ptr<SplitLayer<Dtype> > split_layer_;
   vector<Blob<Dtype>*> split_top_vec_;
   shared_ptr<PowerLayer<Dtype> > square_layer_;
@@ -416,6 +572,33 @@ class PoolingLayer : public Layer<Dtype> {
   bool global_pooling_;
   Blob<Dtype> rand_idx_;
   Blob<int> max_idx_;
+
+  // The CPU passes over the channel planes that thread thread_id of
+  // num_threads is responsible for.  Max pooling writes the argmax to mask
+  // or top_mask unless both are NULL, and only the argmax if top_data is.
+  // Stochastic pooling samples by the uniform numbers in top_mask, replacing
+  // them with the indices of the samples, or averages if top_mask is NULL.
+  void forward_cpu_planes(const Dtype* bottom_data, Dtype* top_data,
+      int* mask, Dtype* top_mask, int num_planes, int num_threads,
+      int thread_id);
+  void backward_cpu_planes(const Dtype* top_diff, const int* mask,
+      const Dtype* top_mask, Dtype* bottom_diff, int num_planes,
+      int num_threads, int thread_id);
+  // Pools the windows of one plane that the fast path does not cover.
+  void max_pool_plane(const Dtype* bottom_data, Dtype* top_data, int* mask,
+      Dtype* top_mask, bool fast) const;
+  void ave_pool_plane(const Dtype* bottom_data, Dtype* top_data,
+      bool fast) const;
+  void sto_pool_plane(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* rand_idx, int plane_offset) const;
+  // Whether the 2x2 and 3x3 stride 2 kernels apply, and the outputs
+  // [ph_begin_, ph_end_) x [pw_begin_, pw_end_) whose windows they cover
+  // (those that lie inside the image).
+  bool fast_kernel_;
+  int ph_begin_, ph_end_, pw_begin_, pw_end_;
+  // Whether max_idx_ holds the argmax of the last forward pass, which the
+  // TEST phase skips unless Backward asks for it.
+  bool max_idx_valid_;
 };
 
 #ifdef USE_CUDNN
@@ -9,6 +9,7 @@
 #include <numpy/arrayobject.h>
 
 // these need to be included after boost on OS X
+#include <map>  // NOLINT(build/include_order)
 #include <string>  // NOLINT(build/include_order)
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
@@ -130,6 +131,35 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+// The memory accounting of the net as a list of (owner, category, cpu bytes,
+// peak cpu bytes, gpu bytes, peak gpu bytes) tuples.
+bp::tuple MemoryAccountTuple(const MemoryAccount& account) {
+  return bp::make_tuple(account.owner(), account.category(),
+      account.cpu_bytes(), account.peak_cpu_bytes(),
+      account.gpu_bytes(), account.peak_gpu_bytes());
+}
+
+bp::list Net_MemoryUsage(const Net<Dtype>& net) {
+  bp::list usage;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    usage.append(MemoryAccountTuple(*net.layer_memory_accounts()[i]));
+    for (int j = 0; j < net.category_memory_accounts()[i].size(); ++j) {
+      usage.append(MemoryAccountTuple(*net.category_memory_accounts()[i][j]));
+    }
+  }
+  usage.append(MemoryAccountTuple(*net.memory_account()));
+  return usage;
+}
+
+bp::dict Net_BlobAliases(const Net<Dtype>& net) {
+  bp::dict aliases;
+  for (map<string, string>::const_iterator it = net.blob_aliases().begin();
+       it != net.blob_aliases().end(); ++it) {
+    aliases[it->first] = it->second;
+  }
+  return aliases;
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadProtoFromTextFileOrDie(filename, &param);
@@ -201,6 +231,7 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::return_internal_reference<>()))
     .add_property("_blob_names", bp::make_function(&Net<Dtype>::blob_names,
         bp::return_value_policy<bp::copy_const_reference>()))
+    .add_property("_blob_aliases", &Net_BlobAliases)
     .add_property("_layer_names", bp::make_function(&Net<Dtype>::layer_names,
         bp::return_value_policy<bp::copy_const_reference>()))
     .add_property("_inputs", bp::make_function(&Net<Dtype>::input_blob_indices,
@@ -208,6 +239,7 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("_outputs",
         bp::make_function(&Net<Dtype>::output_blob_indices,
         bp::return_value_policy<bp::copy_const_reference>()))
+    .add_property("_memory_usage", &Net_MemoryUsage)
     .def("_set_input_arrays", &Net_SetInputArrays,
         bp::with_custodian_and_ward<1, 2, bp::with_custodian_and_ward<1, 3> >())
     .def("save", &Net_Save);
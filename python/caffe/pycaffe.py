@@ -22,9 +22,13 @@ import caffe.io
 def _Net_blobs(self):
     """
     An OrderedDict (bottom to top, i.e., input to output) of network
-    blobs indexed by name
+    blobs indexed by name; the blobs computed in place come after the others,
+    under their own names as well
     """
-    return OrderedDict(zip(self._blob_names, self._blobs))
+    blobs = OrderedDict(zip(self._blob_names, self._blobs))
+    for alias, name in sorted(self._blob_aliases.items()):
+        blobs[alias] = blobs[name]
+    return blobs
 
 
 @property
@@ -39,6 +43,22 @@ def _Net_params(self):
                         if len(lr.blobs) > 0])
 
 
+@property
+def _Net_memory_usage(self):
+    """
+    An OrderedDict (bottom to top) of the memory held by each layer's blobs,
+    indexed by layer name. Each value is an OrderedDict indexed by category
+    ('total', 'top_data', 'top_diff', 'param_data', 'param_diff',
+    'internal') of (cpu bytes, peak cpu bytes, gpu bytes, peak gpu bytes)
+    tuples. The whole net is listed last under its own name.
+    """
+    usage = OrderedDict()
+    for owner, category, cpu, peak_cpu, gpu, peak_gpu in self._memory_usage:
+        usage.setdefault(owner, OrderedDict())[category] = \
+            (cpu, peak_cpu, gpu, peak_gpu)
+    return usage
+
+
 @property
 def _Net_inputs(self):
     return [self.blobs.keys()[i] for i in self._inputs]
@@ -269,3 +289,4 @@ Net.set_input_arrays = _Net_set_input_arrays
 Net._batch = _Net_batch
 Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
+Net.memory_usage = _Net_memory_usage
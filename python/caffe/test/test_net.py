@@ -60,6 +60,20 @@ class TestNet(unittest.TestCase):
         self.net.forward()
         self.net.backward()
 
+    def test_memory_usage(self):
+        self.net.forward()
+        self.net.backward()
+        usage = self.net.memory_usage
+        self.assertEqual(usage.keys()[:4], ['data', 'conv', 'ip', 'loss'])
+        cpu, peak_cpu, gpu, peak_gpu = usage['conv']['param_data']
+        # 11 x 2 x 2 x 2 weights and 11 biases
+        self.assertEqual(cpu, (11 * 2 * 2 * 2 + 11) * 4)
+        self.assertGreaterEqual(peak_cpu, cpu)
+        self.assertGreater(usage['conv']['internal'][1], 0)
+        self.assertEqual(usage['conv']['total'][0],
+                sum(usage['conv'][c][0] for c in usage['conv']
+                    if c != 'total'))
+
     def test_inputs_outputs(self):
         self.assertEqual(self.net.inputs, [])
         self.assertEqual(self.net.outputs, ['loss'])
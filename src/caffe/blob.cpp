@@ -1,7 +1,12 @@
+#include <stdint.h>
+
+#include <vector>
+
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
 
 namespace caffe {
 
@@ -18,12 +23,19 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
   width_ = width;
   count_ = num_ * channels_ * height_ * width_;
   if (count_ > capacity_) {
-    capacity_ = count_;
-    data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
-    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    Reallocate();
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::Reallocate() {
+  capacity_ = count_;
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  if (data_account_) { data_->set_account(data_account_); }
+  if (diff_account_) { diff_->set_account(diff_account_); }
+}
+
 template <typename Dtype>
 void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.num(), other.channels(), other.height(), other.width());
@@ -103,6 +115,43 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareData(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  if (data_ && data_->size() == count_ * sizeof(Dtype) &&
+      data_->is_view_of(*other.data(), offset * sizeof(Dtype))) {
+    return;
+  }
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  // A larger reshape must not run past the end of the view.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiff(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  if (diff_ && diff_->size() == count_ * sizeof(Dtype) &&
+      diff_->is_view_of(*other.diff(), offset * sizeof(Dtype))) {
+    return;
+  }
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_memory_accounts(
+    const shared_ptr<MemoryAccount>& data_account,
+    const shared_ptr<MemoryAccount>& diff_account) {
+  data_account_ = data_account;
+  diff_account_ = diff_account;
+  if (data_) { data_->set_account(data_account_); }
+  if (diff_) { diff_->set_account(diff_account_); }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -384,8 +433,30 @@ void Blob<Dtype>::FromProto(const BlobProto& proto) {
   Reshape(proto.num(), proto.channels(), proto.height(), proto.width());
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    data_vec[i] = proto.data(i);
+  if (proto.has_int8_data()) {
+    // Quantized by QuantizeBlobProto.
+    CHECK_EQ(proto.int8_data().size(), count_);
+    CHECK_GT(proto.int8_scale_size(), 0);
+    const int row_size = count_ / proto.int8_scale_size();
+    const int8_t* q = reinterpret_cast<const int8_t*>(
+        proto.int8_data().data());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = q[i] * proto.int8_scale(i / row_size);
+    }
+  } else if (proto.has_half_data()) {
+    // Converted by ConvertBlobProtoToHalf.
+    CHECK_EQ(proto.half_data().size(), count_ * sizeof(uint16_t));
+    vector<float> values(count_);
+    caffe_cpu_from_half(count_,
+        reinterpret_cast<const uint16_t*>(proto.half_data().data()),
+        &values[0]);
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = values[i];
+    }
+  } else {
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = proto.data(i);
+    }
   }
   if (proto.diff_size() > 0) {
     Dtype* diff_vec = mutable_cpu_diff();
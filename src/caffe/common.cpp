@@ -4,6 +4,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -39,10 +40,28 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_num_threads(const int num_threads) {
+  CHECK_GT(num_threads, 0);
+  if (!Get().thread_pool_ || Get().thread_pool_->num_threads() != num_threads) {
+    Get().thread_pool_.reset(new ThreadPool(num_threads));
+  }
+}
+
+int Caffe::num_threads() {
+  return thread_pool().num_threads();
+}
+
+ThreadPool& Caffe::thread_pool() {
+  if (!Get().thread_pool_) {
+    Get().thread_pool_.reset(new ThreadPool(1));
+  }
+  return *(Get().thread_pool_);
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
-    : random_generator_(), mode_(Caffe::CPU) { }
+    : random_generator_(), thread_pool_(), mode_(Caffe::CPU) { }
 
 Caffe::~Caffe() { }
 
@@ -86,6 +105,7 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
+    thread_pool_(),
     mode_(Caffe::CPU) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
@@ -2,7 +2,7 @@
 
 #include "caffe/layer.hpp"
 #include "caffe/neuron_layers.hpp"
-#include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
 
 namespace caffe {
 
@@ -19,7 +19,7 @@ void AbsValLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_abs(count, bottom[0]->cpu_data(), top_data);
+  caffe_cpu_absval(count, bottom[0]->cpu_data(), top_data);
 }
 
 template <typename Dtype>
@@ -30,8 +30,7 @@ void AbsValLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (propagate_down[0]) {
     const Dtype* bottom_data = bottom[0]->cpu_data();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_cpu_sign(count, bottom_data, bottom_diff);
-    caffe_mul(count, bottom_diff, top_diff, bottom_diff);
+    caffe_cpu_absval_backward(count, bottom_data, top_diff, bottom_diff);
   }
 }
 
@@ -1,11 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
-#include <functional>
-#include <utility>
 #include <vector>
 
 #include "caffe/layer.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -38,44 +39,48 @@ void AccuracyLayer<Dtype>::Reshape(
 template <typename Dtype>
 void AccuracyLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  Dtype accuracy = 0;
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* bottom_label = bottom[1]->cpu_data();
-  int num = bottom[0]->num();
-  int dim = bottom[0]->count() / bottom[0]->num();
-  vector<Dtype> maxval(top_k_+1);
-  vector<int> max_id(top_k_+1);
-  for (int i = 0; i < num; ++i) {
-    // Top-k accuracy
-    std::vector<std::pair<Dtype, int> > bottom_data_vector;
-    for (int j = 0; j < dim; ++j) {
-      if (has_ignore_label_) {
-        if ((ignore_mode_ == 1 && j > ignore_label_) ||
-            (ignore_mode_ == 2 && j == ignore_label_) ||
-            (ignore_mode_ == 3 && j < ignore_label_)) {
-          bottom_data_vector.push_back(std::make_pair(-9999, j));
-          continue;
-        }
-      }
-      bottom_data_vector.push_back(
-        std::make_pair(bottom_data[i * dim + j], j));
-    }
-    std::partial_sort(
-        bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-        bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
-    // check if true label is in top k predictions
-    for (int k = 0; k < top_k_; k++) {
-      // printf("pred = %d, label = %d\n",  bottom_data_vector[k].second, static_cast<int>(bottom_label[i]));
-      if (bottom_data_vector[k].second == static_cast<int>(bottom_label[i])) {
-        ++accuracy;
-        break;
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count() / num;
+  const int num_threads = NumParallelThreads(bottom[0]->count(), num);
+  correct_.resize(num_threads);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &AccuracyLayer<Dtype>::forward_cpu_inputs, this, bottom_data,
+      bottom_label, num, dim, num_threads, _1));
+  int accuracy = 0;
+  for (int t = 0; t < num_threads; ++t) { accuracy += correct_[t]; }
+  top[0]->mutable_cpu_data()[0] = Dtype(accuracy) / num;
+  // Accuracy layer should not be used as a loss function.
+}
+
+template <typename Dtype>
+void AccuracyLayer<Dtype>::forward_cpu_inputs(const Dtype* bottom_data,
+    const Dtype* bottom_label, const int num, const int dim, int num_threads,
+    int thread_id) {
+  const int begin = num * thread_id / num_threads;
+  const int end = num * (thread_id + 1) / num_threads;
+  int correct = 0;
+  for (int i = begin; i < end; ++i) {
+    const Dtype* x = bottom_data + i * dim;
+    const int label = static_cast<int>(bottom_label[i]);
+    if (label < 0 || label >= dim) { continue; }
+    // The label is in the top k if fewer than k classes rank above it, the
+    // classes of the same score ranking above it when their index is larger.
+    const Dtype score = ignored_class(label) ? Dtype(-9999) : x[label];
+    int above = 0;
+    if (has_ignore_label_) {
+      for (int j = 0; j < dim; ++j) {
+        const Dtype x_j = ignored_class(j) ? Dtype(-9999) : x[j];
+        above += x_j > score || (x_j == score && j > label);
       }
+    } else {
+      for (int j = 0; j < label; ++j) { above += x[j] > score; }
+      for (int j = label + 1; j < dim; ++j) { above += x[j] >= score; }
     }
+    correct += above < top_k_;
   }
-
-  // LOG(INFO) << "Accuracy: " << accuracy;
-  top[0]->mutable_cpu_data()[0] = accuracy / num;
-  // Accuracy layer should not be used as a loss function.
+  correct_[thread_id] = correct;
 }
 
 INSTANTIATE_CLASS(AccuracyLayer);
@@ -1,9 +1,11 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
-#include <functional>
-#include <utility>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -11,23 +13,48 @@ namespace caffe {
 template <typename Dtype>
 void ArgMaxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  out_max_val_ = this->layer_param_.argmax_param().out_max_val();
-  top_k_ = this->layer_param_.argmax_param().top_k();
+  const ArgMaxParameter& argmax_param = this->layer_param_.argmax_param();
+  out_max_val_ = argmax_param.out_max_val();
+  top_k_ = argmax_param.top_k();
+  has_axis_ = argmax_param.has_axis();
   CHECK_GE(top_k_, 1) << " top k must not be less than 1.";
-  CHECK_LE(top_k_, bottom[0]->count() / bottom[0]->num())
-      << "top_k must be less than or equal to the number of classes.";
+  if (has_axis_) {
+    axis_ = argmax_param.axis() < 0 ? argmax_param.axis() + 4 :
+        argmax_param.axis();
+    CHECK_GE(axis_, 0) << "axis out of range.";
+    CHECK_LT(axis_, 4) << "axis out of range.";
+  }
 }
 
 template <typename Dtype>
 void ArgMaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  if (out_max_val_) {
-    // Produces max_ind and max_val
-    top[0]->Reshape(bottom[0]->num(), 2, top_k_, 1);
-  } else {
-    // Produces only max_ind
-    top[0]->Reshape(bottom[0]->num(), 1, top_k_, 1);
+  if (!has_axis_) {
+    outer_num_ = bottom[0]->num();
+    axis_dim_ = bottom[0]->count() / bottom[0]->num();
+    inner_num_ = 1;
+    CHECK_LE(top_k_, axis_dim_)
+        << "top_k must be less than or equal to the number of classes.";
+    if (out_max_val_) {
+      // Produces max_ind and max_val
+      top[0]->Reshape(bottom[0]->num(), 2, top_k_, 1);
+    } else {
+      // Produces only max_ind
+      top[0]->Reshape(bottom[0]->num(), 1, top_k_, 1);
+    }
+    return;
   }
+  int shape[4] = { bottom[0]->num(), bottom[0]->channels(),
+      bottom[0]->height(), bottom[0]->width() };
+  outer_num_ = 1;
+  for (int i = 0; i < axis_; ++i) { outer_num_ *= shape[i]; }
+  axis_dim_ = shape[axis_];
+  inner_num_ = 1;
+  for (int i = axis_ + 1; i < 4; ++i) { inner_num_ *= shape[i]; }
+  CHECK_LE(top_k_, axis_dim_)
+      << "top_k must be less than or equal to the dimension of the axis.";
+  shape[axis_] = top_k_;
+  top[0]->Reshape(shape[0], shape[1], shape[2], shape[3]);
 }
 
 template <typename Dtype>
@@ -35,23 +62,38 @@ void ArgMaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->num();
-  int dim = bottom[0]->count() / bottom[0]->num();
-  for (int i = 0; i < num; ++i) {
-    std::vector<std::pair<Dtype, int> > bottom_data_vector;
-    for (int j = 0; j < dim; ++j) {
-      bottom_data_vector.push_back(
-          std::make_pair(bottom_data[i * dim + j], j));
-    }
-    std::partial_sort(
-        bottom_data_vector.begin(), bottom_data_vector.begin() + top_k_,
-        bottom_data_vector.end(), std::greater<std::pair<Dtype, int> >());
+  const int num_rows = outer_num_ * inner_num_;
+  const int num_threads = NumParallelThreads(bottom[0]->count(), num_rows);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &ArgMaxLayer<Dtype>::forward_cpu_rows, this, bottom_data, top_data,
+      num_threads, _1));
+}
+
+template <typename Dtype>
+void ArgMaxLayer<Dtype>::forward_cpu_rows(const Dtype* bottom_data,
+    Dtype* top_data, int num_threads, int thread_id) {
+  const int num_rows = outer_num_ * inner_num_;
+  const int begin = num_rows * thread_id / num_threads;
+  const int end = num_rows * (thread_id + 1) / num_threads;
+  if (begin >= end) { return; }
+  vector<Dtype> values(top_k_);
+  vector<int> indices(top_k_);
+  // Without an axis, each image has top_k indices and then, with
+  // out_max_val, its top_k values.
+  const int top_dim = has_axis_ ? top_k_ * inner_num_ :
+      (out_max_val_ ? 2 : 1) * top_k_;
+  for (int row = begin; row < end; ++row) {
+    const int n = row / inner_num_;
+    const int i = row % inner_num_;
+    caffe_cpu_top_k(axis_dim_, bottom_data + n * axis_dim_ * inner_num_ + i,
+        inner_num_, top_k_, &values[0], &indices[0]);
+    Dtype* top_row = top_data + n * top_dim + i;
     for (int j = 0; j < top_k_; ++j) {
-      top_data[top[0]->offset(i, 0, j)] = bottom_data_vector[j].second;
-    }
-    if (out_max_val_) {
-      for (int j = 0; j < top_k_; ++j) {
-        top_data[top[0]->offset(i, 1, j)] = bottom_data_vector[j].first;
+      if (has_axis_) {
+        top_row[j * inner_num_] = out_max_val_ ? values[j] : indices[j];
+      } else {
+        top_row[j] = indices[j];
+        if (out_max_val_) { top_row[top_k_ + j] = values[j]; }
       }
     }
   }
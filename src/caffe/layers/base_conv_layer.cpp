@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -51,6 +55,23 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // and no padding, so flag for skipping the buffer and transformation.
   is_1x1_ = kernel_w_ == 1 && kernel_h_ == 1
       && stride_h_ == 1 && stride_w_ == 1 && pad_h_ == 0 && pad_w_ == 0;
+  fused_activation_ = conv_param.fused_activation();
+  CHECK(!reverse_dimensions() ||
+        fused_activation_ == ConvolutionParameter_Activation_NONE)
+      << "Only convolution supports fused activations.";
+  negative_slope_ = this->layer_param_.relu_param().negative_slope();
+  threshold_ = this->layer_param_.threshold_param().threshold();
+  quantize_ = this->phase_ == TEST &&
+      this->layer_param_.has_quantization_param();
+  CHECK(!reverse_dimensions() || !quantize_)
+      << "Only convolution supports int8 inference.";
+  if (quantize_) {
+    GetInputQuantization(this->layer_param_.quantization_param(),
+        &int8_input_scale_, &int8_zero_point_);
+  }
+  sparse_inference_ = this->phase_ == TEST && !reverse_dimensions() &&
+      !quantize_;
+  sparse_threshold_ = conv_param.sparse_threshold();
   // Configure output channels and groups.
   channels_ = bottom[0]->channels();
   num_output_ = this->layer_param_.convolution_param().num_output();
@@ -142,6 +163,9 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else {
     col_buffer_.Reshape(1, kernel_dim_, height_out_, width_out_);
   }
+  for (int i = 0; i < col_buffers_.size(); ++i) {
+    col_buffers_[i]->ReshapeLike(col_buffer_);
+  }
   // Set up the all ones "bias multiplier" for adding biases by BLAS
   if (bias_term_) {
     bias_multiplier_.Reshape(1, 1, 1, height_out_ * width_out_);
@@ -152,13 +176,28 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col, int thread_id) {
+  if (quantize_) {
+    forward_cpu_int8(input, output, thread_id);
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer(thread_id)->mutable_cpu_data());
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer(thread_id)->cpu_data();
+  }
+  if (sparse_inference_ && sparse_weights_.sparse()) {
+    const int group_outputs = conv_out_channels_ / group_;
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_csrmm(group_outputs, conv_out_spatial_dim_,
+          sparse_weights_.row_ptr() + group_outputs * g,
+          sparse_weights_.col_idx(), sparse_weights_.values(),
+          col_buff + col_offset_ * g, conv_out_spatial_dim_,
+          output + output_offset_ * g, conv_out_spatial_dim_);
+    }
+    return;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -168,6 +207,41 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_int8(const Dtype* input,
+    Dtype* output, int thread_id) {
+  // The buffer holds the quantized image, pixel by pixel, the patches of a
+  // group (see im2patches_cpu) and the int32 outputs of the group.
+  const int in_spatial_dim = conv_in_height_ * conv_in_width_;
+  const int image_size = conv_in_channels_ * in_spatial_dim;
+  const int group_channels = conv_in_channels_ / group_;
+  const int group_outputs = conv_out_channels_ / group_;
+  const int padded_kernel_dim = int8_weights_.padded_cols();
+  uint8_t* image = static_cast<uint8_t*>(
+      int8_buffers_[thread_id]->mutable_cpu_data());
+  uint8_t* patches = image + (image_size + 3) / 4 * 4;
+  int32_t* sums = reinterpret_cast<int32_t*>(
+      patches + conv_out_spatial_dim_ * padded_kernel_dim);
+  caffe_cpu_quantize_image(conv_in_channels_, in_spatial_dim, input,
+      int8_input_scale_, int8_zero_point_, image);
+  for (int g = 0; g < group_; ++g) {
+    im2patches_cpu(image + g * group_channels, group_channels,
+        conv_in_height_, conv_in_width_, kernel_h_, kernel_w_, pad_h_, pad_w_,
+        stride_h_, stride_w_, conv_in_channels_, int8_zero_point_,
+        padded_kernel_dim, patches);
+    caffe_cpu_int8_gemm(conv_out_spatial_dim_, group_outputs,
+        padded_kernel_dim, patches,
+        int8_weights_.data() + g * group_outputs * padded_kernel_dim, sums,
+        group_outputs);
+    caffe_cpu_dequantize(conv_out_spatial_dim_, group_outputs, sums,
+        group_outputs, int8_zero_point_, int8_input_scale_,
+        int8_weights_.sums() + g * group_outputs,
+        int8_weights_.scales() + g * group_outputs,
+        static_cast<const Dtype*>(NULL), output + output_offset_ * g, 1,
+        conv_out_spatial_dim_);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -176,12 +250,38 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias_activation(Dtype* output,
+    const Dtype* bias) {
+  if (fused_activation_ == ConvolutionParameter_Activation_NONE) {
+    if (bias) { forward_cpu_bias(output, bias); }
+    return;
+  }
+  // Same arithmetic as the bias GEMM followed by a ReLU or Threshold layer.
+  const int spatial_dim = height_out_ * width_out_;
+  for (int o = 0; o < num_output_; ++o) {
+    Dtype* out = output + o * spatial_dim;
+    const Dtype b = bias ? bias[o] : Dtype(0);
+    if (fused_activation_ == ConvolutionParameter_Activation_RELU) {
+      for (int j = 0; j < spatial_dim; ++j) {
+        const Dtype value = out[j] + b;
+        out[j] = std::max(value, Dtype(0))
+            + negative_slope_ * std::min(value, Dtype(0));
+      }
+    } else {
+      for (int j = 0; j < spatial_dim; ++j) {
+        out[j] = (out[j] + b > threshold_) ? Dtype(1) : Dtype(0);
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+    const Dtype* weights, Dtype* input, int thread_id) {
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    col_buff = col_buffer(thread_id)->mutable_cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_ / group_,
@@ -196,11 +296,11 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, int thread_id) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    conv_im2col_cpu(input, col_buffer(thread_id)->mutable_cpu_data());
+    col_buff = col_buffer(thread_id)->cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -217,6 +317,40 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::prepare_cpu_threads() {
+  const int num_threads = std::min(Caffe::num_threads(), num_);
+  while (col_buffers_.size() + 1 < num_threads) {
+    col_buffers_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    col_buffers_.back()->ReshapeLike(col_buffer_);
+  }
+  // Make sure the bias multiplier is on the CPU before threads read it.
+  if (bias_term_) { bias_multiplier_.cpu_data(); }
+  if (quantize_) {
+    int8_weights_.Update(*this->blobs_[0], conv_out_channels_,
+        conv_in_channels_ / group_);
+    const size_t size = (conv_in_channels_ * conv_in_height_ *
+        conv_in_width_ + 3) / 4 * 4 + conv_out_spatial_dim_ *
+        (int8_weights_.padded_cols() + sizeof(int32_t) * conv_out_channels_
+        / group_);
+    int8_buffers_.resize(std::max<size_t>(int8_buffers_.size(), num_threads));
+    for (int t = 0; t < num_threads; ++t) {
+      if (!int8_buffers_[t] || int8_buffers_[t]->size() < size) {
+        int8_buffers_[t].reset(new SyncedMemory(size));
+      }
+      int8_buffers_[t]->mutable_cpu_data();
+    }
+  }
+  if (sparse_inference_ &&
+      sparse_weights_.Update(*this->blobs_[0], conv_out_channels_,
+      sparse_threshold_)) {
+    sparse_weights_.row_ptr();
+    sparse_weights_.col_idx();
+    sparse_weights_.values();
+  }
+  return num_threads;
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -14,6 +14,8 @@ void ConcatLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     "concat_dim should be >= 0";
   CHECK_LE(concat_dim_, 1) <<
     "For now concat_dim <=1, it can only concat num and channels";
+  share_bottoms_ = this->layer_param_.concat_param().share_bottoms();
+  bottoms_shared_ = false;
 }
 
 template <typename Dtype>
@@ -39,6 +41,24 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(num_, channels_, height_, width_);
   CHECK_EQ(count_, top[0]->count());
+  // Bottoms shared by an earlier pass already hold their producers' output.
+  // Unless they still are views of their ranges of the reshaped top, the
+  // copies of the forward pass could overwrite ranges not yet copied or
+  // overlap their sources, so give the top new memory and leave the old one
+  // to the views until ShareBottoms replaces them.
+  if (bottoms_shared_) {
+    bool views_match = !(concat_dim_ == 1 && num_ != 1);
+    int offset = 0;
+    for (int i = 0; views_match && i < bottom.size(); ++i) {
+      views_match = bottom[i]->data()->is_view_of(*top[0]->data(),
+          offset * sizeof(Dtype));
+      offset += bottom[i]->count();
+    }
+    if (!views_match) {
+      top[0]->Reallocate();
+      bottoms_shared_ = false;
+    }
+  }
 }
 
 template <typename Dtype>
@@ -66,6 +86,7 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       offset_channel += bottom[i]->channels();
     }  // concat_dim_ is guaranteed to be 0 or 1 by LayerSetUp.
   }
+  ShareBottoms(bottom, top);
 }
 
 template <typename Dtype>
@@ -100,6 +121,24 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }  // concat_dim_ is guaranteed to be 0 or 1 by LayerSetUp.
 }
 
+template <typename Dtype>
+void ConcatLayer<Dtype>::ShareBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  // Each bottom is a contiguous range of the top only along num, or along
+  // channels of a single image.  Once the bottoms are views, the copies of
+  // the forward and backward passes have the same source and destination,
+  // which caffe_copy skips; when a producer reshapes its top to new memory,
+  // the next forward pass copies once and shares again.
+  if (!share_bottoms_ || (concat_dim_ == 1 && num_ != 1)) { return; }
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom[i]->ShareData(*top[0], offset);
+    bottom[i]->ShareDiff(*top[0], offset);
+    offset += bottom[i]->count();
+  }
+  bottoms_shared_ = true;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(ConcatLayer);
 #endif
@@ -34,6 +34,7 @@ void ConcatLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     LOG(FATAL) << "concat_dim along dim" << concat_dim_ <<
       " not implemented yet";
   }
+  ShareBottoms(bottom, top);
 }
 
 template <typename Dtype>
@@ -1,9 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -20,17 +23,29 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (this->bias_term_) { this->blobs_[1]->cpu_data(); }
+  const int num_threads = this->prepare_cpu_threads();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + bottom[i]->offset(n), weight,
-          top_data + top[i]->offset(n));
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
-      }
-    }
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &ConvolutionLayer<Dtype>::forward_cpu_images, this, bottom_data,
+        weight, top_data, num_threads, _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_images(const Dtype* bottom_data,
+      const Dtype* weight, Dtype* top_data, int num_threads, int thread_id) {
+  const int bottom_dim = this->channels_ * this->height_ * this->width_;
+  const int top_dim = this->num_output_ * this->height_out_ * this->width_out_;
+  const int begin = this->num_ * thread_id / num_threads;
+  const int end = this->num_ * (thread_id + 1) / num_threads;
+  for (int n = begin; n < end; ++n) {
+    this->forward_cpu_gemm(bottom_data + n * bottom_dim, weight,
+        top_data + n * top_dim, false, thread_id);
+    this->forward_cpu_bias_activation(top_data + n * top_dim,
+        this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL);
   }
 }
 
@@ -38,30 +53,85 @@ template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int num_threads = this->prepare_cpu_threads();
+  // Every thread but the first accumulates its parameter gradients in a
+  // buffer of its own, summed into the parameter diffs at the end.
+  for (int t = weight_diff_buffers_.size() + 1; t < num_threads; ++t) {
+    weight_diff_buffers_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    bias_diff_buffers_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  const bool weight_propagate_down = this->param_propagate_down_[0];
+  const bool bias_propagate_down =
+      this->bias_term_ && this->param_propagate_down_[1];
+  for (int t = 0; t + 1 < num_threads; ++t) {
+    if (weight_propagate_down) {
+      weight_diff_buffers_[t]->ReshapeLike(*this->blobs_[0]);
+      caffe_set(weight_diff_buffers_[t]->count(), Dtype(0),
+          weight_diff_buffers_[t]->mutable_cpu_diff());
+    }
+    if (bias_propagate_down) {
+      bias_diff_buffers_[t]->ReshapeLike(*this->blobs_[1]);
+      caffe_set(bias_diff_buffers_[t]->count(), Dtype(0),
+          bias_diff_buffers_[t]->mutable_cpu_diff());
+    }
+  }
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
-    // Bias gradient, if necessary.
-    if (this->bias_term_ && this->param_propagate_down_[1]) {
-      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-      for (int n = 0; n < this->num_; ++n) {
-        this->backward_cpu_bias(bias_diff, top_diff + top[i]->offset(n));
-      }
+    Dtype* bottom_diff =
+        propagate_down[i] ? bottom[i]->mutable_cpu_diff() : NULL;
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &ConvolutionLayer<Dtype>::backward_cpu_images, this, top_diff,
+        bottom_data, bottom_diff, weight, num_threads, _1));
+  }
+  for (int t = 0; t + 1 < num_threads; ++t) {
+    if (weight_propagate_down) {
+      caffe_axpy(this->blobs_[0]->count(), Dtype(1.),
+          weight_diff_buffers_[t]->cpu_diff(),
+          this->blobs_[0]->mutable_cpu_diff());
+    }
+    if (bias_propagate_down) {
+      caffe_axpy(this->blobs_[1]->count(), Dtype(1.),
+          bias_diff_buffers_[t]->cpu_diff(),
+          this->blobs_[1]->mutable_cpu_diff());
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + bottom[i]->offset(n),
-              top_diff + top[i]->offset(n), weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + top[i]->offset(n), weight,
-              bottom_diff + bottom[i]->offset(n));
-        }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_images(const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, const Dtype* weight,
+      int num_threads, int thread_id) {
+  const int bottom_dim = this->channels_ * this->height_ * this->width_;
+  const int top_dim = this->num_output_ * this->height_out_ * this->width_out_;
+  const int begin = this->num_ * thread_id / num_threads;
+  const int end = this->num_ * (thread_id + 1) / num_threads;
+  // Bias gradient, if necessary.
+  if (this->bias_term_ && this->param_propagate_down_[1]) {
+    Dtype* bias_diff = (thread_id == 0) ?
+        this->blobs_[1]->mutable_cpu_diff() :
+        bias_diff_buffers_[thread_id - 1]->mutable_cpu_diff();
+    for (int n = begin; n < end; ++n) {
+      this->backward_cpu_bias(bias_diff, top_diff + n * top_dim);
+    }
+  }
+  if (this->param_propagate_down_[0] || bottom_diff) {
+    Dtype* weight_diff = NULL;
+    if (this->param_propagate_down_[0]) {
+      weight_diff = (thread_id == 0) ? this->blobs_[0]->mutable_cpu_diff() :
+          weight_diff_buffers_[thread_id - 1]->mutable_cpu_diff();
+    }
+    for (int n = begin; n < end; ++n) {
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (this->param_propagate_down_[0]) {
+        this->weight_cpu_gemm(bottom_data + n * bottom_dim,
+            top_diff + n * top_dim, weight_diff, thread_id);
+      }
+      // gradient w.r.t. bottom data, if necessary.
+      if (bottom_diff) {
+        this->backward_cpu_gemm(top_diff + n * top_dim, weight,
+            bottom_diff + n * bottom_dim, thread_id);
       }
     }
   }
@@ -8,6 +8,47 @@
 
 namespace caffe {
 
+template <typename Dtype>
+__global__ void FusedReLUForward(const int n, const Dtype negative_slope,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] : data[index] * negative_slope;
+  }
+}
+
+template <typename Dtype>
+__global__ void FusedThresholdForward(const int n, const Dtype threshold,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > threshold ? 1 : 0;
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_gpu_activation(Dtype* top_data,
+    int count) {
+  // The GPU has no bias pass to fold the activation into, so it runs as a
+  // separate kernel, the same as the ReLU or Threshold layer would.
+  switch (this->fused_activation_) {
+  case ConvolutionParameter_Activation_NONE:
+    break;
+  case ConvolutionParameter_Activation_RELU:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    FusedReLUForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, this->negative_slope_, top_data);
+    CUDA_POST_KERNEL_CHECK;
+    break;
+  case ConvolutionParameter_Activation_THRESHOLD:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    FusedThresholdForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, this->threshold_, top_data);
+    CUDA_POST_KERNEL_CHECK;
+    break;
+  default:
+    LOG(FATAL) << "Unknown fused activation.";
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -23,6 +64,7 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + top[i]->offset(n), bias);
       }
     }
+    this->forward_gpu_activation(top_data, top[i]->count());
   }
 }
 
@@ -1,9 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -20,16 +23,37 @@ template <typename Dtype>
 void DeconvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (this->bias_term_) { this->blobs_[1]->cpu_data(); }
+  const int num_threads = this->prepare_cpu_threads();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->backward_cpu_gemm(bottom_data + bottom[i]->offset(n), weight,
-          top_data + top[i]->offset(n));
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + top[i]->offset(n), bias);
-      }
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &DeconvolutionLayer<Dtype>::forward_cpu_images, this, bottom_data,
+        weight, top_data, num_threads, _1));
+  }
+}
+
+template <typename Dtype>
+void DeconvolutionLayer<Dtype>::forward_cpu_images(const Dtype* bottom_data,
+      const Dtype* weight, Dtype* top_data, int num_threads, int thread_id) {
+  const int bottom_dim = this->channels_ * this->height_ * this->width_;
+  const int top_dim = this->num_output_ * this->height_out_ * this->width_out_;
+  const int begin = this->num_ * thread_id / num_threads;
+  const int end = this->num_ * (thread_id + 1) / num_threads;
+  for (int n = begin; n < end; ++n) {
+    if (channelwise()) {
+      deconv_channelwise_cpu(bottom_data + n * bottom_dim, weight,
+          this->channels_, this->height_out_, this->width_out_,
+          this->kernel_h_, this->kernel_w_, this->pad_h_, this->pad_w_,
+          this->stride_h_, this->stride_w_, top_data + n * top_dim);
+    } else {
+      this->backward_cpu_gemm(bottom_data + n * bottom_dim, weight,
+          top_data + n * top_dim, thread_id);
+    }
+    if (this->bias_term_) {
+      this->forward_cpu_bias(top_data + n * top_dim,
+          this->blobs_[1]->cpu_data());
     }
   }
 }
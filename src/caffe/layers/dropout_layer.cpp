@@ -1,15 +1,27 @@
 // TODO (sergeyk): effect should not be dependent on phase. wasted memcpy.
 
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
+namespace {
+
+// The fewest mask words worth a thread of their own.
+const int kWordsPerThread = 512;
+
+}  // namespace
+
 template <typename Dtype>
 void DropoutLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -28,9 +40,18 @@ void DropoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     top[i]->ReshapeLike(*bottom[i]);
   }
-  // Set up the cache for random number generation
+  // Set up the cache for random number generation.  Each mode only allocates
+  // the mask it uses.
   rand_vec_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
+  count_ = bottom[0]->count();
+  mask_bits_.Reshape(1, 1, 1, (count_ + 31) / 32);
+}
+
+template <typename Dtype>
+int DropoutLayer<Dtype>::cpu_threads() const {
+  return std::max(1, std::min(Caffe::num_threads(),
+      mask_bits_.count() / kWordsPerThread));
 }
 
 template <typename Dtype>
@@ -38,19 +59,35 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
-  const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
-    // Create random numbers
-    caffe_rng_bernoulli(count, 1. - threshold_, mask);
-    for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
-    }
+    // Key a new stream of random numbers off the global generator, so that
+    // the masks only depend on the random seed.
+    const unsigned int key0 = caffe_rng_rand();
+    const unsigned int key1 = caffe_rng_rand();
+    unsigned int* mask = mask_bits_.mutable_cpu_data();
+    const int num_threads = cpu_threads();
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &DropoutLayer<Dtype>::forward_cpu_words, this, bottom_data, mask,
+        top_data, key0, key1, num_threads, _1));
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
 }
 
+template <typename Dtype>
+void DropoutLayer<Dtype>::forward_cpu_words(const Dtype* bottom_data,
+    unsigned int* mask, Dtype* top_data, unsigned int key0, unsigned int key1,
+    int num_threads, int thread_id) {
+  const int num_words = mask_bits_.count();
+  const int begin = 32 * (num_words * thread_id / num_threads);
+  const int end =
+      std::min(count_, 32 * (num_words * (thread_id + 1) / num_threads));
+  caffe_cpu_dropout_mask(end - begin, begin, key0, key1, uint_thres_,
+      mask + begin / 32);
+  caffe_cpu_dropout(end - begin, bottom_data + begin, mask + begin / 32,
+      scale_, top_data + begin);
+}
+
 template <typename Dtype>
 void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
@@ -59,17 +96,29 @@ void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     if (this->phase_ == TRAIN) {
-      const unsigned int* mask = rand_vec_.cpu_data();
-      const int count = bottom[0]->count();
-      for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
-      }
+      const unsigned int* mask = mask_bits_.cpu_data();
+      const int num_threads = cpu_threads();
+      Caffe::thread_pool().Run(num_threads, boost::bind(
+          &DropoutLayer<Dtype>::backward_cpu_words, this, top_diff, mask,
+          bottom_diff, num_threads, _1));
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
     }
   }
 }
 
+template <typename Dtype>
+void DropoutLayer<Dtype>::backward_cpu_words(const Dtype* top_diff,
+    const unsigned int* mask, Dtype* bottom_diff, int num_threads,
+    int thread_id) {
+  const int num_words = mask_bits_.count();
+  const int begin = 32 * (num_words * thread_id / num_threads);
+  const int end =
+      std::min(count_, 32 * (num_words * (thread_id + 1) / num_threads));
+  caffe_cpu_dropout(end - begin, top_diff + begin, mask + begin / 32, scale_,
+      bottom_diff + begin);
+}
+
 
 #ifdef CPU_ONLY
 STUB_GPU(DropoutLayer);
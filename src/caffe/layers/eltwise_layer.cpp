@@ -1,8 +1,12 @@
-#include <cfloat>
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -52,52 +56,45 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  int* mask = NULL;
-  const Dtype* bottom_data_a = NULL;
-  const Dtype* bottom_data_b = NULL;
-  const int count = top[0]->count();
+  count_ = top[0]->count();
+  bottom_data_.resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data_[i] = bottom[i]->cpu_data();
+  }
   Dtype* top_data = top[0]->mutable_cpu_data();
+  int* mask = NULL;
+  if (op_ == EltwiseParameter_EltwiseOp_MAX && this->phase_ == TRAIN) {
+    mask = max_idx_.mutable_cpu_data();
+  }
+  // One task per cache line of the output at most (see forward_cpu_chunk).
+  const int num_threads = NumParallelThreads(count_, (count_ + 15) / 16);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &EltwiseLayer<Dtype>::forward_cpu_chunk, this, top_data, mask,
+      num_threads, _1));
+}
+
+template <typename Dtype>
+void EltwiseLayer<Dtype>::forward_cpu_chunk(Dtype* top_data, int* mask,
+    int num_threads, int thread_id) {
+  // Chunks of whole cache lines of the output.
+  const int num_lines = (count_ + 15) / 16;
+  const int begin = num_lines * thread_id / num_threads * 16;
+  const int end = std::min(count_, num_lines * (thread_id + 1) / num_threads
+      * 16);
+  if (begin >= end) { return; }
+  vector<const Dtype*> x(bottom_data_.size());
+  for (int i = 0; i < x.size(); ++i) { x[i] = bottom_data_[i] + begin; }
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
-    }
+    caffe_cpu_eltwise_prod(end - begin, x.size(), &x[0], top_data + begin);
     break;
   case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, Dtype(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
-    }
+    caffe_cpu_eltwise_sum(end - begin, x.size(), &x[0], &coeffs_[0],
+        top_data + begin);
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    mask = max_idx_.mutable_cpu_data();
-    caffe_set(count, -1, mask);
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
-    for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-        mask[idx] = 0;  // maxid
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
-        mask[idx] = 1;  // maxid
-      }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
-          mask[idx] = blob_idx;  // maxid
-        }
-      }
-    }
+    caffe_cpu_eltwise_max(end - begin, x.size(), &x[0], top_data + begin,
+        mask ? mask + begin : NULL);
     break;
   default:
     LOG(FATAL) << "Unknown elementwise operation.";
@@ -111,6 +108,15 @@ void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int count = top[0]->count();
   const Dtype* top_data = top[0]->cpu_data();
   const Dtype* top_diff = top[0]->cpu_diff();
+  if (op_ == EltwiseParameter_EltwiseOp_MAX && this->phase_ == TEST) {
+    // The TEST forward pass skips the indices of the maxima, so find them
+    // again for a backward pass (e.g. with force_backward).
+    vector<const Dtype*> x(bottom.size());
+    for (int i = 0; i < bottom.size(); ++i) { x[i] = bottom[i]->cpu_data(); }
+    vector<Dtype> max(count);
+    caffe_cpu_eltwise_max(count, x.size(), &x[0], &max[0],
+        max_idx_.mutable_cpu_data());
+  }
   for (int i = 0; i < bottom.size(); ++i) {
     if (propagate_down[i]) {
       const Dtype* bottom_data = bottom[i]->cpu_data();
@@ -1,3 +1,6 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -5,6 +8,10 @@
 #include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -14,6 +21,15 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
+  half_weights_ = this->layer_param_.inner_product_param().half_weights();
+  sparse_threshold_ =
+      this->layer_param_.inner_product_param().sparse_threshold();
+  quantize_ = this->phase_ == TEST &&
+      this->layer_param_.has_quantization_param();
+  if (quantize_) {
+    GetInputQuantization(this->layer_param_.quantization_param(),
+        &int8_input_scale_, &int8_zero_point_);
+  }
   N_ = num_output;
   K_ = bottom[0]->count() / bottom[0]->num();
   // Check if we need to set up the weights
@@ -64,7 +80,35 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  if (float_weights_dropped_ && this->phase_ == TEST &&
+      M_ <= kMaxPanelBatch) {
+    forward_cpu_packed(bottom_data, top_data);
+    return;
+  }
+  restore_float_weights();
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (quantize_) {
+    forward_cpu_int8(bottom_data, top_data);
+    return;
+  }
+  if (this->phase_ == TEST &&
+      sparse_weights_.Update(*this->blobs_[0], N_, sparse_threshold_)) {
+    forward_cpu_sparse(bottom_data, top_data);
+    return;
+  }
+  if (this->phase_ == TEST && M_ <= kMaxPanelBatch) {
+    forward_cpu_packed(bottom_data, top_data);
+    return;
+  }
+  if (M_ == 1) {
+    // A single input is a matrix-vector product, with the bias as its start.
+    if (bias_term_) {
+      caffe_copy(N_, this->blobs_[1]->cpu_data(), top_data);
+    }
+    caffe_cpu_gemv<Dtype>(CblasNoTrans, N_, K_, (Dtype)1., weight,
+        bottom_data, (Dtype)(bias_term_ ? 1 : 0), top_data);
+    return;
+  }
   caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
       bottom_data, weight, (Dtype)0., top_data);
   if (bias_term_) {
@@ -74,10 +118,199 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_packed(const Dtype* bottom_data,
+    Dtype* top_data) {
+  const shared_ptr<SyncedMemory>& weight_memory = this->blobs_[0]->data();
+  const int count = caffe_cpu_panels_count(N_, K_);
+  if (packed_memory_ != weight_memory ||
+      packed_version_ != weight_memory->version()) {
+    // Weights written since they were dropped replace those of the panels.
+    float_weights_dropped_ = false;
+    if (half_weights_) {
+      if (!packed_half_weight_ ||
+          packed_half_weight_->size() != count * sizeof(uint16_t)) {
+        packed_half_weight_.reset(
+            new SyncedMemory(count * sizeof(uint16_t)));
+      }
+      caffe_cpu_pack_half_panels(N_, K_, this->blobs_[0]->cpu_data(),
+          static_cast<uint16_t*>(packed_half_weight_->mutable_cpu_data()));
+    } else {
+      packed_weight_.Reshape(1, 1, 1, count);
+      caffe_cpu_pack_panels(N_, K_, this->blobs_[0]->cpu_data(),
+          packed_weight_.mutable_cpu_data());
+    }
+    packed_memory_ = weight_memory;
+    packed_version_ = weight_memory->version();
+    drop_float_weights();
+  }
+  if (bias_term_) { this->blobs_[1]->cpu_data(); }
+  if (half_weights_) {
+    packed_half_weight_->cpu_data();
+  } else {
+    packed_weight_.cpu_data();
+  }
+  const int num_panels = (N_ + kCpuPanelRows - 1) / kCpuPanelRows;
+  const int num_threads = std::min(Caffe::num_threads(), num_panels);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &InnerProductLayer<Dtype>::forward_cpu_panels, this, bottom_data,
+      top_data, num_threads, _1));
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::drop_float_weights() {
+  if (!half_weights_ || this->phase_ != TEST || packed_memory_->is_view()) {
+    return;
+  }
+  // Only blobs_[0] and packed_memory_ may hold the memory.
+  sparse_weights_.Forget();
+  if (packed_memory_.use_count() != 2) { return; }
+  this->blobs_[0]->Reallocate();
+  packed_memory_ = this->blobs_[0]->data();
+  packed_version_ = packed_memory_->version();
+  float_weights_dropped_ = true;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::restore_float_weights() {
+  if (!float_weights_dropped_) { return; }
+  float_weights_dropped_ = false;
+  const shared_ptr<SyncedMemory>& weight_memory = this->blobs_[0]->data();
+  if (packed_memory_ != weight_memory ||
+      packed_version_ != weight_memory->version()) {
+    return;
+  }
+  caffe_cpu_unpack_half_panels(N_, K_,
+      static_cast<const uint16_t*>(packed_half_weight_->cpu_data()),
+      this->blobs_[0]->mutable_cpu_data());
+  packed_version_ = weight_memory->version();
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ToProto(LayerParameter* param,
+    bool write_diff) {
+  const bool dropped = float_weights_dropped_;
+  restore_float_weights();
+  Layer<Dtype>::ToProto(param, write_diff);
+  if (dropped) { drop_float_weights(); }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_panels(const Dtype* bottom_data,
+    Dtype* top_data, int num_threads, int thread_id) {
+  const int num_panels = (N_ + kCpuPanelRows - 1) / kCpuPanelRows;
+  const int begin = num_panels * thread_id / num_threads * kCpuPanelRows;
+  const int end = std::min(N_,
+      num_panels * (thread_id + 1) / num_threads * kCpuPanelRows);
+  if (begin >= end) { return; }
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() + begin : NULL;
+  if (half_weights_) {
+    caffe_cpu_half_panel_inner_product(M_, end - begin, K_,
+        static_cast<const uint16_t*>(packed_half_weight_->cpu_data()) +
+        begin * K_, bottom_data, bias, top_data + begin, N_);
+  } else {
+    caffe_cpu_panel_inner_product(M_, end - begin, K_,
+        packed_weight_.cpu_data() + begin * K_, bottom_data, bias,
+        top_data + begin, N_);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_int8(const Dtype* bottom_data,
+    Dtype* top_data) {
+  int8_weights_.Update(*this->blobs_[0], N_);
+  // The buffer holds the quantized inputs, row by row, and then their int32
+  // outputs.
+  const int padded_k = int8_weights_.padded_cols();
+  const size_t size = M_ * padded_k + sizeof(int32_t) * M_ * N_;
+  if (!int8_buffer_ || int8_buffer_->size() < size) {
+    int8_buffer_.reset(new SyncedMemory(size));
+  }
+  uint8_t* inputs = static_cast<uint8_t*>(int8_buffer_->mutable_cpu_data());
+  int32_t* sums = reinterpret_cast<int32_t*>(inputs + M_ * padded_k);
+  for (int i = 0; i < M_; ++i) {
+    uint8_t* row = inputs + i * padded_k;
+    caffe_cpu_quantize_inputs(K_, bottom_data + i * K_, int8_input_scale_,
+        int8_zero_point_, row);
+    caffe_memset(padded_k - K_, 0, row + K_);
+  }
+  if (bias_term_) { this->blobs_[1]->cpu_data(); }
+  const int num_threads = std::min(Caffe::num_threads(), (N_ + 3) / 4);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &InnerProductLayer<Dtype>::forward_cpu_int8_outputs, this, inputs, sums,
+      top_data, num_threads, _1));
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_int8_outputs(
+    const uint8_t* inputs, int32_t* sums, Dtype* top_data, int num_threads,
+    int thread_id) {
+  // Whole blocks of outputs of the int8 GEMM.
+  const int num_blocks = (N_ + 3) / 4;
+  const int begin = num_blocks * thread_id / num_threads * 4;
+  const int end = std::min(N_, num_blocks * (thread_id + 1) / num_threads * 4);
+  if (begin >= end) { return; }
+  const int padded_k = int8_weights_.padded_cols();
+  caffe_cpu_int8_gemm(M_, end - begin, padded_k, inputs,
+      int8_weights_.data() + begin * padded_k, sums + begin, N_);
+  caffe_cpu_dequantize(M_, end - begin, sums + begin, N_, int8_zero_point_,
+      int8_input_scale_, int8_weights_.sums() + begin,
+      int8_weights_.scales() + begin,
+      bias_term_ ? this->blobs_[1]->cpu_data() + begin : NULL,
+      top_data + begin, N_, 1);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_sparse(const Dtype* bottom_data,
+    Dtype* top_data) {
+  // A single input is its own transpose, and its outputs go straight to top.
+  const Dtype* inputs = bottom_data;
+  Dtype* outputs = top_data;
+  if (M_ > 1) {
+    sparse_buffer_.Reshape(1, 1, K_ + N_, M_);
+    Dtype* buffer = sparse_buffer_.mutable_cpu_data();
+    for (int i = 0; i < M_; ++i) {
+      for (int k = 0; k < K_; ++k) {
+        buffer[k * M_ + i] = bottom_data[i * K_ + k];
+      }
+    }
+    inputs = buffer;
+    outputs = buffer + K_ * M_;
+  }
+  sparse_weights_.row_ptr();
+  sparse_weights_.col_idx();
+  sparse_weights_.values();
+  if (bias_term_) { this->blobs_[1]->cpu_data(); }
+  const int num_threads = std::min(Caffe::num_threads(), N_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &InnerProductLayer<Dtype>::forward_cpu_sparse_outputs, this, inputs,
+      outputs, top_data, num_threads, _1));
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_sparse_outputs(
+    const Dtype* inputs, Dtype* outputs, Dtype* top_data, int num_threads,
+    int thread_id) {
+  const int begin = N_ * thread_id / num_threads;
+  const int end = N_ * (thread_id + 1) / num_threads;
+  if (begin >= end) { return; }
+  caffe_cpu_csrmm(end - begin, M_, sparse_weights_.row_ptr() + begin,
+      sparse_weights_.col_idx(), sparse_weights_.values(), inputs, M_,
+      outputs + begin * M_, M_);
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int j = begin; j < end; ++j) {
+    const Dtype b = bias ? bias[j] : Dtype(0);
+    for (int i = 0; i < M_; ++i) {
+      top_data[i * N_ + j] = outputs[j * M_ + i] + b;
+    }
+  }
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  restore_float_weights();
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
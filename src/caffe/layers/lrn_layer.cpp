@@ -1,7 +1,12 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -15,55 +20,58 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   alpha_ = this->layer_param_.lrn_param().alpha();
   beta_ = this->layer_param_.lrn_param().beta();
   k_ = this->layer_param_.lrn_param().k();
-  if (this->layer_param_.lrn_param().norm_region() ==
-      LRNParameter_NormRegion_WITHIN_CHANNEL) {
-    // Set up split_layer_ to use inputs in the numerator and denominator.
-    split_top_vec_.clear();
-    split_top_vec_.push_back(&product_input_);
-    split_top_vec_.push_back(&square_input_);
-    LayerParameter split_param;
-    split_layer_.reset(new SplitLayer<Dtype>(split_param));
-    split_layer_->SetUp(bottom, split_top_vec_);
-    // Set up square_layer_ to square the inputs.
-    square_bottom_vec_.clear();
-    square_top_vec_.clear();
-    square_bottom_vec_.push_back(&square_input_);
-    square_top_vec_.push_back(&square_output_);
-    LayerParameter square_param;
-    square_param.mutable_power_param()->set_power(Dtype(2));
-    square_layer_.reset(new PowerLayer<Dtype>(square_param));
-    square_layer_->SetUp(square_bottom_vec_, square_top_vec_);
-    // Set up pool_layer_ to sum over square neighborhoods of the input.
-    pool_top_vec_.clear();
-    pool_top_vec_.push_back(&pool_output_);
-    LayerParameter pool_param;
-    pool_param.mutable_pooling_param()->set_pool(
-        PoolingParameter_PoolMethod_AVE);
-    pool_param.mutable_pooling_param()->set_pad(pre_pad_);
-    pool_param.mutable_pooling_param()->set_kernel_size(size_);
-    pool_layer_.reset(new PoolingLayer<Dtype>(pool_param));
-    pool_layer_->SetUp(square_top_vec_, pool_top_vec_);
-    // Set up power_layer_ to compute (1 + alpha_/N^2 s)^-beta_, where s is
-    // the sum of a squared neighborhood (the output of pool_layer_).
-    power_top_vec_.clear();
-    power_top_vec_.push_back(&power_output_);
-    LayerParameter power_param;
-    power_param.mutable_power_param()->set_power(-beta_);
-    power_param.mutable_power_param()->set_scale(alpha_);
-    power_param.mutable_power_param()->set_shift(Dtype(1));
-    power_layer_.reset(new PowerLayer<Dtype>(power_param));
-    power_layer_->SetUp(pool_top_vec_, power_top_vec_);
-    // Set up a product_layer_ to compute outputs by multiplying inputs by the
-    // inverse demoninator computed by the power layer.
-    product_bottom_vec_.clear();
-    product_bottom_vec_.push_back(&product_input_);
-    product_bottom_vec_.push_back(&power_output_);
-    LayerParameter product_param;
-    EltwiseParameter* eltwise_param = product_param.mutable_eltwise_param();
-    eltwise_param->set_operation(EltwiseParameter_EltwiseOp_PROD);
-    product_layer_.reset(new EltwiseLayer<Dtype>(product_param));
-    product_layer_->SetUp(product_bottom_vec_, top);
-  }
+  scale_valid_ = false;
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::SetUpWithinChannelLayers(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Set up split_layer_ to use inputs in the numerator and denominator.
+  split_top_vec_.clear();
+  split_top_vec_.push_back(&product_input_);
+  split_top_vec_.push_back(&square_input_);
+  LayerParameter split_param;
+  split_layer_.reset(new SplitLayer<Dtype>(split_param));
+  split_layer_->SetUp(bottom, split_top_vec_);
+  // Set up square_layer_ to square the inputs.
+  square_bottom_vec_.clear();
+  square_top_vec_.clear();
+  square_bottom_vec_.push_back(&square_input_);
+  square_top_vec_.push_back(&square_output_);
+  LayerParameter square_param;
+  square_param.mutable_power_param()->set_power(Dtype(2));
+  square_layer_.reset(new PowerLayer<Dtype>(square_param));
+  square_layer_->SetUp(square_bottom_vec_, square_top_vec_);
+  // Set up pool_layer_ to sum over square neighborhoods of the input.
+  pool_top_vec_.clear();
+  pool_top_vec_.push_back(&pool_output_);
+  LayerParameter pool_param;
+  pool_param.mutable_pooling_param()->set_pool(
+      PoolingParameter_PoolMethod_AVE);
+  pool_param.mutable_pooling_param()->set_pad(pre_pad_);
+  pool_param.mutable_pooling_param()->set_kernel_size(size_);
+  pool_layer_.reset(new PoolingLayer<Dtype>(pool_param));
+  pool_layer_->SetUp(square_top_vec_, pool_top_vec_);
+  // Set up power_layer_ to compute (1 + alpha_/N^2 s)^-beta_, where s is
+  // the sum of a squared neighborhood (the output of pool_layer_).
+  power_top_vec_.clear();
+  power_top_vec_.push_back(&power_output_);
+  LayerParameter power_param;
+  power_param.mutable_power_param()->set_power(-beta_);
+  power_param.mutable_power_param()->set_scale(alpha_);
+  power_param.mutable_power_param()->set_shift(Dtype(1));
+  power_layer_.reset(new PowerLayer<Dtype>(power_param));
+  power_layer_->SetUp(pool_top_vec_, power_top_vec_);
+  // Set up a product_layer_ to compute outputs by multiplying inputs by the
+  // inverse demoninator computed by the power layer.
+  product_bottom_vec_.clear();
+  product_bottom_vec_.push_back(&product_input_);
+  product_bottom_vec_.push_back(&power_output_);
+  LayerParameter product_param;
+  EltwiseParameter* eltwise_param = product_param.mutable_eltwise_param();
+  eltwise_param->set_operation(EltwiseParameter_EltwiseOp_PROD);
+  product_layer_.reset(new EltwiseLayer<Dtype>(product_param));
+  product_layer_->SetUp(product_bottom_vec_, top);
 }
 
 template <typename Dtype>
@@ -73,18 +81,16 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   channels_ = bottom[0]->channels();
   height_ = bottom[0]->height();
   width_ = bottom[0]->width();
-  switch (this->layer_param_.lrn_param().norm_region()) {
-  case LRNParameter_NormRegion_ACROSS_CHANNELS:
-    top[0]->Reshape(num_, channels_, height_, width_);
-    scale_.Reshape(num_, channels_, height_, width_);
-    break;
-  case LRNParameter_NormRegion_WITHIN_CHANNEL:
+  top[0]->Reshape(num_, channels_, height_, width_);
+  // Only allocated once written, which the TEST phase on the CPU never does.
+  scale_.Reshape(num_, channels_, height_, width_);
+  scale_valid_ = false;
+  if (split_layer_) {
     split_layer_->Reshape(bottom, split_top_vec_);
     square_layer_->Reshape(square_bottom_vec_, square_top_vec_);
     pool_layer_->Reshape(square_top_vec_, pool_top_vec_);
     power_layer_->Reshape(pool_top_vec_, power_top_vec_);
     product_layer_->Reshape(product_bottom_vec_, top);
-    break;
   }
 }
 
@@ -96,63 +102,206 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
   }
 }
 
+namespace {
+
+// y = x * scale^-beta, taking the common betas of 0.75 and 0.5 through
+// square roots rather than pow.
+template <typename Dtype>
+void lrn_scale_output(const int n, const Dtype* x, const Dtype* scale,
+    const Dtype beta, Dtype* y) {
+  if (beta == Dtype(0.75)) {
+    for (int i = 0; i < n; ++i) {
+      const Dtype root = std::sqrt(scale[i]);
+      y[i] = x[i] / (root * std::sqrt(root));
+    }
+  } else if (beta == Dtype(0.5)) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] / std::sqrt(scale[i]);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] * std::pow(scale[i], -beta);
+    }
+  }
+}
+
+// y += x^2
+template <typename Dtype>
+inline void lrn_add_square(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += x[i] * x[i];
+  }
+}
+
+// y -= x^2
+template <typename Dtype>
+inline void lrn_sub_square(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] -= x[i] * x[i];
+  }
+}
+
+// y += sign * a * b / c
+template <typename Dtype>
+inline void lrn_add_ratio(const int n, const Dtype sign, const Dtype* a,
+    const Dtype* b, const Dtype* c, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] += sign * a[i] * b[i] / c[i];
+  }
+}
+
+// Sums x over the size x size windows centered on each pixel of a height x
+// width plane, padded with zeros, a row and then a column at a time.
+template <typename Dtype>
+void lrn_box_sum(const int height, const int width, const int size,
+    const Dtype* x, Dtype* row_sum, Dtype* y) {
+  const int pre_pad = (size - 1) / 2;
+  caffe_set(height * width, Dtype(0), row_sum);
+  for (int h = 0; h < height; ++h) {
+    const Dtype* x_row = x + h * width;
+    Dtype* sum_row = row_sum + h * width;
+    for (int offset = -pre_pad; offset <= pre_pad; ++offset) {
+      const int w_begin = std::max(0, -offset);
+      const int w_end = std::min(width, width - offset);
+      for (int w = w_begin; w < w_end; ++w) {
+        sum_row[w] += x_row[w + offset];
+      }
+    }
+  }
+  caffe_set(height * width, Dtype(0), y);
+  for (int h = 0; h < height; ++h) {
+    const int h_begin = std::max(0, h - pre_pad);
+    const int h_end = std::min(height, h + pre_pad + 1);
+    Dtype* y_row = y + h * width;
+    for (int i = h_begin; i < h_end; ++i) {
+      const Dtype* sum_row = row_sum + i * width;
+      for (int w = 0; w < width; ++w) {
+        y_row[w] += sum_row[w];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+int LRNLayer<Dtype>::cpu_pixel_blocks(int num_threads) const {
+  // Split the pixels of each image into blocks when there are fewer images
+  // than threads.
+  return std::min(height_ * width_, (num_threads + num_ - 1) / num_);
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  // Backward recomputes the scale if need be, which the TEST phase skips.
+  Dtype* scale_data =
+      this->phase_ == TEST ? NULL : scale_.mutable_cpu_data();
+  const int num_threads =
+      std::min(Caffe::num_threads(), num_ * height_ * width_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &LRNLayer<Dtype>::cross_channel_forward_cpu, this, bottom_data,
+      top_data, scale_data, num_threads, _1));
+  scale_valid_ = (scale_data != NULL);
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::cross_channel_forward_cpu(const Dtype* bottom_data,
+      Dtype* top_data, Dtype* scale_data, int num_threads, int thread_id) {
+  const int dim = height_ * width_;
+  const int num_blocks = cpu_pixel_blocks(num_threads);
+  const int num_units = num_ * num_blocks;
+  const int begin = num_units * thread_id / num_threads;
+  const int end = num_units * (thread_id + 1) / num_threads;
+  const Dtype alpha_over_size = alpha_ / size_;
+  vector<Dtype> square_sum(dim);
+  vector<Dtype> scale(scale_data ? 0 : dim);
+  for (int unit = begin; unit < end; ++unit) {
+    const int n = unit / num_blocks;
+    const int pixel_begin = dim * (unit % num_blocks) / num_blocks;
+    const int pixels = dim * (unit % num_blocks + 1) / num_blocks -
+        pixel_begin;
+    const int offset = n * channels_ * dim + pixel_begin;
+    const Dtype* x = bottom_data + offset;
+    // Slide the window of squares over the channels of the pixels.
+    caffe_set(pixels, Dtype(0), &square_sum[0]);
+    for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+      lrn_add_square(pixels, x + c * dim, &square_sum[0]);
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    for (int c = 0; c < channels_; ++c) {
+      if (c + pre_pad_ < channels_) {
+        lrn_add_square(pixels, x + (c + pre_pad_) * dim, &square_sum[0]);
+      }
+      if (c - pre_pad_ > 0) {
+        lrn_sub_square(pixels, x + (c - pre_pad_ - 1) * dim, &square_sum[0]);
+      }
+      Dtype* scale_c =
+          scale_data ? scale_data + offset + c * dim : &scale[0];
+      for (int i = 0; i < pixels; ++i) {
+        scale_c[i] = k_ + alpha_over_size * square_sum[i];
+      }
+      if (top_data) {
+        lrn_scale_output(pixels, x + c * dim, scale_c, beta_,
+            top_data + offset + c * dim);
+      }
     }
   }
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype* scale_data =
+      this->phase_ == TEST ? NULL : scale_.mutable_cpu_data();
+  const int num_threads = std::min(Caffe::num_threads(), num_ * channels_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &LRNLayer<Dtype>::within_channel_forward_cpu, this, bottom_data,
+      top_data, scale_data, num_threads, _1));
+  scale_valid_ = (scale_data != NULL);
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::within_channel_forward_cpu(const Dtype* bottom_data,
+      Dtype* top_data, Dtype* scale_data, int num_threads, int thread_id) {
+  const int dim = height_ * width_;
+  const int num_planes = num_ * channels_;
+  const int begin = num_planes * thread_id / num_threads;
+  const int end = num_planes * (thread_id + 1) / num_threads;
+  const Dtype alpha_over_area = alpha_ / (size_ * size_);
+  vector<Dtype> square(dim);
+  vector<Dtype> row_sum(dim);
+  vector<Dtype> scale(scale_data ? 0 : dim);
+  for (int p = begin; p < end; ++p) {
+    const Dtype* x = bottom_data + p * dim;
+    Dtype* scale_p = scale_data ? scale_data + p * dim : &scale[0];
+    caffe_sqr(dim, x, &square[0]);
+    lrn_box_sum(height_, width_, size_, &square[0], &row_sum[0], scale_p);
+    for (int i = 0; i < dim; ++i) {
+      scale_p[i] = 1 + alpha_over_area * scale_p[i];
+    }
+    if (top_data) {
+      lrn_scale_output(dim, x, scale_p, beta_, top_data + p * dim);
+    }
+  }
 }
 
 template <typename Dtype>
 void LRNLayer<Dtype>::WithinChannelForward(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!split_layer_) {
+    SetUpWithinChannelLayers(bottom, top);
+  }
   split_layer_->Forward(bottom, split_top_vec_);
   square_layer_->Forward(square_bottom_vec_, square_top_vec_);
   pool_layer_->Forward(square_top_vec_, pool_top_vec_);
@@ -163,12 +312,35 @@ void LRNLayer<Dtype>::WithinChannelForward(
 template <typename Dtype>
 void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const bool across_channels = this->layer_param_.lrn_param().norm_region()
+      == LRNParameter_NormRegion_ACROSS_CHANNELS;
+  const int num_threads = across_channels ?
+      std::min(Caffe::num_threads(), num_ * height_ * width_) :
+      std::min(Caffe::num_threads(), num_ * channels_);
+  if (!scale_valid_) {
+    // The forward pass skipped the scale.
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    Dtype* scale_data = scale_.mutable_cpu_data();
+    if (across_channels) {
+      Caffe::thread_pool().Run(num_threads, boost::bind(
+          &LRNLayer<Dtype>::cross_channel_forward_cpu, this, bottom_data,
+          static_cast<Dtype*>(NULL), scale_data, num_threads, _1));
+    } else {
+      Caffe::thread_pool().Run(num_threads, boost::bind(
+          &LRNLayer<Dtype>::within_channel_forward_cpu, this, bottom_data,
+          static_cast<Dtype*>(NULL), scale_data, num_threads, _1));
+    }
+    scale_valid_ = true;
+  }
   switch (this->layer_param_.lrn_param().norm_region()) {
   case LRNParameter_NormRegion_ACROSS_CHANNELS:
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -179,53 +351,96 @@ template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelBackward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* scale_data = scale_.cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  const int num_threads =
+      std::min(Caffe::num_threads(), num_ * height_ * width_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &LRNLayer<Dtype>::cross_channel_backward_cpu, this, top[0]->cpu_diff(),
+      top[0]->cpu_data(), bottom[0]->cpu_data(), scale_.cpu_data(),
+      bottom[0]->mutable_cpu_diff(), num_threads, _1));
+}
 
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::cross_channel_backward_cpu(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data, const Dtype* scale_data,
+      Dtype* bottom_diff, int num_threads, int thread_id) {
+  const int dim = height_ * width_;
+  const int num_blocks = cpu_pixel_blocks(num_threads);
+  const int num_units = num_ * num_blocks;
+  const int begin = num_units * thread_id / num_threads;
+  const int end = num_units * (thread_id + 1) / num_threads;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  vector<Dtype> accum_ratio(dim);
+  for (int unit = begin; unit < end; ++unit) {
+    const int n = unit / num_blocks;
+    const int pixel_begin = dim * (unit % num_blocks) / num_blocks;
+    const int pixels = dim * (unit % num_blocks + 1) / num_blocks -
+        pixel_begin;
+    const int offset = n * channels_ * dim + pixel_begin;
+    const Dtype* dy = top_diff + offset;
+    const Dtype* y = top_data + offset;
+    const Dtype* scale = scale_data + offset;
+    // Slide the window of diff_i * y_i / scale_i over the channels.
+    caffe_set(pixels, Dtype(0), &accum_ratio[0]);
+    for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+      lrn_add_ratio(pixels, Dtype(1), dy + c * dim, y + c * dim,
+          scale + c * dim, &accum_ratio[0]);
     }
     for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
+      const int head = (c + pre_pad_) * dim;
+      const int tail = (c - pre_pad_ - 1) * dim;
+      if (c + pre_pad_ < channels_) {
+        lrn_add_ratio(pixels, Dtype(1), dy + head, y + head, scale + head,
+            &accum_ratio[0]);
+      }
+      if (c - pre_pad_ > 0) {
+        lrn_add_ratio(pixels, Dtype(-1), dy + tail, y + tail, scale + tail,
+            &accum_ratio[0]);
+      }
+      Dtype* dx = bottom_diff + offset + c * dim;
+      const Dtype* x = bottom_data + offset + c * dim;
+      lrn_scale_output(pixels, dy + c * dim, scale + c * dim, beta_, dx);
+      for (int i = 0; i < pixels; ++i) {
+        dx[i] -= cache_ratio_value * x[i] * accum_ratio[i];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  const int num_threads = std::min(Caffe::num_threads(), num_ * channels_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &LRNLayer<Dtype>::within_channel_backward_cpu, this, top[0]->cpu_diff(),
+      top[0]->cpu_data(), bottom[0]->cpu_data(), scale_.cpu_data(),
+      bottom[0]->mutable_cpu_diff(), num_threads, _1));
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::within_channel_backward_cpu(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data, const Dtype* scale_data,
+      Dtype* bottom_diff, int num_threads, int thread_id) {
+  const int dim = height_ * width_;
+  const int num_planes = num_ * channels_;
+  const int begin = num_planes * thread_id / num_threads;
+  const int end = num_planes * (thread_id + 1) / num_threads;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / (size_ * size_);
+  vector<Dtype> ratio(dim);
+  vector<Dtype> row_sum(dim);
+  vector<Dtype> accum_ratio(dim);
+  for (int p = begin; p < end; ++p) {
+    const int offset = p * dim;
+    caffe_set(dim, Dtype(0), &ratio[0]);
+    lrn_add_ratio(dim, Dtype(1), top_diff + offset, top_data + offset,
+        scale_data + offset, &ratio[0]);
+    lrn_box_sum(height_, width_, size_, &ratio[0], &row_sum[0],
+        &accum_ratio[0]);
+    Dtype* dx = bottom_diff + offset;
+    const Dtype* x = bottom_data + offset;
+    lrn_scale_output(dim, top_diff + offset, scale_data + offset, beta_, dx);
+    for (int i = 0; i < dim; ++i) {
+      dx[i] -= cache_ratio_value * x[i] * accum_ratio[i];
     }
   }
 }
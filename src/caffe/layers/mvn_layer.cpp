@@ -1,9 +1,14 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/common_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -16,6 +21,13 @@ void MVNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       1, 1);
   variance_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       1, 1);
+  if (this->layer_param_.mvn_param().across_channels()) {
+    num_rows_ = bottom[0]->num();
+  } else {
+    num_rows_ = bottom[0]->num() * bottom[0]->channels();
+  }
+  row_dim_ = bottom[0]->count() / num_rows_;
+  // Shaped for the GPU, but only allocated if it runs.
   temp_.Reshape(bottom[0]->num(), bottom[0]->channels(),
       bottom[0]->height(), bottom[0]->width());
   sum_multiplier_.Reshape(1, 1,
@@ -29,60 +41,33 @@ void MVNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int num;
-  if (this->layer_param_.mvn_param().across_channels())
-    num = bottom[0]->num();
-  else
-    num = bottom[0]->num() * bottom[0]->channels();
-
-  int dim = bottom[0]->count() / num;
-  Dtype eps = 1e-10;
-
-  if (this->layer_param_.mvn_param().normalize_variance()) {
-    // put the squares of bottom into temp_
-    caffe_powx(bottom[0]->count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
-
-    // computes variance using var(X) = E(X^2) - (EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-        sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.cpu_data(),
-        sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E(X^2)
-    caffe_powx(mean_.count(), mean_.cpu_data(), Dtype(2),
-        temp_.mutable_cpu_data());  // (EX)^2
-    caffe_sub(mean_.count(), variance_.cpu_data(), temp_.cpu_data(),
-        variance_.mutable_cpu_data());  // variance
-
-    // do mean and variance normalization
-    // subtract mean
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
-
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
-
-    // normalize variance
-    caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-          variance_.mutable_cpu_data());
-
-    caffe_add_scalar(variance_.count(), eps, variance_.mutable_cpu_data());
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-          variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  } else {
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-            sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-
-    // subtract mean
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, -1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-            temp_.mutable_cpu_data());
+  const int num_threads = NumParallelThreads(bottom[0]->count(), num_rows_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &MVNLayer<Dtype>::forward_cpu_rows, this, bottom_data, top_data,
+      mean_.mutable_cpu_data(), variance_.mutable_cpu_data(), num_threads,
+      _1));
+}
 
-    caffe_add(temp_.count(), bottom_data, temp_.cpu_data(), top_data);
+template <typename Dtype>
+void MVNLayer<Dtype>::forward_cpu_rows(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* mean, Dtype* variance, int num_threads,
+    int thread_id) {
+  const bool normalize_variance =
+      this->layer_param_.mvn_param().normalize_variance();
+  const Dtype eps = 1e-10;
+  const int begin = num_rows_ * thread_id / num_threads;
+  const int end = num_rows_ * (thread_id + 1) / num_threads;
+  for (int row = begin; row < end; ++row) {
+    const Dtype* x = bottom_data + row * row_dim_;
+    Dtype row_variance;
+    caffe_cpu_mean_variance(row_dim_, x, mean + row, &row_variance);
+    Dtype scale = 1;
+    if (normalize_variance) {
+      variance[row] = std::sqrt(row_variance) + eps;
+      scale = 1 / variance[row];
+    }
+    caffe_cpu_normalize(row_dim_, x, mean[row], scale,
+        top_data + row * row_dim_);
   }
 }
 
@@ -91,65 +76,28 @@ void MVNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (!this->layer_param_.mvn_param().normalize_variance()) {
+    caffe_copy(bottom[0]->count(), top_diff, bottom_diff);
+    return;
+  }
+  const Dtype* top_data = top[0]->cpu_data();
+  const int num_threads = NumParallelThreads(bottom[0]->count(), num_rows_);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &MVNLayer<Dtype>::backward_cpu_rows, this, top_data, top_diff,
+      variance_.cpu_data(), bottom_diff, num_threads, _1));
+}
 
-  int num;
-  if (this->layer_param_.mvn_param().across_channels())
-    num = bottom[0]->num();
-  else
-    num = bottom[0]->num() * bottom[0]->channels();
-
-  int dim = bottom[0]->count() / num;
-  Dtype eps = 1e-10;
-
-  if (this->layer_param_.mvn_param().normalize_variance()) {
-    caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., bottom_diff,
-          sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-          mean_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-          bottom_diff);
-    caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1., top_diff,
-            sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-            mean_.cpu_data(), sum_multiplier_.cpu_data(), 1.,
-            bottom_diff);
-
-    caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff, Dtype(-1. / dim),
-        bottom_diff);
-
-    // put the squares of bottom into temp_
-    caffe_powx(temp_.count(), bottom_data, Dtype(2),
-        temp_.mutable_cpu_data());
-
-    // computes variance using var(X) = E(X^2) - (EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, bottom_data,
-        sum_multiplier_.cpu_data(), 0., mean_.mutable_cpu_data());  // EX
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, num, dim, 1. / dim, temp_.cpu_data(),
-        sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E(X^2)
-    caffe_powx(mean_.count(), mean_.cpu_data(), Dtype(2),
-        temp_.mutable_cpu_data());  // (EX)^2
-    caffe_sub(mean_.count(), variance_.cpu_data(), temp_.cpu_data(),
-        variance_.mutable_cpu_data());  // variance
-
-    // normalize variance
-    caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-          variance_.mutable_cpu_data());
-
-    caffe_add_scalar(variance_.count(), eps, variance_.mutable_cpu_data());
-
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, dim, 1, 1.,
-        variance_.cpu_data(), sum_multiplier_.cpu_data(), 0.,
-        temp_.mutable_cpu_data());
-
-    caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
-  } else {
-    caffe_copy(temp_.count(), top_diff, bottom_diff);
+template <typename Dtype>
+void MVNLayer<Dtype>::backward_cpu_rows(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* variance, Dtype* bottom_diff,
+    int num_threads, int thread_id) {
+  const int begin = num_rows_ * thread_id / num_threads;
+  const int end = num_rows_ * (thread_id + 1) / num_threads;
+  for (int row = begin; row < end; ++row) {
+    caffe_cpu_normalize_backward(row_dim_, top_data + row * row_dim_,
+        top_diff + row * row_dim_, 1 / variance[row],
+        bottom_diff + row * row_dim_);
   }
 }
 
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
@@ -6,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -109,6 +112,21 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
+  // The 2x2 and 3x3 stride 2 kernels cover the outputs whose windows lie
+  // inside the image; the generic loops take the padded and clipped border.
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  fast_kernel_ = !global_pooling_ && kernel_h_ == kernel_w_ &&
+      (kernel_h_ == 2 || kernel_h_ == 3) && stride_h_ == 2 &&
+      stride_w_ == 2 && (pool == PoolingParameter_PoolMethod_MAX ||
+      pool == PoolingParameter_PoolMethod_AVE);
+  ph_begin_ = (pad_h_ + 1) / 2;
+  pw_begin_ = (pad_w_ + 1) / 2;
+  ph_end_ = height_ + pad_h_ < kernel_h_ ? ph_begin_ :
+      min(pooled_height_, (height_ + pad_h_ - kernel_h_) / 2 + 1);
+  pw_end_ = width_ + pad_w_ < kernel_w_ ? pw_begin_ :
+      min(pooled_width_, (width_ + pad_w_ - kernel_w_) / 2 + 1);
+  max_idx_valid_ = false;
   // If max pooling, we will initialize the vector index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
@@ -123,107 +141,260 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+namespace {
+
+// Pools the outputs [ph_begin, ph_end) x [pw_begin, pw_end) of a plane, whose
+// KxK stride 2 windows lie inside the image, separably: each output row first
+// reduces its K input rows element-wise into row, then the K columns of each
+// window of row.  Both passes run over contiguous memory and vectorize.
+template <typename Dtype, int K, bool kMax>
+void pool_interior_s2(const Dtype* bottom_data, int width, int pad_h,
+    int pad_w, int ph_begin, int ph_end, int pw_begin, int pw_end,
+    int pooled_width, Dtype* top_data, Dtype* row) {
+  if (ph_begin >= ph_end || pw_begin >= pw_end) { return; }
+  const int wstart = pw_begin * 2 - pad_w;
+  const int span = (pw_end - pw_begin - 1) * 2 + K;
+  const int num_outputs = pw_end - pw_begin;
+  for (int ph = ph_begin; ph < ph_end; ++ph) {
+    const Dtype* in = bottom_data + (ph * 2 - pad_h) * width + wstart;
+    for (int w = 0; w < span; ++w) {
+      row[w] = in[w];
+    }
+    for (int k = 1; k < K; ++k) {
+      const Dtype* in_k = in + k * width;
+      for (int w = 0; w < span; ++w) {
+        row[w] = kMax ? max(row[w], in_k[w]) : row[w] + in_k[w];
+      }
+    }
+    Dtype* out = top_data + ph * pooled_width + pw_begin;
+    for (int i = 0; i < num_outputs; ++i) {
+      Dtype value = row[2 * i];
+      for (int k = 1; k < K; ++k) {
+        value = kMax ? max(value, row[2 * i + k]) : value + row[2 * i + k];
+      }
+      out[i] = kMax ? value : value / (K * K);
+    }
+  }
+}
+
+template <typename Dtype, bool kMax>
+void pool_interior_s2(int kernel, const Dtype* bottom_data, int width,
+    int pad_h, int pad_w, int ph_begin, int ph_end, int pw_begin, int pw_end,
+    int pooled_width, Dtype* top_data, Dtype* row) {
+  if (kernel == 2) {
+    pool_interior_s2<Dtype, 2, kMax>(bottom_data, width, pad_h, pad_w,
+        ph_begin, ph_end, pw_begin, pw_end, pooled_width, top_data, row);
+  } else {
+    pool_interior_s2<Dtype, 3, kMax>(bottom_data, width, pad_h, pad_w,
+        ph_begin, ph_end, pw_begin, pw_end, pooled_width, top_data, row);
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
-  // We'll output the mask to top[1] if it's of size >1.
-  const bool use_top_mask = top.size() > 1;
-  int* mask = NULL;  // suppress warnings about uninitalized variables
+  const int num_planes = bottom[0]->num() * channels_;
+  const int num_threads = min(Caffe::num_threads(), num_planes);
+  int* mask = NULL;
   Dtype* top_mask = NULL;
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
-    if (use_top_mask) {
+    // We'll output the mask to top[1] if it's of size >1.  Otherwise only
+    // training needs it; Backward computes it after the fact if need be.
+    if (top.size() > 1) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
-    } else {
+    } else if (this->phase_ != TEST) {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
+    max_idx_valid_ = (mask != NULL);
+    // Fall through.
+  case PoolingParameter_PoolMethod_AVE:
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &PoolingLayer<Dtype>::forward_cpu_planes, this, bottom_data,
+        top_data, mask, top_mask, num_planes, num_threads, _1));
+    break;
+  case PoolingParameter_PoolMethod_STOCHASTIC:
+    if (this->phase_ == TRAIN) {
+      // The uniform numbers that pick the samples, which replace them by
+      // their indices.
+      top_mask = rand_idx_.mutable_cpu_data();
+      caffe_rng_uniform(rand_idx_.count(), Dtype(0), Dtype(1), top_mask);
+    }
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &PoolingLayer<Dtype>::forward_cpu_planes, this, bottom_data,
+        top_data, mask, top_mask, num_planes, num_threads, _1));
+    break;
+  default:
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_planes(const Dtype* bottom_data,
+      Dtype* top_data, int* mask, Dtype* top_mask, int num_planes,
+      int num_threads, int thread_id) {
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
+  const int begin = num_planes * thread_id / num_threads;
+  const int end = num_planes * (thread_id + 1) / num_threads;
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  const bool is_max = pool == PoolingParameter_PoolMethod_MAX;
+  // The fast path computes no argmax.
+  const bool fast = fast_kernel_ && top_data && !mask && !top_mask;
+  vector<Dtype> row(fast ? width_ : 0);
+  for (int p = begin; p < end; ++p) {
+    const Dtype* plane_data = bottom_data + p * bottom_dim;
+    Dtype* plane_top = top_data ? top_data + p * top_dim : NULL;
+    if (fast) {
+      if (is_max) {
+        pool_interior_s2<Dtype, true>(kernel_h_, plane_data, width_, pad_h_,
+            pad_w_, ph_begin_, ph_end_, pw_begin_, pw_end_, pooled_width_,
+            plane_top, &row[0]);
+      } else {
+        pool_interior_s2<Dtype, false>(kernel_h_, plane_data, width_, pad_h_,
+            pad_w_, ph_begin_, ph_end_, pw_begin_, pw_end_, pooled_width_,
+            plane_top, &row[0]);
+      }
+    }
+    if (is_max) {
+      max_pool_plane(plane_data, plane_top, mask ? mask + p * top_dim : NULL,
+          top_mask ? top_mask + p * top_dim : NULL, fast);
+    } else if (pool == PoolingParameter_PoolMethod_STOCHASTIC) {
+      sto_pool_plane(plane_data, plane_top,
+          top_mask ? top_mask + p * top_dim : NULL, p * bottom_dim);
+    } else {
+      ave_pool_plane(plane_data, plane_top, fast);
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::max_pool_plane(const Dtype* bottom_data,
+      Dtype* top_data, int* mask, Dtype* top_mask, bool fast) const {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const bool skip_interior = fast && ph >= ph_begin_ && ph < ph_end_ &&
+        pw_begin_ < pw_end_;
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      if (skip_interior && pw == pw_begin_) {
+        pw = pw_end_ - 1;
+        continue;
+      }
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_);
+      int wend = min(wstart + kernel_w_, width_);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      Dtype max_value = -FLT_MAX;
+      int max_index = -1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int index = h * width_ + w;
+          if (bottom_data[index] > max_value) {
+            max_value = bottom_data[index];
+            max_index = index;
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+      }
+      const int pool_index = ph * pooled_width_ + pw;
+      if (top_data) {
+        top_data[pool_index] = max_value;
+      }
+      if (mask) {
+        mask[pool_index] = max_index;
+      } else if (top_mask) {
+        top_mask[pool_index] = static_cast<Dtype>(max_index);
       }
     }
-    break;
-  case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ave_pool_plane(const Dtype* bottom_data,
+      Dtype* top_data, bool fast) const {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    const bool skip_interior = fast && ph >= ph_begin_ && ph < ph_end_ &&
+        pw_begin_ < pw_end_;
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      if (skip_interior && pw == pw_begin_) {
+        pw = pw_end_ - 1;
+        continue;
+      }
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      Dtype sum = 0;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          sum += bottom_data[h * width_ + w];
+        }
+      }
+      top_data[ph * pooled_width_ + pw] = sum / pool_size;
     }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::sto_pool_plane(const Dtype* bottom_data,
+      Dtype* top_data, Dtype* rand_idx, int plane_offset) const {
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      const int hstart = ph * stride_h_;
+      const int hend = min(hstart + kernel_h_, height_);
+      const int wstart = pw * stride_w_;
+      const int wend = min(wstart + kernel_w_, width_);
+      const int pool_index = ph * pooled_width_ + pw;
+      if (!rand_idx) {
+        // The average of the window weighted by its activations, starting
+        // from FLT_MIN to avoid dividing by zero.
+        Dtype cumsum = FLT_MIN;
+        Dtype cumvalues = 0;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype value = bottom_data[h * width_ + w];
+            cumsum += value;
+            cumvalues += value * value;
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
+        top_data[pool_index] = cumvalues / cumsum;
+        continue;
       }
+      // Sample an element with probability proportional to its activation,
+      // by the first whose cumulative sum reaches the uniform number times
+      // the sum of the window.
+      Dtype cumsum = 0;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          cumsum += bottom_data[h * width_ + w];
+        }
+      }
+      const Dtype thres = rand_idx[pool_index] * cumsum;
+      cumsum = 0;
+      int index = (hend - 1) * width_ + wend - 1;
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          cumsum += bottom_data[h * width_ + w];
+          if (cumsum >= thres) {
+            index = h * width_ + w;
+            h = hend;
+            break;
+          }
+        }
+      }
+      rand_idx[pool_index] = plane_offset + index;
+      top_data[pool_index] = bottom_data[index];
     }
-    break;
-  case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
-    break;
-  default:
-    LOG(FATAL) << "Unknown pooling method.";
   }
 }
 
@@ -235,78 +406,92 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
-  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
-  // We'll output the mask to top[1] if it's of size >1.
-  const bool use_top_mask = top.size() > 1;
-  const int* mask = NULL;  // suppress warnings about uninitialized variables
+  const int num_planes = top[0]->num() * channels_;
+  const int num_threads = min(Caffe::num_threads(), num_planes);
+  const int* mask = NULL;
   const Dtype* top_mask = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // The main loop
-    if (use_top_mask) {
+    if (top.size() > 1) {
       top_mask = top[1]->cpu_data();
     } else {
-      mask = max_idx_.cpu_data();
-    }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+      if (!max_idx_valid_) {
+        Caffe::thread_pool().Run(num_threads, boost::bind(
+            &PoolingLayer<Dtype>::forward_cpu_planes, this,
+            bottom[0]->cpu_data(), static_cast<Dtype*>(NULL),
+            max_idx_.mutable_cpu_data(), static_cast<Dtype*>(NULL),
+            num_planes, num_threads, _1));
+        max_idx_valid_ = true;
       }
+      mask = max_idx_.cpu_data();
     }
-    break;
+    // Fall through.
   case PoolingParameter_PoolMethod_AVE:
-    // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
-            }
-          }
-        }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-      }
-    }
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &PoolingLayer<Dtype>::backward_cpu_planes, this, top_diff, mask,
+        top_mask, bottom_diff, num_planes, num_threads, _1));
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
+    top_mask = rand_idx_.cpu_data();
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &PoolingLayer<Dtype>::backward_cpu_planes, this, top_diff, mask,
+        top_mask, bottom_diff, num_planes, num_threads, _1));
     break;
   default:
     LOG(FATAL) << "Unknown pooling method.";
   }
 }
 
+template <typename Dtype>
+void PoolingLayer<Dtype>::backward_cpu_planes(const Dtype* top_diff,
+      const int* mask, const Dtype* top_mask, Dtype* bottom_diff,
+      int num_planes, int num_threads, int thread_id) {
+  const int bottom_dim = height_ * width_;
+  const int top_dim = pooled_height_ * pooled_width_;
+  const int begin = num_planes * thread_id / num_threads;
+  const int end = num_planes * (thread_id + 1) / num_threads;
+  const PoolingParameter_PoolMethod pool =
+      this->layer_param_.pooling_param().pool();
+  caffe_set((end - begin) * bottom_dim, Dtype(0),
+      bottom_diff + begin * bottom_dim);
+  for (int p = begin; p < end; ++p) {
+    const Dtype* plane_top_diff = top_diff + p * top_dim;
+    Dtype* plane_diff = bottom_diff + p * bottom_dim;
+    if (pool != PoolingParameter_PoolMethod_AVE) {
+      // The max pooling indices are within the plane, the stochastic ones,
+      // as on the GPU, within the blob.
+      const int plane_offset =
+          pool == PoolingParameter_PoolMethod_MAX ? 0 : p * bottom_dim;
+      for (int index = 0; index < top_dim; ++index) {
+        const int bottom_index = top_mask ?
+            static_cast<int>(top_mask[p * top_dim + index]) - plane_offset :
+            mask[p * top_dim + index];
+        plane_diff[bottom_index] += plane_top_diff[index];
+      }
+      continue;
+    }
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        const Dtype diff = plane_top_diff[ph * pooled_width_ + pw] / pool_size;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            plane_diff[h * width_ + w] += diff;
+          }
+        }
+      }
+    }
+  }
+}
+
 
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
@@ -1,7 +1,7 @@
-#include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -22,10 +22,7 @@ void ReLULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     Dtype* top_data = top[i]->mutable_cpu_data();
     const int count = bottom[i]->count();
     Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-    for (int j = 0; j < count; ++j) {
-      top_data[j] = std::max(bottom_data[j], Dtype(0))
-          + negative_slope * std::min(bottom_data[j], Dtype(0));
-    }
+    caffe_cpu_relu(count, bottom_data, negative_slope, top_data);
   }
 }
 
@@ -40,10 +37,8 @@ void ReLULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
       const int count = bottom[i]->count();
       Dtype negative_slope = this->layer_param_.relu_param().negative_slope();
-      for (int j = 0; j < count; ++j) {
-        bottom_diff[j] = top_diff[j] * ((bottom_data[j] > 0)
-            + negative_slope * (bottom_data[j] <= 0));
-      }
+      caffe_cpu_relu_backward(count, bottom_data, top_diff, negative_slope,
+          bottom_diff);
     }
   }
 }
@@ -1,26 +1,19 @@
-#include <algorithm>
-#include <cmath>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
-template <typename Dtype>
-inline Dtype sigmoid(Dtype x) {
-  return 1. / (1. + exp(-x));
-}
-
 template <typename Dtype>
 void SigmoidLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = sigmoid(bottom_data[i]);
-  }
+  caffe_cpu_sigmoid(count, bottom_data, top_data,
+      this->layer_param_.sigmoid_param().fast_math());
 }
 
 template <typename Dtype>
@@ -32,10 +25,7 @@ void SigmoidLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
-    for (int i = 0; i < count; ++i) {
-      const Dtype sigmoid_x = top_data[i];
-      bottom_diff[i] = top_diff[i] * sigmoid_x * (1. - sigmoid_x);
-    }
+    caffe_cpu_sigmoid_backward(count, top_data, top_diff, bottom_diff);
   }
 }
 
@@ -18,6 +18,8 @@ void SliceLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   std::copy(slice_param.slice_point().begin(),
       slice_param.slice_point().end(),
       std::back_inserter(slice_point_));
+  share_tops_ = slice_param.share_tops();
+  tops_shared_ = false;
 }
 
 template <typename Dtype>
@@ -73,6 +75,25 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   CHECK_EQ(count_, bottom[0]->count());
+  // As for ConcatLayer::Reshape: tops shared by an earlier pass that no
+  // longer are views of their ranges of the reshaped bottom would have the
+  // copies of the forward pass write into other ranges of the bottom, so
+  // give them memory of their own until ShareTops shares them again.
+  if (tops_shared_) {
+    bool views_match = !(slice_dim_ == 1 && num_ != 1);
+    int offset = 0;
+    for (int i = 0; views_match && i < top.size(); ++i) {
+      views_match = top[i]->data()->is_view_of(*bottom[0]->data(),
+          offset * sizeof(Dtype));
+      offset += top[i]->count();
+    }
+    if (!views_match) {
+      for (int i = 0; i < top.size(); ++i) {
+        top[i]->Reallocate();
+      }
+      tops_shared_ = false;
+    }
+  }
 }
 
 template <typename Dtype>
@@ -101,6 +122,7 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       offset_channel += blob->channels();
     }
   }  // slice_dim_ is guaranteed to be 0 or 1 by SetUp.
+  ShareTops(bottom, top);
 }
 
 template <typename Dtype>
@@ -132,6 +154,20 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }  // slice_dim_ is guaranteed to be 0 or 1 by SetUp.
 }
 
+template <typename Dtype>
+void SliceLayer<Dtype>::ShareTops(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  // As for ConcatLayer::ShareBottoms, with the tops as views of the bottom.
+  if (!share_tops_ || (slice_dim_ == 1 && num_ != 1)) { return; }
+  int offset = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    top[i]->ShareData(*bottom[0], offset);
+    top[i]->ShareDiff(*bottom[0], offset);
+    offset += top[i]->count();
+  }
+  tops_shared_ = true;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(SliceLayer);
 #endif
@@ -1,8 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -18,43 +22,34 @@ void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     multiplier_data[i] = 1.;
   }
   scale_.Reshape(bottom[0]->num(), 1, bottom[0]->height(), bottom[0]->width());
+  num_ = bottom[0]->num();
+  channels_ = bottom[0]->channels();
+  spatial_dim_ = bottom[0]->height() * bottom[0]->width();
 }
 
 template <typename Dtype>
 void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int num = bottom[0]->num();
-  int channels = bottom[0]->channels();
-  int dim = bottom[0]->count() / bottom[0]->num();
-  int spatial_dim = bottom[0]->height() * bottom[0]->width();
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  // We need to subtract the max to avoid numerical issues, compute the exp,
-  // and then normalize.
-  for (int i = 0; i < num; ++i) {
-    // initialize scale_data to the first plane
-    caffe_copy(spatial_dim, bottom_data + i * dim, scale_data);
-    for (int j = 0; j < channels; j++) {
-      for (int k = 0; k < spatial_dim; k++) {
-        scale_data[k] = std::max(scale_data[k],
-            bottom_data[i * dim + j * spatial_dim + k]);
-      }
-    }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, spatial_dim,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data + i * dim);
-    // exponentiation
-    caffe_exp<Dtype>(dim, top_data + i * dim, top_data + i * dim);
-    // sum after exp
-    caffe_cpu_gemv<Dtype>(CblasTrans, channels, spatial_dim, 1.,
-        top_data + i * dim, sum_multiplier_.cpu_data(), 0., scale_data);
-    // division
-    for (int j = 0; j < channels; j++) {
-      caffe_div(spatial_dim, top_data + top[0]->offset(i, j), scale_data,
-          top_data + top[0]->offset(i, j));
-    }
+  const int num_threads = std::min(Caffe::num_threads(),
+      num_ * caffe_softmax_num_tiles(spatial_dim_));
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &SoftmaxLayer<Dtype>::forward_cpu_tiles, this, bottom[0]->cpu_data(),
+      top[0]->mutable_cpu_data(), num_threads, _1));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::forward_cpu_tiles(const Dtype* bottom_data,
+    Dtype* top_data, int num_threads, int thread_id) {
+  const int num_tiles = caffe_softmax_num_tiles(spatial_dim_);
+  const int begin = num_ * num_tiles * thread_id / num_threads;
+  const int end = num_ * num_tiles * (thread_id + 1) / num_threads;
+  vector<Dtype> scratch(2 * std::min(spatial_dim_, kSoftmaxTile));
+  for (int tile = begin; tile < end; ++tile) {
+    const int k = tile % num_tiles * kSoftmaxTile;
+    const int offset = tile / num_tiles * channels_ * spatial_dim_ + k;
+    caffe_cpu_softmax(channels_, std::min(kSoftmaxTile, spatial_dim_ - k),
+        spatial_dim_, bottom_data + offset, top_data + offset, &scratch[0],
+        this->layer_param_.softmax_param().fast_math());
   }
 }
 
@@ -62,28 +57,29 @@ template <typename Dtype>
 void SoftmaxLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int num = top[0]->num();
-  int channels = top[0]->channels();
-  int dim = top[0]->count() / top[0]->num();
-  int spatial_dim = top[0]->height() * top[0]->width();
-  caffe_copy(top[0]->count(), top_diff, bottom_diff);
-  for (int i = 0; i < num; ++i) {
-    // compute dot(top_diff, top_data) and subtract them from the bottom diff
-    for (int k = 0; k < spatial_dim; ++k) {
-      scale_data[k] = caffe_cpu_strided_dot<Dtype>(channels,
-          bottom_diff + i * dim + k, spatial_dim,
-          top_data + i * dim + k, spatial_dim);
-    }
-    // subtraction
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, spatial_dim, 1,
-        -1., sum_multiplier_.cpu_data(), scale_data, 1., bottom_diff + i * dim);
+  const int num_threads = std::min(Caffe::num_threads(),
+      num_ * caffe_softmax_num_tiles(spatial_dim_));
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &SoftmaxLayer<Dtype>::backward_cpu_tiles, this, top[0]->cpu_data(),
+      top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff(), num_threads, _1));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::backward_cpu_tiles(const Dtype* top_data,
+    const Dtype* top_diff, Dtype* bottom_diff, int num_threads,
+    int thread_id) {
+  const int num_tiles = caffe_softmax_num_tiles(spatial_dim_);
+  const int begin = num_ * num_tiles * thread_id / num_threads;
+  const int end = num_ * num_tiles * (thread_id + 1) / num_threads;
+  vector<Dtype> scratch(std::min(spatial_dim_, kSoftmaxTile));
+  for (int tile = begin; tile < end; ++tile) {
+    const int k = tile % num_tiles * kSoftmaxTile;
+    const int offset = tile / num_tiles * channels_ * spatial_dim_ + k;
+    caffe_cpu_softmax_backward(channels_,
+        std::min(kSoftmaxTile, spatial_dim_ - k), spatial_dim_,
+        top_data + offset, top_diff + offset, bottom_diff + offset,
+        &scratch[0]);
   }
-  // elementwise multiplication
-  caffe_mul(top[0]->count(), bottom_diff, top_data, bottom_diff);
 }
 
 
@@ -1,3 +1,5 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
@@ -5,6 +7,8 @@
 #include "caffe/layer.hpp"
 #include "caffe/layer_factory.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -42,37 +46,43 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
   }
 }
 
+template <typename Dtype>
+int SoftmaxWithLossLayer<Dtype>::label_channel(Dtype label) const {
+  int label_value = static_cast<int>(label);
+  if (has_ignore_label_) {
+    if ((ignore_mode_ == 1 && label_value > ignore_label_) ||
+        (ignore_mode_ == 2 && label_value == ignore_label_) ||
+        (ignore_mode_ == 3 && label_value < ignore_label_)) {
+      return -1;
+    }
+    if (ignore_mode_ == 3) {
+      label_value = label_value - ignore_label_;
+    }
+  }
+  DCHECK_GE(label_value, 0);
+  DCHECK_LT(label_value, prob_.channels());
+  return label_value;
+}
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
-  const Dtype* label = bottom[1]->cpu_data();
+  // The forward pass computes the softmax prob values, and the loss while
+  // they are still in cache, rather than going through softmax_layer_.
   int num = prob_.num();
-  int dim = prob_.count() / num;
-  int spatial_dim = prob_.height() * prob_.width();
+  const int num_threads = std::min(Caffe::num_threads(),
+      num * caffe_softmax_num_tiles(prob_.height() * prob_.width()));
+  vector<Dtype> losses(num_threads);
+  vector<int> counts(num_threads);
+  Caffe::thread_pool().Run(num_threads, boost::bind(
+      &SoftmaxWithLossLayer<Dtype>::forward_cpu_tiles, this,
+      bottom[0]->cpu_data(), bottom[1]->cpu_data(), prob_.mutable_cpu_data(),
+      &losses[0], &counts[0], num_threads, _1));
   int count = 0;
   Dtype loss = 0;
-  for (int i = 0; i < num; ++i) {
-    for (int j = 0; j < spatial_dim; j++) {
-      int label_value = static_cast<int>(label[i * spatial_dim + j]);
-      if (has_ignore_label_) {
-        if ((ignore_mode_ == 1 && label_value > ignore_label_) ||
-            (ignore_mode_ == 2 && label_value == ignore_label_) ||
-            (ignore_mode_ == 3 && label_value < ignore_label_)) {
-          continue;
-        }
-        if (ignore_mode_ == 3) {
-          label_value = label_value - ignore_label_; 
-        } 
-      }
-      DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, prob_.channels());
-      loss -= log(std::max(prob_data[i * dim + label_value * spatial_dim + j],
-                           Dtype(FLT_MIN)));
-      ++count;
-    }
+  for (int t = 0; t < num_threads; ++t) {
+    loss += losses[t];
+    count += counts[t];
   }
   if (normalize_) {
     top[0]->mutable_cpu_data()[0] = loss / count;
@@ -84,6 +94,40 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void SoftmaxWithLossLayer<Dtype>::forward_cpu_tiles(const Dtype* bottom_data,
+    const Dtype* label, Dtype* prob_data, Dtype* losses, int* counts,
+    int num_threads, int thread_id) {
+  const int channels = prob_.channels();
+  const int spatial_dim = prob_.height() * prob_.width();
+  const int num_tiles = caffe_softmax_num_tiles(spatial_dim);
+  const int begin = prob_.num() * num_tiles * thread_id / num_threads;
+  const int end = prob_.num() * num_tiles * (thread_id + 1) / num_threads;
+  vector<Dtype> scratch(2 * std::min(spatial_dim, kSoftmaxTile));
+  int count = 0;
+  Dtype loss = 0;
+  for (int tile = begin; tile < end; ++tile) {
+    const int i = tile / num_tiles;
+    const int k = tile % num_tiles * kSoftmaxTile;
+    const int n = std::min(kSoftmaxTile, spatial_dim - k);
+    const int offset = i * channels * spatial_dim + k;
+    caffe_cpu_softmax(channels, n, spatial_dim, bottom_data + offset,
+        prob_data + offset, &scratch[0],
+        this->layer_param_.softmax_param().fast_math());
+    for (int j = 0; j < n; ++j) {
+      const int c = label_channel(label[i * spatial_dim + k + j]);
+      if (c < 0) {
+        continue;
+      }
+      loss -= log(std::max(prob_data[offset + c * spatial_dim + j],
+                           Dtype(FLT_MIN)));
+      ++count;
+    }
+  }
+  losses[thread_id] = loss;
+  counts[thread_id] = count;
+}
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -92,40 +136,57 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                << " Layer cannot backpropagate to label inputs.";
   }
   if (propagate_down[0]) {
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
     const Dtype* label = bottom[1]->cpu_data();
     int num = prob_.num();
-    int dim = prob_.count() / num;
     int spatial_dim = prob_.height() * prob_.width();
     int count = 0;
-    for (int i = 0; i < num; ++i) {
-      for (int j = 0; j < spatial_dim; ++j) {
-        int label_value = static_cast<int>(label[i * spatial_dim + j]);
-        if (has_ignore_label_) {
-          if ((ignore_mode_ == 1 && label_value > ignore_label_) ||
-              (ignore_mode_ == 2 && label_value == ignore_label_) ||
-              (ignore_mode_ == 3 && label_value < ignore_label_)) {
-            for (int c = 0; c < bottom[0]->channels(); ++c) {
-              bottom_diff[i * dim + c * spatial_dim + j] = 0;
-            }
-            continue;
-          }
-          if (ignore_mode_ == 3) {
-            label_value = label_value - ignore_label_; 
-          } 
-        }
-        bottom_diff[i * dim + label_value * spatial_dim + j] -= 1;
+    for (int i = 0; i < num * spatial_dim; ++i) {
+      if (label_channel(label[i]) >= 0) {
         ++count;
       }
     }
     // Scale gradient
     const Dtype loss_weight = top[0]->cpu_diff()[0];
-    if (normalize_) {
-      caffe_scal(prob_.count(), loss_weight / count, bottom_diff);
-    } else {
-      caffe_scal(prob_.count(), loss_weight / num, bottom_diff);
+    const Dtype scale = normalize_ ? loss_weight / count : loss_weight / num;
+    const int num_threads = std::min(Caffe::num_threads(),
+        num * caffe_softmax_num_tiles(spatial_dim));
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &SoftmaxWithLossLayer<Dtype>::backward_cpu_tiles, this,
+        prob_.cpu_data(), label, scale, bottom[0]->mutable_cpu_diff(),
+        num_threads, _1));
+  }
+}
+
+template <typename Dtype>
+void SoftmaxWithLossLayer<Dtype>::backward_cpu_tiles(const Dtype* prob_data,
+    const Dtype* label, Dtype scale, Dtype* bottom_diff, int num_threads,
+    int thread_id) {
+  const int channels = prob_.channels();
+  const int spatial_dim = prob_.height() * prob_.width();
+  const int num_tiles = caffe_softmax_num_tiles(spatial_dim);
+  const int begin = prob_.num() * num_tiles * thread_id / num_threads;
+  const int end = prob_.num() * num_tiles * (thread_id + 1) / num_threads;
+  for (int tile = begin; tile < end; ++tile) {
+    const int i = tile / num_tiles;
+    const int k = tile % num_tiles * kSoftmaxTile;
+    const int n = std::min(kSoftmaxTile, spatial_dim - k);
+    const int offset = i * channels * spatial_dim + k;
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* prob_c = prob_data + offset + c * spatial_dim;
+      Dtype* diff_c = bottom_diff + offset + c * spatial_dim;
+      for (int j = 0; j < n; ++j) {
+        diff_c[j] = prob_c[j] * scale;
+      }
+    }
+    for (int j = 0; j < n; ++j) {
+      const int c = label_channel(label[i * spatial_dim + k + j]);
+      if (c >= 0) {
+        bottom_diff[offset + c * spatial_dim + j] -= scale;
+      } else {
+        for (int c_zero = 0; c_zero < channels; ++c_zero) {
+          bottom_diff[offset + c_zero * spatial_dim + j] = 0;
+        }
+      }
     }
   }
 }
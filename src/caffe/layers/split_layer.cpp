@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
@@ -6,6 +7,9 @@
 
 namespace caffe {
 
+// Number of elements summed over all tops at a time in Backward_cpu.
+const int kSplitBackwardBlockSize = 2048;
+
 template <typename Dtype>
 void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -40,13 +44,20 @@ void SplitLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     caffe_copy(count_, top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
     return;
   }
-  caffe_add(count_, top[0]->cpu_diff(), top[1]->cpu_diff(),
-            bottom[0]->mutable_cpu_diff());
-  // Add remaining top blob diffs.
-  for (int i = 2; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_axpy(count_, Dtype(1.), top_diff, bottom_diff);
+  vector<const Dtype*> top_diffs(top.size());
+  for (int i = 0; i < top.size(); ++i) {
+    top_diffs[i] = top[i]->cpu_diff();
+  }
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  // Sum the top diffs one cache-sized block at a time, so that the bottom
+  // diff is written in a single pass however many tops there are.
+  for (int offset = 0; offset < count_; offset += kSplitBackwardBlockSize) {
+    const int n = std::min(kSplitBackwardBlockSize, count_ - offset);
+    caffe_add(n, top_diffs[0] + offset, top_diffs[1] + offset,
+              bottom_diff + offset);
+    for (int i = 2; i < top.size(); ++i) {
+      caffe_axpy(n, Dtype(1.), top_diffs[i] + offset, bottom_diff + offset);
+    }
   }
 }
 
@@ -14,6 +14,22 @@ void SplitLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Sums up to four top diffs (unused ones are NULL) into bottom_diff, adding
+// to its current value if accumulate is set.
+template <typename Dtype>
+__global__ void SplitBackward(const int nthreads, const Dtype* top_diff_0,
+    const Dtype* top_diff_1, const Dtype* top_diff_2, const Dtype* top_diff_3,
+    const bool accumulate, Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    Dtype sum = accumulate ? bottom_diff[index] : top_diff_0[index];
+    if (accumulate) { sum += top_diff_0[index]; }
+    if (top_diff_1) { sum += top_diff_1[index]; }
+    if (top_diff_2) { sum += top_diff_2[index]; }
+    if (top_diff_3) { sum += top_diff_3[index]; }
+    bottom_diff[index] = sum;
+  }
+}
+
 template <typename Dtype>
 void SplitLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -22,13 +38,18 @@ void SplitLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     caffe_copy(count_, top[0]->gpu_diff(), bottom[0]->mutable_gpu_diff());
     return;
   }
-  caffe_gpu_add(count_, top[0]->gpu_diff(), top[1]->gpu_diff(),
-                bottom[0]->mutable_gpu_diff());
-  // Add remaining top blob diffs.
-  for (int i = 2; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->gpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
-    caffe_gpu_axpy(count_, Dtype(1.), top_diff, bottom_diff);
+  Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+  // Sum four tops per kernel launch instead of one pass per top.
+  for (int i = 0; i < top.size(); i += 4) {
+    const Dtype* top_diffs[4] = { NULL, NULL, NULL, NULL };
+    for (int j = 0; j < 4 && i + j < top.size(); ++j) {
+      top_diffs[j] = top[i + j]->gpu_diff();
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SplitBackward<Dtype><<<CAFFE_GET_BLOCKS(count_), CAFFE_CUDA_NUM_THREADS>>>(
+        count_, top_diffs[0], top_diffs[1], top_diffs[2], top_diffs[3],
+        i > 0, bottom_diff);
+    CUDA_POST_KERNEL_CHECK;
   }
 }
 
@@ -1,10 +1,10 @@
 // TanH neuron activation function layer.
 // Adapted from ReLU layer code written by Yangqing Jia
 
-#include <algorithm>
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
@@ -15,9 +15,8 @@ void TanHLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = tanh(bottom_data[i]);
-  }
+  caffe_cpu_tanh(count, bottom_data, top_data,
+      this->layer_param_.tanh_param().fast_math());
 }
 
 template <typename Dtype>
@@ -29,11 +28,7 @@ void TanHLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int count = bottom[0]->count();
-    Dtype tanhx;
-    for (int i = 0; i < count; ++i) {
-      tanhx = top_data[i];
-      bottom_diff[i] = top_diff[i] * (1 - tanhx * tanhx);
-    }
+    caffe_cpu_tanh_backward(count, top_data, top_diff, bottom_diff);
   }
 }
 
@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 
@@ -19,9 +20,7 @@ void ThresholdLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = (bottom_data[i] > threshold_) ? Dtype(1) : Dtype(0);
-  }
+  caffe_cpu_threshold(count, bottom_data, threshold_, top_data);
 }
 
 #ifdef CPU_ONLY
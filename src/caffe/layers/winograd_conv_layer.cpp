@@ -0,0 +1,243 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/vision_layers.hpp"
+
+namespace caffe {
+
+namespace {
+
+// F(2x2, 3x3): every 4x4 input tile yields a 2x2 output tile.
+const int kWinogradTile = 4;
+const int kWinogradTileArea = kWinogradTile * kWinogradTile;
+const int kWinogradOutputTile = 2;
+
+}  // namespace
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_winograd()) { return; }
+  tiles_h_ = (this->height_out_ + kWinogradOutputTile - 1)
+      / kWinogradOutputTile;
+  tiles_w_ = (this->width_out_ + kWinogradOutputTile - 1)
+      / kWinogradOutputTile;
+  // The padded input covers every input tile, including the bottom and right
+  // ones that overhang an odd sized output.
+  padded_height_ = tiles_h_ * kWinogradOutputTile + 2;
+  padded_width_ = tiles_w_ * kWinogradOutputTile + 2;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::prepare_buffers(int num_threads) {
+  while (padded_inputs_.size() < num_threads) {
+    padded_inputs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    transformed_inputs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    transformed_outputs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
+  const int tiles = tiles_h_ * tiles_w_;
+  for (int t = 0; t < num_threads; ++t) {
+    padded_inputs_[t]->Reshape(1, this->channels_, padded_height_,
+        padded_width_);
+    transformed_inputs_[t]->Reshape(1, kWinogradTileArea,
+        this->channels_ / this->group_, tiles);
+    transformed_outputs_[t]->Reshape(1, kWinogradTileArea,
+        this->num_output_ / this->group_, tiles);
+  }
+}
+
+template <typename Dtype>
+bool WinogradConvolutionLayer<Dtype>::use_winograd() const {
+  return this->kernel_h_ == 3 && this->kernel_w_ == 3
+      && this->stride_h_ == 1 && this->stride_w_ == 1;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd()) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  transform_weights();
+  if (this->bias_term_) { this->blobs_[1]->cpu_data(); }
+  const int num_threads = std::min(Caffe::num_threads(), this->num_);
+  prepare_buffers(num_threads);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    Caffe::thread_pool().Run(num_threads, boost::bind(
+        &WinogradConvolutionLayer<Dtype>::forward_cpu_winograd_images, this,
+        bottom_data, top_data, num_threads, _1));
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::transform_weights() {
+  const shared_ptr<SyncedMemory>& weight_memory = this->blobs_[0]->data();
+  if (transformed_memory_ == weight_memory &&
+      transformed_version_ == weight_memory->version()) {
+    return;
+  }
+  const int in_channels = this->channels_ / this->group_;
+  const int out_channels = this->num_output_ / this->group_;
+  transformed_weight_.Reshape(this->group_, kWinogradTileArea, out_channels,
+      in_channels);
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* transformed = transformed_weight_.mutable_cpu_data();
+  const int stride = out_channels * in_channels;
+  for (int g = 0; g < this->group_; ++g) {
+    for (int o = 0; o < out_channels; ++o) {
+      for (int c = 0; c < in_channels; ++c) {
+        const Dtype* w =
+            weight + ((g * out_channels + o) * in_channels + c) * 9;
+        // G w, with G = [1 0 0; .5 .5 .5; .5 -.5 .5; 0 0 1].
+        Dtype gw[4][3];
+        for (int j = 0; j < 3; ++j) {
+          gw[0][j] = w[j];
+          gw[1][j] = Dtype(0.5) * (w[j] + w[3 + j] + w[6 + j]);
+          gw[2][j] = Dtype(0.5) * (w[j] - w[3 + j] + w[6 + j]);
+          gw[3][j] = w[6 + j];
+        }
+        // (G w) G^T, scattered to one matrix per tile element.
+        Dtype* u = transformed + transformed_weight_.offset(g) +
+            o * in_channels + c;
+        for (int i = 0; i < 4; ++i) {
+          u[(i * 4 + 0) * stride] = gw[i][0];
+          u[(i * 4 + 1) * stride] =
+              Dtype(0.5) * (gw[i][0] + gw[i][1] + gw[i][2]);
+          u[(i * 4 + 2) * stride] =
+              Dtype(0.5) * (gw[i][0] - gw[i][1] + gw[i][2]);
+          u[(i * 4 + 3) * stride] = gw[i][2];
+        }
+      }
+    }
+  }
+  transformed_memory_ = weight_memory;
+  transformed_version_ = weight_memory->version();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::forward_cpu_winograd_images(
+    const Dtype* bottom_data, Dtype* top_data, int num_threads,
+    int thread_id) {
+  const int bottom_dim = this->channels_ * this->height_ * this->width_;
+  const int top_dim = this->num_output_ * this->height_out_ * this->width_out_;
+  const int begin = this->num_ * thread_id / num_threads;
+  const int end = this->num_ * (thread_id + 1) / num_threads;
+  for (int n = begin; n < end; ++n) {
+    forward_cpu_winograd(bottom_data + n * bottom_dim,
+        top_data + n * top_dim, thread_id);
+    // The bias is added by the output transform.
+    this->forward_cpu_bias_activation(top_data + n * top_dim, NULL);
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::forward_cpu_winograd(
+    const Dtype* input, Dtype* output, int thread_id) {
+  const int height = this->height_;
+  const int width = this->width_;
+  const int height_out = this->height_out_;
+  const int width_out = this->width_out_;
+  const int in_channels = this->channels_ / this->group_;
+  const int out_channels = this->num_output_ / this->group_;
+  const int padded_dim = padded_height_ * padded_width_;
+  const int tiles = tiles_h_ * tiles_w_;
+  // Copy the image into the zero-padded buffer.
+  Blob<Dtype>* padded_input_blob = padded_inputs_[thread_id].get();
+  Dtype* padded_input = padded_input_blob->mutable_cpu_data();
+  caffe_set(padded_input_blob->count(), Dtype(0), padded_input);
+  for (int c = 0; c < this->channels_; ++c) {
+    for (int h = 0; h < height; ++h) {
+      caffe_copy(width, input + (c * height + h) * width,
+          padded_input + c * padded_dim + (h + this->pad_h_) * padded_width_
+          + this->pad_w_);
+    }
+  }
+  Dtype* v = transformed_inputs_[thread_id]->mutable_cpu_data();
+  Dtype* m = transformed_outputs_[thread_id]->mutable_cpu_data();
+  const int v_stride = in_channels * tiles;
+  const int m_stride = out_channels * tiles;
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int g = 0; g < this->group_; ++g) {
+    // V = B^T d B for every 4x4 input tile d, with
+    // B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1].
+    for (int c = 0; c < in_channels; ++c) {
+      const Dtype* channel = padded_input + (g * in_channels + c) * padded_dim;
+      for (int ty = 0; ty < tiles_h_; ++ty) {
+        for (int tx = 0; tx < tiles_w_; ++tx) {
+          const Dtype* d = channel + ty * kWinogradOutputTile * padded_width_
+              + tx * kWinogradOutputTile;
+          Dtype btd[4][4];
+          for (int j = 0; j < 4; ++j) {
+            const Dtype d0 = d[j];
+            const Dtype d1 = d[padded_width_ + j];
+            const Dtype d2 = d[2 * padded_width_ + j];
+            const Dtype d3 = d[3 * padded_width_ + j];
+            btd[0][j] = d0 - d2;
+            btd[1][j] = d1 + d2;
+            btd[2][j] = d2 - d1;
+            btd[3][j] = d1 - d3;
+          }
+          Dtype* vt = v + c * tiles + ty * tiles_w_ + tx;
+          for (int i = 0; i < 4; ++i) {
+            vt[(i * 4 + 0) * v_stride] = btd[i][0] - btd[i][2];
+            vt[(i * 4 + 1) * v_stride] = btd[i][1] + btd[i][2];
+            vt[(i * 4 + 2) * v_stride] = btd[i][2] - btd[i][1];
+            vt[(i * 4 + 3) * v_stride] = btd[i][1] - btd[i][3];
+          }
+        }
+      }
+    }
+    // M = U V, one GEMM per tile element.
+    const Dtype* u = transformed_weight_.cpu_data() +
+        transformed_weight_.offset(g);
+    for (int i = 0; i < kWinogradTileArea; ++i) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels, tiles,
+          in_channels, (Dtype)1., u + i * out_channels * in_channels,
+          v + i * v_stride, (Dtype)0., m + i * m_stride);
+    }
+    // Y = A^T M A for every output tile, with A^T = [1 1 1 0; 0 1 -1 -1].
+    for (int o = 0; o < out_channels; ++o) {
+      const int out_c = g * out_channels + o;
+      const Dtype b = bias ? bias[out_c] : Dtype(0);
+      Dtype* out = output + out_c * height_out * width_out;
+      for (int ty = 0; ty < tiles_h_; ++ty) {
+        for (int tx = 0; tx < tiles_w_; ++tx) {
+          const Dtype* mt = m + o * tiles + ty * tiles_w_ + tx;
+          Dtype atm[2][4];
+          for (int j = 0; j < 4; ++j) {
+            const Dtype m0 = mt[j * m_stride];
+            const Dtype m1 = mt[(4 + j) * m_stride];
+            const Dtype m2 = mt[(8 + j) * m_stride];
+            const Dtype m3 = mt[(12 + j) * m_stride];
+            atm[0][j] = m0 + m1 + m2;
+            atm[1][j] = m1 - m2 - m3;
+          }
+          const int y = ty * kWinogradOutputTile;
+          const int x = tx * kWinogradOutputTile;
+          for (int i = 0; i < 2 && y + i < height_out; ++i) {
+            Dtype* out_row = out + (y + i) * width_out + x;
+            out_row[0] = atm[i][0] + atm[i][1] + atm[i][2] + b;
+            if (x + 1 < width_out) {
+              out_row[1] = atm[i][1] - atm[i][2] - atm[i][3] + b;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <iomanip>
 #include <map>
 #include <set>
 #include <string>
@@ -9,9 +10,12 @@
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fuse_activations.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/plan_in_place.hpp"
+#include "caffe/util/plan_views.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -35,22 +39,69 @@ template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  // Skip building the (possibly large) setup messages when INFO logs are
+  // dropped anyway, e.g. with GLOG_minloglevel=1.
+  log_init_ = FLAGS_minloglevel <= google::INFO;
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
-  LOG(INFO) << "Initializing net from parameters: " << std::endl
-            << filtered_param.DebugString();
+  LOG_IF(INFO, log_init_) << "Initializing net from parameters: " << std::endl
+                          << filtered_param.DebugString();
   // Create a copy of filtered_param with splits added where necessary.
+  NetParameter split_param;
+  InsertSplits(filtered_param, &split_param);
+  // Run element-wise layers in place where it is safe to do so.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  map<string, string> blob_aliases;
+  if (split_param.plan_in_place()) {
+    PlanInPlace(split_param, &param, &blob_aliases);
+  } else {
+    param.CopyFrom(split_param);
+  }
+  // Apply activations in the bias pass of the convolutions they follow.
+  if (param.fuse_activations()) {
+    NetParameter fused_param;
+    FuseActivations(param, &fused_param);
+    param.Swap(&fused_param);
+  }
+  // Let Concat and Slice layers share memory with their bottoms or tops.
+  if (param.plan_views()) {
+    NetParameter views_param;
+    PlanViews(param, &views_param);
+    param.Swap(&views_param);
+  }
   // Basically, build all the layers and set up its connections.
   name_ = param.name();
+  memory_account_.reset(new MemoryAccount(name_, "total"));
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
+  // A blob stays available until the last layer reading it, which is the
+  // layer after its producer unless PlanInPlace has dropped a Split layer.
+  map<string, int> blob_reads_left;
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    const LayerParameter& layer_param = param.layer(layer_id);
+    for (int bottom_id = 0; bottom_id < layer_param.bottom_size();
+         ++bottom_id) {
+      ++blob_reads_left[layer_param.bottom(bottom_id)];
+    }
+  }
   CHECK_EQ(param.input_size() * 4, param.input_dim_size())
       << "Incorrect input blob dimension specifications.";
   memory_used_ = 0;
+  // Reserve all containers up front.
+  int num_blobs = param.input_size();
+  for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
+    num_blobs += param.layer(layer_id).top_size();
+  }
+  blobs_.reserve(num_blobs);
+  blob_names_.reserve(num_blobs);
+  blob_need_backward_.reserve(num_blobs);
+  layers_.reserve(param.layer_size());
+  layer_names_.reserve(param.layer_size());
+  layer_need_backward_.reserve(param.layer_size());
+  layer_memory_accounts_.reserve(param.layer_size());
+  category_memory_accounts_.reserve(param.layer_size());
   // set the input blobs
   for (int input_id = 0; input_id < param.input_size(); ++input_id) {
     const int layer_id = -1;  // inputs have fake layer ID -1
@@ -73,13 +124,14 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     const LayerParameter& layer_param = param.layer(layer_id);
     layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     layer_names_.push_back(layer_param.name());
-    LOG(INFO) << "Creating Layer " << layer_param.name();
+    AppendMemoryAccounts(layer_param.name());
+    LOG_IF(INFO, log_init_) << "Creating Layer " << layer_param.name();
     bool need_backward = false;
     // Figure out this layer's input and output
     for (int bottom_id = 0; bottom_id < layer_param.bottom_size();
          ++bottom_id) {
       const int blob_id = AppendBottom(param, layer_id, bottom_id,
-                                       &available_blobs, &blob_name_to_idx);
+          &available_blobs, &blob_name_to_idx, &blob_reads_left);
       // If a blob needs backward, this layer should provide it.
       need_backward |= blob_need_backward_[blob_id];
     }
@@ -102,20 +154,25 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       }
     }
     // After this layer is connected, set it up.
-    LOG(INFO) << "Setting up " << layer_names_[layer_id];
+    LOG_IF(INFO, log_init_) << "Setting up " << layer_names_[layer_id];
+    const shared_ptr<MemoryAccount> previous_account = MemoryAccount::current();
+    MemoryAccount::set_current(category_memory_accounts_[layer_id][INTERNAL]);
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    MemoryAccount::set_current(previous_account);
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
       if (blob_loss_weights_.size() <= top_id_vecs_[layer_id][top_id]) {
         blob_loss_weights_.resize(top_id_vecs_[layer_id][top_id] + 1, Dtype(0));
       }
       blob_loss_weights_[top_id_vecs_[layer_id][top_id]] = layer->loss(top_id);
-      LOG(INFO) << "Top shape: " << top_vecs_[layer_id][top_id]->num() << " "
+      LOG_IF(INFO, log_init_) << "Top shape: "
+          << top_vecs_[layer_id][top_id]->num() << " "
           << top_vecs_[layer_id][top_id]->channels() << " "
           << top_vecs_[layer_id][top_id]->height() << " "
           << top_vecs_[layer_id][top_id]->width() << " ("
           << top_vecs_[layer_id][top_id]->count() << ")";
       if (layer->loss(top_id)) {
-        LOG(INFO) << "    with loss weight " << layer->loss(top_id);
+        LOG_IF(INFO, log_init_) << "    with loss weight "
+                                << layer->loss(top_id);
       }
       memory_used_ += top_vecs_[layer_id][top_id]->count();
     }
@@ -134,6 +191,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
                                                   param_need_backward);
     }
     for (int param_id = 0; param_id < num_param_blobs; ++param_id) {
+      layers_[layer_id]->blobs()[param_id]->set_memory_accounts(
+          category_memory_accounts_[layer_id][PARAM_DATA],
+          category_memory_accounts_[layer_id][PARAM_DIFF]);
       AppendParam(param, layer_id, param_id);
     }
     // Finally, set the backward flag
@@ -160,10 +220,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     }
     if (!layer_contributes_loss) { layer_need_backward_[layer_id] = false; }
     if (layer_need_backward_[layer_id]) {
-      LOG(INFO) << layer_names_[layer_id] << " needs backward computation.";
+      LOG_IF(INFO, log_init_) << layer_names_[layer_id]
+                              << " needs backward computation.";
     } else {
-      LOG(INFO) << layer_names_[layer_id]
-                << " does not need backward computation.";
+      LOG_IF(INFO, log_init_) << layer_names_[layer_id]
+                              << " does not need backward computation.";
     }
     for (int bottom_id = 0; bottom_id < bottom_vecs_[layer_id].size();
          ++bottom_id) {
@@ -198,20 +259,31 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   // In the end, all remaining blobs are considered output blobs.
   for (set<string>::iterator it = available_blobs.begin();
       it != available_blobs.end(); ++it) {
-    LOG(INFO) << "This network produces output " << *it;
+    LOG_IF(INFO, log_init_) << "This network produces output " << *it;
     net_output_blobs_.push_back(blobs_[blob_name_to_idx[*it]].get());
     net_output_blob_indices_.push_back(blob_name_to_idx[*it]);
   }
   for (size_t blob_id = 0; blob_id < blob_names_.size(); ++blob_id) {
     blob_names_index_[blob_names_[blob_id]] = blob_id;
   }
+  // Blobs renamed by PlanInPlace remain accessible by their original names.
+  blob_aliases_.clear();
+  for (map<string, string>::const_iterator it = blob_aliases.begin();
+       it != blob_aliases.end(); ++it) {
+    if (!blob_names_index_.count(it->first) &&
+        blob_names_index_.count(it->second)) {
+      blob_names_index_[it->first] = blob_names_index_[it->second];
+      blob_aliases_[it->first] = it->second;
+    }
+  }
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   GetLearningRateAndWeightDecay();
   debug_info_ = param.debug_info();
-  LOG(INFO) << "Network initialization done.";
-  LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
+  LOG_IF(INFO, log_init_) << "Network initialization done.";
+  LOG_IF(INFO, log_init_) << "Memory required for data: "
+                          << memory_used_ * sizeof(Dtype);
 }
 
 template <typename Dtype>
@@ -320,7 +392,8 @@ void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
   if (blob_name_to_idx && layer_param && layer_param->bottom_size() > top_id &&
       blob_name == layer_param->bottom(top_id)) {
     // In-place computation
-    LOG(INFO) << layer_param->name() << " -> " << blob_name << " (in-place)";
+    LOG_IF(INFO, log_init_) << layer_param->name() << " -> " << blob_name
+                            << " (in-place)";
     top_vecs_[layer_id].push_back(blobs_[(*blob_name_to_idx)[blob_name]].get());
     top_id_vecs_[layer_id].push_back((*blob_name_to_idx)[blob_name]);
   } else if (blob_name_to_idx &&
@@ -331,9 +404,9 @@ void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
   } else {
     // Normal output.
     if (layer_param) {
-      LOG(INFO) << layer_param->name() << " -> " << blob_name;
+      LOG_IF(INFO, log_init_) << layer_param->name() << " -> " << blob_name;
     } else {
-      LOG(INFO) << "Input " << top_id << " -> " << blob_name;
+      LOG_IF(INFO, log_init_) << "Input " << top_id << " -> " << blob_name;
     }
     shared_ptr<Blob<Dtype> > blob_pointer(new Blob<Dtype>());
     const int blob_id = blobs_.size();
@@ -342,6 +415,7 @@ void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
     blob_need_backward_.push_back(false);
     if (blob_name_to_idx) { (*blob_name_to_idx)[blob_name] = blob_id; }
     if (layer_id == -1) {
+      blob_pointer->set_memory_accounts(memory_account_, memory_account_);
       // Set the (explicitly specified) dimensions of the input blob.
       blob_pointer->Reshape(param.input_dim(top_id * 4),
                             param.input_dim(top_id * 4 + 1),
@@ -350,6 +424,9 @@ void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
       net_input_blob_indices_.push_back(blob_id);
       net_input_blobs_.push_back(blob_pointer.get());
     } else {
+      blob_pointer->set_memory_accounts(
+          category_memory_accounts_[layer_id][TOP_DATA],
+          category_memory_accounts_[layer_id][TOP_DIFF]);
       top_id_vecs_[layer_id].push_back(blob_id);
       top_vecs_[layer_id].push_back(blob_pointer.get());
     }
@@ -361,7 +438,8 @@ void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
 template <typename Dtype>
 int Net<Dtype>::AppendBottom(const NetParameter& param,
     const int layer_id, const int bottom_id,
-    set<string>* available_blobs, map<string, int>* blob_name_to_idx) {
+    set<string>* available_blobs, map<string, int>* blob_name_to_idx,
+    map<string, int>* blob_reads_left) {
   const LayerParameter& layer_param = param.layer(layer_id);
   const string& blob_name = layer_param.bottom(bottom_id);
   if (available_blobs->find(blob_name) == available_blobs->end()) {
@@ -369,10 +447,12 @@ int Net<Dtype>::AppendBottom(const NetParameter& param,
                << " (at index " << bottom_id << ") to layer " << layer_id;
   }
   const int blob_id = (*blob_name_to_idx)[blob_name];
-  LOG(INFO) << layer_names_[layer_id] << " <- " << blob_name;
+  LOG_IF(INFO, log_init_) << layer_names_[layer_id] << " <- " << blob_name;
   bottom_vecs_[layer_id].push_back(blobs_[blob_id].get());
   bottom_id_vecs_[layer_id].push_back(blob_id);
-  available_blobs->erase(blob_name);
+  if (--(*blob_reads_left)[blob_name] == 0) {
+    available_blobs->erase(blob_name);
+  }
   const bool need_backward = blob_need_backward_[blob_id];
   bottom_need_backward_[layer_id].push_back(need_backward);
   return blob_id;
@@ -413,9 +493,9 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
         param_layer_indices_[owner_net_param_id];
     const int owner_layer_id = owner_index.first;
     const int owner_param_id = owner_index.second;
-    LOG(INFO) << "Sharing parameters '" << param_name << "' owned by "
-              << "layer '" << layer_names_[owner_layer_id] << "', param "
-              << "index " << owner_param_id;
+    LOG_IF(INFO, log_init_) << "Sharing parameters '" << param_name
+        << "' owned by layer '" << layer_names_[owner_layer_id] << "', param "
+        << "index " << owner_param_id;
     Blob<Dtype>* this_blob = layers_[layer_id]->blobs()[param_id].get();
     Blob<Dtype>* owner_blob =
         layers_[owner_layer_id]->blobs()[owner_param_id].get();
@@ -441,6 +521,66 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+// The names of the Net::MemoryCategory values.
+static const char* kMemoryCategoryNames[] =
+    {"top_data", "top_diff", "param_data", "param_diff", "internal"};
+
+template <typename Dtype>
+void Net<Dtype>::AppendMemoryAccounts(const string& layer_name) {
+  shared_ptr<MemoryAccount> layer_account(
+      new MemoryAccount(layer_name, "total", memory_account_));
+  layer_memory_accounts_.push_back(layer_account);
+  category_memory_accounts_.push_back(vector<shared_ptr<MemoryAccount> >());
+  for (int i = 0; i < NUM_MEMORY_CATEGORIES; ++i) {
+    category_memory_accounts_.back().push_back(shared_ptr<MemoryAccount>(
+        new MemoryAccount(layer_name, kMemoryCategoryNames[i], layer_account)));
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::LogMemoryUsage() const {
+  LOG(INFO) << "Memory usage per layer, current (peak) bytes:";
+  vector<size_t> category_cpu_bytes(NUM_MEMORY_CATEGORIES, 0);
+  vector<size_t> category_peak_cpu_bytes(NUM_MEMORY_CATEGORIES, 0);
+  vector<size_t> category_gpu_bytes(NUM_MEMORY_CATEGORIES, 0);
+  vector<size_t> category_peak_gpu_bytes(NUM_MEMORY_CATEGORIES, 0);
+  for (int i = 0; i < layers_.size(); ++i) {
+    const MemoryAccount& layer_account = *layer_memory_accounts_[i];
+    ostringstream categories;
+    for (int j = 0; j < NUM_MEMORY_CATEGORIES; ++j) {
+      const MemoryAccount& account = *category_memory_accounts_[i][j];
+      category_cpu_bytes[j] += account.cpu_bytes();
+      category_peak_cpu_bytes[j] += account.peak_cpu_bytes();
+      category_gpu_bytes[j] += account.gpu_bytes();
+      category_peak_gpu_bytes[j] += account.peak_gpu_bytes();
+      if (account.peak_cpu_bytes() || account.peak_gpu_bytes()) {
+        categories << " " << account.category() << ": "
+            << account.cpu_bytes() << " (" << account.peak_cpu_bytes() << ")";
+      }
+    }
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << layer_names_[i]
+        << "\tcpu: " << layer_account.cpu_bytes()
+        << " (" << layer_account.peak_cpu_bytes() << ")"
+        << "\tgpu: " << layer_account.gpu_bytes()
+        << " (" << layer_account.peak_gpu_bytes() << ")"
+        << "\t[" << categories.str() << " ]";
+  }
+  // The peaks of different layers need not coincide, so the category peaks
+  // summed over layers are upper bounds.
+  LOG(INFO) << "Memory usage per category, current (peak) bytes:";
+  for (int j = 0; j < NUM_MEMORY_CATEGORIES; ++j) {
+    LOG(INFO) << std::setfill(' ') << std::setw(10) << kMemoryCategoryNames[j]
+        << "\tcpu: " << category_cpu_bytes[j]
+        << " (" << category_peak_cpu_bytes[j] << ")"
+        << "\tgpu: " << category_gpu_bytes[j]
+        << " (" << category_peak_gpu_bytes[j] << ")";
+  }
+  LOG(INFO) << "Total memory usage: cpu: " << memory_account_->cpu_bytes()
+      << " (" << memory_account_->peak_cpu_bytes() << ")"
+      << "\tgpu: " << memory_account_->gpu_bytes()
+      << " (" << memory_account_->peak_gpu_bytes() << ")";
+}
+
 template <typename Dtype>
 void Net<Dtype>::GetLearningRateAndWeightDecay() {
   LOG(INFO) << "Collecting Learning Rate and Weight Decay.";
@@ -467,13 +607,16 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
       InputDebugInfo(i);
     }
   }
+  const shared_ptr<MemoryAccount> previous_account = MemoryAccount::current();
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    MemoryAccount::set_current(category_memory_accounts_[i][INTERNAL]);
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  MemoryAccount::set_current(previous_account);
   return loss;
 }
 
@@ -532,14 +675,16 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  const shared_ptr<MemoryAccount> previous_account = MemoryAccount::current();
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
-      
+      MemoryAccount::set_current(category_memory_accounts_[i][INTERNAL]);
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
   }
+  MemoryAccount::set_current(previous_account);
 }
 
 template <typename Dtype>
@@ -682,9 +827,12 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  const shared_ptr<MemoryAccount> previous_account = MemoryAccount::current();
   for (int i = 0; i < layers_.size(); ++i) {
+    MemoryAccount::set_current(category_memory_accounts_[i][INTERNAL]);
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  MemoryAccount::set_current(previous_account);
 }
 
 template <typename Dtype>
@@ -719,11 +867,49 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  if (IsWeightMapFile(trained_filename)) {
+    MapTrainedLayersFrom(trained_filename);
+    return;
+  }
   NetParameter param;
   ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
   CopyTrainedLayersFrom(param);
 }
 
+template <typename Dtype>
+void Net<Dtype>::MapTrainedLayersFrom(const string& weight_map_filename) {
+  shared_ptr<WeightMap> weight_map(new WeightMap(weight_map_filename));
+  const WeightMapIndex& index = weight_map->index();
+  for (int i = 0; i < index.entry_size(); ++i) {
+    const WeightMapEntry& entry = index.entry(i);
+    if (!has_layer(entry.layer_name())) {
+      DLOG(INFO) << "Ignoring source layer " << entry.layer_name();
+      continue;
+    }
+    DLOG(INFO) << "Mapping source layer " << entry.layer_name();
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[layer_names_index_[entry.layer_name()]]->blobs();
+    CHECK_LT(entry.blob_index(), target_blobs.size())
+        << "Incompatible number of blobs for layer " << entry.layer_name();
+    Blob<Dtype>* target_blob = target_blobs[entry.blob_index()].get();
+    CHECK_EQ(target_blob->num(), entry.num());
+    CHECK_EQ(target_blob->channels(), entry.channels());
+    CHECK_EQ(target_blob->height(), entry.height());
+    CHECK_EQ(target_blob->width(), entry.width());
+    float* source_data = weight_map->mutable_data(entry);
+    if (sizeof(Dtype) == sizeof(float)) {
+      target_blob->set_cpu_data(reinterpret_cast<Dtype*>(source_data));
+    } else {
+      // The file stores floats, so other types still need a converting copy.
+      Dtype* target_data = target_blob->mutable_cpu_data();
+      for (int k = 0; k < target_blob->count(); ++k) {
+        target_data[k] = source_data[k];
+      }
+    }
+  }
+  weight_maps_.push_back(weight_map);
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
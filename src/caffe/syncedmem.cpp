@@ -1,4 +1,8 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <cstring>
+#include <string>
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
@@ -6,7 +10,96 @@
 
 namespace caffe {
 
+// The current account of each thread.
+static boost::thread_specific_ptr<shared_ptr<MemoryAccount> >
+    current_memory_account;
+
+MemoryAccount::MemoryAccount(const string& owner, const string& category,
+    const shared_ptr<MemoryAccount>& parent)
+    : owner_(owner), category_(category), parent_(parent), cpu_bytes_(0),
+      gpu_bytes_(0), peak_cpu_bytes_(0), peak_gpu_bytes_(0),
+      mutex_(new boost::mutex()) {}
+
+size_t MemoryAccount::cpu_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return cpu_bytes_;
+}
+
+size_t MemoryAccount::gpu_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return gpu_bytes_;
+}
+
+size_t MemoryAccount::peak_cpu_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return peak_cpu_bytes_;
+}
+
+size_t MemoryAccount::peak_gpu_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return peak_gpu_bytes_;
+}
+
+void MemoryAccount::ResetPeak() {
+  // Parents keep their own high-water marks; reset them separately.
+  boost::mutex::scoped_lock lock(*mutex_);
+  peak_cpu_bytes_ = cpu_bytes_;
+  peak_gpu_bytes_ = gpu_bytes_;
+}
+
+void MemoryAccount::Allocate(size_t cpu_bytes, size_t gpu_bytes) {
+  for (MemoryAccount* account = this; account;
+       account = account->parent_.get()) {
+    boost::mutex::scoped_lock lock(*account->mutex_);
+    account->cpu_bytes_ += cpu_bytes;
+    account->gpu_bytes_ += gpu_bytes;
+    account->peak_cpu_bytes_ =
+        std::max(account->peak_cpu_bytes_, account->cpu_bytes_);
+    account->peak_gpu_bytes_ =
+        std::max(account->peak_gpu_bytes_, account->gpu_bytes_);
+  }
+}
+
+void MemoryAccount::Free(size_t cpu_bytes, size_t gpu_bytes) {
+  for (MemoryAccount* account = this; account;
+       account = account->parent_.get()) {
+    boost::mutex::scoped_lock lock(*account->mutex_);
+    CHECK_GE(account->cpu_bytes_, cpu_bytes);
+    CHECK_GE(account->gpu_bytes_, gpu_bytes);
+    account->cpu_bytes_ -= cpu_bytes;
+    account->gpu_bytes_ -= gpu_bytes;
+  }
+}
+
+shared_ptr<MemoryAccount> MemoryAccount::current() {
+  const shared_ptr<MemoryAccount>* account = current_memory_account.get();
+  return account ? *account : shared_ptr<MemoryAccount>();
+}
+
+void MemoryAccount::set_current(const shared_ptr<MemoryAccount>& account) {
+  if (!current_memory_account.get()) {
+    current_memory_account.reset(new shared_ptr<MemoryAccount>());
+  }
+  *current_memory_account = account;
+}
+
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& base,
+    size_t offset, size_t size)
+    : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+      own_cpu_data_(false), base_(base), offset_(offset), version_(0) {
+  CHECK(base_);
+  // Views of views view the underlying memory directly.
+  if (base_->base_) {
+    offset_ += base_->offset_;
+    base_ = base_->base_;
+  }
+  CHECK_LE(offset_ + size_, base_->size_) << "view exceeds its base";
+}
+
 SyncedMemory::~SyncedMemory() {
+  if (account_) {
+    account_->Free(cpu_bytes(), gpu_bytes());
+  }
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_);
   }
@@ -25,12 +118,14 @@ inline void SyncedMemory::to_cpu() {
     caffe_memset(size_, 0, cpu_ptr_);
     head_ = HEAD_AT_CPU;
     own_cpu_data_ = true;
+    if (account_) { account_->Allocate(size_, 0); }
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
       CaffeMallocHost(&cpu_ptr_, size_);
       own_cpu_data_ = true;
+      if (account_) { account_->Allocate(size_, 0); }
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
     head_ = SYNCED;
@@ -51,10 +146,12 @@ inline void SyncedMemory::to_gpu() {
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
     caffe_gpu_memset(size_, 0, gpu_ptr_);
     head_ = HEAD_AT_GPU;
+    if (account_) { account_->Allocate(0, size_); }
     break;
   case HEAD_AT_CPU:
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
+      if (account_) { account_->Allocate(0, size_); }
     }
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
     head_ = SYNCED;
@@ -69,22 +166,31 @@ inline void SyncedMemory::to_gpu() {
 }
 
 const void* SyncedMemory::cpu_data() {
+  if (base_) {
+    return static_cast<const char*>(base_->cpu_data()) + offset_;
+  }
   to_cpu();
   return (const void*)cpu_ptr_;
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
   CHECK(data);
+  CHECK(!base_) << "cannot set the data of a view";
   if (own_cpu_data_) {
+    if (account_) { account_->Free(size_, 0); }
     CaffeFreeHost(cpu_ptr_);
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
 #ifndef CPU_ONLY
+  if (base_) {
+    return static_cast<const char*>(base_->gpu_data()) + offset_;
+  }
   to_gpu();
   return (const void*)gpu_ptr_;
 #else
@@ -93,21 +199,45 @@ const void* SyncedMemory::gpu_data() {
 }
 
 void* SyncedMemory::mutable_cpu_data() {
+  if (base_) {
+    return static_cast<char*>(base_->mutable_cpu_data()) + offset_;
+  }
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
 void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
+  if (base_) {
+    return static_cast<char*>(base_->mutable_gpu_data()) + offset_;
+  }
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
 #endif
 }
 
+bool SyncedMemory::is_view_of(const SyncedMemory& base, size_t offset) const {
+  if (base.base_) {
+    return base_ == base.base_ && offset_ == base.offset_ + offset;
+  }
+  return base_.get() == &base && offset_ == offset;
+}
+
+void SyncedMemory::set_account(const shared_ptr<MemoryAccount>& account) {
+  if (account_) {
+    account_->Free(cpu_bytes(), gpu_bytes());
+  }
+  account_ = account;
+  if (account_) {
+    account_->Allocate(cpu_bytes(), gpu_bytes());
+  }
+}
 
 }  // namespace caffe
 
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <cstring>
+#include <functional>
+#include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -137,4 +140,51 @@ TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopK) {
               num_correct_labels / 100.0, 1e-4);
 }
 
+TYPED_TEST(AccuracyLayerTest, TestForwardCPUTiesThreads) {
+  // Many equal scores, some labels ignored, and enough classes to spread the
+  // inputs over threads.
+  const int num = 100;
+  const int dim = 1000;
+  Blob<TypeParam> data(num, dim, 1, 1);
+  for (int i = 0; i < data.count(); ++i) {
+    data.mutable_cpu_data()[i] = (i * 7919) % 5;
+  }
+  vector<Blob<TypeParam>*> bottom_vec(1, &data);
+  bottom_vec.push_back(this->blob_bottom_label_);
+  LayerParameter layer_param;
+  layer_param.mutable_accuracy_param()->set_top_k(this->top_k_);
+  for (int ignore_mode = 0; ignore_mode <= 3; ++ignore_mode) {
+    if (ignore_mode > 0) {
+      layer_param.mutable_loss_param()->set_ignore_label(5);
+      layer_param.mutable_loss_param()->set_ignore_mode(ignore_mode);
+    }
+    AccuracyLayer<TypeParam> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    Caffe::set_num_threads(3);
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    Caffe::set_num_threads(1);
+    // The ranking of the layer before it was threaded.
+    int num_correct_labels = 0;
+    for (int i = 0; i < num; ++i) {
+      vector<std::pair<TypeParam, int> > pairs;
+      for (int j = 0; j < dim; ++j) {
+        const bool ignored = (ignore_mode == 1 && j > 5) ||
+            (ignore_mode == 2 && j == 5) || (ignore_mode == 3 && j < 5);
+        pairs.push_back(std::make_pair(
+            ignored ? TypeParam(-9999) : data.data_at(i, j, 0, 0), j));
+      }
+      std::partial_sort(pairs.begin(), pairs.begin() + this->top_k_,
+          pairs.end(), std::greater<std::pair<TypeParam, int> >());
+      for (int k = 0; k < this->top_k_; ++k) {
+        if (pairs[k].second == this->blob_bottom_label_->data_at(i, 0, 0, 0)) {
+          ++num_correct_labels;
+        }
+      }
+    }
+    EXPECT_NEAR(this->blob_top_->data_at(0, 0, 0, 0),
+                num_correct_labels / 100.0, 1e-4)
+        << "ignore_mode = " << ignore_mode;
+  }
+}
+
 }  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <functional>
 #include <utility>
 #include <vector>
 
@@ -166,4 +168,60 @@ TYPED_TEST(ArgMaxLayerTest, TestCPUMaxValTopK) {
 }
 
 
+TYPED_TEST(ArgMaxLayerTest, TestCPUAxis) {
+  // The top k classes of each pixel, with ties, over threads.
+  Blob<TypeParam> bottom(2, 20, 40, 30);
+  for (int i = 0; i < bottom.count(); ++i) {
+    bottom.mutable_cpu_data()[i] = (i * 7919) % 7;
+  }
+  vector<Blob<TypeParam>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ArgMaxParameter* argmax_param = layer_param.mutable_argmax_param();
+  argmax_param->set_top_k(this->top_k_);
+  argmax_param->set_axis(1);
+  ArgMaxLayer<TypeParam> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  EXPECT_EQ(2, this->blob_top_->num());
+  EXPECT_EQ(this->top_k_, this->blob_top_->channels());
+  EXPECT_EQ(40, this->blob_top_->height());
+  EXPECT_EQ(30, this->blob_top_->width());
+  Caffe::set_num_threads(3);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  Caffe::set_num_threads(1);
+  for (int n = 0; n < 2; ++n) {
+    for (int h = 0; h < 40; ++h) {
+      for (int w = 0; w < 30; ++w) {
+        vector<std::pair<TypeParam, int> > pairs;
+        for (int c = 0; c < 20; ++c) {
+          pairs.push_back(std::make_pair(bottom.data_at(n, c, h, w), c));
+        }
+        std::partial_sort(pairs.begin(), pairs.begin() + this->top_k_,
+            pairs.end(), std::greater<std::pair<TypeParam, int> >());
+        for (int j = 0; j < this->top_k_; ++j) {
+          EXPECT_EQ(pairs[j].second, this->blob_top_->data_at(n, j, h, w));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ArgMaxLayerTest, TestCPUAxisMaxVal) {
+  LayerParameter layer_param;
+  ArgMaxParameter* argmax_param = layer_param.mutable_argmax_param();
+  argmax_param->set_out_max_val(true);
+  argmax_param->set_axis(-4);
+  ArgMaxLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, this->blob_top_->num());
+  EXPECT_EQ(20, this->blob_top_->channels());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int c = 0; c < 20; ++c) {
+    TypeParam max_val = this->blob_bottom_->data_at(0, c, 0, 0);
+    for (int n = 1; n < 10; ++n) {
+      max_val = std::max(max_val, this->blob_bottom_->data_at(n, c, 0, 0));
+    }
+    EXPECT_EQ(max_val, this->blob_top_->data_at(0, c, 0, 0));
+  }
+}
+
 }  // namespace caffe
@@ -54,6 +54,30 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareView) {
+  this->blob_->Reshape(1, 2, 4, 5);
+  this->blob_->ShareData(*this->blob_preshaped_, 40);
+  this->blob_->ShareDiff(*this->blob_preshaped_, 80);
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  TypeParam* diff = this->blob_preshaped_->mutable_cpu_diff();
+  EXPECT_EQ(data + 40, this->blob_->cpu_data());
+  EXPECT_EQ(diff + 80, this->blob_->cpu_diff());
+  this->blob_->mutable_cpu_data()[0] = 3;
+  EXPECT_EQ(3, data[40]);
+  // Sharing the same view again keeps it.
+  shared_ptr<SyncedMemory> view = this->blob_->data();
+  this->blob_->ShareData(*this->blob_preshaped_, 40);
+  EXPECT_EQ(view, this->blob_->data());
+  // Growing past the view allocates new memory.
+  this->blob_->Reshape(1, 3, 4, 5);
+  EXPECT_NE(data + 40, this->blob_->cpu_data());
+  EXPECT_EQ(3, data[40]);
+  // So does reallocating.
+  this->blob_->ShareData(*this->blob_preshaped_, 40);
+  this->blob_->Reallocate();
+  EXPECT_NE(data + 40, this->blob_->cpu_data());
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -119,4 +119,106 @@ TYPED_TEST(ConcatLayerTest, TestGradient) {
     this->blob_top_vec_);
 }
 
+TYPED_TEST(ConcatLayerTest, TestShareBottomsNum) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_concat_dim(0);
+  layer_param.mutable_concat_param()->set_share_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_1, this->blob_top_vec_);
+  // The first pass copies the bottoms and makes them views of the top.
+  layer.Forward(this->blob_bottom_vec_1, this->blob_top_vec_);
+  const int count_0 = this->blob_bottom_0->count();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  EXPECT_EQ(top_data, this->blob_bottom_0->cpu_data());
+  EXPECT_EQ(top_data + count_0, this->blob_bottom_2->cpu_data());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(i < count_0 ? 1 : 3, top_data[i]);
+  }
+  // Later writes to the bottoms land in the top.
+  caffe_set(this->blob_bottom_2->count(), Dtype(4),
+      this->blob_bottom_2->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_1, this->blob_top_vec_);
+  EXPECT_EQ(top_data, this->blob_top_->cpu_data());
+  for (int i = count_0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(4, top_data[i]);
+  }
+  caffe_set(this->blob_top_->count(), Dtype(5),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(2, true);
+  layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_1);
+  EXPECT_EQ(this->blob_top_->cpu_diff() + count_0,
+      this->blob_bottom_2->cpu_diff());
+  for (int i = 0; i < this->blob_bottom_0->count(); ++i) {
+    EXPECT_EQ(5, this->blob_bottom_0->cpu_diff()[i]);
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestShareBottomsAfterReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_concat_dim(0);
+  layer_param.mutable_concat_param()->set_share_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_1, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1, this->blob_top_vec_);
+  // Growing the first bottom into memory of its own and shrinking the second
+  // one keeps the size of the top but moves the range of the second bottom,
+  // whose producer writes into its old range before the layer reshapes.
+  this->blob_bottom_0->Reshape(3, 3, 6, 5);
+  this->blob_bottom_2->Reshape(4, 3, 6, 5);
+  caffe_set(this->blob_bottom_0->count(), Dtype(6),
+      this->blob_bottom_0->mutable_cpu_data());
+  for (int i = 0; i < this->blob_bottom_2->count(); ++i) {
+    this->blob_bottom_2->mutable_cpu_data()[i] = i;
+  }
+  layer.Reshape(this->blob_bottom_vec_1, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_1, this->blob_top_vec_);
+  // The top is the same as without sharing, and the bottoms are views again.
+  const int count_0 = this->blob_bottom_0->count();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  ASSERT_EQ(count_0 + this->blob_bottom_2->count(), this->blob_top_->count());
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(i < count_0 ? 6 : i - count_0, top_data[i]);
+  }
+  EXPECT_EQ(top_data + count_0, this->blob_bottom_2->cpu_data());
+}
+
+TYPED_TEST(ConcatLayerTest, TestShareBottomsChannels) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_share_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  // Channels of several images are not contiguous: the layer copies.
+  layer.SetUp(this->blob_bottom_vec_0, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_0, this->blob_top_vec_);
+  EXPECT_NE(this->blob_top_->cpu_data(), this->blob_bottom_0->cpu_data());
+  // Those of a single image are.
+  this->blob_bottom_0->Reshape(1, 3, 6, 5);
+  this->blob_bottom_1->Reshape(1, 5, 6, 5);
+  caffe_set(this->blob_bottom_1->count(), Dtype(2),
+      this->blob_bottom_1->mutable_cpu_data());
+  layer.Reshape(this->blob_bottom_vec_0, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_0, this->blob_top_vec_);
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  EXPECT_EQ(top_data, this->blob_bottom_0->cpu_data());
+  EXPECT_EQ(top_data + this->blob_bottom_0->count(),
+      this->blob_bottom_1->cpu_data());
+  for (int c = 0; c < this->blob_top_->channels(); ++c) {
+    EXPECT_EQ(c < 3 ? 1 : 2, this->blob_top_->data_at(0, c, 2, 3));
+  }
+}
+
+TYPED_TEST(ConcatLayerTest, TestGradientShareBottoms) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_concat_dim(0);
+  layer_param.mutable_concat_param()->set_share_bottoms(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, this->blob_bottom_vec_1,
+    this->blob_top_vec_);
+}
+
 }  // namespace caffe
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -137,6 +138,55 @@ TYPED_TEST(DeconvolutionLayerTest, TestSimpleDeconvolution) {
   }
 }
 
+TYPED_TEST(DeconvolutionLayerTest, TestChannelwiseDeconvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A deconvolution with a group per channel against the same one with a
+  // single group and zero weights across channels, over threads.
+  const int shapes[][6] = {  // kernel_h, kernel_w, stride_h, stride_w, pads
+    {4, 4, 2, 2, 1, 1}, {5, 3, 3, 2, 1, 0}, {3, 3, 1, 1, 1, 1},
+    {2, 2, 3, 3, 0, 0}, {64, 64, 32, 32, 16, 16}};
+  const int channels = this->blob_bottom_->channels();
+  for (int i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_kernel_h(shapes[i][0]);
+    convolution_param->set_kernel_w(shapes[i][1]);
+    convolution_param->set_stride_h(shapes[i][2]);
+    convolution_param->set_stride_w(shapes[i][3]);
+    convolution_param->set_pad_h(shapes[i][4]);
+    convolution_param->set_pad_w(shapes[i][5]);
+    convolution_param->set_num_output(channels);
+    convolution_param->set_group(channels);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    DeconvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    convolution_param->set_group(1);
+    DeconvolutionLayer<Dtype> dense_layer(layer_param);
+    vector<Blob<Dtype>*> dense_top_vec(1, this->blob_top_2_);
+    dense_layer.SetUp(this->blob_bottom_vec_, dense_top_vec);
+    const int kernel_dim = shapes[i][0] * shapes[i][1];
+    Dtype* dense_weights = dense_layer.blobs()[0]->mutable_cpu_data();
+    caffe_set(dense_layer.blobs()[0]->count(), Dtype(0), dense_weights);
+    for (int c = 0; c < channels; ++c) {
+      caffe_copy(kernel_dim, layer.blobs()[0]->cpu_data() + c * kernel_dim,
+          dense_weights + (c * channels + c) * kernel_dim);
+    }
+    caffe_copy(channels, layer.blobs()[1]->cpu_data(),
+        dense_layer.blobs()[1]->mutable_cpu_data());
+    Caffe::set_num_threads(3);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Caffe::set_num_threads(1);
+    dense_layer.Forward(this->blob_bottom_vec_, dense_top_vec);
+    ASSERT_EQ(this->blob_top_2_->count(), this->blob_top_->count());
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(this->blob_top_2_->cpu_data()[j],
+          this->blob_top_->cpu_data()[j], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(DeconvolutionLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -206,4 +207,54 @@ TYPED_TEST(EltwiseLayerTest, TestMaxGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(EltwiseLayerTest, TestMaxThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Four inputs with many ties, large enough to be split over the threads,
+  // in the TRAIN phase, with the index of each maximum, and the TEST one,
+  // whose backward pass has to find those indices again.
+  const int count = 3 * 17 * 31 * 37;
+  vector<shared_ptr<Blob<Dtype> > > bottoms;
+  vector<Blob<Dtype>*> bottom_vec;
+  for (int j = 0; j < 4; ++j) {
+    bottoms.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(3, 17, 31, 37)));
+    for (int i = 0; i < count; ++i) {
+      bottoms[j]->mutable_cpu_data()[i] = (i * 7919 + j * 104729) % 3;
+    }
+    bottom_vec.push_back(bottoms[j].get());
+  }
+  LayerParameter layer_param;
+  layer_param.mutable_eltwise_param()->set_operation(
+      EltwiseParameter_EltwiseOp_MAX);
+  for (int phase = TRAIN; phase <= TEST; ++phase) {
+    layer_param.set_phase(static_cast<Phase>(phase));
+    EltwiseLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    Caffe::set_num_threads(3);
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    Caffe::set_num_threads(1);
+    for (int i = 0; i < count; ++i) {
+      Dtype expected = bottoms[0]->cpu_data()[i];
+      for (int j = 1; j < 4; ++j) {
+        expected = std::max(expected, bottoms[j]->cpu_data()[i]);
+      }
+      EXPECT_EQ(expected, this->blob_top_->cpu_data()[i]);
+    }
+    // The gradient goes to the input of each maximum.
+    caffe_set(count, Dtype(1), this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, vector<bool>(4, true), bottom_vec);
+    for (int i = 0; i < count; ++i) {
+      int expected = bottoms[0]->cpu_data()[i] > bottoms[1]->cpu_data()[i] ?
+          0 : 1;
+      for (int j = 2; j < 4; ++j) {
+        if (bottoms[j]->cpu_data()[i] > bottoms[expected]->cpu_data()[i]) {
+          expected = j;
+        }
+      }
+      for (int j = 0; j < 4; ++j) {
+        EXPECT_EQ(j == expected, bottoms[j]->cpu_diff()[i]);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,196 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fuse_activations.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class FuseActivationsTest : public ::testing::Test {
+ protected:
+  void RunFuseTest(const string& input_param_string,
+      const string& output_param_string) {
+    // Test that FuseActivations called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    FuseActivations(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_fuse_param;
+    FuseActivations(actual_output_param, &double_fuse_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+        double_fuse_param.DebugString());
+  }
+};
+
+TEST_F(FuseActivationsTest, TestFuseInTestPhase) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+      "  relu_param { negative_slope: 0.1 } } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'conv1' top: 'conv2' } "
+      "layer { name: 'thresh' type: 'Threshold' bottom: 'conv2' "
+      "  top: 'conv2' threshold_param { threshold: 0.5 } } ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' "
+      "  convolution_param { fused_activation: RELU } "
+      "  relu_param { negative_slope: 0.1 } } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'conv1' top: 'conv2' "
+      "  convolution_param { fused_activation: THRESHOLD } "
+      "  threshold_param { threshold: 0.5 } } ";
+  this->RunFuseTest(input_proto, expected_output_proto);
+}
+
+TEST_F(FuseActivationsTest, TestNoFuse) {
+  // The first ReLU does not compute in place, the pooling layer reads the
+  // convolution output before the second ReLU, and the sigmoid cannot be
+  // fused.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'relu1' } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'relu1' top: 'conv2' } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'conv2' top: 'pool' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' } "
+      "layer { name: 'conv3' type: 'Convolution' "
+      "  bottom: 'conv2' top: 'conv3' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'conv3' "
+      "  top: 'conv3' } ";
+  this->RunFuseTest(input_proto, input_proto);
+}
+
+TEST_F(FuseActivationsTest, TestNoFuseWithBackward) {
+  // Without an explicit TEST phase, or with force_backward, the net may be
+  // run backward.
+  const string& layers =
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } ";
+  this->RunFuseTest("name: 'TestNetwork' " + layers,
+      "name: 'TestNetwork' " + layers);
+  this->RunFuseTest(
+      "name: 'TestNetwork' force_backward: true state { phase: TEST } "
+      + layers,
+      "name: 'TestNetwork' force_backward: true state { phase: TEST } "
+      + layers);
+}
+
+template <typename TypeParam>
+class FuseActivationsNetTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  void InitParam(bool fuse_activations, NetParameter* param) {
+    const string& proto =
+        "name: 'TestNetwork' "
+        "layer { name: 'data' type: 'DummyData' top: 'data' "
+        "  dummy_data_param { num: 2 channels: 3 height: 6 width: 5 "
+        "    data_filler { type: 'gaussian' std: 1 } } } "
+        "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv1' convolution_param { num_output: 4 kernel_size: 3 "
+        "    pad: 1 weight_filler { type: 'gaussian' std: 1 } "
+        "    bias_filler { type: 'gaussian' std: 1 } } } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'relu1' "
+        "  relu_param { negative_slope: 0.1 } } "
+        "layer { name: 'conv2' type: 'Convolution' bottom: 'relu1' "
+        "  top: 'conv2' convolution_param { num_output: 3 kernel_size: 2 "
+        "    engine: WINOGRAD weight_filler { type: 'gaussian' std: 1 } } } "
+        "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'relu2' } "
+        "layer { name: 'conv3' type: 'Convolution' bottom: 'relu2' "
+        "  top: 'conv3' convolution_param { num_output: 2 kernel_size: 3 "
+        "    pad: 1 engine: WINOGRAD "
+        "    weight_filler { type: 'gaussian' std: 1 } "
+        "    bias_filler { type: 'gaussian' std: 1 } } } "
+        "layer { name: 'thresh' type: 'Threshold' bottom: 'conv3' "
+        "  top: 'thresh' } "
+        "layer { name: 'silence' type: 'Silence' bottom: 'thresh' } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, param));
+    param->mutable_state()->set_phase(TEST);
+    param->set_plan_in_place(true);
+    param->set_fuse_activations(fuse_activations);
+  }
+
+  void ForwardAndCompare(Net<Dtype>* fused_net, Net<Dtype>* unfused_net) {
+    // DummyData refills its gaussian data on every forward pass.
+    vector<Blob<Dtype>*> bottom;
+    Caffe::set_random_seed(1702);
+    fused_net->Forward(bottom);
+    Caffe::set_random_seed(1702);
+    unfused_net->Forward(bottom);
+    const char* blob_names[] = {"relu1", "relu2", "thresh"};
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_TRUE(fused_net->has_blob(blob_names[i]));
+      const Blob<Dtype>& fused = *fused_net->blob_by_name(blob_names[i]);
+      const Blob<Dtype>& unfused = *unfused_net->blob_by_name(blob_names[i]);
+      ASSERT_EQ(unfused.count(), fused.count());
+      for (int j = 0; j < fused.count(); ++j) {
+        EXPECT_EQ(unfused.cpu_data()[j], fused.cpu_data()[j]);
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(FuseActivationsNetTest, TestDtypesAndDevices);
+
+TYPED_TEST(FuseActivationsNetTest, TestForwardMatchesUnfused) {
+  typedef typename TypeParam::Dtype Dtype;
+  NetParameter param;
+  this->InitParam(true, &param);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> fused_net(param);
+  this->InitParam(false, &param);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> unfused_net(param);
+  EXPECT_EQ(unfused_net.layers().size() - 3, fused_net.layers().size());
+  this->ForwardAndCompare(&fused_net, &unfused_net);
+}
+
+#ifndef CPU_ONLY
+TYPED_TEST(FuseActivationsNetTest, TestGPUForwardAfterCPUInit) {
+  // Fusion is decided when the net is built, so a net built in CPU mode must
+  // still apply its fused activations when run in GPU mode.
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter param;
+  this->InitParam(true, &param);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> fused_net(param);
+  this->InitParam(false, &param);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> unfused_net(param);
+  Caffe::set_mode(Caffe::GPU);
+  this->ForwardAndCompare(&fused_net, &unfused_net);
+}
+#endif
+
+}  // namespace caffe
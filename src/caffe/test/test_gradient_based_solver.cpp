@@ -162,10 +162,10 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     for (int i = 0; i <= D; ++i) {
       // Compute the derivative with respect to the ith weight (i.e., the ith
       // element of the gradient).
-      Dtype grad = 0;
+      double grad = 0;
       for (int j = 0; j <= D; ++j) {
         // Compute element (i, j) of X^T * X.
-        Dtype element = 0;
+        double element = 0;
         for (int k = 0; k < N; ++k) {
           // (i, k) in X^T (== (k, i) in X) times (k, j) in X.
           const Dtype element_i = (i == D) ? 1 : data.cpu_data()[k * D + i];
@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/im2col.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -115,4 +116,124 @@ TYPED_TEST(Im2colLayerTest, TestRectGradient) {
       this->blob_top_vec_);
 }
 
+// Reference im2col and col2im for checking results: one bounds checked
+// element at a time.
+template <typename Dtype>
+void reference_im2col(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_col) {
+  int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  int channels_col = channels * kernel_h * kernel_w;
+  for (int c = 0; c < channels_col; ++c) {
+    int w_offset = c % kernel_w;
+    int h_offset = (c / kernel_w) % kernel_h;
+    int c_im = c / kernel_h / kernel_w;
+    for (int h = 0; h < height_col; ++h) {
+      for (int w = 0; w < width_col; ++w) {
+        int h_pad = h * stride_h - pad_h + h_offset;
+        int w_pad = w * stride_w - pad_w + w_offset;
+        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
+          data_col[(c * height_col + h) * width_col + w] =
+            data_im[(c_im * height + h_pad) * width + w_pad];
+        else
+          data_col[(c * height_col + h) * width_col + w] = 0;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void reference_col2im(const Dtype* data_col, const int channels,
+    const int height, const int width, const int patch_h, const int patch_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    Dtype* data_im) {
+  memset(data_im, 0, sizeof(Dtype) * height * width * channels);
+  int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
+  int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
+  int channels_col = channels * patch_h * patch_w;
+  for (int c = 0; c < channels_col; ++c) {
+    int w_offset = c % patch_w;
+    int h_offset = (c / patch_w) % patch_h;
+    int c_im = c / patch_h / patch_w;
+    for (int h = 0; h < height_col; ++h) {
+      for (int w = 0; w < width_col; ++w) {
+        int h_pad = h * stride_h - pad_h + h_offset;
+        int w_pad = w * stride_w - pad_w + w_offset;
+        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
+          data_im[(c_im * height + h_pad) * width + w_pad] +=
+              data_col[(c * height_col + h) * width_col + w];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+class Im2colCPUTest : public ::testing::Test {
+ protected:
+  Im2colCPUTest() {}
+
+  // Checks im2col_cpu and col2im_cpu against the reference implementations
+  // on a random channels x height x width image.
+  void Check(int channels, int height, int width, int kernel_h, int kernel_w,
+      int pad_h, int pad_w, int stride_h, int stride_w) {
+    Blob<Dtype> image(1, channels, height, width);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&image);
+    const int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+    const int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+    Blob<Dtype> col(1, channels * kernel_h * kernel_w, height_col, width_col);
+    Blob<Dtype> ref_col(1, col.channels(), height_col, width_col);
+    im2col_cpu(image.cpu_data(), channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, col.mutable_cpu_data());
+    reference_im2col(image.cpu_data(), channels, height, width, kernel_h,
+        kernel_w, pad_h, pad_w, stride_h, stride_w,
+        ref_col.mutable_cpu_data());
+    for (int i = 0; i < col.count(); ++i) {
+      EXPECT_EQ(ref_col.cpu_data()[i], col.cpu_data()[i]);
+    }
+    // Fill the image with garbage to check that col2im overwrites it.
+    filler.Fill(&image);
+    Blob<Dtype> ref_image(1, channels, height, width);
+    col2im_cpu(col.cpu_data(), channels, height, width, kernel_h, kernel_w,
+        pad_h, pad_w, stride_h, stride_w, image.mutable_cpu_data());
+    reference_col2im(col.cpu_data(), channels, height, width, kernel_h,
+        kernel_w, pad_h, pad_w, stride_h, stride_w,
+        ref_image.mutable_cpu_data());
+    for (int i = 0; i < image.count(); ++i) {
+      EXPECT_EQ(ref_image.cpu_data()[i], image.cpu_data()[i]);
+    }
+  }
+};
+
+TYPED_TEST_CASE(Im2colCPUTest, TestDtypes);
+
+TYPED_TEST(Im2colCPUTest, TestStride1) {
+  this->Check(3, 6, 5, 3, 3, 1, 1, 1, 1);
+  this->Check(3, 6, 5, 1, 1, 0, 0, 1, 1);
+  this->Check(2, 7, 9, 5, 3, 2, 1, 1, 1);
+}
+
+TYPED_TEST(Im2colCPUTest, TestStrided) {
+  this->Check(3, 6, 5, 3, 3, 0, 0, 2, 2);
+  this->Check(3, 11, 10, 5, 3, 2, 1, 3, 2);
+  this->Check(2, 8, 8, 3, 3, 1, 1, 2, 1);
+}
+
+TYPED_TEST(Im2colCPUTest, TestLargePadding) {
+  // Some taps fall entirely into the padding.
+  this->Check(2, 4, 3, 2, 2, 3, 3, 1, 1);
+  this->Check(2, 4, 3, 2, 3, 3, 2, 3, 2);
+}
+
+TYPED_TEST(Im2colCPUTest, TestThreads) {
+  // Large enough for the channels to be spread over the threads.
+  Caffe::set_num_threads(3);
+  this->Check(8, 32, 31, 3, 3, 1, 1, 1, 1);
+  this->Check(7, 33, 32, 3, 3, 0, 1, 2, 2);
+  Caffe::set_num_threads(1);
+}
+
 }  // namespace caffe
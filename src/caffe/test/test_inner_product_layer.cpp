@@ -6,6 +6,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -85,6 +87,180 @@ TYPED_TEST(InnerProductLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardSmallBatch) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Batches of 1 to 5 inputs in both phases, over several threads, against
+  // the outputs of a layer computing a batch of 6.
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(19);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<Dtype> bottom(6, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  InnerProductLayer<Dtype> reference_layer(layer_param);
+  reference_layer.SetUp(bottom_vec, this->blob_top_vec_);
+  Caffe::set_num_threads(3);
+  for (int phase = TRAIN; phase <= TEST; ++phase) {
+    for (int bias_term = 0; bias_term < 2; ++bias_term) {
+      inner_product_param->set_bias_term(bias_term);
+      layer_param.set_phase(static_cast<Phase>(phase));
+      reference_layer.Forward(bottom_vec, this->blob_top_vec_);
+      InnerProductLayer<Dtype> layer(layer_param);
+      Blob<Dtype> small_bottom;
+      vector<Blob<Dtype>*> small_bottom_vec(1, &small_bottom);
+      Blob<Dtype> small_top;
+      vector<Blob<Dtype>*> small_top_vec(1, &small_top);
+      for (int num = 1; num <= 5; ++num) {
+        small_bottom.Reshape(num, 3, 4, 5);
+        caffe_copy(small_bottom.count(), bottom.cpu_data(),
+            small_bottom.mutable_cpu_data());
+        if (num == 1) {
+          layer.SetUp(small_bottom_vec, small_top_vec);
+          layer.blobs()[0]->ShareData(*reference_layer.blobs()[0]);
+          if (bias_term) {
+            layer.blobs()[1]->ShareData(*reference_layer.blobs()[1]);
+          }
+        }
+        layer.Reshape(small_bottom_vec, small_top_vec);
+        layer.Forward(small_bottom_vec, small_top_vec);
+        for (int i = 0; i < small_top.count(); ++i) {
+          const Dtype expected = this->blob_top_->cpu_data()[i] -
+              (bias_term ? Dtype(0) :
+               reference_layer.blobs()[1]->cpu_data()[i % 19]);
+          EXPECT_NEAR(expected, small_top.cpu_data()[i], 1e-4)
+              << "phase " << phase << ", num " << num;
+        }
+      }
+    }
+  }
+  // Writing the weights repacks them.
+  layer_param.set_phase(TEST);
+  inner_product_param->set_bias_term(true);
+  InnerProductLayer<Dtype> layer(layer_param);
+  Blob<Dtype> small_bottom(1, 3, 4, 5);
+  caffe_copy(small_bottom.count(), bottom.cpu_data(),
+      small_bottom.mutable_cpu_data());
+  vector<Blob<Dtype>*> small_bottom_vec(1, &small_bottom);
+  layer.SetUp(small_bottom_vec, this->blob_top_vec_);
+  layer.Forward(small_bottom_vec, this->blob_top_vec_);
+  caffe_scal(layer.blobs()[0]->count(), Dtype(2),
+      layer.blobs()[0]->mutable_cpu_data());
+  vector<Dtype> expected(19);
+  for (int j = 0; j < 19; ++j) {
+    expected[j] = 2 * this->blob_top_->cpu_data()[j] -
+        layer.blobs()[1]->cpu_data()[j];
+  }
+  layer.Forward(small_bottom_vec, this->blob_top_vec_);
+  for (int j = 0; j < 19; ++j) {
+    EXPECT_NEAR(expected[j], this->blob_top_->cpu_data()[j], 1e-4);
+  }
+  Caffe::set_num_threads(1);
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Small batches against a layer whose weights are rounded to half
+  // precision.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(19);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<Dtype> bottom(4, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  InnerProductLayer<Dtype> reference_layer(layer_param);
+  reference_layer.SetUp(bottom_vec, this->blob_top_vec_);
+  Blob<Dtype>& weights = *reference_layer.blobs()[0];
+  vector<uint16_t> half_weights(weights.count());
+  caffe_cpu_to_half(weights.count(), weights.cpu_data(), &half_weights[0]);
+  inner_product_param->set_half_weights(true);
+  InnerProductLayer<Dtype> layer(layer_param);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  layer.SetUp(bottom_vec, top_vec);
+  layer.blobs()[0]->ShareData(weights);
+  layer.blobs()[1]->ShareData(*reference_layer.blobs()[1]);
+  Caffe::set_num_threads(3);
+  layer.Forward(bottom_vec, top_vec);
+  caffe_cpu_from_half(weights.count(), &half_weights[0],
+      weights.mutable_cpu_data());
+  reference_layer.Forward(bottom_vec, this->blob_top_vec_);
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top.cpu_data()[i], 1e-4);
+  }
+  Caffe::set_num_threads(1);
+}
+
+TYPED_TEST(InnerProductLayerTest, TestHalfWeightsDropFloatWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // A layer owning its weights frees them once packed in half precision,
+  // and brings them back for larger batches and ToProto.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(19);
+  inner_product_param->set_half_weights(true);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  Blob<Dtype> bottom(2, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  InnerProductLayer<Dtype> layer(layer_param);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  layer.SetUp(bottom_vec, top_vec);
+  Blob<Dtype> weights;
+  weights.CopyFrom(*layer.blobs()[0], false, true);
+  vector<uint16_t> half_weights(weights.count());
+  caffe_cpu_to_half(weights.count(), weights.cpu_data(), &half_weights[0]);
+  caffe_cpu_from_half(weights.count(), &half_weights[0],
+      weights.mutable_cpu_data());
+  layer.Forward(bottom_vec, top_vec);
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, layer.blobs()[0]->data()->head());
+  LayerParameter saved_param;
+  layer.ToProto(&saved_param);
+  ASSERT_EQ(weights.count(), saved_param.blobs(0).data_size());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], saved_param.blobs(0).data(i));
+  }
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, layer.blobs()[0]->data()->head());
+  // A batch too large for the panels uses the (rounded) float weights.
+  bottom.Reshape(6, 3, 4, 5);
+  filler.Fill(&bottom);
+  layer.Reshape(bottom_vec, top_vec);
+  layer.Forward(bottom_vec, top_vec);
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], layer.blobs()[0]->cpu_data()[i]);
+  }
+  const Dtype* bias = layer.blobs()[1]->cpu_data();
+  for (int b = 0; b < 6; ++b) {
+    for (int j = 0; j < 19; ++j) {
+      Dtype expected = bias[j];
+      for (int i = 0; i < 60; ++i) {
+        expected += bottom.cpu_data()[b * 60 + i] *
+            weights.cpu_data()[j * 60 + i];
+      }
+      EXPECT_NEAR(expected, top.cpu_data()[b * 19 + j], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   bool IS_VALID_CUDA = false;
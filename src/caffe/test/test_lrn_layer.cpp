@@ -159,6 +159,43 @@ TYPED_TEST(LRNLayerTest, TestGradientAcrossChannels) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // More threads than images: the pixels of each image are split as well.
+  Caffe::set_num_threads(3);
+  for (int beta = 0; beta < 3; ++beta) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    layer_param.mutable_lrn_param()->set_beta(Dtype(0.5 + 0.1 * beta));
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                  this->epsilon_);
+    }
+  }
+  Caffe::set_num_threads(1);
+}
+
+TYPED_TEST(LRNLayerTest, TestGradientAcrossChannelsTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Backward recomputes the scale that the TEST phase forward skips.
+  Caffe::set_num_threads(2);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.mutable_lrn_param()->set_local_size(3);
+  layer_param.mutable_lrn_param()->set_beta(Dtype(0.6));
+  LRNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  Caffe::set_num_threads(1);
+}
+
 TYPED_TEST(LRNLayerTest, TestSetupWithinChannel) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -208,5 +245,49 @@ TYPED_TEST(LRNLayerTest, TestGradientWithinChannel) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardWithinChannelTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 3, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Caffe::set_num_threads(3);
+  for (int size = 1; size <= 5; size += 2) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    layer_param.mutable_lrn_param()->set_norm_region(
+        LRNParameter_NormRegion_WITHIN_CHANNEL);
+    layer_param.mutable_lrn_param()->set_local_size(size);
+    layer_param.mutable_lrn_param()->set_alpha(Dtype(2));
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                  this->epsilon_);
+    }
+  }
+  Caffe::set_num_threads(1);
+}
+
+TYPED_TEST(LRNLayerTest, TestGradientWithinChannelTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_num_threads(2);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.mutable_lrn_param()->set_norm_region(
+      LRNParameter_NormRegion_WITHIN_CHANNEL);
+  layer_param.mutable_lrn_param()->set_local_size(3);
+  layer_param.mutable_lrn_param()->set_beta(Dtype(0.5));
+  LRNLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  Caffe::set_num_threads(1);
+}
+
 
 }  // namespace caffe
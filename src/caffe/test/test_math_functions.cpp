@@ -1,8 +1,12 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <climits>
 #include <cmath>  // for std::fabs
 #include <cstdlib>  // for rand_r
+#include <functional>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -144,6 +148,71 @@ TYPED_TEST(MathFunctionsTest, TestCopyCPU) {
   }
 }
 
+TYPED_TEST(MathFunctionsTest, TestElementwiseThreadsCPU) {
+  // The blobs are large enough to be split over the threads.
+  const int n = this->blob_bottom_->count();
+  const TypeParam* a = this->blob_bottom_->cpu_data();
+  const TypeParam* b = this->blob_top_->cpu_data();
+  Blob<TypeParam> result(11, 17, 19, 23);
+  TypeParam* y = result.mutable_cpu_data();
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_num_threads(3);
+  caffe_add(n, a, b, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(a[i] + b[i], y[i]);
+  }
+  caffe_mul(n, a, b, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(a[i] * b[i], y[i]);
+  }
+  caffe_sqr(n, a, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(a[i] * a[i], y[i]);
+  }
+  caffe_abs(n, a, y);
+  caffe_powx(n, y, TypeParam(1.5), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(std::pow(std::fabs(a[i]), TypeParam(1.5)), y[i], 1e-5);
+  }
+  caffe_exp(n, a, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(std::exp(a[i]), y[i], 1e-5 * std::exp(a[i]));
+  }
+  caffe_copy(n, a, y);
+  caffe_add_scalar(n, TypeParam(2), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(a[i] + TypeParam(2), y[i]);
+  }
+  caffe_set(n, TypeParam(3), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(TypeParam(3), y[i]);
+  }
+  Caffe::set_num_threads(1);
+}
+
+TYPED_TEST(MathFunctionsTest, TestTopKCPU) {
+  // Every third value, with many equal ones.
+  const int n = 50;
+  const int incx = 3;
+  vector<TypeParam> x(n * incx);
+  for (int i = 0; i < x.size(); ++i) { x[i] = (i * 7919) % 13; }
+  vector<std::pair<TypeParam, int> > pairs;
+  for (int i = 0; i < n; ++i) {
+    pairs.push_back(std::make_pair(x[i * incx], i));
+  }
+  std::sort(pairs.begin(), pairs.end(),
+      std::greater<std::pair<TypeParam, int> >());
+  for (int k = 1; k <= n; k += 7) {
+    vector<TypeParam> values(k);
+    vector<int> indices(k);
+    caffe_cpu_top_k(n, &x[0], incx, k, &values[0], &indices[0]);
+    for (int j = 0; j < k; ++j) {
+      EXPECT_EQ(pairs[j].first, values[j]) << "k = " << k;
+      EXPECT_EQ(pairs[j].second, indices[j]) << "k = " << k;
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 // TODO: Fix caffe_gpu_hamming_distance and re-enable this test.
@@ -137,6 +137,37 @@ TYPED_TEST(MVNLayerTest, TestForwardAcrossChannels) {
   }
 }
 
+TYPED_TEST(MVNLayerTest, TestForwardLargeMeanThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Channels of a mean far above their spread, where E(X^2) - (EX)^2 would
+  // cancel in float, large enough to be split over the threads.
+  Blob<Dtype> bottom(3, 4, 67, 71);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  const int dim = bottom.height() * bottom.width();
+  for (int i = 0; i < bottom.count(); ++i) {
+    bottom.mutable_cpu_data()[i] += 1000 * (i / dim + 1);
+  }
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  MVNLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  Caffe::set_num_threads(3);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  Caffe::set_num_threads(1);
+  for (int row = 0; row < bottom.count() / dim; ++row) {
+    const Dtype* top_data = this->blob_top_->cpu_data() + row * dim;
+    double sum = 0, squares = 0;
+    for (int i = 0; i < dim; ++i) {
+      sum += top_data[i];
+      squares += top_data[i] * top_data[i];
+    }
+    EXPECT_NEAR(0, sum / dim, 1e-3);
+    EXPECT_NEAR(1, squares / dim, 1e-3);
+  }
+}
+
 TYPED_TEST(MVNLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
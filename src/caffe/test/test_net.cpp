@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include <string>
 #include <utility>
 #include <vector>
@@ -9,7 +11,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/weight_map.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -1132,6 +1136,99 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   EXPECT_NE(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
 }
 
+TYPED_TEST(NetTest, TestMapTrainedLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitTinyNet();
+  vector<shared_ptr<Blob<Dtype> > > trained_params;
+  const bool kCopyDiff = false;
+  this->CopyNetParams(kCopyDiff, &trained_params);
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteWeightMap(net_param, filename);
+  EXPECT_TRUE(IsWeightMapFile(filename));
+
+  // Reinitialize the net with different weights and map the trained ones.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitTinyNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(trained_params[i]->count(), params[i]->count());
+    if (sizeof(Dtype) == sizeof(float)) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(params[i]->cpu_data())
+                   % kWeightMapAlignment);
+    }
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_FLOAT_EQ(trained_params[i]->cpu_data()[j],
+                      params[i]->cpu_data()[j]);
+    }
+  }
+  // Updating mapped weights must work (the mapping is copy-on-write).
+  vector<Blob<Dtype>*> bottom;
+  this->net_->ForwardBackward(bottom);
+  this->net_->Update();
+  // Writes into one net's mapping are not visible to another net.
+  Caffe::set_random_seed(this->seed_ + 1);
+  Net<Dtype> other_net(net_param);
+  other_net.CopyTrainedLayersFrom(filename);
+  for (int i = 0; i < other_net.params().size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_FLOAT_EQ(trained_params[i]->cpu_data()[j],
+                      other_net.params()[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestMemoryAccounting) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitTinyNet();
+  vector<Blob<Dtype>*> bottom;
+  this->net_->Forward(bottom);
+  const vector<shared_ptr<Layer<Dtype> > >& layers = this->net_->layers();
+  const vector<vector<shared_ptr<MemoryAccount> > >& accounts =
+      this->net_->category_memory_accounts();
+  ASSERT_EQ(layers.size(), accounts.size());
+  ASSERT_EQ(layers.size(), this->net_->layer_memory_accounts().size());
+  size_t layers_cpu_bytes = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    size_t param_bytes = 0;
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      param_bytes += layers[i]->blobs()[j]->count() * sizeof(Dtype);
+    }
+    EXPECT_EQ(param_bytes,
+              accounts[i][Net<Dtype>::PARAM_DATA]->cpu_bytes());
+    size_t top_bytes = 0;
+    const vector<Blob<Dtype>*>& top = this->net_->top_vecs()[i];
+    for (int j = 0; j < top.size(); ++j) {
+      top_bytes += top[j]->count() * sizeof(Dtype);
+    }
+    EXPECT_EQ(top_bytes, accounts[i][Net<Dtype>::TOP_DATA]->cpu_bytes());
+    layers_cpu_bytes += this->net_->layer_memory_accounts()[i]->cpu_bytes();
+  }
+  EXPECT_EQ(layers_cpu_bytes, this->net_->memory_account()->cpu_bytes());
+}
+
+TYPED_TEST(NetTest, TestBlobOutlivesNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A blob kept after its net is gone keeps its data, and only its data.
+  this->InitTinyNet();
+  vector<Blob<Dtype>*> bottom;
+  this->net_->Forward(bottom);
+  shared_ptr<Blob<Dtype> > blob = this->net_->blob_by_name("innerproduct");
+  const vector<Dtype> data(blob->cpu_data(), blob->cpu_data() + blob->count());
+  shared_ptr<MemoryAccount> account = this->net_->memory_account();
+  this->net_.reset();
+  ASSERT_EQ(data.size(), blob->count());
+  for (int i = 0; i < blob->count(); ++i) {
+    EXPECT_EQ(data[i], blob->cpu_data()[i]);
+  }
+  EXPECT_EQ(blob->count() * sizeof(Dtype), account->cpu_bytes());
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   vector<Blob<Dtype>*> bottom;
@@ -0,0 +1,621 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/neuron_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Checks the float kernels of every instruction set the CPU supports against
+// scalar references computed in double.
+class NeuronFunctionsTest : public ::testing::Test {
+ protected:
+  NeuronFunctionsTest() {
+    // An odd count, so that every kernel has a tail to handle, and values
+    // from well into saturation down to tiny ones.
+    for (int i = 0; i < 1003; ++i) {
+      const float t = static_cast<float>(i) / 1002;
+      x_.push_back(-100 + 200 * t);
+      x_.push_back(-8 + 16 * t);
+      x_.push_back((t - 0.5f) * 1e-3f);
+    }
+    x_.push_back(0);
+    x_.push_back(-0.0f);
+    for (int i = 0; i < x_.size(); ++i) {
+      dy_.push_back(std::cos(static_cast<float>(i)));
+    }
+    y_.resize(x_.size());
+  }
+  virtual void TearDown() {
+    caffe_set_cpu_simd_level(caffe_cpu_max_simd_level());
+  }
+
+  int count() const { return x_.size(); }
+
+  // Expects y_ to be within a relative error of max_error of reference, or
+  // within abs_error of it where it is that close to 0.
+  template <typename Reference>
+  void ExpectNear(const Reference& reference, double max_error,
+      double abs_error, const char* name) {
+    for (int i = 0; i < count(); ++i) {
+      const double expected = reference(i);
+      EXPECT_LE(std::fabs(y_[i] - expected),
+          std::max(max_error * std::fabs(expected), abs_error))
+          << name << " at simd level " << caffe_cpu_simd_level()
+          << ", x = " << x_[i];
+    }
+  }
+
+  vector<float> x_;
+  vector<float> dy_;
+  vector<float> y_;
+};
+
+TEST_F(NeuronFunctionsTest, TestExact) {
+  const float slope = 0.25f;
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    caffe_cpu_relu(count(), &x_[0], slope, &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(std::max(x_[i], 0.f) + slope * std::min(x_[i], 0.f), y_[i]);
+    }
+    caffe_cpu_relu_backward(count(), &x_[0], &dy_[0], slope, &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(x_[i] > 0 ? dy_[i] : dy_[i] * slope, y_[i]);
+    }
+    caffe_cpu_threshold(count(), &x_[0], 0.5f, &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(x_[i] > 0.5f ? 1 : 0, y_[i]);
+    }
+    caffe_cpu_absval(count(), &x_[0], &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(std::fabs(x_[i]), y_[i]);
+    }
+    caffe_cpu_absval_backward(count(), &x_[0], &dy_[0], &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(x_[i] > 0 ? dy_[i] : (x_[i] < 0 ? -dy_[i] : 0), y_[i]);
+    }
+    // The AVX2 kernels may fuse the multiply and subtract of 1 - y^2, which
+    // cancel where |y| is close to 1.
+    caffe_cpu_tanh_backward(count(), &dy_[0], &x_[0], &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_NEAR(x_[i] * (1 - dy_[i] * dy_[i]), y_[i],
+          1e-6 * std::fabs(x_[i]));
+    }
+  }
+}
+
+struct SigmoidReference {
+  const vector<float>& x;
+  explicit SigmoidReference(const vector<float>& x) : x(x) {}
+  double operator()(int i) const { return 1. / (1. + std::exp(-x[i])); }
+};
+
+struct SigmoidBackwardReference {
+  const vector<float>& y;
+  const vector<float>& dy;
+  SigmoidBackwardReference(const vector<float>& y, const vector<float>& dy)
+      : y(y), dy(dy) {}
+  double operator()(int i) const {
+    return static_cast<double>(dy[i]) * y[i] * (1. - y[i]);
+  }
+};
+
+struct TanHReference {
+  const vector<float>& x;
+  explicit TanHReference(const vector<float>& x) : x(x) {}
+  double operator()(int i) const { return std::tanh(x[i]); }
+};
+
+struct BNLLReference {
+  const vector<float>& x;
+  explicit BNLLReference(const vector<float>& x) : x(x) {}
+  double operator()(int i) const {
+    const double v = x[i];
+    return std::max(v, 0.) + std::log(1. + std::exp(-std::fabs(v)));
+  }
+};
+
+struct BNLLBackwardReference {
+  const vector<float>& x;
+  const vector<float>& dy;
+  BNLLBackwardReference(const vector<float>& x, const vector<float>& dy)
+      : x(x), dy(dy) {}
+  double operator()(int i) const {
+    return dy[i] / (1. + std::exp(-static_cast<double>(x[i])));
+  }
+};
+
+// Where the reference underflows float, only its magnitude matters.
+const double kTiny = 1e-37;
+
+TEST_F(NeuronFunctionsTest, TestExactMath) {
+  caffe_cpu_sigmoid(count(), &x_[0], &y_[0], false);
+  ExpectNear(SigmoidReference(x_), 1e-6, kTiny, "sigmoid");
+  caffe_cpu_tanh(count(), &x_[0], &y_[0], false);
+  ExpectNear(TanHReference(x_), 1e-6, 0, "tanh");
+  caffe_cpu_bnll(count(), &x_[0], &y_[0], false);
+  ExpectNear(BNLLReference(x_), 1e-6, 1e-7, "bnll");
+  caffe_cpu_bnll_backward(count(), &x_[0], &dy_[0], &y_[0], false);
+  ExpectNear(BNLLBackwardReference(x_, dy_), 1e-6, kTiny, "bnll_backward");
+}
+
+TEST_F(NeuronFunctionsTest, TestFastMath) {
+  vector<float> sigmoid(count());
+  caffe_cpu_sigmoid(count(), &x_[0], &sigmoid[0], false);
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    caffe_cpu_sigmoid(count(), &x_[0], &y_[0], true);
+    ExpectNear(SigmoidReference(x_), 1e-6, kTiny, "sigmoid");
+    caffe_cpu_sigmoid_backward(count(), &sigmoid[0], &dy_[0], &y_[0]);
+    ExpectNear(SigmoidBackwardReference(sigmoid, dy_), 1e-6, kTiny,
+        "sigmoid_backward");
+    caffe_cpu_tanh(count(), &x_[0], &y_[0], true);
+    ExpectNear(TanHReference(x_), 1e-6, 0, "tanh");
+    caffe_cpu_bnll(count(), &x_[0], &y_[0], true);
+    ExpectNear(BNLLReference(x_), 1e-6, 1e-7, "bnll");
+    caffe_cpu_bnll_backward(count(), &x_[0], &dy_[0], &y_[0], true);
+    ExpectNear(BNLLBackwardReference(x_, dy_), 1e-6, kTiny, "bnll_backward");
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestFastExp) {
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    caffe_cpu_exp(count(), &x_[0], &y_[0], true);
+    // Beyond the range of normal floats, the approximation clamps.
+    for (int i = 0; i < count(); ++i) {
+      if (std::fabs(x_[i]) < 87) {
+        EXPECT_NEAR(std::exp(static_cast<double>(x_[i])), y_[i],
+            1e-6 * std::exp(static_cast<double>(x_[i])))
+            << "at simd level " << level << ", x = " << x_[i];
+      }
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestDropoutMask) {
+  // Three quarters dropped, over a partial last word.
+  const unsigned int threshold = 3u << 30;
+  const int n = 32 * 300 + 7;
+  const int num_words = (n + 31) / 32;
+  vector<unsigned int> expected(num_words);
+  caffe_set_cpu_simd_level(SIMD_NONE);
+  caffe_cpu_dropout_mask(n, 0, 1701, 1702, threshold, &expected[0]);
+  int num_kept = 0;
+  for (int i = 0; i < n; ++i) {
+    num_kept += (expected[i / 32] >> (i % 32)) & 1;
+  }
+  EXPECT_EQ(0, expected[num_words - 1] >> 7);
+  EXPECT_NEAR(n / 4, num_kept, 4 * std::sqrt(n * 3. / 16));
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    // The stream does not depend on how it is split.
+    vector<unsigned int> mask(num_words);
+    caffe_cpu_dropout_mask(32 * 100, 0, 1701, 1702, threshold, &mask[0]);
+    caffe_cpu_dropout_mask(n - 32 * 100, 32 * 100, 1701, 1702, threshold,
+        &mask[100]);
+    for (int i = 0; i < num_words; ++i) {
+      EXPECT_EQ(expected[i], mask[i]) << "at simd level " << level;
+    }
+    caffe_cpu_dropout(count(), &x_[0], &mask[0], 4.f, &y_[0]);
+    for (int i = 0; i < count(); ++i) {
+      EXPECT_EQ(((mask[i / 32] >> (i % 32)) & 1) ? x_[i] * 4.f : 0.f, y_[i])
+          << "at simd level " << level;
+    }
+  }
+  // Other keys draw other masks.
+  vector<unsigned int> mask(num_words);
+  caffe_cpu_dropout_mask(n, 0, 1701, 1703, threshold, &mask[0]);
+  int num_same = 0;
+  for (int i = 0; i < n; ++i) {
+    num_same += ((expected[i / 32] ^ mask[i / 32]) >> (i % 32) & 1) == 0;
+  }
+  EXPECT_LT(num_same, n * 3 / 4);
+}
+
+TEST_F(NeuronFunctionsTest, TestRng) {
+  // A partial last Box-Muller block.
+  const int n = 16 * 250 + 5;
+  vector<float> uniform(n);
+  vector<float> gaussian(n);
+  vector<unsigned int> bernoulli(n);
+  caffe_set_cpu_simd_level(SIMD_NONE);
+  caffe_cpu_rng_uniform(n, 0, 1701, 1702, -2.f, 3.f, &uniform[0]);
+  caffe_cpu_rng_gaussian(n, 0, 1701, 1702, 1.f, 2.f, &gaussian[0]);
+  caffe_cpu_rng_bernoulli(n, 0, 1701, 1702, 3u << 30, &bernoulli[0]);
+  double uniform_sum = 0;
+  double gaussian_sum = 0;
+  double gaussian_sum_sq = 0;
+  int num_ones = 0;
+  for (int i = 0; i < n; ++i) {
+    EXPECT_GE(uniform[i], -2.f);
+    EXPECT_LE(uniform[i], 3.f);
+    uniform_sum += uniform[i];
+    gaussian_sum += gaussian[i];
+    gaussian_sum_sq += (gaussian[i] - 1.) * (gaussian[i] - 1.);
+    num_ones += bernoulli[i];
+  }
+  EXPECT_NEAR(0.5, uniform_sum / n, 4 * 5 / std::sqrt(12. * n));
+  EXPECT_NEAR(1, gaussian_sum / n, 4 * 2 / std::sqrt(n));
+  EXPECT_NEAR(4, gaussian_sum_sq / n, 0.3);
+  EXPECT_NEAR(n * 3 / 4, num_ones, 4 * std::sqrt(n * 3. / 16));
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    // The streams do not depend on how they are split, and only the
+    // rounding of fused multiply-adds on the instruction set.
+    vector<float> y(n);
+    vector<unsigned int> bits(n);
+    caffe_cpu_rng_uniform(160, 0, 1701, 1702, -2.f, 3.f, &y[0]);
+    caffe_cpu_rng_uniform(n - 160, 160, 1701, 1702, -2.f, 3.f, &y[160]);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(uniform[i], y[i], 1e-6) << "at simd level " << level;
+    }
+    caffe_cpu_rng_gaussian(160, 0, 1701, 1702, 1.f, 2.f, &y[0]);
+    caffe_cpu_rng_gaussian(n - 160, 160, 1701, 1702, 1.f, 2.f, &y[160]);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(gaussian[i], y[i], 1e-5 * std::fabs(gaussian[i]) + 1e-6)
+          << "at simd level " << level;
+    }
+    caffe_cpu_rng_bernoulli(160, 0, 1701, 1702, 3u << 30, &bits[0]);
+    caffe_cpu_rng_bernoulli(n - 160, 160, 1701, 1702, 3u << 30, &bits[160]);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(bernoulli[i], bits[i]) << "at simd level " << level;
+    }
+  }
+  // The double versions draw from the same random numbers.
+  vector<double> gaussian_double(n);
+  caffe_cpu_rng_gaussian(n, 0, 1701, 1702, 1., 2., &gaussian_double[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(gaussian[i], gaussian_double[i],
+        1e-4 * std::fabs(gaussian[i]) + 1e-4);
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestPanelInnerProduct) {
+  // A partial last panel, and a k that is not a multiple of the vectors.
+  const int n = 3 * kCpuPanelRows + 5;
+  const int k = 37;
+  const int ldy = n + 2;
+  vector<float> w(n * k);
+  vector<float> x(5 * k);
+  vector<float> bias(n);
+  for (int i = 0; i < w.size(); ++i) { w[i] = x_[i % count()] / 100; }
+  for (int i = 0; i < x.size(); ++i) { x[i] = dy_[i]; }
+  for (int j = 0; j < n; ++j) { bias[j] = dy_[j + 7]; }
+  vector<float> panels(caffe_cpu_panels_count(n, k), 1);
+  caffe_cpu_pack_panels(n, k, &w[0], &panels[0]);
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    for (int m = 1; m <= 5; ++m) {
+      for (int use_bias = 0; use_bias < 2; ++use_bias) {
+        vector<float> y(m * ldy, -1);
+        caffe_cpu_panel_inner_product(m, n, k, &panels[0], &x[0],
+            use_bias ? &bias[0] : NULL, &y[0], ldy);
+        for (int b = 0; b < m; ++b) {
+          for (int j = 0; j < n; ++j) {
+            double expected = use_bias ? bias[j] : 0;
+            for (int i = 0; i < k; ++i) {
+              expected += static_cast<double>(w[j * k + i]) * x[b * k + i];
+            }
+            EXPECT_NEAR(expected, y[b * ldy + j], 1e-5)
+                << "at simd level " << level << ", m = " << m;
+          }
+          // The padding between rows is left alone.
+          EXPECT_EQ(-1, y[b * ldy + n]);
+          EXPECT_EQ(-1, y[b * ldy + n + 1]);
+        }
+      }
+    }
+  }
+  vector<double> w_double(w.begin(), w.end());
+  vector<double> x_double(x.begin(), x.end());
+  vector<double> panels_double(caffe_cpu_panels_count(n, k));
+  caffe_cpu_pack_panels(n, k, &w_double[0], &panels_double[0]);
+  vector<double> y_double(2 * n);
+  caffe_cpu_panel_inner_product(2, n, k, &panels_double[0], &x_double[0],
+      static_cast<const double*>(NULL), &y_double[0], n);
+  for (int b = 0; b < 2; ++b) {
+    for (int j = 0; j < n; ++j) {
+      double expected = 0;
+      for (int i = 0; i < k; ++i) {
+        expected += w_double[j * k + i] * x_double[b * k + i];
+      }
+      EXPECT_NEAR(expected, y_double[b * n + j], 1e-12);
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestHalf) {
+  // Every half, and the floats halfway between consecutive finite halves,
+  // which round to the one with the even mantissa.  Those halfway past the
+  // largest half, where the next would be 2^16, round to infinity.
+  vector<uint16_t> halves(1 << 16);
+  for (int i = 0; i < halves.size(); ++i) { halves[i] = i; }
+  vector<float> values(halves.size());
+  caffe_set_cpu_simd_level(SIMD_NONE);
+  caffe_cpu_from_half(halves.size(), &halves[0], &values[0]);
+  EXPECT_EQ(1, values[0x3c00]);
+  EXPECT_EQ(-2, values[0xc000]);
+  EXPECT_EQ(65504, values[0x7bff]);
+  EXPECT_EQ(std::ldexp(1.0f, -24), values[0x0001]);
+  EXPECT_EQ(std::ldexp(1023.0f, -24), values[0x03ff]);
+  EXPECT_TRUE(std::isinf(values[0x7c00]));
+  EXPECT_TRUE(std::isnan(values[0x7e00]));
+  vector<float> halfway;
+  vector<uint16_t> rounded;
+  for (int i = 0; i < 0x7c00; ++i) {
+    for (int sign = 0; sign < 2; ++sign) {
+      const float a = sign ? -values[i] : values[i];
+      const float b = i < 0x7bff ? (sign ? -values[i + 1] : values[i + 1]) :
+          (sign ? -65536.0f : 65536.0f);
+      halfway.push_back((a + b) / 2);
+      rounded.push_back((sign ? 0x8000 : 0) | (i % 2 ? i + 1 : i));
+    }
+  }
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    vector<float> level_values(halves.size());
+    caffe_cpu_from_half(halves.size(), &halves[0], &level_values[0]);
+    vector<uint16_t> round_trip(halves.size());
+    caffe_cpu_to_half(halves.size(), &level_values[0], &round_trip[0]);
+    for (int i = 0; i < halves.size(); ++i) {
+      if (std::isnan(values[i])) {
+        EXPECT_TRUE(std::isnan(level_values[i]));
+        EXPECT_EQ(0x7e00, round_trip[i] & 0x7e00);
+      } else {
+        EXPECT_EQ(values[i], level_values[i]) << "at simd level " << level;
+        EXPECT_EQ(halves[i], round_trip[i]) << "at simd level " << level;
+      }
+    }
+    vector<uint16_t> halfway_halves(halfway.size());
+    caffe_cpu_to_half(halfway.size(), &halfway[0], &halfway_halves[0]);
+    for (int i = 0; i < halfway.size(); ++i) {
+      EXPECT_EQ(rounded[i], halfway_halves[i])
+          << "for " << halfway[i] << " at simd level " << level;
+    }
+  }
+  // Doubles round through float.
+  const double x_double[3] = { 1.0 / 3, -65504, 1e-9 };
+  uint16_t h_double[3];
+  caffe_cpu_to_half(3, x_double, h_double);
+  double y_double[3];
+  caffe_cpu_from_half(3, h_double, y_double);
+  EXPECT_EQ(0x3555, h_double[0]);
+  EXPECT_EQ(-65504, y_double[1]);
+  EXPECT_EQ(0, y_double[2]);
+}
+
+TEST_F(NeuronFunctionsTest, TestHalfPanelInnerProduct) {
+  const int n = 2 * kCpuPanelRows + 3;
+  const int k = 29;
+  vector<float> w(n * k);
+  vector<float> x(5 * k);
+  vector<float> bias(n);
+  for (int i = 0; i < w.size(); ++i) { w[i] = x_[i % count()] / 100; }
+  for (int i = 0; i < x.size(); ++i) { x[i] = dy_[i]; }
+  for (int j = 0; j < n; ++j) { bias[j] = dy_[j + 7]; }
+  vector<uint16_t> panels(caffe_cpu_panels_count(n, k), 1);
+  caffe_cpu_pack_half_panels(n, k, &w[0], &panels[0]);
+  // The weights the panels hold.
+  vector<uint16_t> w_half(w.size());
+  caffe_cpu_to_half(w.size(), &w[0], &w_half[0]);
+  vector<double> w_rounded(w.size());
+  caffe_cpu_from_half(w.size(), &w_half[0], &w_rounded[0]);
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    for (int m = 1; m <= 5; ++m) {
+      vector<float> y(m * n);
+      caffe_cpu_half_panel_inner_product(m, n, k, &panels[0], &x[0],
+          &bias[0], &y[0], n);
+      for (int b = 0; b < m; ++b) {
+        for (int j = 0; j < n; ++j) {
+          double expected = bias[j];
+          for (int i = 0; i < k; ++i) {
+            expected += w_rounded[j * k + i] * x[b * k + i];
+          }
+          EXPECT_NEAR(expected, y[b * n + j], 1e-5)
+              << "at simd level " << level << ", m = " << m;
+        }
+      }
+    }
+  }
+  vector<double> x_double(x.begin(), x.end());
+  vector<double> y_double(n);
+  caffe_cpu_half_panel_inner_product(1, n, k, &panels[0], &x_double[0],
+      static_cast<const double*>(NULL), &y_double[0], n);
+  for (int j = 0; j < n; ++j) {
+    double expected = 0;
+    for (int i = 0; i < k; ++i) {
+      expected += w_rounded[j * k + i] * x_double[i];
+    }
+    EXPECT_NEAR(expected, y_double[j], 1e-12);
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestInt8Gemm) {
+  // Tails of both blocks of rows, and extreme codes.
+  const int m = 7;
+  const int n = 13;
+  const int k = 3 * kCpuInt8Block;
+  const int ldc = n + 3;
+  vector<uint8_t> a(m * k);
+  vector<int8_t> b(n * k);
+  for (int i = 0; i < a.size(); ++i) { a[i] = (i * 37 + 11) % 128; }
+  for (int i = 0; i < b.size(); ++i) { b[i] = (i * 53 + 7) % 255 - 127; }
+  a[0] = 127;
+  b[0] = -127;
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    vector<int32_t> c(m * ldc, -1);
+    caffe_cpu_int8_gemm(m, n, k, &a[0], &b[0], &c[0], ldc);
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+        int32_t expected = 0;
+        for (int t = 0; t < k; ++t) { expected += a[i * k + t] * b[j * k + t]; }
+        EXPECT_EQ(expected, c[i * ldc + j]) << "at simd level " << level;
+      }
+      for (int j = n; j < ldc; ++j) { EXPECT_EQ(-1, c[i * ldc + j]); }
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestEltwise) {
+  // The inputs are rotations of x_, so that there are ties.
+  const int n = count() - 5;
+  const float coeffs[] = { 1, -0.5f, 2, 0.25f, 3 };
+  vector<int> mask(n);
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    for (int k = 2; k <= 5; ++k) {
+      vector<const float*> x(k);
+      for (int j = 0; j < k; ++j) { x[j] = &x_[j % 3]; }
+      caffe_cpu_eltwise_sum(n, k, &x[0], coeffs, &y_[0]);
+      for (int i = 0; i < n; ++i) {
+        double expected = 0;
+        for (int j = 0; j < k; ++j) { expected += coeffs[j] * x[j][i]; }
+        EXPECT_NEAR(expected, y_[i], 1e-4 * std::max(1., std::fabs(expected)))
+            << "at simd level " << level << ", k = " << k;
+      }
+      caffe_cpu_eltwise_prod(n, k, &x[0], &y_[0]);
+      for (int i = 0; i < n; ++i) {
+        double expected = 1;
+        for (int j = 0; j < k; ++j) { expected *= x[j][i]; }
+        EXPECT_NEAR(expected, y_[i], 1e-6 * std::max(1., std::fabs(expected)))
+            << "at simd level " << level << ", k = " << k;
+      }
+      caffe_cpu_eltwise_max(n, k, &x[0], &y_[0], &mask[0]);
+      for (int i = 0; i < n; ++i) {
+        int expected = x[0][i] > x[1][i] ? 0 : 1;
+        for (int j = 2; j < k; ++j) {
+          if (x[j][i] > x[expected][i]) { expected = j; }
+        }
+        EXPECT_EQ(x[expected][i], y_[i]) << "at simd level " << level;
+        EXPECT_EQ(expected, mask[i]) << "at simd level " << level;
+      }
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestNormalize) {
+  // x_ shifted far from 0, over several blocks of the kernels and a tail.
+  const int n = count();
+  vector<float> x(n);
+  double mean = 0;
+  for (int i = 0; i < n; ++i) {
+    x[i] = 1000 + x_[i];
+    mean += x[i];
+  }
+  mean /= n;
+  double variance = 0;
+  for (int i = 0; i < n; ++i) { variance += (x[i] - mean) * (x[i] - mean); }
+  variance /= n;
+  const double scale = 1 / std::sqrt(variance);
+  vector<double> y(n);
+  double mean_dy = 0, mean_y_dy = 0;
+  for (int i = 0; i < n; ++i) {
+    y[i] = (x[i] - mean) * scale;
+    mean_dy += dy_[i] / n;
+    mean_y_dy += y[i] * dy_[i] / n;
+  }
+  vector<float> dx(n);
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    float mean_x, variance_x;
+    caffe_cpu_mean_variance(n, &x[0], &mean_x, &variance_x);
+    EXPECT_NEAR(mean, mean_x, 1e-6 * mean) << "at simd level " << level;
+    EXPECT_NEAR(variance, variance_x, 1e-4 * variance)
+        << "at simd level " << level;
+    caffe_cpu_normalize(n, &x[0], mean_x, static_cast<float>(scale), &y_[0]);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(y[i], y_[i], 1e-3) << "at simd level " << level;
+    }
+    caffe_cpu_normalize_backward(n, &y_[0], &dy_[0],
+        static_cast<float>(scale), &dx[0]);
+    for (int i = 0; i < n; ++i) {
+      const double expected = (dy_[i] - mean_dy - y[i] * mean_y_dy) * scale;
+      EXPECT_NEAR(expected, dx[i], 1e-5) << "at simd level " << level;
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestCsrmm) {
+  // Rows of no, one and many nonzeros, and n over the widths of all blocks
+  // with a tail.
+  const int m = 6;
+  const int k = 37;
+  const int n = 4 * 8 + 8 + 5;
+  const int ldb = n + 2;
+  const int ldc = n + 3;
+  vector<float> a(m * k, 0);
+  for (int r = 1; r < m; ++r) {
+    for (int c = 0; c < k; c += r * r) { a[r * k + c] = dy_[r * k + c]; }
+  }
+  vector<int> row_ptr(1, 0);
+  vector<int> col_idx;
+  vector<float> values;
+  for (int r = 0; r < m; ++r) {
+    for (int c = 0; c < k; ++c) {
+      if (a[r * k + c] != 0) {
+        col_idx.push_back(c);
+        values.push_back(a[r * k + c]);
+      }
+    }
+    row_ptr.push_back(values.size());
+  }
+  vector<float> b(k * ldb);
+  for (int i = 0; i < b.size(); ++i) { b[i] = x_[i] / 100; }
+  for (int level = SIMD_NONE; level <= caffe_cpu_max_simd_level(); ++level) {
+    caffe_set_cpu_simd_level(static_cast<SimdLevel>(level));
+    for (int cols = 1; cols <= n; cols += 11) {
+      vector<float> c(m * ldc, -1);
+      caffe_cpu_csrmm(m, cols, &row_ptr[0], &col_idx[0], &values[0], &b[0],
+          ldb, &c[0], ldc);
+      for (int r = 0; r < m; ++r) {
+        for (int j = 0; j < cols; ++j) {
+          double expected = 0;
+          for (int t = 0; t < k; ++t) {
+            expected += a[r * k + t] * static_cast<double>(b[t * ldb + j]);
+          }
+          EXPECT_NEAR(expected, c[r * ldc + j], 1e-5)
+              << "at simd level " << level << ", n = " << cols;
+        }
+        for (int j = cols; j < ldc; ++j) { EXPECT_EQ(-1, c[r * ldc + j]); }
+      }
+    }
+  }
+  vector<double> values_double(values.begin(), values.end());
+  vector<double> b_double(b.begin(), b.end());
+  vector<double> c_double(m * ldc);
+  caffe_cpu_csrmm(m, n, &row_ptr[0], &col_idx[0], &values_double[0],
+      &b_double[0], ldb, &c_double[0], ldc);
+  for (int r = 0; r < m; ++r) {
+    for (int j = 0; j < n; ++j) {
+      double expected = 0;
+      for (int t = 0; t < k; ++t) {
+        expected += a[r * k + t] * b_double[t * ldb + j];
+      }
+      EXPECT_NEAR(expected, c_double[r * ldc + j], 1e-12);
+    }
+  }
+}
+
+TEST_F(NeuronFunctionsTest, TestDouble) {
+  vector<double> x(x_.begin(), x_.end());
+  vector<double> y(count());
+  caffe_cpu_sigmoid(count(), &x[0], &y[0], true);
+  for (int i = 0; i < count(); ++i) {
+    EXPECT_DOUBLE_EQ(1. / (1. + std::exp(-x[i])), y[i]);
+  }
+  caffe_cpu_relu(count(), &x[0], 0.5, &y[0]);
+  for (int i = 0; i < count(); ++i) {
+    EXPECT_EQ(x[i] > 0 ? x[i] : 0.5 * x[i], y[i]);
+  }
+}
+
+}  // namespace caffe
@@ -207,6 +207,30 @@ TYPED_TEST(NeuronLayerTest, TestSigmoidGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(NeuronLayerTest, TestSigmoidFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_sigmoid_param()->set_fast_math(true);
+  SigmoidLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_FLOAT_EQ(top_data[i], 1. / (1 + exp(-bottom_data[i])));
+  }
+}
+
+TYPED_TEST(NeuronLayerTest, TestSigmoidGradientFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_sigmoid_param()->set_fast_math(true);
+  SigmoidLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3, 1701, 0., 0.01);
+  checker.CheckGradientEltwise(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(NeuronLayerTest, TestTanH) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -239,6 +263,30 @@ TYPED_TEST(NeuronLayerTest, TestTanHGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(NeuronLayerTest, TestTanHFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_tanh_param()->set_fast_math(true);
+  TanHLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], tanh(bottom_data[i]), 1e-6);
+  }
+}
+
+TYPED_TEST(NeuronLayerTest, TestTanHGradientFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_tanh_param()->set_fast_math(true);
+  TanHLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientEltwise(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 TYPED_TEST(NeuronLayerTest, TestExpLayer) {
   typedef typename TypeParam::Dtype Dtype;
   // Test default base of "-1" -- should actually set base := e.
@@ -348,6 +396,41 @@ TYPED_TEST(NeuronLayerTest, TestDropoutTestPhase) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestDropoutThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough inputs for three threads, and a partial last mask word.
+  Blob<Dtype> bottom(3, 17, 31, 33);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  layer_param.set_phase(TRAIN);
+  DropoutLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  // The masks only depend on the random seed.
+  Caffe::set_random_seed(1702);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->blob_top_, false, true);
+  caffe_copy(bottom.count(), bottom.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+  expected.CopyFrom(bottom, true, false);
+  Caffe::set_num_threads(3);
+  Caffe::set_random_seed(1702);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+  Caffe::set_num_threads(1);
+  for (int i = 0; i < bottom.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+    EXPECT_EQ(expected.cpu_diff()[i], bottom.cpu_diff()[i]);
+    // The backward pass applies the same mask as the forward pass.
+    EXPECT_EQ(this->blob_top_->cpu_data()[i], bottom.cpu_diff()[i]);
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestDropoutGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -392,6 +475,30 @@ TYPED_TEST(NeuronLayerTest, TestBNLLGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(NeuronLayerTest, TestBNLLFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_bnll_param()->set_fast_math(true);
+  BNLLLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], log(1. + exp(bottom_data[i])), 1e-6);
+  }
+}
+
+TYPED_TEST(NeuronLayerTest, TestBNLLGradientFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_bnll_param()->set_fast_math(true);
+  BNLLLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientEltwise(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNNeuronLayerTest : public ::testing::Test {
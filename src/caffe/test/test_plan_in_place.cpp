@@ -0,0 +1,207 @@
+#include <map>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/plan_in_place.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PlanInPlaceTest : public ::testing::Test {
+ protected:
+  void RunPlanTest(const string& input_param_string,
+      const string& output_param_string) {
+    // Test that PlanInPlace called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    PlanInPlace(input_param, &actual_output_param, &blob_aliases_);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_plan_param;
+    map<string, string> double_plan_aliases;
+    PlanInPlace(actual_output_param, &double_plan_param,
+                &double_plan_aliases);
+    EXPECT_EQ(actual_output_param.DebugString(),
+        double_plan_param.DebugString());
+    EXPECT_EQ(0, double_plan_aliases.size());
+  }
+
+  map<string, string> blob_aliases_;
+};
+
+TEST_F(PlanInPlaceTest, TestInPlaceAfterInnerProduct) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'ip' type: 'InnerProduct' "
+      "  bottom: 'data' top: 'ip' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip' top: 'relu' } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'relu' top: 'drop' } "
+      "layer { name: 'loss' type: 'SoftmaxWithLoss' "
+      "  bottom: 'drop' bottom: 'label' } ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'ip' type: 'InnerProduct' "
+      "  bottom: 'data' top: 'ip' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip' top: 'ip' } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'ip' top: 'ip' } "
+      "layer { name: 'loss' type: 'SoftmaxWithLoss' "
+      "  bottom: 'ip' bottom: 'label' } ";
+  this->RunPlanTest(input_proto, expected_output_proto);
+  EXPECT_EQ(2, blob_aliases_.size());
+  EXPECT_EQ("ip", blob_aliases_["relu"]);
+  EXPECT_EQ("ip", blob_aliases_["drop"]);
+}
+
+TEST_F(PlanInPlaceTest, TestNoInPlace) {
+  // The data is used twice; the sigmoid output is read by its backward pass;
+  // the last ReLU produces a net output.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'data_split' type: 'Split' bottom: 'data' "
+      "  top: 'data_split_0' top: 'data_split_1' } "
+      "layer { name: 'relu1' type: 'ReLU' "
+      "  bottom: 'data_split_0' top: 'relu1' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' "
+      "  bottom: 'data_split_1' top: 'sigmoid' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'sigmoid' top: 'relu2' } "
+      "layer { name: 'relu3' type: 'ReLU' bottom: 'relu1' top: 'relu3' } ";
+  this->RunPlanTest(input_proto, input_proto);
+  EXPECT_EQ(0, blob_aliases_.size());
+}
+
+TEST_F(PlanInPlaceTest, TestElideSplitsInTestPhase) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'ip' type: 'InnerProduct' "
+      "  bottom: 'data' top: 'ip' } "
+      "layer { name: 'ip_split' type: 'Split' bottom: 'ip' "
+      "  top: 'ip_split_0' top: 'ip_split_1' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip_split_0' top: 'relu' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' "
+      "  bottom: 'ip_split_1' top: 'sigmoid' } "
+      "layer { name: 'tanh' type: 'TanH' bottom: 'sigmoid' top: 'tanh' } "
+      "layer { name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'relu' bottom: 'tanh' } ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'ip' type: 'InnerProduct' "
+      "  bottom: 'data' top: 'ip' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip' top: 'relu' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' "
+      "  bottom: 'ip' top: 'sigmoid' } "
+      "layer { name: 'tanh' type: 'TanH' "
+      "  bottom: 'sigmoid' top: 'sigmoid' } "
+      "layer { name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'relu' bottom: 'sigmoid' } ";
+  this->RunPlanTest(input_proto, expected_output_proto);
+  EXPECT_EQ(3, blob_aliases_.size());
+  EXPECT_EQ("ip", blob_aliases_["ip_split_0"]);
+  EXPECT_EQ("ip", blob_aliases_["ip_split_1"]);
+  EXPECT_EQ("sigmoid", blob_aliases_["tanh"]);
+}
+
+TEST_F(PlanInPlaceTest, TestKeepSplitsWithInPlaceConsumer) {
+  // InsertSplits renames the bottom of the in-place ReLU to 'ip_split_0' but
+  // keeps its top 'ip': eliding the split would have the ReLU overwrite the
+  // 'ip' the sigmoid reads.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'ip' type: 'InnerProduct' "
+      "  bottom: 'data' top: 'ip' } "
+      "layer { name: 'ip_split' type: 'Split' bottom: 'ip' "
+      "  top: 'ip_split_0' top: 'ip_split_1' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip_split_0' top: 'ip' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' "
+      "  bottom: 'ip_split_1' top: 'sigmoid' } "
+      "layer { name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'ip' bottom: 'sigmoid' } ";
+  this->RunPlanTest(input_proto, input_proto);
+  EXPECT_EQ(0, blob_aliases_.size());
+}
+
+TEST_F(PlanInPlaceTest, TestKeepSplitsWithForceBackward) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "force_backward: true "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Data' top: 'data' top: 'label' } "
+      "layer { name: 'data_split' type: 'Split' bottom: 'data' "
+      "  top: 'data_split_0' top: 'data_split_1' } "
+      "layer { name: 'loss' type: 'EuclideanLoss' "
+      "  bottom: 'data_split_0' bottom: 'data_split_1' } ";
+  this->RunPlanTest(input_proto, input_proto);
+}
+
+template <typename TypeParam>
+class PlanInPlaceNetTest : public MultiDeviceTest<TypeParam> {};
+
+TYPED_TEST_CASE(PlanInPlaceNetTest, TestDtypesAndDevices);
+
+TYPED_TEST(PlanInPlaceNetTest, TestForwardMatchesUnplanned) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { num: 2 channels: 3 height: 1 width: 1 "
+      "    data_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip' top: 'relu' } "
+      "layer { name: 'tanh' type: 'TanH' bottom: 'relu' top: 'tanh' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'data' "
+      "  top: 'sigmoid' } "
+      "layer { name: 'silence' type: 'Silence' bottom: 'tanh' "
+      "  bottom: 'sigmoid' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TEST);
+  // Dropping the Split of 'data' leaves two layers reading it.
+  param.set_plan_in_place(true);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> planned_net(param);
+  param.set_plan_in_place(false);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> unplanned_net(param);
+  EXPECT_EQ(unplanned_net.blob_names().size() - 4,
+            planned_net.blob_names().size());
+  // DummyData refills its gaussian data on every forward pass.
+  vector<Blob<Dtype>*> bottom;
+  Caffe::set_random_seed(1702);
+  planned_net.Forward(bottom);
+  Caffe::set_random_seed(1702);
+  unplanned_net.Forward(bottom);
+  ASSERT_TRUE(planned_net.has_blob("tanh"));
+  const Blob<Dtype>& planned = *planned_net.blob_by_name("tanh");
+  const Blob<Dtype>& unplanned = *unplanned_net.blob_by_name("tanh");
+  ASSERT_EQ(unplanned.count(), planned.count());
+  for (int i = 0; i < planned.count(); ++i) {
+    EXPECT_EQ(unplanned.cpu_data()[i], planned.cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,213 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/plan_views.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class PlanViewsTest : public ::testing::Test {
+ protected:
+  void RunPlanTest(const string& input_param_string,
+      const string& output_param_string) {
+    // Test that PlanViews called on the proto specified by
+    // input_param_string results in the proto specified by
+    // output_param_string.
+    NetParameter input_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        input_param_string, &input_param));
+    NetParameter expected_output_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(
+        output_param_string, &expected_output_param));
+    NetParameter actual_output_param;
+    PlanViews(input_param, &actual_output_param);
+    EXPECT_EQ(expected_output_param.DebugString(),
+        actual_output_param.DebugString());
+    // Also test idempotence.
+    NetParameter double_plan_param;
+    PlanViews(actual_output_param, &double_plan_param);
+    EXPECT_EQ(actual_output_param.DebugString(),
+        double_plan_param.DebugString());
+  }
+};
+
+TEST_F(PlanViewsTest, TestShare) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv2' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' } "
+      "layer { name: 'concat' type: 'Concat' "
+      "  bottom: 'conv1' bottom: 'conv2' top: 'concat' } "
+      "layer { name: 'slice' type: 'Slice' bottom: 'concat' "
+      "  top: 'slice1' top: 'slice2' } "
+      "layer { name: 'ip1' type: 'InnerProduct' "
+      "  bottom: 'slice1' top: 'ip1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' "
+      "  bottom: 'slice2' top: 'ip2' } ";
+  const string& expected_output_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv2' } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' } "
+      "layer { name: 'concat' type: 'Concat' "
+      "  bottom: 'conv1' bottom: 'conv2' top: 'concat' "
+      "  concat_param { share_bottoms: true } } "
+      "layer { name: 'slice' type: 'Slice' bottom: 'concat' "
+      "  top: 'slice1' top: 'slice2' slice_param { share_tops: true } } "
+      "layer { name: 'ip1' type: 'InnerProduct' "
+      "  bottom: 'slice1' top: 'ip1' } "
+      "layer { name: 'ip2' type: 'InnerProduct' "
+      "  bottom: 'slice2' top: 'ip2' } ";
+  this->RunPlanTest(input_proto, expected_output_proto);
+}
+
+TEST_F(PlanViewsTest, TestNoShare) {
+  // The first Concat reads a data layer top, the second a blob that the
+  // pooling layer reads as well, and the third a split top.  The top of the
+  // fourth is written in place while the net may run backward, as is a top
+  // of the Slice layer.
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'concat1' type: 'Concat' "
+      "  bottom: 'data' bottom: 'conv1' top: 'concat1' } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'concat1' top: 'conv2' } "
+      "layer { name: 'conv3' type: 'Convolution' "
+      "  bottom: 'concat1' top: 'conv3' } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'conv2' top: 'pool' } "
+      "layer { name: 'concat2' type: 'Concat' "
+      "  bottom: 'conv2' bottom: 'conv3' top: 'concat2' } "
+      "layer { name: 'split' type: 'Split' bottom: 'concat2' "
+      "  top: 'split1' top: 'split2' } "
+      "layer { name: 'concat3' type: 'Concat' "
+      "  bottom: 'split1' bottom: 'pool' top: 'concat3' } "
+      "layer { name: 'conv4' type: 'Convolution' "
+      "  bottom: 'split2' top: 'conv4' } "
+      "layer { name: 'conv5' type: 'Convolution' "
+      "  bottom: 'split2' top: 'conv5' } "
+      "layer { name: 'concat4' type: 'Concat' "
+      "  bottom: 'conv4' bottom: 'conv5' top: 'concat4' } "
+      "layer { name: 'relu4' type: 'ReLU' "
+      "  bottom: 'concat4' top: 'concat4' } "
+      "layer { name: 'slice' type: 'Slice' bottom: 'concat3' "
+      "  top: 'slice1' top: 'slice2' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' "
+      "  bottom: 'slice2' top: 'slice2' } ";
+  this->RunPlanTest(input_proto, input_proto);
+}
+
+TEST_F(PlanViewsTest, TestShareInTestPhase) {
+  // Without a backward pass, the producers of the bottoms do not need them
+  // once they have been concatenated.
+  const string& producers =
+      "layer { name: 'data' type: 'Data' top: 'data' } "
+      "layer { name: 'conv1' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv1' } "
+      "layer { name: 'conv2' type: 'Convolution' "
+      "  bottom: 'data' top: 'conv2' } ";
+  const string& concat =
+      "layer { name: 'concat' type: 'Concat' "
+      "  bottom: 'conv1' bottom: 'conv2' top: 'concat' ";
+  const string& relu =
+      "layer { name: 'relu' type: 'ReLU' bottom: 'concat' top: 'concat' } ";
+  const string& input_layers = producers + concat + "} " + relu;
+  this->RunPlanTest(
+      "name: 'TestNetwork' state { phase: TEST } " + input_layers,
+      "name: 'TestNetwork' state { phase: TEST } " + producers + concat +
+      "concat_param { share_bottoms: true } } " + relu);
+  this->RunPlanTest("name: 'TestNetwork' " + input_layers,
+      "name: 'TestNetwork' " + input_layers);
+}
+
+template <typename TypeParam>
+class PlanViewsNetTest : public MultiDeviceTest<TypeParam> {};
+
+TYPED_TEST_CASE(PlanViewsNetTest, TestDtypesAndDevices);
+
+TYPED_TEST(PlanViewsNetTest, TestForwardBackwardMatchesCopies) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+      "name: 'TestNetwork' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { num: 1 channels: 3 height: 6 width: 5 "
+      "    data_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv1' convolution_param { num_output: 4 kernel_size: 3 "
+      "    pad: 1 weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'conv2' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv2' convolution_param { num_output: 2 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'relu2' type: 'ReLU' bottom: 'conv2' top: 'conv2' } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'conv1' "
+      "  bottom: 'conv2' top: 'concat' } "
+      "layer { name: 'slice' type: 'Slice' bottom: 'concat' "
+      "  top: 'slice1' top: 'slice2' slice_param { slice_point: 3 } } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'slice1' "
+      "  top: 'ip1' inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'slice2' "
+      "  top: 'ip2' inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } } } "
+      "layer { name: 'loss' type: 'EuclideanLoss' bottom: 'ip1' "
+      "  bottom: 'ip2' top: 'loss' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> view_net(param);
+  param.set_plan_views(false);
+  Caffe::set_random_seed(1701);
+  Net<Dtype> copy_net(param);
+  const int concat_id = 5;
+  const int slice_id = 6;
+  ASSERT_EQ("concat", view_net.layer_names()[concat_id]);
+  ASSERT_EQ("slice", view_net.layer_names()[slice_id]);
+  EXPECT_TRUE(view_net.layers()[concat_id]->layer_param().concat_param().
+      share_bottoms());
+  EXPECT_TRUE(view_net.layers()[slice_id]->layer_param().slice_param().
+      share_tops());
+  // The second pass is the first to run without copies.
+  vector<Blob<Dtype>*> bottom;
+  for (int pass = 0; pass < 2; ++pass) {
+    // DummyData refills its gaussian data on every forward pass.
+    Caffe::set_random_seed(1702 + pass);
+    const Dtype view_loss = view_net.ForwardBackward(bottom);
+    Caffe::set_random_seed(1702 + pass);
+    const Dtype copy_loss = copy_net.ForwardBackward(bottom);
+    EXPECT_EQ(copy_loss, view_loss);
+    const Blob<Dtype>& view_concat = *view_net.blob_by_name("concat");
+    const Blob<Dtype>& copy_concat = *copy_net.blob_by_name("concat");
+    for (int i = 0; i < view_concat.count(); ++i) {
+      EXPECT_EQ(copy_concat.cpu_data()[i], view_concat.cpu_data()[i]);
+    }
+    for (int i = 0; i < view_net.params().size(); ++i) {
+      const Blob<Dtype>& view_param = *view_net.params()[i];
+      const Blob<Dtype>& copy_param = *copy_net.params()[i];
+      for (int j = 0; j < view_param.count(); ++j) {
+        EXPECT_EQ(copy_param.cpu_diff()[j], view_param.cpu_diff()[j]);
+      }
+    }
+  }
+  const Blob<Dtype>& concat = *view_net.blob_by_name("concat");
+  EXPECT_EQ(concat.cpu_data(), view_net.blob_by_name("conv1")->cpu_data());
+  EXPECT_EQ(concat.cpu_data() + 3 * 6 * 5,
+      view_net.blob_by_name("slice2")->cpu_data());
+}
+
+}  // namespace caffe
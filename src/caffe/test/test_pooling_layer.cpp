@@ -606,6 +606,67 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Odd sizes, so that the last windows overhang the image.
+  this->blob_bottom_->Reshape(2, 3, 11, 13);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Blob<Dtype> reference;
+  vector<Blob<Dtype>*> reference_vec(1, &reference);
+  for (int pool = PoolingParameter_PoolMethod_MAX;
+       pool <= PoolingParameter_PoolMethod_AVE; ++pool) {
+    for (int kernel = 2; kernel <= 3; ++kernel) {
+      for (int pad = 0; pad < kernel; ++pad) {
+        LayerParameter layer_param;
+        PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+        pooling_param->set_kernel_size(kernel);
+        pooling_param->set_stride(2);
+        pooling_param->set_pad(pad);
+        pooling_param->set_pool(
+            static_cast<PoolingParameter_PoolMethod>(pool));
+        PoolingLayer<Dtype> reference_layer(layer_param);
+        reference_layer.SetUp(this->blob_bottom_vec_, reference_vec);
+        reference_layer.Forward(this->blob_bottom_vec_, reference_vec);
+        // The TEST phase takes the fast path, over the planes of 3 threads.
+        layer_param.set_phase(TEST);
+        Caffe::set_num_threads(3);
+        PoolingLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        Caffe::set_num_threads(1);
+        ASSERT_EQ(reference.count(), this->blob_top_->count());
+        for (int i = 0; i < reference.count(); ++i) {
+          EXPECT_NEAR(reference.cpu_data()[i], this->blob_top_->cpu_data()[i],
+              1e-6) << "pool " << pool << " kernel " << kernel
+              << " pad " << pad;
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Backward recomputes the argmax that the TEST phase forward skips.
+  Caffe::set_num_threads(2);
+  for (int kernel = 2; kernel <= 3; ++kernel) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(kernel);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-4, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+  Caffe::set_num_threads(1);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public ::testing::Test {
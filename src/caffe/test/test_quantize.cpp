@@ -0,0 +1,342 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class QuantizeTest : public ::testing::Test {
+ protected:
+  QuantizeTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 6, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_mode(Caffe::CPU);
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(3);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~QuantizeTest() { delete blob_bottom_; delete blob_top_; }
+
+  // Checks that layer_param with a quantization_param in the TEST phase
+  // computes what the float layer computes from the inputs and weights its
+  // int8 codes stand for.
+  template <typename LayerType>
+  void TestInt8(LayerParameter layer_param, const int rows) {
+    layer_param.set_phase(TEST);
+    LayerType float_layer(layer_param);
+    float_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    QuantizationParameter* quantization_param =
+        layer_param.mutable_quantization_param();
+    quantization_param->set_input_min(-0.5);
+    quantization_param->set_input_max(2.5);
+    LayerType int8_layer(layer_param);
+    int8_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    // The weights that quantize to the same codes.
+    BlobProto proto;
+    float_layer.blobs()[0]->ToProto(&proto);
+    QuantizeBlobProto(rows, &proto);
+    float_layer.blobs()[0]->FromProto(proto);
+    for (int i = 0; i < float_layer.blobs().size(); ++i) {
+      int8_layer.blobs()[i]->ShareData(*float_layer.blobs()[i]);
+    }
+    // The inputs, clamped to the range of the codes.
+    Dtype scale;
+    int zero_point;
+    GetInputQuantization(*quantization_param, &scale, &zero_point);
+    Blob<Dtype> quantized_bottom;
+    quantized_bottom.ReshapeLike(*blob_bottom_);
+    vector<uint8_t> codes(blob_bottom_->count());
+    caffe_cpu_quantize_inputs(blob_bottom_->count(), blob_bottom_->cpu_data(),
+        scale, zero_point, &codes[0]);
+    for (int i = 0; i < codes.size(); ++i) {
+      quantized_bottom.mutable_cpu_data()[i] =
+          (static_cast<int>(codes[i]) - zero_point) * scale;
+    }
+    vector<Blob<Dtype>*> quantized_bottom_vec(1, &quantized_bottom);
+    float_layer.Forward(quantized_bottom_vec, blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*blob_top_, false, true);
+    Caffe::set_num_threads(3);
+    int8_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    Caffe::set_num_threads(1);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], blob_top_->cpu_data()[i],
+          1e-4 * std::max(Dtype(1), std::abs(expected.cpu_data()[i])));
+    }
+    // Writing the weights requantizes them.
+    caffe_scal(float_layer.blobs()[0]->count(), Dtype(2),
+        float_layer.blobs()[0]->mutable_cpu_data());
+    float_layer.Forward(quantized_bottom_vec, blob_top_vec_);
+    expected.CopyFrom(*blob_top_);
+    int8_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], blob_top_->cpu_data()[i],
+          1e-4 * std::max(Dtype(1), std::abs(expected.cpu_data()[i])));
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuantizeTest, TestDtypes);
+
+TYPED_TEST(QuantizeTest, TestInputQuantization) {
+  QuantizationParameter param;
+  param.set_input_min(-0.5);
+  param.set_input_max(2.5);
+  TypeParam scale;
+  int zero_point;
+  GetInputQuantization(param, &scale, &zero_point);
+  EXPECT_NEAR(3. / 127, scale, 1e-6);
+  EXPECT_EQ(21, zero_point);
+  const TypeParam x[] = { -1, -0.5, 0, 1, 2.5, 3 };
+  uint8_t q[6];
+  caffe_cpu_quantize_inputs(6, x, scale, zero_point, q);
+  EXPECT_EQ(0, q[0]);
+  EXPECT_EQ(0, q[1]);
+  EXPECT_EQ(21, q[2]);
+  EXPECT_EQ(63, q[3]);
+  EXPECT_EQ(127, q[4]);
+  EXPECT_EQ(127, q[5]);
+  // Ranges without 0 widen to include it.
+  param.set_input_min(1);
+  GetInputQuantization(param, &scale, &zero_point);
+  EXPECT_NEAR(2.5 / 127, scale, 1e-6);
+  EXPECT_EQ(0, zero_point);
+}
+
+TYPED_TEST(QuantizeTest, TestIm2patches) {
+  // The patches of the first 2 channels of an image of 3.
+  const int channels = 2;
+  const int pixel_stride = 3;
+  const int height = 5;
+  const int width = 6;
+  const int spatial_dim = height * width;
+  vector<uint8_t> image(pixel_stride * spatial_dim);
+  vector<TypeParam> float_image(channels * spatial_dim);
+  for (int i = 0; i < image.size(); ++i) {
+    image[i] = 1 + i % 120;
+    if (i % pixel_stride < channels) {
+      float_image[i % pixel_stride * spatial_dim + i / pixel_stride] =
+          image[i];
+    }
+  }
+  // 3 x 2 kernels with stride 2 x 1 and padding 1 x 2.
+  const int height_col = (height + 2 - 3) / 2 + 1;
+  const int width_col = (width + 4 - 2) / 1 + 1;
+  const int taps = 3 * 2;
+  const int patch_size = channels * taps;
+  const int ldp = 16;
+  vector<TypeParam> col(patch_size * height_col * width_col);
+  im2col_cpu(&float_image[0], channels, height, width, 3, 2, 1, 2, 2, 1,
+      &col[0]);
+  for (int stride = pixel_stride; stride >= channels; --stride) {
+    vector<uint8_t> patches(height_col * width_col * ldp);
+    if (stride == channels) {
+      // Without the third channel.
+      for (int i = 0; i < spatial_dim; ++i) {
+        image[i * channels] = image[i * pixel_stride];
+        image[i * channels + 1] = image[i * pixel_stride + 1];
+      }
+    }
+    im2patches_cpu(&image[0], channels, height, width, 3, 2, 1, 2, 2, 1,
+        stride, 200, ldp, &patches[0]);
+    for (int p = 0; p < height_col * width_col; ++p) {
+      for (int c = 0; c < channels; ++c) {
+        for (int t = 0; t < taps; ++t) {
+          const TypeParam value = col[(c * taps + t) * height_col * width_col
+              + p];
+          EXPECT_EQ(value == 0 ? 200 : value,
+              patches[p * ldp + t * channels + c]);
+        }
+      }
+      for (int k = patch_size; k < ldp; ++k) {
+        EXPECT_EQ(0, patches[p * ldp + k]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(QuantizeTest, TestBlobProto) {
+  Blob<TypeParam> weights(3, 2, 2, 2);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&weights);
+  weights.mutable_cpu_data()[8] = 0;
+  BlobProto proto;
+  weights.ToProto(&proto);
+  QuantizeBlobProto(3, &proto);
+  EXPECT_EQ(0, proto.data_size());
+  EXPECT_EQ(24, proto.int8_data().size());
+  EXPECT_EQ(3, proto.int8_scale_size());
+  Blob<TypeParam> loaded;
+  loaded.FromProto(proto);
+  ASSERT_EQ(3, loaded.num());
+  QuantizedWeights<TypeParam> quantized;
+  quantized.Update(loaded, 3);
+  const int padded_cols = quantized.padded_cols();
+  EXPECT_EQ(32, padded_cols);
+  for (int r = 0; r < 3; ++r) {
+    TypeParam max_abs = 0;
+    int sum = 0;
+    for (int i = 0; i < 8; ++i) {
+      max_abs = std::max(max_abs, std::abs(weights.cpu_data()[r * 8 + i]));
+      // The loaded weights quantize to the codes they were loaded from.
+      EXPECT_EQ(static_cast<int8_t>(proto.int8_data()[r * 8 + i]),
+          quantized.data()[r * padded_cols + i]);
+      sum += quantized.data()[r * padded_cols + i];
+      EXPECT_NEAR(weights.cpu_data()[r * 8 + i], loaded.cpu_data()[r * 8 + i],
+          proto.int8_scale(r) / 2 + 1e-6);
+    }
+    for (int i = 8; i < padded_cols; ++i) {
+      EXPECT_EQ(0, quantized.data()[r * padded_cols + i]);
+    }
+    EXPECT_NEAR(max_abs / 127, proto.int8_scale(r), 1e-6);
+    EXPECT_NEAR(max_abs / 127, quantized.scales()[r], 1e-6);
+    EXPECT_EQ(sum, quantized.sums()[r]);
+  }
+  EXPECT_EQ(0, loaded.cpu_data()[8]);
+}
+
+TYPED_TEST(QuantizeTest, TestConvertToHalf) {
+  NetParameter param;
+  LayerParameter* layer_param = param.add_layer();
+  Blob<TypeParam> weights(2, 3, 1, 5);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&weights);
+  weights.ToProto(layer_param->add_blobs());
+  layer_param->add_blobs()->set_num(0);
+  ConvertNetWeightsToHalf(&param);
+  const BlobProto& proto = layer_param->blobs(0);
+  EXPECT_EQ(0, proto.data_size());
+  EXPECT_EQ(2 * weights.count(), proto.half_data().size());
+  EXPECT_FALSE(layer_param->blobs(1).has_half_data());
+  Blob<TypeParam> loaded;
+  loaded.FromProto(proto);
+  ASSERT_EQ(weights.count(), loaded.count());
+  for (int i = 0; i < weights.count(); ++i) {
+    // Half precision has 11 significant bits.
+    EXPECT_NEAR(weights.cpu_data()[i], loaded.cpu_data()[i],
+        std::abs(weights.cpu_data()[i]) / 2048);
+  }
+}
+
+TYPED_TEST(QuantizeTest, TestConvolution) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(6);
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(1);
+  convolution_param->set_pad(1);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  convolution_param->set_fused_activation(
+      ConvolutionParameter_Activation_RELU);
+  this->template TestInt8<ConvolutionLayer<TypeParam> >(layer_param, 6);
+}
+
+TYPED_TEST(QuantizeTest, TestConvolution1x1) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(5);
+  convolution_param->set_kernel_size(1);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->template TestInt8<ConvolutionLayer<TypeParam> >(layer_param, 5);
+}
+
+TYPED_TEST(QuantizeTest, TestInnerProduct) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(11);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  this->template TestInt8<InnerProductLayer<TypeParam> >(layer_param, 11);
+}
+
+TYPED_TEST(QuantizeTest, TestCalibrateQuantization) {
+  typedef TypeParam Dtype;
+  const string& proto =
+      "name: 'TestNetwork' "
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { num: 4 channels: 3 height: 6 width: 5 "
+      "    data_filler { type: 'uniform' min: -1 max: 3 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv' convolution_param { num_output: 8 kernel_size: 3 "
+      "    pad: 1 weight_filler { type: 'gaussian' std: 0.3 } "
+      "    bias_filler { type: 'gaussian' } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 10 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } } } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Caffe::set_random_seed(1701);
+  Net<Dtype> net(param);
+  NetParameter quantized_param(param);
+  CalibrateQuantization(&net, 2, &quantized_param);
+  EXPECT_FALSE(quantized_param.layer(0).has_quantization_param());
+  const QuantizationParameter& conv_quantization =
+      quantized_param.layer(1).quantization_param();
+  EXPECT_NEAR(-1, conv_quantization.input_min(), 0.05);
+  EXPECT_NEAR(3, conv_quantization.input_max(), 0.05);
+  // The ReLU output, which the IP layer reads, has no negative values.
+  const QuantizationParameter& ip_quantization =
+      quantized_param.layer(3).quantization_param();
+  EXPECT_EQ(0, ip_quantization.input_min());
+  EXPECT_GT(ip_quantization.input_max(), 0);
+  // Both nets score the same batch, and the int8 net the quantized weights.
+  NetParameter weights;
+  net.ToProto(&weights);
+  QuantizeNetWeights(&weights);
+  EXPECT_TRUE(weights.layer(1).blobs(0).has_int8_data());
+  EXPECT_FALSE(weights.layer(1).blobs(1).has_int8_data());
+  Net<Dtype> int8_net(quantized_param);
+  int8_net.CopyTrainedLayersFrom(weights);
+  Caffe::set_random_seed(1702);
+  net.ForwardPrefilled();
+  Caffe::set_random_seed(1702);
+  int8_net.ForwardPrefilled();
+  const Blob<Dtype>& ip = *net.blob_by_name("ip");
+  const Blob<Dtype>& int8_ip = *int8_net.blob_by_name("ip");
+  Dtype max_abs = 0;
+  for (int i = 0; i < ip.count(); ++i) {
+    max_abs = std::max(max_abs, std::abs(ip.cpu_data()[i]));
+  }
+  for (int i = 0; i < ip.count(); ++i) {
+    EXPECT_NEAR(ip.cpu_data()[i], int8_ip.cpu_data()[i], 0.05 * max_abs);
+  }
+}
+
+}  // namespace caffe
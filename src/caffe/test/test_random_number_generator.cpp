@@ -1,5 +1,6 @@
 #include <cmath>
 #include <cstring>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -396,6 +397,37 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestRngThreads) {
+  // Enough numbers for several chunks, and a partial last Box-Muller block.
+  const int n = 100003;
+  vector<TypeParam> uniform[2];
+  vector<TypeParam> gaussian[2];
+  vector<unsigned int> bernoulli[2];
+  for (int i = 0; i < 2; ++i) {
+    Caffe::set_num_threads(i == 0 ? 1 : 3);
+    Caffe::set_random_seed(this->seed_);
+    uniform[i].resize(n);
+    caffe_rng_uniform(n, TypeParam(-1), TypeParam(2), &uniform[i][0]);
+    gaussian[i].resize(n);
+    caffe_rng_gaussian(n, TypeParam(1), TypeParam(2), &gaussian[i][0]);
+    bernoulli[i].resize(n);
+    caffe_rng_bernoulli(n, TypeParam(0.3), &bernoulli[i][0]);
+  }
+  Caffe::set_num_threads(1);
+  for (int j = 0; j < n; ++j) {
+    EXPECT_EQ(uniform[0][j], uniform[1][j]);
+    EXPECT_EQ(gaussian[0][j], gaussian[1][j]);
+    EXPECT_EQ(bernoulli[0][j], bernoulli[1][j]);
+  }
+  // Each call draws new numbers.
+  caffe_rng_uniform(n, TypeParam(-1), TypeParam(2), &uniform[1][0]);
+  int num_same = 0;
+  for (int j = 0; j < n; ++j) {
+    num_same += uniform[0][j] == uniform[1][j];
+  }
+  EXPECT_LT(num_same, 10);
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
@@ -186,4 +186,81 @@ TYPED_TEST(SliceLayerTest, TestGradientAcrossChannels) {
     this->blob_top_vec_0_);
 }
 
+TYPED_TEST(SliceLayerTest, TestShareTopsAcrossChannels) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(1, 12, 2, 3);
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->add_slice_point(4);
+  layer_param.mutable_slice_param()->set_share_tops(true);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // The first pass copies the tops and makes them views of the bottom.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  EXPECT_EQ(bottom_data, this->blob_top_0_->cpu_data());
+  EXPECT_EQ(bottom_data + this->blob_top_0_->count(),
+      this->blob_top_1_->cpu_data());
+  for (int c = 0; c < this->blob_top_1_->channels(); ++c) {
+    EXPECT_EQ(this->blob_bottom_->data_at(0, c + 4, 1, 2),
+        this->blob_top_1_->data_at(0, c, 1, 2));
+  }
+  // Later writes to the bottom show in the tops.
+  caffe_set(this->blob_bottom_->count(), Dtype(2),
+      this->blob_bottom_->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  for (int i = 0; i < this->blob_top_1_->count(); ++i) {
+    EXPECT_EQ(2, this->blob_top_1_->cpu_data()[i]);
+  }
+  caffe_set(this->blob_top_1_->count(), Dtype(3),
+      this->blob_top_1_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_0_, propagate_down,
+      this->blob_bottom_vec_);
+  EXPECT_EQ(3, this->blob_bottom_->diff_at(0, 4, 0, 0));
+  EXPECT_EQ(3, this->blob_bottom_->diff_at(0, 11, 1, 2));
+}
+
+TYPED_TEST(SliceLayerTest, TestShareTopsAfterReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(1, 12, 2, 3);
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_slice_dim(1);
+  layer_param.mutable_slice_param()->add_slice_point(4);
+  layer_param.mutable_slice_param()->set_share_tops(true);
+  SliceLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // Shrinking the bottom within its memory moves the range of the second
+  // top.
+  this->blob_bottom_->Reshape(1, 12, 1, 3);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    this->blob_bottom_->mutable_cpu_data()[i] = i;
+  }
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_0_);
+  // The tops are the same as without sharing, and views again.
+  const int count_0 = this->blob_top_0_->count();
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  for (int i = 0; i < count_0; ++i) {
+    EXPECT_EQ(i, this->blob_top_0_->cpu_data()[i]);
+  }
+  for (int i = 0; i < this->blob_top_1_->count(); ++i) {
+    EXPECT_EQ(count_0 + i, this->blob_top_1_->cpu_data()[i]);
+  }
+  EXPECT_EQ(bottom_data + count_0, this->blob_top_1_->cpu_data());
+}
+
+TYPED_TEST(SliceLayerTest, TestGradientShareTops) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Gradient checks are slow; reduce blob size.
+  this->ReduceBottomBlobSize();
+  LayerParameter layer_param;
+  layer_param.mutable_slice_param()->set_slice_dim(0);
+  layer_param.mutable_slice_param()->set_share_tops(true);
+  SliceLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+    this->blob_top_vec_0_);
+}
+
 }  // namespace caffe
@@ -7,6 +7,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -80,6 +81,66 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardBackwardTiles) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Wide enough for each image to be split into tiles, and more tiles than
+  // threads.
+  this->blob_bottom_->Reshape(2, 5, 23, 25);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  Caffe::set_num_threads(3);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Caffe::set_num_threads(1);
+  for (int i = 0; i < this->blob_bottom_->num(); ++i) {
+    for (int k = 0; k < this->blob_bottom_->height(); ++k) {
+      for (int l = 0; l < this->blob_bottom_->width(); ++l) {
+        Dtype scale = 0;
+        Dtype dot = 0;
+        for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+          scale += exp(this->blob_bottom_->data_at(i, j, k, l));
+          dot += this->blob_top_->data_at(i, j, k, l) *
+              this->blob_top_->diff_at(i, j, k, l);
+        }
+        for (int j = 0; j < this->blob_bottom_->channels(); ++j) {
+          const Dtype top_data = this->blob_top_->data_at(i, j, k, l);
+          EXPECT_NEAR(exp(this->blob_bottom_->data_at(i, j, k, l)) / scale,
+              top_data, 1e-4);
+          EXPECT_NEAR((this->blob_top_->diff_at(i, j, k, l) - dot) * top_data,
+              this->blob_bottom_->diff_at(i, j, k, l), 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(SoftmaxLayerTest, TestForwardFastMath) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> reference_layer(layer_param);
+  Blob<Dtype> reference;
+  vector<Blob<Dtype>*> reference_vec(1, &reference);
+  reference_layer.SetUp(this->blob_bottom_vec_, reference_vec);
+  reference_layer.Forward(this->blob_bottom_vec_, reference_vec);
+  layer_param.mutable_softmax_param()->set_fast_math(true);
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < reference.count(); ++i) {
+    EXPECT_NEAR(reference.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-6 * reference.cpu_data()[i]);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public ::testing::Test {
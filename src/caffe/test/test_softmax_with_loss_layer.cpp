@@ -107,4 +107,17 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientUnnormalized) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The loss of each thread is summed after the pass over its images.
+  Caffe::set_num_threads(3);
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  Caffe::set_num_threads(1);
+}
+
 }  // namespace caffe
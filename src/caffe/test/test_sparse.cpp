@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/vision_layers.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SparseTest : public ::testing::Test {
+ protected:
+  SparseTest()
+      : blob_bottom_(new Blob<Dtype>(3, 4, 6, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_mode(Caffe::CPU);
+    FillBottom();
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~SparseTest() { delete blob_bottom_; delete blob_top_; }
+
+  void FillBottom() {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+  }
+
+  // Checks that layer_param in the TEST phase, with its weights pruned,
+  // computes what it computes with the sparse path turned off.
+  template <typename LayerType>
+  void TestSparse(LayerParameter layer_param) {
+    layer_param.set_phase(TEST);
+    LayerType sparse_layer(layer_param);
+    sparse_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer_param.mutable_convolution_param()->set_sparse_threshold(2);
+    layer_param.mutable_inner_product_param()->set_sparse_threshold(2);
+    LayerType dense_layer(layer_param);
+    dense_layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    BlobProto proto;
+    dense_layer.blobs()[0]->ToProto(&proto);
+    PruneBlobProto(0.9, &proto);
+    dense_layer.blobs()[0]->FromProto(proto);
+    for (int i = 0; i < dense_layer.blobs().size(); ++i) {
+      sparse_layer.blobs()[i]->ShareData(*dense_layer.blobs()[i]);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+      dense_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      Blob<Dtype> expected;
+      expected.CopyFrom(*blob_top_, false, true);
+      Caffe::set_num_threads(3);
+      sparse_layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      Caffe::set_num_threads(1);
+      for (int i = 0; i < expected.count(); ++i) {
+        EXPECT_NEAR(expected.cpu_data()[i], blob_top_->cpu_data()[i], 1e-4);
+      }
+      // Writing the weights updates the sparse copy.
+      caffe_scal(dense_layer.blobs()[0]->count(), Dtype(-2),
+          dense_layer.blobs()[0]->mutable_cpu_data());
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SparseTest, TestDtypes);
+
+TYPED_TEST(SparseTest, TestPruneBlobProto) {
+  Blob<TypeParam> weights(4, 5, 1, 1);
+  for (int i = 0; i < weights.count(); ++i) {
+    // Ties at the cutoff magnitude.
+    weights.mutable_cpu_data()[i] = (i % 2 ? 1 : -1) * (i / 4 + 1);
+  }
+  BlobProto proto;
+  weights.ToProto(&proto);
+  PruneBlobProto(0.5, &proto);
+  int zeros = 0;
+  for (int i = 0; i < proto.data_size(); ++i) {
+    if (proto.data(i) == 0) {
+      ++zeros;
+      EXPECT_LE(std::abs(weights.cpu_data()[i]), 3);
+    } else {
+      EXPECT_EQ(weights.cpu_data()[i], proto.data(i));
+      EXPECT_GE(std::abs(weights.cpu_data()[i]), 3);
+    }
+  }
+  EXPECT_EQ(10, zeros);
+}
+
+TYPED_TEST(SparseTest, TestSparseWeights) {
+  Blob<TypeParam> weights(3, 1, 1, 4);
+  const TypeParam w[] = { 0, 1, 0, 2,  0, 0, 0, 0,  3, 0, 0, 0 };
+  caffe_copy(12, w, weights.mutable_cpu_data());
+  SparseWeights<TypeParam> sparse;
+  EXPECT_FALSE(sparse.Update(weights, 3, 0.8));
+  EXPECT_FALSE(sparse.sparse());
+  EXPECT_TRUE(sparse.Update(weights, 3, 0.75));
+  EXPECT_TRUE(sparse.sparse());
+  const int row_ptr[] = { 0, 2, 2, 3 };
+  const int col_idx[] = { 1, 3, 0 };
+  for (int r = 0; r <= 3; ++r) { EXPECT_EQ(row_ptr[r], sparse.row_ptr()[r]); }
+  for (int p = 0; p < 3; ++p) {
+    EXPECT_EQ(col_idx[p], sparse.col_idx()[p]);
+    EXPECT_EQ(p + 1, sparse.values()[p]);
+  }
+  // Writing the weights rebuilds the rows.
+  weights.mutable_cpu_data()[5] = 4;
+  EXPECT_FALSE(sparse.Update(weights, 3, 0.75));
+}
+
+TYPED_TEST(SparseTest, TestInnerProduct) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(11);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  this->template TestSparse<InnerProductLayer<TypeParam> >(layer_param);
+}
+
+TYPED_TEST(SparseTest, TestInnerProductSingleInput) {
+  this->blob_bottom_->Reshape(1, 4, 6, 5);
+  this->FillBottom();
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(11);
+  inner_product_param->set_bias_term(false);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  this->template TestSparse<InnerProductLayer<TypeParam> >(layer_param);
+}
+
+TYPED_TEST(SparseTest, TestConvolution) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(6);
+  convolution_param->set_kernel_size(3);
+  convolution_param->set_pad(1);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->template TestSparse<ConvolutionLayer<TypeParam> >(layer_param);
+}
+
+TYPED_TEST(SparseTest, TestConvolution1x1) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(5);
+  convolution_param->set_kernel_size(1);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->template TestSparse<ConvolutionLayer<TypeParam> >(layer_param);
+}
+
+}  // namespace caffe
@@ -85,6 +85,39 @@ TYPED_TEST(SplitLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SplitLayerTest, TestBackwardManyTops) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Use more than four tops and more elements than one block of the CPU sum.
+  Blob<Dtype> bottom(3, 4, 20, 20);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  const int kNumTops = 6;
+  vector<shared_ptr<Blob<Dtype> > > tops(kNumTops);
+  vector<Blob<Dtype>*> top_vec(kNumTops);
+  for (int i = 0; i < kNumTops; ++i) {
+    tops[i].reset(new Blob<Dtype>());
+    top_vec[i] = tops[i].get();
+  }
+  LayerParameter layer_param;
+  SplitLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, top_vec);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < kNumTops; ++i) {
+    filler.Fill(tops[i].get());
+    caffe_copy(tops[i]->count(), tops[i]->cpu_data(),
+               tops[i]->mutable_cpu_diff());
+  }
+  layer.Forward(bottom_vec, top_vec);
+  layer.Backward(top_vec, vector<bool>(1, true), bottom_vec);
+  for (int j = 0; j < bottom.count(); ++j) {
+    Dtype expected = 0;
+    for (int i = 0; i < kNumTops; ++i) {
+      expected += tops[i]->cpu_diff()[j];
+    }
+    EXPECT_NEAR(expected, bottom.cpu_diff()[j], 1e-4);
+  }
+}
+
 
 class SplitLayerInsertionTest : public ::testing::Test {
  protected:
@@ -39,6 +39,101 @@ class StochasticPoolingLayerTest : public ::testing::Test {
     delete blob_bottom_; delete blob_top_;
   }
 
+  void TestStochastic() {
+    LayerParameter layer_param;
+    layer_param.set_phase(TRAIN);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    // Check if the output is correct - it should do random sampling
+    const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    Dtype total = 0;
+    for (int n = 0; n < this->blob_top_->num(); ++n) {
+      for (int c = 0; c < this->blob_top_->channels(); ++c) {
+        for (int ph = 0; ph < this->blob_top_->height(); ++ph) {
+          for (int pw = 0; pw < this->blob_top_->width(); ++pw) {
+            Dtype pooled = top_data[this->blob_top_->offset(n, c, ph, pw)];
+            total += pooled;
+            int hstart = ph * 2;
+            int hend = min(hstart + 3, this->blob_bottom_->height());
+            int wstart = pw * 2;
+            int wend = min(wstart + 3, this->blob_bottom_->width());
+            bool has_equal = false;
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                has_equal |= (pooled == bottom_data[this->blob_bottom_->
+                    offset(n, c, h, w)]);
+              }
+            }
+            EXPECT_TRUE(has_equal);
+          }
+        }
+      }
+    }
+    // When we are doing stochastic pooling, the average we get should be higher
+    // than the simple data average since we are weighting more on higher-valued
+    // ones.
+    EXPECT_GE(total / this->blob_top_->count(), 0.55);
+  }
+
+  void TestStochasticTestPhase() {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    // Check if the output is correct - it should do random sampling
+    const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int n = 0; n < this->blob_top_->num(); ++n) {
+      for (int c = 0; c < this->blob_top_->channels(); ++c) {
+        for (int ph = 0; ph < this->blob_top_->height(); ++ph) {
+          for (int pw = 0; pw < this->blob_top_->width(); ++pw) {
+            Dtype pooled = top_data[this->blob_top_->offset(n, c, ph, pw)];
+            int hstart = ph * 2;
+            int hend = min(hstart + 3, this->blob_bottom_->height());
+            int wstart = pw * 2;
+            int wend = min(wstart + 3, this->blob_bottom_->width());
+            bool smaller_than_max = false;
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                smaller_than_max |= (pooled <= bottom_data[this->blob_bottom_->
+                    offset(n, c, h, w)]);
+              }
+            }
+            EXPECT_TRUE(smaller_than_max);
+          }
+        }
+      }
+    }
+  }
+
+  void TestGradient() {
+    LayerParameter layer_param;
+    layer_param.set_phase(TRAIN);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
+    PoolingLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-4, 1e-2);
+    // it is too expensive to call curand multiple times, so we don't do an
+    // exhaustive gradient check.
+    checker.CheckGradient(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_top_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
@@ -60,8 +155,23 @@ TYPED_TEST(StochasticPoolingLayerTest, TestSetup) {
   EXPECT_EQ(this->blob_top_->width(), 2);
 }
 
-TYPED_TEST(StochasticPoolingLayerTest, TestStochasticGPU) {
-  Caffe::set_mode(Caffe::GPU);
+TYPED_TEST(StochasticPoolingLayerTest, TestStochasticCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  this->TestStochastic();
+}
+
+TYPED_TEST(StochasticPoolingLayerTest, TestStochasticCPUTestPhase) {
+  Caffe::set_mode(Caffe::CPU);
+  this->TestStochasticTestPhase();
+}
+
+TYPED_TEST(StochasticPoolingLayerTest, TestGradientCPU) {
+  Caffe::set_mode(Caffe::CPU);
+  this->TestGradient();
+}
+
+TYPED_TEST(StochasticPoolingLayerTest, TestStochasticCPUThreads) {
+  Caffe::set_mode(Caffe::CPU);
   LayerParameter layer_param;
   layer_param.set_phase(TRAIN);
   PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
@@ -70,94 +180,44 @@ TYPED_TEST(StochasticPoolingLayerTest, TestStochasticGPU) {
   pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
   PoolingLayer<TypeParam> layer(layer_param);
   layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Caffe::set_random_seed(1702);
   layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
-
-  // Check if the output is correct - it should do random sampling
-  const TypeParam* bottom_data = this->blob_bottom_->cpu_data();
-  const TypeParam* top_data = this->blob_top_->cpu_data();
-  TypeParam total = 0;
-  for (int n = 0; n < this->blob_top_->num(); ++n) {
-    for (int c = 0; c < this->blob_top_->channels(); ++c) {
-      for (int ph = 0; ph < this->blob_top_->height(); ++ph) {
-        for (int pw = 0; pw < this->blob_top_->width(); ++pw) {
-          TypeParam pooled = top_data[this->blob_top_->offset(n, c, ph, pw)];
-          total += pooled;
-          int hstart = ph * 2;
-          int hend = min(hstart + 3, this->blob_bottom_->height());
-          int wstart = pw * 2;
-          int wend = min(wstart + 3, this->blob_bottom_->width());
-          bool has_equal = false;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              has_equal |= (pooled == bottom_data[this->blob_bottom_->
-                  offset(n, c, h, w)]);
-            }
-          }
-          EXPECT_TRUE(has_equal);
-        }
-      }
-    }
+  Blob<TypeParam> expected;
+  expected.CopyFrom(*this->blob_top_, false, true);
+  // The samples do not depend on the number of threads.
+  Caffe::set_num_threads(3);
+  Caffe::set_random_seed(1702);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+    this->blob_top_->mutable_cpu_diff()[i] = i;
+  }
+  // Each sample takes the whole gradient of its output.
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+      this->blob_bottom_vec_);
+  Caffe::set_num_threads(1);
+  const TypeParam* bottom_diff = this->blob_bottom_->cpu_diff();
+  TypeParam sum = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    sum += bottom_diff[i];
   }
-  // When we are doing stochastic pooling, the average we get should be higher
-  // than the simple data average since we are weighting more on higher-valued
-  // ones.
-  EXPECT_GE(total / this->blob_top_->count(), 0.55);
+  const int count = this->blob_top_->count();
+  EXPECT_EQ(TypeParam(count * (count - 1) / 2), sum);
 }
 
-TYPED_TEST(StochasticPoolingLayerTest, TestStochasticGPUTestPhase) {
+TYPED_TEST(StochasticPoolingLayerTest, TestStochasticGPU) {
   Caffe::set_mode(Caffe::GPU);
-  LayerParameter layer_param;
-  layer_param.set_phase(TEST);
-  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
-  pooling_param->set_kernel_size(3);
-  pooling_param->set_stride(2);
-  pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
-  PoolingLayer<TypeParam> layer(layer_param);
-  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
-  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->TestStochastic();
+}
 
-  // Check if the output is correct - it should do random sampling
-  const TypeParam* bottom_data = this->blob_bottom_->cpu_data();
-  const TypeParam* top_data = this->blob_top_->cpu_data();
-  for (int n = 0; n < this->blob_top_->num(); ++n) {
-    for (int c = 0; c < this->blob_top_->channels(); ++c) {
-      for (int ph = 0; ph < this->blob_top_->height(); ++ph) {
-        for (int pw = 0; pw < this->blob_top_->width(); ++pw) {
-          TypeParam pooled = top_data[this->blob_top_->offset(n, c, ph, pw)];
-          int hstart = ph * 2;
-          int hend = min(hstart + 3, this->blob_bottom_->height());
-          int wstart = pw * 2;
-          int wend = min(wstart + 3, this->blob_bottom_->width());
-          bool smaller_than_max = false;
-          for (int h = hstart; h < hend; ++h) {
-            for (int w = wstart; w < wend; ++w) {
-              smaller_than_max |= (pooled <= bottom_data[this->blob_bottom_->
-                  offset(n, c, h, w)]);
-            }
-          }
-          EXPECT_TRUE(smaller_than_max);
-        }
-      }
-    }
-  }
+TYPED_TEST(StochasticPoolingLayerTest, TestStochasticGPUTestPhase) {
+  Caffe::set_mode(Caffe::GPU);
+  this->TestStochasticTestPhase();
 }
 
 TYPED_TEST(StochasticPoolingLayerTest, TestGradientGPU) {
   Caffe::set_mode(Caffe::GPU);
-  LayerParameter layer_param;
-  layer_param.set_phase(TRAIN);
-  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
-  pooling_param->set_kernel_size(3);
-  pooling_param->set_stride(2);
-  pooling_param->set_pool(PoolingParameter_PoolMethod_STOCHASTIC);
-  PoolingLayer<TypeParam> layer(layer_param);
-  GradientChecker<TypeParam> checker(1e-4, 1e-2);
-  // it is too expensive to call curand multiple times, so we don't do an
-  // exhaustive gradient check.
-  checker.CheckGradient(&layer, this->blob_bottom_vec_,
-      this->blob_top_vec_);
+  this->TestGradient();
 }
 
-
-
 }  // namespace caffe
@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include <cstring>
 #include <vector>
 
@@ -14,6 +16,16 @@ namespace caffe {
 
 class SyncedMemoryTest : public ::testing::Test {};
 
+namespace {
+
+void AllocateWithCurrentAccount(shared_ptr<MemoryAccount>* current) {
+  *current = MemoryAccount::current();
+  SyncedMemory mem(4);
+  mem.mutable_cpu_data();
+}
+
+}  // namespace
+
 TEST_F(SyncedMemoryTest, TestInitialization) {
   SyncedMemory mem(10);
   EXPECT_EQ(mem.head(), SyncedMemory::UNINITIALIZED);
@@ -51,6 +63,43 @@ TEST_F(SyncedMemoryTest, TestAllocationGPU) {
 
 #endif
 
+TEST_F(SyncedMemoryTest, TestMemoryAccount) {
+  shared_ptr<MemoryAccount> parent(new MemoryAccount("net", "total"));
+  shared_ptr<MemoryAccount> account(
+      new MemoryAccount("layer", "internal", parent));
+  MemoryAccount::set_current(account);
+  SyncedMemory* mem = new SyncedMemory(10);
+  MemoryAccount::set_current(shared_ptr<MemoryAccount>());
+  EXPECT_EQ(account->cpu_bytes(), 0);
+  mem->mutable_cpu_data();
+  EXPECT_EQ(account->cpu_bytes(), 10);
+  EXPECT_EQ(parent->cpu_bytes(), 10);
+  SyncedMemory other(6);
+  other.set_account(account);
+  other.cpu_data();
+  EXPECT_EQ(account->cpu_bytes(), 16);
+  delete mem;
+  EXPECT_EQ(account->cpu_bytes(), 6);
+  EXPECT_EQ(account->peak_cpu_bytes(), 16);
+  EXPECT_EQ(parent->peak_cpu_bytes(), 16);
+  account->ResetPeak();
+  EXPECT_EQ(account->peak_cpu_bytes(), 6);
+  EXPECT_EQ(parent->peak_cpu_bytes(), 16);
+  EXPECT_EQ(account->gpu_bytes(), 0);
+}
+
+TEST_F(SyncedMemoryTest, TestMemoryAccountPerThread) {
+  shared_ptr<MemoryAccount> account(new MemoryAccount("layer", "internal"));
+  MemoryAccount::set_current(account);
+  shared_ptr<MemoryAccount> thread_account(account);
+  boost::thread thread(&AllocateWithCurrentAccount, &thread_account);
+  thread.join();
+  EXPECT_FALSE(thread_account);
+  EXPECT_EQ(MemoryAccount::current(), account);
+  MemoryAccount::set_current(shared_ptr<MemoryAccount>());
+  EXPECT_EQ(account->cpu_bytes(), 0);
+}
+
 TEST_F(SyncedMemoryTest, TestCPUWrite) {
   SyncedMemory mem(10);
   void* cpu_data = mem.mutable_cpu_data();
@@ -68,6 +117,57 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestView) {
+  shared_ptr<MemoryAccount> account(new MemoryAccount("layer", "internal"));
+  MemoryAccount::set_current(account);
+  shared_ptr<SyncedMemory> base(new SyncedMemory(10));
+  shared_ptr<SyncedMemory> view(new SyncedMemory(base, 4, 6));
+  MemoryAccount::set_current(shared_ptr<MemoryAccount>());
+  EXPECT_TRUE(view->is_view());
+  EXPECT_TRUE(view->is_view_of(*base, 4));
+  EXPECT_FALSE(view->is_view_of(*base, 2));
+  EXPECT_EQ(view->size(), 6);
+  EXPECT_EQ(view->head(), SyncedMemory::UNINITIALIZED);
+  char* view_data = static_cast<char*>(view->mutable_cpu_data());
+  EXPECT_EQ(base->head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(view->head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(static_cast<const char*>(base->cpu_data()) + 4, view_data);
+  // Only the base is charged.
+  EXPECT_EQ(account->cpu_bytes(), 10);
+  caffe_memset(view->size(), 1, view_data);
+  // A view of a view views the base.
+  SyncedMemory view_of_view(view, 2, 3);
+  EXPECT_TRUE(view_of_view.is_view_of(*base, 6));
+  EXPECT_TRUE(view_of_view.is_view_of(*view, 2));
+  EXPECT_EQ(static_cast<const char*>(base->cpu_data()) + 6,
+      view_of_view.cpu_data());
+  // The view keeps the memory of the base.
+  const char* base_data = static_cast<const char*>(base->cpu_data());
+  base.reset();
+  EXPECT_EQ(account->cpu_bytes(), 10);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(base_data[i], i < 4 ? 0 : 1);
+  }
+  view.reset();
+  EXPECT_EQ(static_cast<const char*>(view_of_view.cpu_data()), base_data + 6);
+}
+
+TEST_F(SyncedMemoryTest, TestVersion) {
+  shared_ptr<SyncedMemory> base(new SyncedMemory(10));
+  SyncedMemory view(base, 4, 6);
+  const size_t version = base->version();
+  base->cpu_data();
+  EXPECT_EQ(base->version(), version);
+  base->mutable_cpu_data();
+  EXPECT_GT(base->version(), version);
+  // Writing through a view writes the base.
+  const size_t base_version = base->version();
+  EXPECT_EQ(view.version(), base_version);
+  view.mutable_cpu_data();
+  EXPECT_GT(base->version(), base_version);
+  EXPECT_EQ(view.version(), base->version());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,48 @@
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  ThreadPoolTest() : pool_(4), counts_(100, 0) {}
+
+ public:
+  void Count(int i) { ++counts_[i]; }
+
+  void RunNested(int i) {
+    pool_.Run(counts_.size(), boost::bind(&ThreadPoolTest::Count, this, _1));
+  }
+
+ protected:
+  ThreadPool pool_;
+  vector<int> counts_;
+};
+
+TEST_F(ThreadPoolTest, TestRunAllTasks) {
+  EXPECT_EQ(pool_.num_threads(), 4);
+  for (int iter = 0; iter < 10; ++iter) {
+    pool_.Run(counts_.size(), boost::bind(&ThreadPoolTest::Count, this, _1));
+  }
+  for (int i = 0; i < counts_.size(); ++i) {
+    EXPECT_EQ(counts_[i], 10);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNestedRun) {
+  // Nested regions run serially on their thread, so each task still runs
+  // exactly once per region and counts_ is only written by one thread.
+  pool_.Run(1, boost::bind(&ThreadPoolTest::RunNested, this, _1));
+  for (int i = 0; i < counts_.size(); ++i) {
+    EXPECT_EQ(counts_[i], 1);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,60 @@
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_activations.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Whether activation computes in place on the only top of convolution, so
+// that no other layer can see the convolution output before activation.
+bool CanFuse(const LayerParameter& convolution,
+    const LayerParameter& activation) {
+  if (convolution.type() != "Convolution" || convolution.top_size() != 1 ||
+      convolution.loss_weight_size() > 0 ||
+      convolution.convolution_param().fused_activation() !=
+      ConvolutionParameter_Activation_NONE) {
+    return false;
+  }
+  if ((activation.type() != "ReLU" && activation.type() != "Threshold") ||
+      activation.bottom_size() != 1 || activation.top_size() != 1 ||
+      activation.loss_weight_size() > 0) {
+    return false;
+  }
+  return activation.bottom(0) == convolution.top(0) &&
+      activation.top(0) == convolution.top(0);
+}
+
+}  // namespace
+
+void FuseActivations(const NetParameter& param, NetParameter* param_fused) {
+  param_fused->CopyFrom(param);
+  param_fused->clear_layer();
+  const bool backward_free = param.state().has_phase() &&
+      param.state().phase() == TEST && !param.force_backward();
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    LayerParameter* fused_layer_param = param_fused->add_layer();
+    fused_layer_param->CopyFrom(layer_param);
+    if (!backward_free || i + 1 == param.layer_size() ||
+        !CanFuse(layer_param, param.layer(i + 1))) {
+      continue;
+    }
+    const LayerParameter& activation = param.layer(++i);
+    ConvolutionParameter* conv_param =
+        fused_layer_param->mutable_convolution_param();
+    if (activation.type() == "ReLU") {
+      conv_param->set_fused_activation(ConvolutionParameter_Activation_RELU);
+      fused_layer_param->mutable_relu_param()->CopyFrom(
+          activation.relu_param());
+    } else {
+      conv_param->set_fused_activation(
+          ConvolutionParameter_Activation_THRESHOLD);
+      fused_layer_param->mutable_threshold_param()->CopyFrom(
+          activation.threshold_param());
+    }
+  }
+}
+
+}  // namespace caffe
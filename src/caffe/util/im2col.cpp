@@ -1,37 +1,190 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
+#include "caffe/common.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+namespace {
+
+// im2col/col2im only spread the channels of an image over the threads of
+// Caffe::thread_pool() when the column buffer has at least this many values.
+const int kIm2colParallelThreshold = 1 << 16;
+
+// The first output column (or row) in [0, size_col) whose input coordinate
+// col * stride - pad + offset falls at or beyond bound.
+inline int first_col_at(int bound, int pad, int offset, int stride,
+    int size_col) {
+  const int x = bound + pad - offset;
+  if (x <= 0) { return 0; }
+  return std::min((x + stride - 1) / stride, size_col);
+}
+
+// The shape of an im2col/col2im call, and how its image channels are split
+// into num_tasks tasks.
+struct Im2colShape {
+  int channels, height, width, kernel_h, kernel_w;
+  int pad_h, pad_w, stride_h, stride_w;
+  int height_col, width_col;
+  int num_tasks;
+
+  Im2colShape(int channels, int height, int width, int kernel_h,
+      int kernel_w, int pad_h, int pad_w, int stride_h, int stride_w)
+      : channels(channels), height(height), width(width),
+        kernel_h(kernel_h), kernel_w(kernel_w), pad_h(pad_h), pad_w(pad_w),
+        stride_h(stride_h), stride_w(stride_w),
+        height_col((height + 2 * pad_h - kernel_h) / stride_h + 1),
+        width_col((width + 2 * pad_w - kernel_w) / stride_w + 1) {
+    const int col_count = channels * kernel_h * kernel_w * height_col
+        * width_col;
+    num_tasks = (col_count < kIm2colParallelThreshold) ? 1 :
+        std::min(Caffe::num_threads(), channels);
+  }
+  inline int channel_begin(int task_id) const {
+    return channels * task_id / num_tasks;
+  }
+  inline int channel_end(int task_id) const {
+    return channels * (task_id + 1) / num_tasks;
+  }
+};
+
+template <typename Dtype>
+struct Im2colTask : public Im2colShape {
+  const Dtype* data_im;
+  Dtype* data_col;
+
+  Im2colTask(const Im2colShape& shape, const Dtype* data_im,
+      Dtype* data_col)
+      : Im2colShape(shape), data_im(data_im), data_col(data_col) {}
+
+  // Each row of the column buffer is an output row of one tap of one
+  // channel: a zero prefix and suffix where the tap falls into the padding,
+  // and in between a contiguous (stride 1) or strided copy of an image row.
+  void operator()(int task_id) const {
+    for (int c = this->channel_begin(task_id); c < this->channel_end(task_id);
+         ++c) {
+      const Dtype* im = data_im + c * this->height * this->width;
+      Dtype* col = data_col + c * this->kernel_h * this->kernel_w
+          * this->height_col * this->width_col;
+      for (int kh = 0; kh < this->kernel_h; ++kh) {
+        for (int kw = 0; kw < this->kernel_w; ++kw) {
+          const int w_begin = first_col_at(0, this->pad_w, kw, this->stride_w,
+              this->width_col);
+          const int w_end = first_col_at(this->width, this->pad_w, kw,
+              this->stride_w, this->width_col);
+          for (int h = 0; h < this->height_col; ++h, col += this->width_col) {
+            const int h_im = h * this->stride_h - this->pad_h + kh;
+            if (h_im < 0 || h_im >= this->height || w_begin >= w_end) {
+              memset(col, 0, sizeof(Dtype) * this->width_col);
+              continue;
+            }
+            memset(col, 0, sizeof(Dtype) * w_begin);
+            const Dtype* im_row = im + h_im * this->width
+                + w_begin * this->stride_w - this->pad_w + kw;
+            if (this->stride_w == 1) {
+              memcpy(col + w_begin, im_row, sizeof(Dtype) * (w_end - w_begin));
+            } else {
+              for (int w = w_begin; w < w_end; ++w, im_row += this->stride_w) {
+                col[w] = *im_row;
+              }
+            }
+            memset(col + w_end, 0, sizeof(Dtype) * (this->width_col - w_end));
+          }
+        }
+      }
+    }
+  }
+};
+
+template <typename Dtype>
+struct Col2imTask : public Im2colShape {
+  const Dtype* data_col;
+  const Dtype* kernels;
+  Dtype* data_im;
+
+  Col2imTask(const Im2colShape& shape, const Dtype* data_col,
+      const Dtype* kernels, Dtype* data_im)
+      : Im2colShape(shape), data_col(data_col), kernels(kernels),
+        data_im(data_im) {}
+
+  // The reverse of Im2colTask, one image row at a time so that the row stays
+  // in cache while it sums up: the kernel rows kh = (y + pad_h) % stride_h,
+  // + stride_h, ... reach image row y from column buffer row
+  // (y + pad_h - kh) / stride_h.  With kernels, the column buffer would be
+  // data_col times the kernel of each channel, and is never formed.
+  void operator()(int task_id) const {
+    vector<int> w_begin(this->kernel_w), w_end(this->kernel_w);
+    for (int kw = 0; kw < this->kernel_w; ++kw) {
+      w_begin[kw] = first_col_at(0, this->pad_w, kw, this->stride_w,
+          this->width_col);
+      w_end[kw] = first_col_at(this->width, this->pad_w, kw, this->stride_w,
+          this->width_col);
+    }
+    const int col_dim = this->height_col * this->width_col;
+    for (int c = this->channel_begin(task_id); c < this->channel_end(task_id);
+         ++c) {
+      Dtype* im = data_im + c * this->height * this->width;
+      const Dtype* col = kernels ? data_col + c * col_dim :
+          data_col + c * this->kernel_h * this->kernel_w * col_dim;
+      const Dtype* kernel = kernels ?
+          kernels + c * this->kernel_h * this->kernel_w : NULL;
+      for (int y = 0; y < this->height; ++y) {
+        Dtype* im_row = im + y * this->width;
+        memset(im_row, 0, sizeof(Dtype) * this->width);
+        for (int kh = (y + this->pad_h) % this->stride_h;
+             kh < this->kernel_h; kh += this->stride_h) {
+          const int h = (y + this->pad_h - kh) / this->stride_h;
+          if (h < 0) { break; }
+          if (h >= this->height_col) { continue; }
+          if (kernel) {
+            // Each input value adds its scaled kernel row to a contiguous
+            // run of the image row.
+            const Dtype* in_row = col + h * this->width_col;
+            const Dtype* kernel_row = kernel + kh * this->kernel_w;
+            for (int w = 0; w < this->width_col; ++w) {
+              const int x = w * this->stride_w - this->pad_w;
+              const int kw_begin = std::max(0, -x);
+              const int kw_end = std::min(this->kernel_w, this->width - x);
+              const Dtype a = in_row[w];
+              for (int kw = kw_begin; kw < kw_end; ++kw) {
+                im_row[x + kw] += a * kernel_row[kw];
+              }
+            }
+            continue;
+          }
+          for (int kw = 0; kw < this->kernel_w; ++kw) {
+            Dtype* im_out = im_row + w_begin[kw] * this->stride_w
+                - this->pad_w + kw;
+            const Dtype* col_row = col
+                + (kh * this->kernel_w + kw) * col_dim + h * this->width_col;
+            for (int w = w_begin[kw]; w < w_end[kw];
+                 ++w, im_out += this->stride_w) {
+              *im_out += col_row[w];
+            }
+          }
+        }
+      }
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 void im2col_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     Dtype* data_col) {
-  int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
-  int channels_col = channels * kernel_h * kernel_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % kernel_w;
-    int h_offset = (c / kernel_w) % kernel_h;
-    int c_im = c / kernel_h / kernel_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_col[(c * height_col + h) * width_col + w] =
-            data_im[(c_im * height + h_pad) * width + w_pad];
-        else
-          data_col[(c * height_col + h) * width_col + w] = 0;
-      }
-    }
-  }
+  Im2colTask<Dtype> task(Im2colShape(channels, height, width, kernel_h,
+      kernel_w, pad_h, pad_w, stride_h, stride_w), data_im, data_col);
+  Caffe::thread_pool().Run(task.num_tasks, task);
 }
 
 // Explicit instantiation
@@ -50,24 +203,10 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
-  int height_col = (height + 2 * pad_h - patch_h) / stride_h + 1;
-  int width_col = (width + 2 * pad_w - patch_w) / stride_w + 1;
-  int channels_col = channels * patch_h * patch_w;
-  for (int c = 0; c < channels_col; ++c) {
-    int w_offset = c % patch_w;
-    int h_offset = (c / patch_w) % patch_h;
-    int c_im = c / patch_h / patch_w;
-    for (int h = 0; h < height_col; ++h) {
-      for (int w = 0; w < width_col; ++w) {
-        int h_pad = h * stride_h - pad_h + h_offset;
-        int w_pad = w * stride_w - pad_w + w_offset;
-        if (h_pad >= 0 && h_pad < height && w_pad >= 0 && w_pad < width)
-          data_im[(c_im * height + h_pad) * width + w_pad] +=
-              data_col[(c * height_col + h) * width_col + w];
-      }
-    }
-  }
+  Col2imTask<Dtype> task(Im2colShape(channels, height, width, patch_h,
+      patch_w, pad_h, pad_w, stride_h, stride_w), data_col,
+      static_cast<const Dtype*>(NULL), data_im);
+  Caffe::thread_pool().Run(task.num_tasks, task);
 }
 
 // Explicit instantiation
@@ -80,4 +219,69 @@ template void col2im_cpu<double>(const double* data_col, const int channels,
     const int pad_h, const int pad_w, const int stride_h,
     const int stride_w, double* data_im);
 
+template <typename Dtype>
+void deconv_channelwise_cpu(const Dtype* data_in, const Dtype* kernels,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, Dtype* data_out) {
+  Col2imTask<Dtype> task(Im2colShape(channels, height, width, kernel_h,
+      kernel_w, pad_h, pad_w, stride_h, stride_w), data_in, kernels,
+      data_out);
+  Caffe::thread_pool().Run(task.num_tasks, task);
+}
+
+// Explicit instantiation
+template void deconv_channelwise_cpu<float>(const float* data_in,
+    const float* kernels, const int channels, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    float* data_out);
+template void deconv_channelwise_cpu<double>(const double* data_in,
+    const double* kernels, const int channels, const int height,
+    const int width, const int kernel_h, const int kernel_w, const int pad_h,
+    const int pad_w, const int stride_h, const int stride_w,
+    double* data_out);
+
+void im2patches_cpu(const uint8_t* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int pixel_stride, const uint8_t pad_value,
+    const int ldp, uint8_t* data_patches) {
+  const int height_col = (height + 2 * pad_h - kernel_h) / stride_h + 1;
+  const int width_col = (width + 2 * pad_w - kernel_w) / stride_w + 1;
+  const int patch_size = kernel_h * kernel_w * channels;
+  // Each kernel row of a patch is a run of an image row, which is contiguous
+  // unless the pixels hold more than the channels.
+  const bool contiguous = channels == pixel_stride;
+  for (int h = 0; h < height_col; ++h) {
+    for (int w = 0; w < width_col; ++w) {
+      uint8_t* patch = data_patches + (h * width_col + w) * ldp;
+      const int h_im = h * stride_h - pad_h;
+      const int w_im = w * stride_w - pad_w;
+      const bool inside = w_im >= 0 && w_im + kernel_w <= width;
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        if (h_im + kh < 0 || h_im + kh >= height) {
+          memset(patch, pad_value, kernel_w * channels);
+          patch += kernel_w * channels;
+          continue;
+        }
+        const uint8_t* im_row = data_im + (h_im + kh) * width * pixel_stride;
+        if (inside && contiguous) {
+          memcpy(patch, im_row + w_im * channels, kernel_w * channels);
+          patch += kernel_w * channels;
+          continue;
+        }
+        for (int kw = 0; kw < kernel_w; ++kw, patch += channels) {
+          if (w_im + kw < 0 || w_im + kw >= width) {
+            memset(patch, pad_value, channels);
+          } else {
+            memcpy(patch, im_row + (w_im + kw) * pixel_stride, channels);
+          }
+        }
+      }
+      memset(patch, 0, ldp - patch_size);
+    }
+  }
+}
+
 }  // namespace caffe
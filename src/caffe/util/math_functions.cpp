@@ -1,14 +1,250 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/neuron_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+namespace {
+
+// The number of chunks to split n elements into, over the threads of
+// Caffe::thread_pool().
+inline int num_chunks(const int n) {
+  return NumParallelThreads(n, n);
+}
+
+// The vector math of MKL is multi-threaded already; only split our own.
+inline int num_vml_chunks(const int n) {
+#ifdef USE_MKL
+  return 1;
+#else
+  return num_chunks(n);
+#endif
+}
+
+// Splits [0, n) into num_tasks contiguous chunks, the base of the tasks below.
+struct ChunkedTask {
+  int n, num_tasks;
+
+  ChunkedTask(int n, int num_tasks) : n(n), num_tasks(num_tasks) {}
+  inline int begin(int task_id) const {
+    return static_cast<int>(static_cast<int64_t>(n) * task_id / num_tasks);
+  }
+  inline int end(int task_id) const { return begin(task_id + 1); }
+};
+
+template <typename Dtype>
+struct SetTask : public ChunkedTask {
+  Dtype alpha;
+  Dtype* y;
+
+  SetTask(int n, int num_tasks, Dtype alpha, Dtype* y)
+      : ChunkedTask(n, num_tasks), alpha(alpha), y(y) {}
+  void operator()(int task_id) const {
+    for (int i = begin(task_id); i < end(task_id); ++i) { y[i] = alpha; }
+  }
+};
+
+template <typename Dtype>
+struct AddScalarTask : public ChunkedTask {
+  Dtype alpha;
+  Dtype* y;
+
+  AddScalarTask(int n, int num_tasks, Dtype alpha, Dtype* y)
+      : ChunkedTask(n, num_tasks), alpha(alpha), y(y) {}
+  void operator()(int task_id) const {
+    for (int i = begin(task_id); i < end(task_id); ++i) { y[i] += alpha; }
+  }
+};
+
+template <typename Dtype>
+struct CopyTask : public ChunkedTask {
+  const Dtype* x;
+  Dtype* y;
+
+  CopyTask(int n, int num_tasks, const Dtype* x, Dtype* y)
+      : ChunkedTask(n, num_tasks), x(x), y(y) {}
+  void operator()(int task_id) const {
+    const int offset = begin(task_id);
+    memcpy(y + offset, x + offset,  // NOLINT(caffe/alt_fn)
+        sizeof(Dtype) * (end(task_id) - offset));
+  }
+};
+
+// Runs one of the vector math functions of mkl_alternate.hpp (or MKL) on a
+// chunk of its arguments: y = f(a), y = f(a, b) or y = f(a, scalar).
+template <typename Dtype>
+struct UnaryTask : public ChunkedTask {
+  typedef void (*Function)(const int, const Dtype*, Dtype*);
+  Function f;
+  const Dtype* a;
+  Dtype* y;
+
+  UnaryTask(int n, int num_tasks, Function f, const Dtype* a, Dtype* y)
+      : ChunkedTask(n, num_tasks), f(f), a(a), y(y) {}
+  void operator()(int task_id) const {
+    const int offset = begin(task_id);
+    f(end(task_id) - offset, a + offset, y + offset);
+  }
+};
+
+template <typename Dtype>
+struct BinaryTask : public ChunkedTask {
+  typedef void (*Function)(const int, const Dtype*, const Dtype*, Dtype*);
+  Function f;
+  const Dtype* a;
+  const Dtype* b;
+  Dtype* y;
+
+  BinaryTask(int n, int num_tasks, Function f, const Dtype* a,
+      const Dtype* b, Dtype* y)
+      : ChunkedTask(n, num_tasks), f(f), a(a), b(b), y(y) {}
+  void operator()(int task_id) const {
+    const int offset = begin(task_id);
+    f(end(task_id) - offset, a + offset, b + offset, y + offset);
+  }
+};
+
+template <typename Dtype, typename Scalar>
+struct ScalarTask : public ChunkedTask {
+  typedef void (*Function)(const int, const Dtype*, const Scalar, Dtype*);
+  Function f;
+  const Dtype* a;
+  Scalar b;
+  Dtype* y;
+
+  ScalarTask(int n, int num_tasks, Function f, const Dtype* a, Scalar b,
+      Dtype* y)
+      : ChunkedTask(n, num_tasks), f(f), a(a), b(b), y(y) {}
+  void operator()(int task_id) const {
+    const int offset = begin(task_id);
+    f(end(task_id) - offset, a + offset, b, y + offset);
+  }
+};
+
+// Runs f over num_tasks chunks of its arguments on Caffe::thread_pool(), or
+// directly if there is a single chunk.
+template <typename Dtype>
+inline void run_chunked(int n, int num_tasks,
+    typename UnaryTask<Dtype>::Function f, const Dtype* a, Dtype* y) {
+  if (num_tasks == 1) {
+    f(n, a, y);
+    return;
+  }
+  Caffe::thread_pool().Run(num_tasks, UnaryTask<Dtype>(n, num_tasks, f, a, y));
+}
+
+template <typename Dtype>
+inline void run_chunked(int n, int num_tasks,
+    typename BinaryTask<Dtype>::Function f, const Dtype* a, const Dtype* b,
+    Dtype* y) {
+  if (num_tasks == 1) {
+    f(n, a, b, y);
+    return;
+  }
+  Caffe::thread_pool().Run(num_tasks,
+      BinaryTask<Dtype>(n, num_tasks, f, a, b, y));
+}
+
+// The scalar argument of e.g. vdPowx is a float without MKL, and a double
+// with it.
+template <typename Dtype, typename Scalar>
+inline void run_chunked(int n, int num_tasks,
+    void (*f)(const int, const Dtype*, const Scalar, Dtype*), const Dtype* a,
+    const Dtype b, Dtype* y) {
+  if (num_tasks == 1) {
+    f(n, a, b, y);
+    return;
+  }
+  Caffe::thread_pool().Run(num_tasks, ScalarTask<Dtype, Scalar>(n,
+      num_tasks, f, a, static_cast<Scalar>(b), y));
+}
+
+// The bulk random functions draw each call from a new stream of
+// caffe/util/neuron_functions.hpp, keyed off the global generator.  Their
+// chunks start at multiples of kRngBlock, the Box-Muller block of the normal
+// numbers, and each draws its own elements of the stream, so that the numbers
+// only depend on the random seed, not on the number of threads.
+const int kRngBlock = 16;
+
+struct RngDraw {
+  unsigned int key0, key1;
+
+  RngDraw() : key0(caffe_rng_rand()), key1(caffe_rng_rand()) {}
+};
+
+template <typename Dtype>
+struct UniformDraw : public RngDraw {
+  Dtype a, b;
+  Dtype* r;
+
+  UniformDraw(Dtype a, Dtype b, Dtype* r) : a(a), b(b), r(r) {}
+  void operator()(int begin, int end) const {
+    caffe_cpu_rng_uniform(end - begin, begin, key0, key1, a, b, r + begin);
+  }
+};
+
+template <typename Dtype>
+struct GaussianDraw : public RngDraw {
+  Dtype mu, sigma;
+  Dtype* r;
+
+  GaussianDraw(Dtype mu, Dtype sigma, Dtype* r) : mu(mu), sigma(sigma), r(r) {}
+  void operator()(int begin, int end) const {
+    caffe_cpu_rng_gaussian(end - begin, begin, key0, key1, mu, sigma,
+        r + begin);
+  }
+};
+
+struct BernoulliDraw : public RngDraw {
+  unsigned int threshold;
+  unsigned int* r;
+
+  BernoulliDraw(unsigned int threshold, unsigned int* r)
+      : threshold(threshold), r(r) {}
+  void operator()(int begin, int end) const {
+    caffe_cpu_rng_bernoulli(end - begin, begin, key0, key1, threshold,
+        r + begin);
+  }
+};
+
+// Splits the blocks of the n numbers rather than the numbers.
+template <typename Draw>
+struct RngTask : public ChunkedTask {
+  int num_numbers;
+  Draw draw;
+
+  RngTask(int n, int num_tasks, const Draw& draw)
+      : ChunkedTask((n + kRngBlock - 1) / kRngBlock, num_tasks),
+        num_numbers(n), draw(draw) {}
+  void operator()(int task_id) const {
+    draw(begin(task_id) * kRngBlock,
+        std::min(num_numbers, end(task_id) * kRngBlock));
+  }
+};
+
+// Draws the n numbers of draw over the chunks of Caffe::thread_pool().
+template <typename Draw>
+inline void run_rng(int n, const Draw& draw) {
+  const int num_tasks = num_chunks(n);
+  if (num_tasks == 1) {
+    draw(0, n);
+    return;
+  }
+  Caffe::thread_pool().Run(num_tasks, RngTask<Draw>(n, num_tasks, draw));
+}
+
+}  // namespace
+
 template<>
 void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
@@ -59,6 +295,12 @@ void caffe_set(const int N, const Dtype alpha, Dtype* Y) {
     memset(Y, 0, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
     return;
   }
+  const int num_tasks = num_chunks(N);
+  if (num_tasks > 1) {
+    Caffe::thread_pool().Run(num_tasks,
+        SetTask<Dtype>(N, num_tasks, alpha, Y));
+    return;
+  }
   for (int i = 0; i < N; ++i) {
     Y[i] = alpha;
   }
@@ -70,6 +312,12 @@ template void caffe_set<double>(const int N, const double alpha, double* Y);
 
 template <>
 void caffe_add_scalar(const int N, const float alpha, float* Y) {
+  const int num_tasks = num_chunks(N);
+  if (num_tasks > 1) {
+    Caffe::thread_pool().Run(num_tasks,
+        AddScalarTask<float>(N, num_tasks, alpha, Y));
+    return;
+  }
   for (int i = 0; i < N; ++i) {
     Y[i] += alpha;
   }
@@ -77,6 +325,12 @@ void caffe_add_scalar(const int N, const float alpha, float* Y) {
 
 template <>
 void caffe_add_scalar(const int N, const double alpha, double* Y) {
+  const int num_tasks = num_chunks(N);
+  if (num_tasks > 1) {
+    Caffe::thread_pool().Run(num_tasks,
+        AddScalarTask<double>(N, num_tasks, alpha, Y));
+    return;
+  }
   for (int i = 0; i < N; ++i) {
     Y[i] += alpha;
   }
@@ -93,7 +347,13 @@ void caffe_copy(const int N, const Dtype* X, Dtype* Y) {
       NO_GPU;
 #endif
     } else {
-      memcpy(Y, X, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
+      const int num_tasks = num_chunks(N);
+      if (num_tasks > 1) {
+        Caffe::thread_pool().Run(num_tasks,
+            CopyTask<Dtype>(N, num_tasks, X, Y));
+      } else {
+        memcpy(Y, X, sizeof(Dtype) * N);  // NOLINT(caffe/alt_fn)
+      }
     }
   }
 }
@@ -129,91 +389,91 @@ void caffe_cpu_axpby<double>(const int N, const double alpha, const double* X,
 template <>
 void caffe_add<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsAdd(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vsAdd, a, b, y);
 }
 
 template <>
 void caffe_add<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdAdd(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vdAdd, a, b, y);
 }
 
 template <>
 void caffe_sub<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsSub(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vsSub, a, b, y);
 }
 
 template <>
 void caffe_sub<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdSub(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vdSub, a, b, y);
 }
 
 template <>
 void caffe_mul<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsMul(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vsMul, a, b, y);
 }
 
 template <>
 void caffe_mul<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdMul(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vdMul, a, b, y);
 }
 
 template <>
 void caffe_div<float>(const int n, const float* a, const float* b,
     float* y) {
-  vsDiv(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vsDiv, a, b, y);
 }
 
 template <>
 void caffe_div<double>(const int n, const double* a, const double* b,
     double* y) {
-  vdDiv(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vdDiv, a, b, y);
 }
 
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
-  vsPowx(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vsPowx, a, b, y);
 }
 
 template <>
 void caffe_powx<double>(const int n, const double* a, const double b,
     double* y) {
-  vdPowx(n, a, b, y);
+  run_chunked(n, num_vml_chunks(n), vdPowx, a, b, y);
 }
 
 template <>
 void caffe_sqr<float>(const int n, const float* a, float* y) {
-  vsSqr(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vsSqr, a, y);
 }
 
 template <>
 void caffe_sqr<double>(const int n, const double* a, double* y) {
-  vdSqr(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vdSqr, a, y);
 }
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
-  vsExp(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vsExp, a, y);
 }
 
 template <>
 void caffe_exp<double>(const int n, const double* a, double* y) {
-  vdExp(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vdExp, a, y);
 }
 
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
-    vsAbs(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vsAbs, a, y);
 }
 
 template <>
 void caffe_abs<double>(const int n, const double* a, double* y) {
-    vdAbs(n, a, y);
+  run_chunked(n, num_vml_chunks(n), vdAbs, a, y);
 }
 
 unsigned int caffe_rng_rand() {
@@ -237,12 +497,7 @@ void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  boost::uniform_real<Dtype> random_distribution(a, caffe_nextafter<Dtype>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  run_rng(n, UniformDraw<Dtype>(a, b, r));
 }
 
 template
@@ -259,12 +514,7 @@ void caffe_rng_gaussian(const int n, const Dtype a,
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_GT(sigma, 0);
-  boost::normal_distribution<Dtype> random_distribution(a, sigma);
-  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  run_rng(n, GaussianDraw<Dtype>(a, sigma, r));
 }
 
 template
@@ -277,16 +527,7 @@ void caffe_rng_gaussian<double>(const int n, const double mu,
 
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
-  CHECK_GE(n, 0);
-  CHECK(r);
-  CHECK_GE(p, 0);
-  CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  caffe_rng_bernoulli(n, p, reinterpret_cast<unsigned int*>(r));
 }
 
 template
@@ -301,12 +542,14 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
+  // The random numbers are 32-bit: p = 1 is the one probability they cannot
+  // express.
+  const double threshold = std::floor(p * 4294967296.);
+  if (threshold >= 4294967296.) {
+    std::fill(r, r + n, 1u);
+    return;
   }
+  run_rng(n, BernoulliDraw(static_cast<unsigned int>(threshold), r));
 }
 
 template
@@ -370,6 +613,83 @@ double caffe_cpu_asum<double>(const int n, const double* x) {
   return cblas_dasum(n, x, 1);
 }
 
+namespace {
+
+// Whether (value a, index i) comes before (value b, index j) in the order of
+// caffe_cpu_top_k.
+template <typename Dtype>
+inline bool TopKBefore(const Dtype a, const int i, const Dtype b,
+    const int j) {
+  return a > b || (a == b && i > j);
+}
+
+// Moves the entry at position p of the heap of size entries down to where it
+// belongs, with the entry that comes last in the order of caffe_cpu_top_k on
+// top.
+template <typename Dtype>
+void TopKSiftDown(int p, const int size, Dtype* values, int* indices) {
+  const Dtype value = values[p];
+  const int index = indices[p];
+  for (int child = 2 * p + 1; child < size; child = 2 * p + 1) {
+    if (child + 1 < size && TopKBefore(values[child], indices[child],
+        values[child + 1], indices[child + 1])) {
+      ++child;
+    }
+    if (!TopKBefore(value, index, values[child], indices[child])) { break; }
+    values[p] = values[child];
+    indices[p] = indices[child];
+    p = child;
+  }
+  values[p] = value;
+  indices[p] = index;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_top_k(const int n, const Dtype* x, const int incx, const int k,
+    Dtype* values, int* indices) {
+  CHECK_GE(k, 1);
+  CHECK_LE(k, n);
+  if (k == 1) {
+    int best = 0;
+    for (int i = 1; i < n; ++i) {
+      if (x[i * incx] >= x[best * incx]) { best = i; }
+    }
+    values[0] = x[best * incx];
+    indices[0] = best;
+    return;
+  }
+  for (int i = 0; i < k; ++i) {
+    values[i] = x[i * incx];
+    indices[i] = i;
+  }
+  for (int p = k / 2 - 1; p >= 0; --p) {
+    TopKSiftDown(p, k, values, indices);
+  }
+  // Each value past the first k replaces the top of the heap if it comes
+  // before it, which its larger index settles for equal values.
+  for (int i = k; i < n; ++i) {
+    const Dtype value = x[i * incx];
+    if (value >= values[0]) {
+      values[0] = value;
+      indices[0] = i;
+      TopKSiftDown(0, k, values, indices);
+    }
+  }
+  // Sort the heap, moving the last entry in the order to the back each time.
+  for (int size = k - 1; size > 0; --size) {
+    std::swap(values[0], values[size]);
+    std::swap(indices[0], indices[size]);
+    TopKSiftDown(0, size, values, indices);
+  }
+}
+
+template void caffe_cpu_top_k<float>(const int n, const float* x,
+    const int incx, const int k, float* values, int* indices);
+template void caffe_cpu_top_k<double>(const int n, const double* x,
+    const int incx, const int k, double* values, int* indices);
+
 template <>
 void caffe_cpu_scale<float>(const int n, const float alpha, const float *x,
                             float* y) {
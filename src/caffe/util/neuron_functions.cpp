@@ -0,0 +1,961 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/neuron_kernels.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace caffe {
+
+namespace {
+
+inline uint32_t FloatBits(float a) {
+  uint32_t b;
+  memcpy(&b, &a, sizeof(b));  // NOLINT(caffe/alt_fn)
+  return b;
+}
+
+inline float BitsFloat(uint32_t b) {
+  float a;
+  memcpy(&a, &b, sizeof(a));  // NOLINT(caffe/alt_fn)
+  return a;
+}
+
+// The IEEE half precision conversions of F16C, in software.
+inline float HalfToFloat(uint16_t h) {
+  uint32_t bits = (h & 0x7fff) << 13;
+  const uint32_t exponent = bits & (0x1f << 23);
+  bits += (127 - 15) << 23;
+  if (exponent == 0x1f << 23) {
+    // Infinity or NaN.
+    bits += (128 - 16) << 23;
+  } else if (exponent == 0) {
+    // Zero or subnormal: normalize through the float unit.
+    bits = FloatBits(BitsFloat(bits + (1 << 23)) - BitsFloat(113 << 23));
+  }
+  return BitsFloat(bits | static_cast<uint32_t>(h & 0x8000) << 16);
+}
+
+inline uint16_t FloatToHalf(float a) {
+  uint32_t bits = FloatBits(a);
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  bits &= 0x7fffffff;
+  if (bits >= 0x7f800000) {
+    // Infinity, or a quiet NaN with the top bits of the payload.
+    return sign | 0x7c00 |
+        (bits > 0x7f800000 ? 0x200 | ((bits >> 13) & 0x3ff) : 0);
+  } else if (bits >= (127 + 16) << 23) {
+    return sign | 0x7c00;
+  } else if (bits < (127 - 14) << 23) {
+    // A subnormal half: let the float unit round the mantissa.
+    const uint32_t magic = (127 - 15 + 23 - 10 + 1) << 23;
+    return sign | (FloatBits(BitsFloat(bits) + BitsFloat(magic)) - magic);
+  }
+  // Round to nearest even; a carry into the exponent rounds up correctly.
+  bits -= (127 - 15) << 23;
+  bits += 0xfff + ((bits >> 13) & 1);
+  return sign | (bits >> 13);
+}
+
+// One float at a time, for CPUs without SSE2.  Masks are floats with all bits
+// set, as for the vector instruction sets.
+struct ScalarIsa {
+  typedef float V;
+  typedef int32_t I;
+  static const int kWidth = 1;
+
+  static inline uint32_t bits(V a) {
+    uint32_t b;
+    memcpy(&b, &a, sizeof(b));  // NOLINT(caffe/alt_fn)
+    return b;
+  }
+  static inline V from_bits(uint32_t b) {
+    V a;
+    memcpy(&a, &b, sizeof(a));  // NOLINT(caffe/alt_fn)
+    return a;
+  }
+  static inline V mask(bool m) { return from_bits(m ? 0xffffffff : 0); }
+
+  static inline V loadu(const float* p) { return *p; }
+  static inline void storeu(float* p, V a) { *p = a; }
+  static inline V set1(float a) { return a; }
+  static inline V zero() { return 0.0f; }
+  static inline V add(V a, V b) { return a + b; }
+  static inline V sub(V a, V b) { return a - b; }
+  static inline V mul(V a, V b) { return a * b; }
+  static inline V div(V a, V b) { return a / b; }
+  static inline V sqrt(V a) { return sqrtf(a); }
+  static inline V madd(V a, V b, V c) { return a * b + c; }
+  static inline V min(V a, V b) { return b < a ? b : a; }
+  static inline V max(V a, V b) { return b > a ? b : a; }
+  static inline V gt(V a, V b) { return mask(a > b); }
+  static inline V lt(V a, V b) { return mask(a < b); }
+  static inline V le(V a, V b) { return mask(a <= b); }
+  static inline V and_(V a, V b) { return from_bits(bits(a) & bits(b)); }
+  static inline V or_(V a, V b) { return from_bits(bits(a) | bits(b)); }
+  static inline V select(V m, V a, V b) { return bits(m) ? a : b; }
+  static inline I round(V a) { return static_cast<I>(lrintf(a)); }
+  static inline V to_float(I a) { return static_cast<V>(a); }
+  static inline V pow2(I n) { return from_bits((n + 127) << 23); }
+  static inline V exponent(V a) {
+    return static_cast<V>(static_cast<I>(bits(a) >> 23) - 127);
+  }
+  static inline V lane_mask(uint32_t b) { return mask(b & 1); }
+
+  static inline I iset1(uint32_t a) { return static_cast<I>(a); }
+  static inline I iramp(uint32_t start) { return iset1(start); }
+  static inline I iadd(I a, I b) {
+    return static_cast<I>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+  }
+  static inline I imul(I a, I b) {
+    return static_cast<I>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+  }
+  static inline I iand(I a, I b) { return a & b; }
+  static inline I ixor(I a, I b) { return a ^ b; }
+  static inline I isrl(I a, int n) {
+    return static_cast<I>(static_cast<uint32_t>(a) >> n);
+  }
+  static inline int igt_bits(I a, I b) {
+    return static_cast<uint32_t>(a) > static_cast<uint32_t>(b);
+  }
+  static inline I idot_u8s8(I acc, const uint8_t* a, const int8_t* b) {
+    return acc + a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+  }
+  static inline int32_t ihsum(I a) { return a; }
+
+  static inline V load_half(const uint16_t* p) { return HalfToFloat(*p); }
+  static inline void store_half(uint16_t* p, V a) { *p = FloatToHalf(a); }
+};
+
+#ifdef __SSE2__
+struct Sse2Isa {
+  typedef __m128 V;
+  typedef __m128i I;
+  static const int kWidth = 4;
+
+  static inline V from_bits(uint32_t b) {
+    return _mm_castsi128_ps(_mm_set1_epi32(b));
+  }
+  static inline V loadu(const float* p) { return _mm_loadu_ps(p); }
+  static inline void storeu(float* p, V a) { _mm_storeu_ps(p, a); }
+  static inline V set1(float a) { return _mm_set1_ps(a); }
+  static inline V zero() { return _mm_setzero_ps(); }
+  static inline V add(V a, V b) { return _mm_add_ps(a, b); }
+  static inline V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static inline V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static inline V div(V a, V b) { return _mm_div_ps(a, b); }
+  static inline V sqrt(V a) { return _mm_sqrt_ps(a); }
+  static inline V madd(V a, V b, V c) {
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+  }
+  static inline V min(V a, V b) { return _mm_min_ps(a, b); }
+  static inline V max(V a, V b) { return _mm_max_ps(a, b); }
+  static inline V gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+  static inline V lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static inline V le(V a, V b) { return _mm_cmple_ps(a, b); }
+  static inline V and_(V a, V b) { return _mm_and_ps(a, b); }
+  static inline V or_(V a, V b) { return _mm_or_ps(a, b); }
+  static inline V select(V m, V a, V b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+  }
+  static inline I round(V a) { return _mm_cvtps_epi32(a); }
+  static inline V to_float(I a) { return _mm_cvtepi32_ps(a); }
+  static inline V pow2(I n) {
+    return _mm_castsi128_ps(_mm_slli_epi32(
+        _mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+  }
+  static inline V exponent(V a) {
+    return _mm_cvtepi32_ps(_mm_sub_epi32(
+        _mm_srli_epi32(_mm_castps_si128(a), 23), _mm_set1_epi32(127)));
+  }
+  static inline V lane_mask(uint32_t b) {
+    const I lanes = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_and_si128(_mm_set1_epi32(b), lanes), lanes));
+  }
+
+  static inline I iset1(uint32_t a) { return _mm_set1_epi32(a); }
+  static inline I iramp(uint32_t start) {
+    return _mm_add_epi32(_mm_set1_epi32(start), _mm_setr_epi32(0, 1, 2, 3));
+  }
+  static inline I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+  // SSE2 only multiplies the even elements, into 64 bits.
+  static inline I imul(I a, I b) {
+    const I even = _mm_mul_epu32(a, b);
+    const I odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+        _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+  }
+  static inline I iand(I a, I b) { return _mm_and_si128(a, b); }
+  static inline I ixor(I a, I b) { return _mm_xor_si128(a, b); }
+  static inline I isrl(I a, int n) {
+    return _mm_srl_epi32(a, _mm_cvtsi32_si128(n));
+  }
+  static inline int igt_bits(I a, I b) {
+    const I sign = _mm_set1_epi32(0x80000000);
+    return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+        _mm_xor_si128(a, sign), _mm_xor_si128(b, sign))));
+  }
+  // SSE2 has no byte multiplications: widen the bytes to 16 bits.
+  static inline I idot_u8s8(I acc, const uint8_t* a, const int8_t* b) {
+    const I a_bytes = _mm_loadu_si128(reinterpret_cast<const I*>(a));
+    const I b_bytes = _mm_loadu_si128(reinterpret_cast<const I*>(b));
+    const I zero = _mm_setzero_si128();
+    const I lo = _mm_madd_epi16(_mm_unpacklo_epi8(a_bytes, zero),
+        _mm_srai_epi16(_mm_unpacklo_epi8(b_bytes, b_bytes), 8));
+    const I hi = _mm_madd_epi16(_mm_unpackhi_epi8(a_bytes, zero),
+        _mm_srai_epi16(_mm_unpackhi_epi8(b_bytes, b_bytes), 8));
+    return _mm_add_epi32(acc, _mm_add_epi32(lo, hi));
+  }
+  static inline int32_t ihsum(I a) {
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(a);
+  }
+
+  // HalfToFloat on 4 halves: scaling by 2^112 rebiases the exponent and
+  // normalizes subnormals exactly.
+  static inline V load_half(const uint16_t* p) {
+    const I h = _mm_unpacklo_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const I*>(p)), _mm_setzero_si128());
+    const I magnitude = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const V scaled = _mm_mul_ps(
+        _mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)),
+        from_bits((254 - 15) << 23));
+    const I infinite = _mm_and_si128(
+        _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7bff)),
+        _mm_set1_epi32(255 << 23));
+    const I sign = _mm_slli_epi32(_mm_xor_si128(h, magnitude), 16);
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infinite)));
+  }
+  // Packing is not worth vectorizing without F16C.
+  static inline void store_half(uint16_t* p, V a) {
+    float x[kWidth];
+    _mm_storeu_ps(x, a);
+    for (int i = 0; i < kWidth; ++i) { p[i] = FloatToHalf(x[i]); }
+  }
+};
+#endif  // __SSE2__
+
+// The AVX2 kernels fuse multiplies and adds (FMA) where the SSE2 ones round
+// twice, so their results may differ from those of SSE2 in the last bits.
+SimdLevel DetectSimdLevel() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+      && __builtin_cpu_supports("f16c") && avx2_neuron_kernels()) {
+    return SIMD_AVX2;
+  }
+#endif
+  return sse2_neuron_kernels() ? SIMD_SSE2 : SIMD_NONE;
+}
+
+// -1 until the level is first needed.
+int simd_level_ = -1;
+
+const NeuronKernels& kernels() {
+  switch (caffe_cpu_simd_level()) {
+  case SIMD_AVX2:
+    return *avx2_neuron_kernels();
+  case SIMD_SSE2:
+    return *sse2_neuron_kernels();
+  default:
+    return *scalar_neuron_kernels();
+  }
+}
+
+// The exact versions of the fast_math kernels, calling libm.
+template <typename Dtype>
+void sigmoid_libm(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + exp(-x[i]));
+  }
+}
+
+template <typename Dtype>
+void tanh_libm(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = tanh(x[i]);
+  }
+}
+
+template <typename Dtype>
+void bnll_libm(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = x[i] > 0 ? x[i] + log(1. + exp(-x[i])) : log(1. + exp(x[i]));
+  }
+}
+
+// Beyond this input, the gradient of BNLL is 1 to within float precision.
+const float kBNLL_THRESHOLD = 50.;
+
+template <typename Dtype>
+void bnll_backward_libm(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype expval = exp(std::min(x[i], Dtype(kBNLL_THRESHOLD)));
+    dx[i] = dy[i] * expval / (expval + 1.);
+  }
+}
+
+}  // namespace
+
+const NeuronKernels* scalar_neuron_kernels() {
+  static const NeuronKernels kernels =
+      neuron_kernels::MakeNeuronKernels<ScalarIsa>();
+  return &kernels;
+}
+
+const NeuronKernels* sse2_neuron_kernels() {
+#ifdef __SSE2__
+  static const NeuronKernels kernels =
+      neuron_kernels::MakeNeuronKernels<Sse2Isa>();
+  return &kernels;
+#else
+  return NULL;
+#endif
+}
+
+SimdLevel caffe_cpu_max_simd_level() {
+  static const SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+SimdLevel caffe_cpu_simd_level() {
+  if (simd_level_ < 0) {
+    simd_level_ = caffe_cpu_max_simd_level();
+  }
+  return static_cast<SimdLevel>(simd_level_);
+}
+
+void caffe_set_cpu_simd_level(const SimdLevel level) {
+  CHECK_LE(level, caffe_cpu_max_simd_level())
+      << "The CPU or the build does not support SIMD level " << level;
+  simd_level_ = level;
+}
+
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype* x, const Dtype negative_slope,
+    Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::max(x[i], Dtype(0))
+        + negative_slope * std::min(x[i], Dtype(0));
+  }
+}
+
+template <>
+void caffe_cpu_relu(const int n, const float* x, const float negative_slope,
+    float* y) {
+  kernels().relu(n, x, negative_slope, y);
+}
+
+template void caffe_cpu_relu<double>(const int n, const double* x,
+    const double negative_slope, double* y);
+
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype* x, const Dtype* dy,
+    const Dtype negative_slope, Dtype* dx) {
+  for (int i = 0; i < n; ++i) {
+    dx[i] = dy[i] * ((x[i] > 0) + negative_slope * (x[i] <= 0));
+  }
+}
+
+template <>
+void caffe_cpu_relu_backward(const int n, const float* x, const float* dy,
+    const float negative_slope, float* dx) {
+  kernels().relu_backward(n, x, dy, negative_slope, dx);
+}
+
+template void caffe_cpu_relu_backward<double>(const int n, const double* x,
+    const double* dy, const double negative_slope, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_sigmoid(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math) {
+  sigmoid_libm(n, x, y);
+}
+
+template <>
+void caffe_cpu_sigmoid(const int n, const float* x, float* y,
+    const bool fast_math) {
+  if (fast_math) {
+    kernels().sigmoid(n, x, y);
+  } else {
+    sigmoid_libm(n, x, y);
+  }
+}
+
+template void caffe_cpu_sigmoid<double>(const int n, const double* x,
+    double* y, const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_sigmoid_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx) {
+  for (int i = 0; i < n; ++i) {
+    dx[i] = dy[i] * y[i] * (1. - y[i]);
+  }
+}
+
+template <>
+void caffe_cpu_sigmoid_backward(const int n, const float* y, const float* dy,
+    float* dx) {
+  kernels().sigmoid_backward(n, y, dy, dx);
+}
+
+template void caffe_cpu_sigmoid_backward<double>(const int n, const double* y,
+    const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_tanh(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math) {
+  tanh_libm(n, x, y);
+}
+
+template <>
+void caffe_cpu_tanh(const int n, const float* x, float* y,
+    const bool fast_math) {
+  if (fast_math) {
+    kernels().tanh(n, x, y);
+  } else {
+    tanh_libm(n, x, y);
+  }
+}
+
+template void caffe_cpu_tanh<double>(const int n, const double* x, double* y,
+    const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_tanh_backward(const int n, const Dtype* y, const Dtype* dy,
+    Dtype* dx) {
+  for (int i = 0; i < n; ++i) {
+    dx[i] = dy[i] * (1 - y[i] * y[i]);
+  }
+}
+
+template <>
+void caffe_cpu_tanh_backward(const int n, const float* y, const float* dy,
+    float* dx) {
+  kernels().tanh_backward(n, y, dy, dx);
+}
+
+template void caffe_cpu_tanh_backward<double>(const int n, const double* y,
+    const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_bnll(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math) {
+  bnll_libm(n, x, y);
+}
+
+template <>
+void caffe_cpu_bnll(const int n, const float* x, float* y,
+    const bool fast_math) {
+  if (fast_math) {
+    kernels().bnll(n, x, y);
+  } else {
+    bnll_libm(n, x, y);
+  }
+}
+
+template void caffe_cpu_bnll<double>(const int n, const double* x, double* y,
+    const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_bnll_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx, const bool fast_math) {
+  bnll_backward_libm(n, x, dy, dx);
+}
+
+template <>
+void caffe_cpu_bnll_backward(const int n, const float* x, const float* dy,
+    float* dx, const bool fast_math) {
+  if (fast_math) {
+    kernels().bnll_backward(n, x, dy, dx);
+  } else {
+    bnll_backward_libm(n, x, dy, dx);
+  }
+}
+
+template void caffe_cpu_bnll_backward<double>(const int n, const double* x,
+    const double* dy, double* dx, const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_threshold(const int n, const Dtype* x, const Dtype threshold,
+    Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = (x[i] > threshold) ? Dtype(1) : Dtype(0);
+  }
+}
+
+template <>
+void caffe_cpu_threshold(const int n, const float* x, const float threshold,
+    float* y) {
+  kernels().threshold(n, x, threshold, y);
+}
+
+template void caffe_cpu_threshold<double>(const int n, const double* x,
+    const double threshold, double* y);
+
+template <typename Dtype>
+void caffe_cpu_absval(const int n, const Dtype* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::fabs(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_absval(const int n, const float* x, float* y) {
+  kernels().absval(n, x, y);
+}
+
+template void caffe_cpu_absval<double>(const int n, const double* x,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_absval_backward(const int n, const Dtype* x, const Dtype* dy,
+    Dtype* dx) {
+  for (int i = 0; i < n; ++i) {
+    dx[i] = (x[i] > 0) ? dy[i] : ((x[i] < 0) ? -dy[i] : Dtype(0));
+  }
+}
+
+template <>
+void caffe_cpu_absval_backward(const int n, const float* x, const float* dy,
+    float* dx) {
+  kernels().absval_backward(n, x, dy, dx);
+}
+
+template void caffe_cpu_absval_backward<double>(const int n, const double* x,
+    const double* dy, double* dx);
+
+template <typename Dtype>
+void caffe_cpu_exp(const int n, const Dtype* x, Dtype* y,
+    const bool fast_math) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::exp(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_exp(const int n, const float* x, float* y,
+    const bool fast_math) {
+  if (fast_math) {
+    kernels().exp(n, x, y);
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::exp(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_exp<double>(const int n, const double* x, double* y,
+    const bool fast_math);
+
+void caffe_cpu_dropout_mask(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1,
+    const unsigned int threshold, unsigned int* mask) {
+  CHECK_EQ(start % 32, 0) << "The mask words must not overlap";
+  kernels().dropout_mask(n, start, key0, key1, threshold, mask);
+}
+
+template <typename Dtype>
+void caffe_cpu_dropout(const int n, const Dtype* x, const unsigned int* mask,
+    const Dtype scale, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = ((mask[i / 32] >> (i % 32)) & 1) ? x[i] * scale : Dtype(0);
+  }
+}
+
+template <>
+void caffe_cpu_dropout(const int n, const float* x, const unsigned int* mask,
+    const float scale, float* y) {
+  kernels().dropout(n, x, mask, scale, y);
+}
+
+template void caffe_cpu_dropout<double>(const int n, const double* x,
+    const unsigned int* mask, const double scale, double* y);
+
+namespace {
+
+// The random number of counter i of a stream, as the kernels draw it.
+inline uint32_t random_number(uint32_t i, uint32_t key0, uint32_t key1) {
+  return static_cast<uint32_t>(neuron_kernels::Random<ScalarIsa>(
+      ScalarIsa::iset1(i), ScalarIsa::iset1(key0), ScalarIsa::iset1(key1)));
+}
+
+const double kTwoToMinus32 = 1. / 4294967296.;
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_rng_uniform(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const Dtype a,
+    const Dtype b, Dtype* r) {
+  for (int i = 0; i < n; ++i) {
+    r[i] = a + (b - a) * (random_number(start + i, key0, key1) * kTwoToMinus32);
+  }
+}
+
+template <>
+void caffe_cpu_rng_uniform(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const float a,
+    const float b, float* r) {
+  kernels().rng_uniform(n, start, key0, key1, a, b, r);
+}
+
+template void caffe_cpu_rng_uniform<double>(const int n,
+    const unsigned int start, const unsigned int key0,
+    const unsigned int key1, const double a, const double b, double* r);
+
+// The same blocks of Box-Muller transforms as the kernels.
+template <typename Dtype>
+void caffe_cpu_rng_gaussian(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const Dtype mu,
+    const Dtype sigma, Dtype* r) {
+  CHECK_EQ(start % 16, 0) << "The Box-Muller blocks must not overlap";
+  for (int i = 0; i < n; i += 16) {
+    for (int j = 0; j < 8; ++j) {
+      const uint32_t counter = start + i + 2 * j;
+      const double u0 =
+          (random_number(counter, key0, key1) + 1.) * kTwoToMinus32;
+      const double angle = 2 * M_PI * kTwoToMinus32 *
+          random_number(counter + 1, key0, key1);
+      const double radius = sigma * sqrt(-2 * log(u0));
+      if (i + j < n) { r[i + j] = mu + radius * cos(angle); }
+      if (i + 8 + j < n) { r[i + 8 + j] = mu + radius * sin(angle); }
+    }
+  }
+}
+
+template <>
+void caffe_cpu_rng_gaussian(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1, const float mu,
+    const float sigma, float* r) {
+  CHECK_EQ(start % 16, 0) << "The Box-Muller blocks must not overlap";
+  kernels().rng_gaussian(n, start, key0, key1, mu, sigma, r);
+}
+
+template void caffe_cpu_rng_gaussian<double>(const int n,
+    const unsigned int start, const unsigned int key0,
+    const unsigned int key1, const double mu, const double sigma, double* r);
+
+void caffe_cpu_rng_bernoulli(const int n, const unsigned int start,
+    const unsigned int key0, const unsigned int key1,
+    const unsigned int threshold, unsigned int* r) {
+  kernels().rng_bernoulli(n, start, key0, key1, threshold, r);
+}
+
+template <typename Dtype>
+void caffe_cpu_pack_panels(const int n, const int k, const Dtype* w,
+    Dtype* panels) {
+  DCHECK_EQ(kCpuPanelRows, neuron_kernels::kPanelRows);
+  for (int j0 = 0; j0 < n; j0 += kCpuPanelRows) {
+    Dtype* panel = panels + j0 * k;
+    for (int j = 0; j < kCpuPanelRows; ++j) {
+      if (j0 + j < n) {
+        const Dtype* row = w + (j0 + j) * k;
+        for (int i = 0; i < k; ++i) { panel[i * kCpuPanelRows + j] = row[i]; }
+      } else {
+        for (int i = 0; i < k; ++i) { panel[i * kCpuPanelRows + j] = 0; }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_pack_panels<float>(const int n, const int k,
+    const float* w, float* panels);
+template void caffe_cpu_pack_panels<double>(const int n, const int k,
+    const double* w, double* panels);
+
+template <typename Dtype>
+void caffe_cpu_panel_inner_product(const int m, const int n, const int k,
+    const Dtype* panels, const Dtype* x, const Dtype* bias, Dtype* y,
+    const int ldy) {
+  for (int b = 0; b < m; ++b) {
+    for (int j = 0; j < n; ++j) {
+      const Dtype* column = panels + (j / kCpuPanelRows) * kCpuPanelRows * k
+          + j % kCpuPanelRows;
+      Dtype sum = bias ? bias[j] : Dtype(0);
+      for (int i = 0; i < k; ++i) {
+        sum += column[i * kCpuPanelRows] * x[b * k + i];
+      }
+      y[b * ldy + j] = sum;
+    }
+  }
+}
+
+template <>
+void caffe_cpu_panel_inner_product(const int m, const int n, const int k,
+    const float* panels, const float* x, const float* bias, float* y,
+    const int ldy) {
+  kernels().panel_inner_product(m, n, k, panels, x, bias, y, ldy);
+}
+
+template void caffe_cpu_panel_inner_product<double>(const int m,
+    const int n, const int k, const double* panels, const double* x,
+    const double* bias, double* y, const int ldy);
+
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, uint16_t* h) {
+  for (int i = 0; i < n; ++i) {
+    h[i] = FloatToHalf(static_cast<float>(x[i]));
+  }
+}
+
+template <>
+void caffe_cpu_to_half(const int n, const float* x, uint16_t* h) {
+  kernels().to_half(n, x, h);
+}
+
+template void caffe_cpu_to_half<double>(const int n, const double* x,
+    uint16_t* h);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* h, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = HalfToFloat(h[i]);
+  }
+}
+
+template <>
+void caffe_cpu_from_half(const int n, const uint16_t* h, float* y) {
+  kernels().from_half(n, h, y);
+}
+
+template void caffe_cpu_from_half<double>(const int n, const uint16_t* h,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_pack_half_panels(const int n, const int k, const Dtype* w,
+    uint16_t* panels) {
+  vector<uint16_t> row(k, 0);
+  for (int j0 = 0; j0 < n; j0 += kCpuPanelRows) {
+    uint16_t* panel = panels + j0 * k;
+    for (int j = 0; j < kCpuPanelRows; ++j) {
+      if (j0 + j < n) {
+        caffe_cpu_to_half(k, w + (j0 + j) * k, &row[0]);
+      } else {
+        std::fill(row.begin(), row.end(), 0);
+      }
+      for (int i = 0; i < k; ++i) { panel[i * kCpuPanelRows + j] = row[i]; }
+    }
+  }
+}
+
+template void caffe_cpu_pack_half_panels<float>(const int n, const int k,
+    const float* w, uint16_t* panels);
+template void caffe_cpu_pack_half_panels<double>(const int n, const int k,
+    const double* w, uint16_t* panels);
+
+template <typename Dtype>
+void caffe_cpu_unpack_half_panels(const int n, const int k,
+    const uint16_t* panels, Dtype* w) {
+  vector<uint16_t> row(k);
+  for (int j = 0; j < n; ++j) {
+    const uint16_t* column = panels
+        + (j / kCpuPanelRows) * kCpuPanelRows * k + j % kCpuPanelRows;
+    for (int i = 0; i < k; ++i) { row[i] = column[i * kCpuPanelRows]; }
+    caffe_cpu_from_half(k, &row[0], w + j * k);
+  }
+}
+
+template void caffe_cpu_unpack_half_panels<float>(const int n, const int k,
+    const uint16_t* panels, float* w);
+template void caffe_cpu_unpack_half_panels<double>(const int n, const int k,
+    const uint16_t* panels, double* w);
+
+template <typename Dtype>
+void caffe_cpu_half_panel_inner_product(const int m, const int n,
+    const int k, const uint16_t* panels, const Dtype* x, const Dtype* bias,
+    Dtype* y, const int ldy) {
+  for (int b = 0; b < m; ++b) {
+    for (int j = 0; j < n; ++j) {
+      const uint16_t* column = panels +
+          (j / kCpuPanelRows) * kCpuPanelRows * k + j % kCpuPanelRows;
+      Dtype sum = bias ? bias[j] : Dtype(0);
+      for (int i = 0; i < k; ++i) {
+        sum += HalfToFloat(column[i * kCpuPanelRows]) * x[b * k + i];
+      }
+      y[b * ldy + j] = sum;
+    }
+  }
+}
+
+template <>
+void caffe_cpu_half_panel_inner_product(const int m, const int n,
+    const int k, const uint16_t* panels, const float* x, const float* bias,
+    float* y, const int ldy) {
+  kernels().half_panel_inner_product(m, n, k, panels, x, bias, y, ldy);
+}
+
+template void caffe_cpu_half_panel_inner_product<double>(const int m,
+    const int n, const int k, const uint16_t* panels, const double* x,
+    const double* bias, double* y, const int ldy);
+
+template <typename Dtype>
+void caffe_cpu_eltwise_sum(const int n, const int k, const Dtype* const* x,
+    const Dtype* coeffs, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    Dtype sum = x[0][i] * coeffs[0];
+    for (int j = 1; j < k; ++j) { sum += x[j][i] * coeffs[j]; }
+    y[i] = sum;
+  }
+}
+
+template <>
+void caffe_cpu_eltwise_sum(const int n, const int k, const float* const* x,
+    const float* coeffs, float* y) {
+  kernels().eltwise_sum(n, k, x, coeffs, y);
+}
+
+template void caffe_cpu_eltwise_sum<double>(const int n, const int k,
+    const double* const* x, const double* coeffs, double* y);
+
+template <typename Dtype>
+void caffe_cpu_eltwise_prod(const int n, const int k, const Dtype* const* x,
+    Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    Dtype prod = x[0][i];
+    for (int j = 1; j < k; ++j) { prod *= x[j][i]; }
+    y[i] = prod;
+  }
+}
+
+template <>
+void caffe_cpu_eltwise_prod(const int n, const int k, const float* const* x,
+    float* y) {
+  kernels().eltwise_prod(n, k, x, y);
+}
+
+template void caffe_cpu_eltwise_prod<double>(const int n, const int k,
+    const double* const* x, double* y);
+
+template <typename Dtype>
+void caffe_cpu_eltwise_max(const int n, const int k, const Dtype* const* x,
+    Dtype* y, int* mask) {
+  for (int i = 0; i < n; ++i) {
+    int index = x[0][i] > x[1][i] ? 0 : 1;
+    Dtype max = x[index][i];
+    for (int j = 2; j < k; ++j) {
+      if (x[j][i] > max) {
+        max = x[j][i];
+        index = j;
+      }
+    }
+    y[i] = max;
+    if (mask) { mask[i] = index; }
+  }
+}
+
+template <>
+void caffe_cpu_eltwise_max(const int n, const int k, const float* const* x,
+    float* y, int* mask) {
+  kernels().eltwise_max(n, k, x, y, mask);
+}
+
+template void caffe_cpu_eltwise_max<double>(const int n, const int k,
+    const double* const* x, double* y, int* mask);
+
+template <typename Dtype>
+void caffe_cpu_csrmm(const int m, const int n, const int* row_ptr,
+    const int* col_idx, const Dtype* values, const Dtype* b, const int ldb,
+    Dtype* c, const int ldc) {
+  for (int r = 0; r < m; ++r) {
+    for (int j = 0; j < n; ++j) {
+      Dtype sum = 0;
+      for (int p = row_ptr[r]; p < row_ptr[r + 1]; ++p) {
+        sum += values[p] * b[col_idx[p] * ldb + j];
+      }
+      c[r * ldc + j] = sum;
+    }
+  }
+}
+
+template <>
+void caffe_cpu_csrmm(const int m, const int n, const int* row_ptr,
+    const int* col_idx, const float* values, const float* b, const int ldb,
+    float* c, const int ldc) {
+  kernels().csrmm(m, n, row_ptr, col_idx, values, b, ldb, c, ldc);
+}
+
+template void caffe_cpu_csrmm<double>(const int m, const int n,
+    const int* row_ptr, const int* col_idx, const double* values,
+    const double* b, const int ldb, double* c, const int ldc);
+
+template <typename Dtype>
+void caffe_cpu_mean_variance(const int n, const Dtype* x, Dtype* mean,
+    Dtype* variance) {
+  // In double, the two passes of the textbook method are accurate enough.
+  Dtype sum = 0;
+  for (int i = 0; i < n; ++i) { sum += x[i]; }
+  *mean = n > 0 ? sum / n : 0;
+  Dtype squares = 0;
+  for (int i = 0; i < n; ++i) { squares += (x[i] - *mean) * (x[i] - *mean); }
+  *variance = n > 0 ? squares / n : 0;
+}
+
+template <>
+void caffe_cpu_mean_variance(const int n, const float* x, float* mean,
+    float* variance) {
+  kernels().mean_variance(n, x, mean, variance);
+}
+
+template void caffe_cpu_mean_variance<double>(const int n, const double* x,
+    double* mean, double* variance);
+
+template <typename Dtype>
+void caffe_cpu_normalize(const int n, const Dtype* x, const Dtype mean,
+    const Dtype scale, Dtype* y) {
+  for (int i = 0; i < n; ++i) { y[i] = (x[i] - mean) * scale; }
+}
+
+template <>
+void caffe_cpu_normalize(const int n, const float* x, const float mean,
+    const float scale, float* y) {
+  kernels().normalize(n, x, mean, scale, y);
+}
+
+template void caffe_cpu_normalize<double>(const int n, const double* x,
+    const double mean, const double scale, double* y);
+
+template <typename Dtype>
+void caffe_cpu_normalize_backward(const int n, const Dtype* y,
+    const Dtype* dy, const Dtype scale, Dtype* dx) {
+  Dtype sum_dy = 0;
+  Dtype sum_y_dy = 0;
+  for (int i = 0; i < n; ++i) {
+    sum_dy += dy[i];
+    sum_y_dy += y[i] * dy[i];
+  }
+  const Dtype mean_dy = sum_dy / n;
+  const Dtype mean_y_dy = sum_y_dy / n;
+  for (int i = 0; i < n; ++i) {
+    dx[i] = (dy[i] - mean_dy - y[i] * mean_y_dy) * scale;
+  }
+}
+
+template <>
+void caffe_cpu_normalize_backward(const int n, const float* y,
+    const float* dy, const float scale, float* dx) {
+  kernels().normalize_backward(n, y, dy, scale, dx);
+}
+
+template void caffe_cpu_normalize_backward<double>(const int n,
+    const double* y, const double* dy, const double scale, double* dx);
+
+void caffe_cpu_int8_gemm(const int m, const int n, const int k,
+    const uint8_t* a, const int8_t* b, int32_t* c, const int ldc) {
+  DCHECK_EQ(kCpuInt8Block, neuron_kernels::kInt8Block);
+  CHECK_EQ(k % kCpuInt8Block, 0);
+  kernels().int8_gemm(m, n, k, a, b, c, ldc);
+}
+
+}  // namespace caffe
@@ -0,0 +1,126 @@
+// The AVX2 neuron kernels.  The build compiles this file alone with -mavx2
+// -mfma -mf16c on x86, and neuron_functions.cpp only runs these kernels on
+// CPUs that support all three; so this file must not define anything used
+// elsewhere, nor instantiate inline functions or templates of shared headers
+// (std containers and algorithms included) that have external linkage: the
+// linker could keep this copy of them for the whole program.
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "caffe/util/neuron_kernels.hpp"
+
+#if defined(__AVX2__) && defined(__FMA__) && defined(__F16C__)
+#include <immintrin.h>
+
+namespace caffe {
+
+namespace {
+
+struct Avx2Isa {
+  typedef __m256 V;
+  typedef __m256i I;
+  static const int kWidth = 8;
+
+  static inline V from_bits(uint32_t b) {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(b));
+  }
+  static inline V loadu(const float* p) { return _mm256_loadu_ps(p); }
+  static inline void storeu(float* p, V a) { _mm256_storeu_ps(p, a); }
+  static inline V set1(float a) { return _mm256_set1_ps(a); }
+  static inline V zero() { return _mm256_setzero_ps(); }
+  static inline V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static inline V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static inline V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static inline V div(V a, V b) { return _mm256_div_ps(a, b); }
+  static inline V sqrt(V a) { return _mm256_sqrt_ps(a); }
+  static inline V madd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+  static inline V min(V a, V b) { return _mm256_min_ps(a, b); }
+  static inline V max(V a, V b) { return _mm256_max_ps(a, b); }
+  static inline V gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static inline V lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static inline V le(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  static inline V and_(V a, V b) { return _mm256_and_ps(a, b); }
+  static inline V or_(V a, V b) { return _mm256_or_ps(a, b); }
+  static inline V select(V m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+  static inline I round(V a) { return _mm256_cvtps_epi32(a); }
+  static inline V to_float(I a) { return _mm256_cvtepi32_ps(a); }
+  static inline V pow2(I n) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(
+        _mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+  }
+  static inline V exponent(V a) {
+    return _mm256_cvtepi32_ps(_mm256_sub_epi32(
+        _mm256_srli_epi32(_mm256_castps_si256(a), 23),
+        _mm256_set1_epi32(127)));
+  }
+  static inline V lane_mask(uint32_t b) {
+    const I lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(b), lanes), lanes));
+  }
+
+  static inline I iset1(uint32_t a) { return _mm256_set1_epi32(a); }
+  static inline I iramp(uint32_t start) {
+    return _mm256_add_epi32(_mm256_set1_epi32(start),
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  static inline I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+  static inline I imul(I a, I b) { return _mm256_mullo_epi32(a, b); }
+  static inline I iand(I a, I b) { return _mm256_and_si256(a, b); }
+  static inline I ixor(I a, I b) { return _mm256_xor_si256(a, b); }
+  static inline I isrl(I a, int n) {
+    return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n));
+  }
+  static inline int igt_bits(I a, I b) {
+    const I sign = _mm256_set1_epi32(0x80000000);
+    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+        _mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign))));
+  }
+  // The 16-bit sums of pairs of products do not saturate for the 7-bit a of
+  // caffe_cpu_int8_gemm.
+  static inline I idot_u8s8(I acc, const uint8_t* a, const int8_t* b) {
+    const I pairs = _mm256_maddubs_epi16(
+        _mm256_loadu_si256(reinterpret_cast<const I*>(a)),
+        _mm256_loadu_si256(reinterpret_cast<const I*>(b)));
+    return _mm256_add_epi32(acc,
+        _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+  }
+  static inline int32_t ihsum(I a) {
+    __m128i b = _mm_add_epi32(_mm256_castsi256_si128(a),
+        _mm256_extracti128_si256(a, 1));
+    b = _mm_add_epi32(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2)));
+    b = _mm_add_epi32(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(b);
+  }
+
+  static inline V load_half(const uint16_t* p) {
+    return _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+  static inline void store_half(uint16_t* p, V a) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+        _mm256_cvtps_ph(a, _MM_FROUND_TO_NEAREST_INT));
+  }
+};
+
+}  // namespace
+
+const NeuronKernels* avx2_neuron_kernels() {
+  static const NeuronKernels kernels =
+      neuron_kernels::MakeNeuronKernels<Avx2Isa>();
+  return &kernels;
+}
+
+}  // namespace caffe
+
+#else
+
+namespace caffe {
+
+const NeuronKernels* avx2_neuron_kernels() { return NULL; }
+
+}  // namespace caffe
+
+#endif  // __AVX2__ && __FMA__ && __F16C__
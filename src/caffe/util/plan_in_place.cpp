@@ -0,0 +1,189 @@
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/util/plan_in_place.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Layers whose tops share their data with a bottom: computing in place on
+// such a top would overwrite the data of another blob.
+bool LayerIsView(const string& type) {
+  return type == "Split" || type == "Flatten";
+}
+
+// Whether a layer's backward pass still reads its top data, which must then
+// not be overwritten by an in-place consumer.
+bool BackwardReadsTopData(const LayerParameter& layer_param) {
+  const string& type = layer_param.type();
+  if (layer_param.bottom_size() == 0) { return false; }
+  return !(type == "Convolution" || type == "Deconvolution" ||
+           type == "InnerProduct" || type == "Pooling" ||
+           type == "Concat" || type == "Slice" || type == "Dropout");
+}
+
+// Whether computing consumer in place on the top of producer keeps the
+// backward pass of producer correct.
+bool InPlaceKeepsBackward(const LayerParameter& producer,
+    const LayerParameter& consumer) {
+  if (!BackwardReadsTopData(producer)) { return true; }
+  // ReLU only looks at the sign of its (in place) data, which dropout keeps.
+  return producer.type() == "ReLU" && consumer.type() == "Dropout";
+}
+
+// Drop all Split layers without loss weights, renaming their tops to their
+// bottom.  A Split is kept if a later layer writes a top of the name of the
+// split blob, as a consumer the author wrote in place does: the consumers
+// reading that name after the split would then see the new data instead.
+void ElideSplits(const NetParameter& param, NetParameter* param_elided,
+    map<string, string>* blob_aliases) {
+  param_elided->CopyFrom(param);
+  param_elided->clear_layer();
+  // The index of the last layer writing each blob name.
+  map<string, int> last_producer;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      last_producer[layer_param.top(j)] = i;
+    }
+  }
+  map<string, string> renamed;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    bool has_loss = false;
+    for (int j = 0; j < layer_param.loss_weight_size(); ++j) {
+      has_loss |= (layer_param.loss_weight(j) != 0);
+    }
+    if (layer_param.type() == "Split" && layer_param.bottom_size() == 1 &&
+        !has_loss && !(last_producer.count(layer_param.bottom(0)) &&
+                       last_producer[layer_param.bottom(0)] > i)) {
+      string bottom_name = layer_param.bottom(0);
+      if (renamed.count(bottom_name)) { bottom_name = renamed[bottom_name]; }
+      for (int j = 0; j < layer_param.top_size(); ++j) {
+        renamed[layer_param.top(j)] = bottom_name;
+        (*blob_aliases)[layer_param.top(j)] = bottom_name;
+      }
+      continue;
+    }
+    LayerParameter* elided_layer_param = param_elided->add_layer();
+    elided_layer_param->CopyFrom(layer_param);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (renamed.count(layer_param.bottom(j))) {
+        elided_layer_param->set_bottom(j, renamed[layer_param.bottom(j)]);
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      renamed.erase(layer_param.top(j));
+    }
+  }
+}
+
+}  // namespace
+
+bool LayerSupportsInPlace(const string& type) {
+  return type == "ReLU" || type == "Dropout" || type == "Sigmoid" ||
+      type == "TanH" || type == "Threshold";
+}
+
+void PlanInPlace(const NetParameter& param, NetParameter* param_in_place,
+    map<string, string>* blob_aliases) {
+  CHECK(blob_aliases);
+  blob_aliases->clear();
+  NetParameter source;
+  // Nets put in the TEST phase explicitly (e.g. by the solver or a deploy
+  // tool) are never run backward unless force_backward is set.
+  const bool backward_free = param.state().has_phase() &&
+      param.state().phase() == TEST && !param.force_backward();
+  if (backward_free) {
+    ElideSplits(param, &source, blob_aliases);
+  } else {
+    source.CopyFrom(param);
+  }
+  param_in_place->CopyFrom(source);
+  // As in InsertSplits, a top is identified by (layer index, top index) with
+  // layer index -1 for the net inputs, and a loss counts as one more use.
+  map<string, pair<int, int> > blob_name_to_last_top_idx;
+  map<pair<int, int>, pair<int, int> > bottom_idx_to_source_top_idx;
+  map<pair<int, int>, int> top_idx_to_bottom_count;
+  map<string, int> blob_name_to_last_producer;
+  for (int i = 0; i < source.input_size(); ++i) {
+    blob_name_to_last_top_idx[source.input(i)] = make_pair(-1, i);
+    blob_name_to_last_producer[source.input(i)] = -1;
+  }
+  for (int i = 0; i < source.layer_size(); ++i) {
+    const LayerParameter& layer_param = source.layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const string& blob_name = layer_param.bottom(j);
+      CHECK(blob_name_to_last_top_idx.count(blob_name))
+          << "Unknown blob input " << blob_name << " to layer "
+          << layer_param.name();
+      const pair<int, int>& top_idx = blob_name_to_last_top_idx[blob_name];
+      bottom_idx_to_source_top_idx[make_pair(i, j)] = top_idx;
+      ++top_idx_to_bottom_count[top_idx];
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      blob_name_to_last_top_idx[layer_param.top(j)] = make_pair(i, j);
+      blob_name_to_last_producer[layer_param.top(j)] = i;
+    }
+    for (int j = 0; j < layer_param.loss_weight_size() &&
+         j < layer_param.top_size(); ++j) {
+      if (layer_param.loss_weight(j)) {
+        ++top_idx_to_bottom_count[make_pair(i, j)];
+      }
+    }
+  }
+  map<string, string> renamed;
+  for (int i = 0; i < source.layer_size(); ++i) {
+    const LayerParameter& layer_param = source.layer(i);
+    LayerParameter* in_place_layer_param = param_in_place->mutable_layer(i);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (renamed.count(layer_param.bottom(j))) {
+        in_place_layer_param->set_bottom(j, renamed[layer_param.bottom(j)]);
+      }
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      renamed.erase(layer_param.top(j));
+    }
+    if (!LayerSupportsInPlace(layer_param.type()) ||
+        layer_param.bottom_size() != 1 || layer_param.top_size() != 1 ||
+        layer_param.bottom(0) == layer_param.top(0) ||
+        layer_param.loss_weight_size() > 0) {
+      continue;
+    }
+    // The bottom must be used by this layer only, and no later layer may
+    // produce a blob of the same name while this layer's top is still read.
+    const pair<int, int>& source_top_idx =
+        bottom_idx_to_source_top_idx[make_pair(i, 0)];
+    const string& bottom_name = layer_param.bottom(0);
+    if (source_top_idx.first < 0 ||
+        top_idx_to_bottom_count[source_top_idx] != 1 ||
+        blob_name_to_last_producer[bottom_name] != source_top_idx.first) {
+      continue;
+    }
+    // A top that is never used is a net output and keeps its own name.
+    if (top_idx_to_bottom_count[make_pair(i, 0)] == 0) { continue; }
+    const LayerParameter& producer = source.layer(source_top_idx.first);
+    if (LayerIsView(producer.type()) ||
+        (!backward_free && !InPlaceKeepsBackward(producer, layer_param))) {
+      continue;
+    }
+    const string& in_place_name = in_place_layer_param->bottom(0);
+    in_place_layer_param->set_top(0, in_place_name);
+    renamed[layer_param.top(0)] = in_place_name;
+    (*blob_aliases)[layer_param.top(0)] = in_place_name;
+  }
+  // Resolve aliases of split tops that were later renamed again.
+  for (map<string, string>::iterator it = blob_aliases->begin();
+       it != blob_aliases->end(); ++it) {
+    while (blob_aliases->count(it->second) &&
+           (*blob_aliases)[it->second] != it->second) {
+      it->second = (*blob_aliases)[it->second];
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,88 @@
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/plan_views.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Layers whose tops may share their memory with another blob, or be pointed
+// at memory of their own, so that they cannot be made views.
+bool LayerOwnsTops(const LayerParameter& layer_param) {
+  const string& type = layer_param.type();
+  // Data layers may point their tops at prefetched or user memory.
+  if (layer_param.bottom_size() == 0) { return false; }
+  return !(type == "Split" || type == "Flatten" || type == "Concat" ||
+           type == "Slice" || type == "SoftmaxWithLoss");
+}
+
+}  // namespace
+
+void PlanViews(const NetParameter& param, NetParameter* param_views) {
+  param_views->CopyFrom(param);
+  const bool backward_free = param.state().has_phase() &&
+      param.state().phase() == TEST && !param.force_backward();
+  // The layers writing each blob, in order, and the layers only reading it,
+  // once per bottom.
+  map<string, vector<int> > writers;
+  map<string, vector<int> > readers;
+  const set<string> inputs(param.input().begin(), param.input().end());
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    const set<string> tops(layer_param.top().begin(),
+        layer_param.top().end());
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      writers[layer_param.top(j)].push_back(i);
+    }
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      if (!tops.count(layer_param.bottom(j))) {
+        readers[layer_param.bottom(j)].push_back(i);
+      }
+    }
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    if (layer_param.top_size() == 0 || layer_param.loss_weight_size() > 0) {
+      continue;
+    }
+    bool share = true;
+    if (layer_param.type() == "Concat") {
+      // The first writer of each bottom creates it and the others compute in
+      // place, all before this layer.
+      for (int j = 0; share && j < layer_param.bottom_size(); ++j) {
+        const string& blob_name = layer_param.bottom(j);
+        const vector<int>& blob_writers = writers[blob_name];
+        const vector<int>& blob_readers = readers[blob_name];
+        share = !inputs.count(blob_name) && !blob_writers.empty() &&
+            blob_writers.back() < i && blob_readers.size() == 1 &&
+            blob_readers[0] == i;
+        if (share) {
+          const LayerParameter& producer = param.layer(blob_writers[0]);
+          share = LayerOwnsTops(producer) &&
+              producer.loss_weight_size() == 0;
+        }
+      }
+      // Writing the top in place overwrites the bottoms.
+      share = share &&
+          (backward_free || writers[layer_param.top(0)].size() == 1);
+      if (share) {
+        param_views->mutable_layer(i)->mutable_concat_param()->
+            set_share_bottoms(true);
+      }
+    } else if (layer_param.type() == "Slice") {
+      for (int j = 0; share && j < layer_param.top_size(); ++j) {
+        share = writers[layer_param.top(j)].size() == 1;
+      }
+      if (share) {
+        param_views->mutable_layer(i)->mutable_slice_param()->
+            set_share_tops(true);
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/net.hpp"
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+namespace {
+
+// The number of outputs, and so of weight rows, of the layers with int8
+// inference, or 0 for other layers.
+int QuantizedRows(const LayerParameter& layer_param) {
+  if (layer_param.type() == "Convolution") {
+    return layer_param.convolution_param().num_output();
+  } else if (layer_param.type() == "InnerProduct") {
+    return layer_param.inner_product_param().num_output();
+  }
+  return 0;
+}
+
+}  // namespace
+
+template <typename Dtype>
+void GetInputQuantization(const QuantizationParameter& param, Dtype* scale,
+    int* zero_point) {
+  // 0 (e.g. the padding of a convolution) must have an exact code.
+  const Dtype input_min = std::min(Dtype(param.input_min()), Dtype(0));
+  const Dtype input_max = std::max(Dtype(param.input_max()), Dtype(0));
+  *scale = input_max > input_min ? (input_max - input_min) / 127 : Dtype(1);
+  *zero_point = std::min(127,
+      static_cast<int>(-input_min / *scale + Dtype(0.5)));
+}
+
+template void GetInputQuantization<float>(const QuantizationParameter& param,
+    float* scale, int* zero_point);
+template void GetInputQuantization<double>(const QuantizationParameter& param,
+    double* scale, int* zero_point);
+
+template <typename Dtype>
+void caffe_cpu_quantize_inputs(const int n, const Dtype* x, const Dtype scale,
+    const int zero_point, uint8_t* q) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  // Truncating the clamped x / scale + zero_point + 0.5 rounds it.
+  const Dtype offset = zero_point + Dtype(0.5);
+  for (int i = 0; i < n; ++i) {
+    q[i] = static_cast<uint8_t>(std::min(
+        std::max(x[i] * inv_scale + offset, Dtype(0)), Dtype(127)));
+  }
+}
+
+template void caffe_cpu_quantize_inputs<float>(const int n, const float* x,
+    const float scale, const int zero_point, uint8_t* q);
+template void caffe_cpu_quantize_inputs<double>(const int n, const double* x,
+    const double scale, const int zero_point, uint8_t* q);
+
+template <typename Dtype>
+void caffe_cpu_quantize_image(const int channels, const int spatial_dim,
+    const Dtype* x, const Dtype scale, const int zero_point, uint8_t* q) {
+  const Dtype inv_scale = Dtype(1) / scale;
+  const Dtype offset = zero_point + Dtype(0.5);
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x_c = x + c * spatial_dim;
+    for (int i = 0; i < spatial_dim; ++i) {
+      q[i * channels + c] = static_cast<uint8_t>(std::min(
+          std::max(x_c[i] * inv_scale + offset, Dtype(0)), Dtype(127)));
+    }
+  }
+}
+
+template void caffe_cpu_quantize_image<float>(const int channels,
+    const int spatial_dim, const float* x, const float scale,
+    const int zero_point, uint8_t* q);
+template void caffe_cpu_quantize_image<double>(const int channels,
+    const int spatial_dim, const double* x, const double scale,
+    const int zero_point, uint8_t* q);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* w,
+    const int ldq, int8_t* q, Dtype* scales) {
+  for (int r = 0; r < rows; ++r) {
+    const Dtype* w_r = w + r * cols;
+    int8_t* q_r = q + r * ldq;
+    Dtype max_abs = 0;
+    for (int i = 0; i < cols; ++i) {
+      max_abs = std::max(max_abs, std::abs(w_r[i]));
+    }
+    const Dtype inv_scale = max_abs > 0 ? 127 / max_abs : Dtype(0);
+    for (int i = 0; i < cols; ++i) {
+      const Dtype v = w_r[i] * inv_scale;
+      q_r[i] = static_cast<int8_t>(v < 0 ? -static_cast<int>(0.5 - v) :
+          static_cast<int>(v + 0.5));
+    }
+    for (int i = cols; i < ldq; ++i) { q_r[i] = 0; }
+    scales[r] = max_abs / 127;
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const int rows, const int cols,
+    const float* w, const int ldq, int8_t* q, float* scales);
+template void caffe_cpu_quantize_rows<double>(const int rows, const int cols,
+    const double* w, const int ldq, int8_t* q, double* scales);
+
+template <typename Dtype>
+void caffe_cpu_dequantize(const int m, const int n, const int32_t* c,
+    const int ldc, const int zero_point, const Dtype scale, const int* sums,
+    const Dtype* scales, const Dtype* bias, Dtype* y, const int ldy,
+    const int incy) {
+  for (int j = 0; j < n; ++j) {
+    const int32_t offset = zero_point * sums[j];
+    const Dtype factor = scale * scales[j];
+    const Dtype b = bias ? bias[j] : Dtype(0);
+    for (int i = 0; i < m; ++i) {
+      y[i * ldy + j * incy] = (c[i * ldc + j] - offset) * factor + b;
+    }
+  }
+}
+
+template void caffe_cpu_dequantize<float>(const int m, const int n,
+    const int32_t* c, const int ldc, const int zero_point, const float scale,
+    const int* sums, const float* scales, const float* bias, float* y,
+    const int ldy, const int incy);
+template void caffe_cpu_dequantize<double>(const int m, const int n,
+    const int32_t* c, const int ldc, const int zero_point, const double scale,
+    const int* sums, const double* scales, const double* bias, double* y,
+    const int ldy, const int incy);
+
+template <typename Dtype>
+void QuantizedWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const int rows, const int channels) {
+  const shared_ptr<SyncedMemory>& memory = weights.data();
+  if (memory == memory_ && memory->version() == version_ && rows == rows_ &&
+      channels == channels_) {
+    return;
+  }
+  CHECK_EQ(weights.count() % rows, 0);
+  rows_ = rows;
+  cols_ = weights.count() / rows;
+  channels_ = channels;
+  CHECK_EQ(cols_ % channels_, 0);
+  padded_cols_ = caffe_cpu_int8_padded(cols_);
+  const size_t size = rows_ * padded_cols_;
+  if (!data_ || data_->size() != size) { data_.reset(new SyncedMemory(size)); }
+  scales_.Reshape(1, 1, 1, rows_);
+  sums_.Reshape(1, 1, 1, rows_);
+  const Dtype* w = weights.cpu_data();
+  vector<Dtype> reordered;
+  if (channels_ > 1) {
+    const int taps = cols_ / channels_;
+    reordered.resize(weights.count());
+    for (int r = 0; r < rows_; ++r) {
+      for (int c = 0; c < channels_; ++c) {
+        for (int t = 0; t < taps; ++t) {
+          reordered[(r * taps + t) * channels_ + c] =
+              w[(r * channels_ + c) * taps + t];
+        }
+      }
+    }
+    w = &reordered[0];
+  }
+  int8_t* q = static_cast<int8_t*>(data_->mutable_cpu_data());
+  caffe_cpu_quantize_rows(rows_, cols_, w, padded_cols_, q,
+      scales_.mutable_cpu_data());
+  int* sums = sums_.mutable_cpu_data();
+  for (int r = 0; r < rows_; ++r) {
+    sums[r] = 0;
+    for (int i = 0; i < cols_; ++i) { sums[r] += q[r * padded_cols_ + i]; }
+  }
+  memory_ = memory;
+  version_ = memory->version();
+}
+
+INSTANTIATE_CLASS(QuantizedWeights);
+
+void QuantizeBlobProto(const int rows, BlobProto* proto) {
+  const int count = proto->data_size();
+  CHECK_GT(rows, 0);
+  CHECK_EQ(count % rows, 0) << "Weights not in rows of equal size.";
+  const int cols = count / rows;
+  vector<int8_t> q(count);
+  vector<float> scales(rows);
+  caffe_cpu_quantize_rows(rows, cols, proto->data().data(), cols, &q[0],
+      &scales[0]);
+  proto->clear_data();
+  proto->set_int8_data(reinterpret_cast<const char*>(&q[0]), count);
+  proto->clear_int8_scale();
+  for (int r = 0; r < rows; ++r) { proto->add_int8_scale(scales[r]); }
+}
+
+void QuantizeNetWeights(NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    const int rows = QuantizedRows(*layer_param);
+    if (rows > 0 && layer_param->blobs_size() > 0) {
+      QuantizeBlobProto(rows, layer_param->mutable_blobs(0));
+    }
+  }
+}
+
+void ConvertBlobProtoToHalf(BlobProto* proto) {
+  const int count = proto->data_size();
+  vector<uint16_t> h(count);
+  caffe_cpu_to_half(count, proto->data().data(), &h[0]);
+  proto->clear_data();
+  proto->set_half_data(reinterpret_cast<const char*>(&h[0]),
+      count * sizeof(uint16_t));
+}
+
+void ConvertNetWeightsToHalf(NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    for (int j = 0; j < layer_param->blobs_size(); ++j) {
+      if (layer_param->blobs(j).data_size() > 0) {
+        ConvertBlobProtoToHalf(layer_param->mutable_blobs(j));
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void CalibrateQuantization(Net<Dtype>* net, const int iterations,
+    NetParameter* param) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  vector<bool> quantized(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    quantized[i] = QuantizedRows(layers[i]->layer_param()) > 0;
+  }
+  vector<Dtype> input_min(layers.size(), 0);
+  vector<Dtype> input_max(layers.size(), 0);
+  for (int iter = 0; iter < iterations; ++iter) {
+    // The layers may overwrite their inputs later on in the pass.
+    for (int i = 0; i < layers.size(); ++i) {
+      for (int j = 0; quantized[i] && j < net->bottom_vecs()[i].size(); ++j) {
+        const Blob<Dtype>& bottom = *net->bottom_vecs()[i][j];
+        const Dtype* x = bottom.cpu_data();
+        for (int k = 0; k < bottom.count(); ++k) {
+          input_min[i] = std::min(input_min[i], x[k]);
+          input_max[i] = std::max(input_max[i], x[k]);
+        }
+      }
+      net->ForwardFromTo(i, i);
+    }
+  }
+  std::map<string, int> layer_ids;
+  for (int i = 0; i < layers.size(); ++i) {
+    if (quantized[i]) {
+      layer_ids[net->layer_names()[i]] = i;
+      LOG(INFO) << "Layer " << net->layer_names()[i] << " input range ["
+          << input_min[i] << ", " << input_max[i] << "]";
+    }
+  }
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    std::map<string, int>::const_iterator it =
+        layer_ids.find(layer_param->name());
+    if (it != layer_ids.end()) {
+      QuantizationParameter* quantization_param =
+          layer_param->mutable_quantization_param();
+      quantization_param->set_input_min(input_min[it->second]);
+      quantization_param->set_input_max(input_max[it->second]);
+    }
+  }
+}
+
+template void CalibrateQuantization<float>(Net<float>* net,
+    const int iterations, NetParameter* param);
+template void CalibrateQuantization<double>(Net<double>* net,
+    const int iterations, NetParameter* param);
+
+}  // namespace caffe
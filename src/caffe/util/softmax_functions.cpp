@@ -0,0 +1,114 @@
+#include "caffe/util/neuron_functions.hpp"
+#include "caffe/util/softmax_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int channels, const int n, const int stride,
+    const Dtype* x, Dtype* y, Dtype* scratch, const bool fast_math) {
+  if (n == 1 && stride == 1) {
+    // The channels of a single column are contiguous.
+    Dtype max_value = x[0];
+    for (int c = 1; c < channels; ++c) {
+      max_value = x[c] > max_value ? x[c] : max_value;
+    }
+    for (int c = 0; c < channels; ++c) {
+      y[c] = x[c] - max_value;
+    }
+    caffe_cpu_exp(channels, y, y, fast_math);
+    Dtype sum = 0;
+    for (int c = 0; c < channels; ++c) {
+      sum += y[c];
+    }
+    const Dtype scale = Dtype(1) / sum;
+    for (int c = 0; c < channels; ++c) {
+      y[c] *= scale;
+    }
+    return;
+  }
+  // We need to subtract the max to avoid numerical issues, compute the exp,
+  // and then normalize.
+  Dtype* max_value = scratch;
+  Dtype* scale = scratch + n;
+  for (int k = 0; k < n; ++k) {
+    max_value[k] = x[k];
+    scale[k] = 0;
+  }
+  for (int c = 1; c < channels; ++c) {
+    const Dtype* x_c = x + c * stride;
+    for (int k = 0; k < n; ++k) {
+      max_value[k] = x_c[k] > max_value[k] ? x_c[k] : max_value[k];
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x_c = x + c * stride;
+    Dtype* y_c = y + c * stride;
+    for (int k = 0; k < n; ++k) {
+      y_c[k] = x_c[k] - max_value[k];
+    }
+    caffe_cpu_exp(n, y_c, y_c, fast_math);
+    for (int k = 0; k < n; ++k) {
+      scale[k] += y_c[k];
+    }
+  }
+  for (int k = 0; k < n; ++k) {
+    scale[k] = Dtype(1) / scale[k];
+  }
+  for (int c = 0; c < channels; ++c) {
+    Dtype* y_c = y + c * stride;
+    for (int k = 0; k < n; ++k) {
+      y_c[k] *= scale[k];
+    }
+  }
+}
+
+template void caffe_cpu_softmax<float>(const int channels, const int n,
+    const int stride, const float* x, float* y, float* scratch,
+    const bool fast_math);
+template void caffe_cpu_softmax<double>(const int channels, const int n,
+    const int stride, const double* x, double* y, double* scratch,
+    const bool fast_math);
+
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int channels, const int n,
+    const int stride, const Dtype* y, const Dtype* dy, Dtype* dx,
+    Dtype* scratch) {
+  if (n == 1 && stride == 1) {
+    Dtype dot = 0;
+    for (int c = 0; c < channels; ++c) {
+      dot += dy[c * stride] * y[c * stride];
+    }
+    for (int c = 0; c < channels; ++c) {
+      dx[c * stride] = (dy[c * stride] - dot) * y[c * stride];
+    }
+    return;
+  }
+  Dtype* dot = scratch;
+  for (int k = 0; k < n; ++k) {
+    dot[k] = 0;
+  }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* y_c = y + c * stride;
+    const Dtype* dy_c = dy + c * stride;
+    for (int k = 0; k < n; ++k) {
+      dot[k] += dy_c[k] * y_c[k];
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* y_c = y + c * stride;
+    const Dtype* dy_c = dy + c * stride;
+    Dtype* dx_c = dx + c * stride;
+    for (int k = 0; k < n; ++k) {
+      dx_c[k] = (dy_c[k] - dot[k]) * y_c[k];
+    }
+  }
+}
+
+template void caffe_cpu_softmax_backward<float>(const int channels,
+    const int n, const int stride, const float* y, const float* dy, float* dx,
+    float* scratch);
+template void caffe_cpu_softmax_backward<double>(const int channels,
+    const int n, const int stride, const double* y, const double* dy,
+    double* dx, double* scratch);
+
+}  // namespace caffe
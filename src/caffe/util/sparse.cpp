@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/sparse.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool SparseWeights<Dtype>::Update(const Blob<Dtype>& weights, const int rows,
+    const float threshold) {
+  const shared_ptr<SyncedMemory>& memory = weights.data();
+  if (memory == memory_ && memory->version() == version_ && rows == rows_ &&
+      threshold == threshold_) {
+    return sparse_;
+  }
+  CHECK_EQ(weights.count() % rows, 0);
+  rows_ = rows;
+  threshold_ = threshold;
+  memory_ = memory;
+  version_ = memory->version();
+  const int count = weights.count();
+  const Dtype* w = weights.cpu_data();
+  int nonzeros = 0;
+  for (int i = 0; i < count; ++i) { nonzeros += w[i] != 0; }
+  sparse_ = count - nonzeros >= threshold * count;
+  if (!sparse_) { return false; }
+  const int cols = count / rows;
+  row_ptr_.Reshape(1, 1, 1, rows + 1);
+  // Weights all zero still get arrays to point to.
+  col_idx_.Reshape(1, 1, 1, std::max(nonzeros, 1));
+  values_.Reshape(1, 1, 1, std::max(nonzeros, 1));
+  int* row_ptr = row_ptr_.mutable_cpu_data();
+  int* col_idx = col_idx_.mutable_cpu_data();
+  Dtype* values = values_.mutable_cpu_data();
+  int p = 0;
+  for (int r = 0; r < rows; ++r) {
+    row_ptr[r] = p;
+    for (int c = 0; c < cols; ++c) {
+      if (w[r * cols + c] != 0) {
+        col_idx[p] = c;
+        values[p] = w[r * cols + c];
+        ++p;
+      }
+    }
+  }
+  row_ptr[rows] = p;
+  return true;
+}
+
+INSTANTIATE_CLASS(SparseWeights);
+
+void PruneBlobProto(const float sparsity, BlobProto* proto) {
+  const int count = proto->data_size();
+  const int pruned = std::min(count, static_cast<int>(sparsity * count));
+  if (pruned <= 0) { return; }
+  vector<float> magnitudes(count);
+  for (int i = 0; i < count; ++i) {
+    magnitudes[i] = std::abs(proto->data(i));
+  }
+  std::nth_element(magnitudes.begin(), magnitudes.begin() + pruned - 1,
+      magnitudes.end());
+  const float cutoff = magnitudes[pruned - 1];
+  // The weights of magnitude cutoff go until pruned of them are zero.
+  int zeros = 0;
+  for (int i = 0; i < count; ++i) {
+    zeros += std::abs(proto->data(i)) < cutoff;
+  }
+  for (int i = 0; i < count; ++i) {
+    const float magnitude = std::abs(proto->data(i));
+    if (magnitude < cutoff || (magnitude == cutoff && zeros++ < pruned)) {
+      proto->set_data(i, 0);
+    }
+  }
+}
+
+void PruneNetWeights(const float sparsity, NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    if ((layer_param->type() == "Convolution" ||
+        layer_param->type() == "InnerProduct") &&
+        layer_param->blobs_size() > 0) {
+      PruneBlobProto(sparsity, layer_param->mutable_blobs(0));
+    }
+  }
+}
+
+}  // namespace caffe
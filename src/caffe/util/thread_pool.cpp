@@ -0,0 +1,101 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads), mutex_(new boost::mutex()),
+      region_mutex_(new boost::mutex()),
+      task_available_(new boost::condition_variable()),
+      region_done_(new boost::condition_variable()), num_tasks_(0),
+      next_task_(0), tasks_running_(0), region_(0), shutdown_(false) {
+  CHECK_GT(num_threads, 0);
+  for (int i = 1; i < num_threads; ++i) {
+    workers_.push_back(shared_ptr<boost::thread>(
+        new boost::thread(&ThreadPool::WorkerEntry, this)));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    shutdown_ = true;
+  }
+  task_available_->notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+void ThreadPool::Run(int num_tasks, const boost::function<void(int)>& task) {
+  if (num_tasks <= 0) { return; }
+  // A single task runs without taking the pool, so that it may still start
+  // a parallel region of its own.
+  if (num_tasks == 1) {
+    task(0);
+    return;
+  }
+  boost::mutex::scoped_lock region_lock(*region_mutex_, boost::try_to_lock);
+  if (workers_.empty() || !region_lock.owns_lock()) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    task_ = task;
+    num_tasks_ = num_tasks;
+    next_task_ = 0;
+    ++region_;
+  }
+  task_available_->notify_all();
+  RunTasks();
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (next_task_ < num_tasks_ || tasks_running_ > 0) {
+    region_done_->wait(lock);
+  }
+  task_.clear();
+}
+
+void ThreadPool::RunTasks() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  while (next_task_ < num_tasks_) {
+    const int task_id = next_task_++;
+    ++tasks_running_;
+    lock.unlock();
+    task_(task_id);
+    lock.lock();
+    --tasks_running_;
+  }
+  if (tasks_running_ == 0) {
+    region_done_->notify_all();
+  }
+}
+
+void ThreadPool::WorkerEntry() {
+  int region = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(*mutex_);
+      while (!shutdown_ && region_ == region) {
+        task_available_->wait(lock);
+      }
+      if (shutdown_) { return; }
+      region = region_;
+    }
+    RunTasks();
+  }
+}
+
+int NumParallelThreads(int count, int max_tasks) {
+  return std::max(1, std::min(std::min(Caffe::num_threads(), max_tasks),
+      count / kValuesPerThread));
+}
+
+}  // namespace caffe
@@ -0,0 +1,140 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/weight_map.hpp"
+
+namespace caffe {
+
+namespace {
+
+const char kWeightMapMagic[8] = {'C', 'A', 'F', 'F', 'E', 'W', 'M', '1'};
+
+// The fixed-size header at the start of every weight map file.
+struct WeightMapHeader {
+  char magic[8];
+  uint64_t index_offset;
+  uint64_t index_size;
+};
+
+inline uint64_t AlignWeightMapOffset(uint64_t offset) {
+  return (offset + kWeightMapAlignment - 1) / kWeightMapAlignment
+      * kWeightMapAlignment;
+}
+
+}  // namespace
+
+WeightMap::WeightMap(const string& filename)
+    : filename_(filename), addr_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << filename;
+  size_ = st.st_size;
+  CHECK_GE(size_, sizeof(WeightMapHeader))
+      << "File too small to be a weight map: " << filename;
+  // Map privately so that pages stay shared between processes until written.
+  addr_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(addr_ != MAP_FAILED) << "Failed to mmap " << filename;
+  const char* base = static_cast<const char*>(addr_);
+  WeightMapHeader header;
+  memcpy(&header, base, sizeof(header));
+  CHECK_EQ(memcmp(header.magic, kWeightMapMagic, sizeof(kWeightMapMagic)), 0)
+      << "Not a weight map file: " << filename;
+  CHECK_LE(header.index_offset + header.index_size, size_)
+      << "Truncated weight map file: " << filename;
+  CHECK(index_.ParseFromArray(base + header.index_offset, header.index_size))
+      << "Failed to parse weight map index of " << filename;
+  for (int i = 0; i < index_.entry_size(); ++i) {
+    const WeightMapEntry& entry = index_.entry(i);
+    const uint64_t count = static_cast<uint64_t>(entry.num()) *
+        entry.channels() * entry.height() * entry.width();
+    CHECK_EQ(entry.offset() % kWeightMapAlignment, 0);
+    CHECK_LE(entry.offset() + count * sizeof(float), header.index_offset)
+        << "Blob " << entry.blob_index() << " of layer " << entry.layer_name()
+        << " lies outside the data section of " << filename;
+  }
+}
+
+WeightMap::~WeightMap() {
+  if (addr_) {
+    munmap(addr_, size_);
+  }
+}
+
+float* WeightMap::mutable_data(const WeightMapEntry& entry) const {
+  return reinterpret_cast<float*>(static_cast<char*>(addr_) + entry.offset());
+}
+
+bool IsWeightMapFile(const string& filename) {
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(kWeightMapMagic)];
+  if (!input.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return memcmp(magic, kWeightMapMagic, sizeof(kWeightMapMagic)) == 0;
+}
+
+void WriteWeightMap(const NetParameter& param, const string& filename) {
+  WeightMapIndex index;
+  index.set_name(param.name());
+  uint64_t offset = AlignWeightMapOffset(sizeof(WeightMapHeader));
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.blobs_size(); ++j) {
+      const BlobProto& blob = layer_param.blobs(j);
+      CHECK_EQ(blob.num() * blob.channels() * blob.height() * blob.width(),
+               blob.data_size()) << "Blob " << j << " of layer "
+          << layer_param.name() << " has inconsistent shape and data.";
+      WeightMapEntry* entry = index.add_entry();
+      entry->set_layer_name(layer_param.name());
+      entry->set_blob_index(j);
+      entry->set_num(blob.num());
+      entry->set_channels(blob.channels());
+      entry->set_height(blob.height());
+      entry->set_width(blob.width());
+      entry->set_offset(offset);
+      offset = AlignWeightMapOffset(offset + blob.data_size() * sizeof(float));
+    }
+  }
+  string serialized_index;
+  CHECK(index.SerializeToString(&serialized_index));
+  WeightMapHeader header;
+  memcpy(header.magic, kWeightMapMagic, sizeof(kWeightMapMagic));
+  header.index_offset = offset;
+  header.index_size = serialized_index.size();
+
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output) << "Failed to open " << filename << " for writing.";
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t written = sizeof(header);
+  const vector<char> padding(kWeightMapAlignment, 0);
+  int entry_id = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    for (int j = 0; j < layer_param.blobs_size(); ++j, ++entry_id) {
+      const uint64_t entry_offset = index.entry(entry_id).offset();
+      output.write(&padding[0], entry_offset - written);
+      const BlobProto& blob = layer_param.blobs(j);
+      const uint64_t bytes = blob.data_size() * sizeof(float);
+      output.write(reinterpret_cast<const char*>(blob.data().data()), bytes);
+      written = entry_offset + bytes;
+    }
+  }
+  output.write(&padding[0], offset - written);
+  output.write(serialized_index.data(), serialized_index.size());
+  CHECK(output) << "Failed to write weight map " << filename;
+}
+
+}  // namespace caffe
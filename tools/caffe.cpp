@@ -6,6 +6,8 @@
 #include <vector>
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -29,6 +31,12 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(threads, 1,
+    "Optional; the number of threads to parallelize CPU computation over.");
+DEFINE_string(quantized_model, "",
+    "The quantized model definition protocol buffer text file to write.");
+DEFINE_string(quantized_weights, "",
+    "The quantized weights to write.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -102,6 +110,7 @@ int train() {
   } else {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
   }
 
   LOG(INFO) << "Starting Optimization";
@@ -137,6 +146,7 @@ int test() {
   } else {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TEST);
@@ -190,6 +200,70 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// The mean of each output of net over FLAGS_iterations forward passes.
+static vector<float> MeanScores(Net<float>* net) {
+  vector<float> scores;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    const vector<Blob<float>*>& result = net->ForwardPrefilled();
+    int idx = 0;
+    for (int j = 0; j < result.size(); ++j) {
+      const float* result_vec = result[j]->cpu_data();
+      for (int k = 0; k < result[j]->count(); ++k, ++idx) {
+        if (i == 0) { scores.push_back(0); }
+        scores[idx] += result_vec[k] / FLAGS_iterations;
+      }
+    }
+  }
+  return scores;
+}
+
+// Quantize: calibrate a model for int8 inference on the CPU.
+int quantize() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to quantize.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to quantize.";
+  CHECK_GT(FLAGS_quantized_model.size(), 0)
+      << "Need a file to write the quantized model definition to.";
+  CHECK_GT(FLAGS_quantized_weights.size(), 0)
+      << "Need a file to write the quantized weights to.";
+  LOG(INFO) << "Use CPU.";
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_num_threads(FLAGS_threads);
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  // Calibrate the input ranges on the first FLAGS_iterations batches.
+  Net<float> caffe_net(param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  LOG(INFO) << "Calibrating for " << FLAGS_iterations << " iterations.";
+  caffe::CalibrateQuantization(&caffe_net, FLAGS_iterations, &param);
+  param.clear_state();
+  caffe::WriteProtoToTextFile(param, FLAGS_quantized_model);
+  caffe::NetParameter weights;
+  caffe_net.ToProto(&weights);
+  caffe::QuantizeNetWeights(&weights);
+  caffe::WriteProtoToBinaryFile(weights, FLAGS_quantized_weights);
+  // Score the float and the int8 net on the same batches.
+  Net<float> float_net(FLAGS_model, caffe::TEST);
+  float_net.CopyTrainedLayersFrom(FLAGS_weights);
+  const vector<float> float_scores = MeanScores(&float_net);
+  Net<float> int8_net(FLAGS_quantized_model, caffe::TEST);
+  int8_net.CopyTrainedLayersFrom(weights);
+  const vector<float> int8_scores = MeanScores(&int8_net);
+  int idx = 0;
+  for (int j = 0; j < int8_net.output_blobs().size(); ++j) {
+    const std::string& output_name = int8_net.blob_names()[
+        int8_net.output_blob_indices()[j]];
+    for (int k = 0; k < int8_net.output_blobs()[j]->count(); ++k, ++idx) {
+      LOG(INFO) << output_name << " = " << float_scores[idx] << " (float), "
+          << int8_scores[idx] << " (int8), delta "
+          << int8_scores[idx] - float_scores[idx];
+    }
+  }
+  return 0;
+}
+RegisterBrewFunction(quantize);
+
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
@@ -202,6 +276,7 @@ int time() {
   } else {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_num_threads(FLAGS_threads);
   }
   // Instantiate the caffe net.
   Net<float> caffe_net(FLAGS_model, caffe::TRAIN);
@@ -275,6 +350,7 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  caffe_net.LogMemoryUsage();
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -290,7 +366,8 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  quantize        calibrate a model for int8 CPU inference");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
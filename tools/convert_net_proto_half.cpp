@@ -0,0 +1,32 @@
+// This is a script to convert the weights of a trained network to half
+// precision, which halves the size of the file.
+// Usage:
+//    convert_net_proto_half net_proto_file_in net_proto_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: "
+        << "convert_net_proto_half net_proto_file_in net_proto_file_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  string input_filename(argv[1]);
+  ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+  ConvertNetWeightsToHalf(&net_param);
+  WriteProtoToBinaryFile(net_param, argv[2]);
+
+  LOG(ERROR) << "Wrote half precision NetParameter binary proto to "
+             << argv[2];
+  return 0;
+}
@@ -0,0 +1,41 @@
+// This is a script to convert a trained binary NetParameter (a caffemodel)
+// into a flat weight map file that Net::CopyTrainedLayersFrom can mmap.
+// Usage:
+//    convert_weight_map net_proto_file_in weight_map_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/weight_map.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: "
+        << "convert_weight_map net_proto_file_in weight_map_file_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  string input_filename(argv[1]);
+  if (!ReadProtoFromBinaryFile(input_filename, &net_param)) {
+    LOG(ERROR) << "Failed to parse input binary file as NetParameter: "
+               << input_filename;
+    return 2;
+  }
+  if (NetNeedsUpgrade(net_param) &&
+      !UpgradeNetAsNeeded(input_filename, &net_param)) {
+    LOG(ERROR) << "Encountered error(s) while upgrading NetParameter; "
+               << "see details above.";
+    return 3;
+  }
+
+  WriteWeightMap(net_param, argv[2]);
+
+  LOG(ERROR) << "Wrote weight map to " << argv[2];
+  return 0;
+}
@@ -0,0 +1,117 @@
+// This program compares the per-layer forward time of a net in the TEST phase
+// with and without activations fused into the preceding convolutions (see
+// NetParameter.fuse_activations), and checks that both give the same outputs.
+// The net should not take any input blobs, e.g. use DummyData.
+// Usage:
+//    fusion_benchmark [FLAGS] net_proto_file
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 20,
+    "The number of forward passes to average the layer times over.");
+
+// Runs iterations forward passes of net, accumulating the time of every
+// layer in time_per_layer (in ms per pass).
+void TimeForward(Net<float>* net, vector<double>* time_per_layer) {
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  const vector<vector<Blob<float>*> >& bottom_vecs = net->bottom_vecs();
+  const vector<vector<Blob<float>*> >& top_vecs = net->top_vecs();
+  time_per_layer->assign(layers.size(), 0.0);
+  // Warm up, so that memory allocation is done.
+  net->ForwardPrefilled();
+  CPUTimer timer;
+  for (int j = 0; j < FLAGS_iterations; ++j) {
+    for (int i = 0; i < layers.size(); ++i) {
+      timer.Start();
+      layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
+      (*time_per_layer)[i] += timer.MilliSeconds() / FLAGS_iterations;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Compare fused and unfused forward times\n"
+        "Usage:\n"
+        "    fusion_benchmark [FLAGS] net_proto_file\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/fusion_benchmark");
+    return 1;
+  }
+  CHECK_GT(FLAGS_iterations, 0);
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &param);
+  param.mutable_state()->set_phase(TEST);
+  param.set_plan_in_place(true);
+  param.set_fuse_activations(true);
+  Caffe::set_random_seed(1701);
+  Net<float> fused_net(param);
+  param.set_fuse_activations(false);
+  Caffe::set_random_seed(1701);
+  Net<float> unfused_net(param);
+
+  // Both nets start from the same seed, so random data layers agree.
+  Caffe::set_random_seed(1702);
+  const vector<Blob<float>*>& fused_outputs = fused_net.ForwardPrefilled();
+  Caffe::set_random_seed(1702);
+  const vector<Blob<float>*>& unfused_outputs =
+      unfused_net.ForwardPrefilled();
+  CHECK_EQ(fused_outputs.size(), unfused_outputs.size());
+  float max_diff = 0;
+  for (int i = 0; i < fused_outputs.size(); ++i) {
+    CHECK_EQ(fused_outputs[i]->count(), unfused_outputs[i]->count());
+    for (int j = 0; j < fused_outputs[i]->count(); ++j) {
+      max_diff = std::max(max_diff, std::fabs(
+          fused_outputs[i]->cpu_data()[j] - unfused_outputs[i]->cpu_data()[j]));
+    }
+  }
+  LOG(INFO) << "Maximum difference of the net outputs: " << max_diff;
+
+  vector<double> fused_time, unfused_time;
+  TimeForward(&fused_net, &fused_time);
+  TimeForward(&unfused_net, &unfused_time);
+  // The layers of both nets are in the same order, except that each fused
+  // convolution stands for itself and the activation after it.
+  const vector<string>& fused_names = fused_net.layer_names();
+  const vector<string>& unfused_names = unfused_net.layer_names();
+  double fused_total = 0, unfused_total = 0;
+  LOG(INFO) << "Average forward time per layer (unfused -> fused): ";
+  for (int i = 0, k = 0; i < fused_names.size(); ++i, ++k) {
+    CHECK_EQ(fused_names[i], unfused_names[k]);
+    string name = fused_names[i];
+    double before = unfused_time[k];
+    if (fused_net.layers()[i]->layer_param().convolution_param()
+        .fused_activation() != ConvolutionParameter_Activation_NONE) {
+      ++k;
+      name += " + " + unfused_names[k];
+      before += unfused_time[k];
+    }
+    fused_total += fused_time[i];
+    unfused_total += before;
+    LOG(INFO) << name << ": " << before << " ms -> " << fused_time[i]
+              << " ms (" << before / fused_time[i] << "x)";
+  }
+  LOG(INFO) << "Average forward pass: " << unfused_total << " ms -> "
+            << fused_total << " ms (" << unfused_total / fused_total << "x)";
+  return 0;
+}
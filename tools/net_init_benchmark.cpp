@@ -0,0 +1,72 @@
+// This program measures how long it takes to construct a Net from each of the
+// given prototxt files, e.g. the deploy prototxts of the model zoo.
+// Usage:
+//    net_init_benchmark [FLAGS] net_proto_file [net_proto_file ...]
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 10,
+    "The number of nets to construct from each prototxt.");
+DEFINE_string(phase, "TEST",
+    "The phase to construct the nets in: TRAIN or TEST.");
+DEFINE_bool(quiet, true,
+    "Drop INFO logs while constructing nets, as test harnesses do.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Measure the time to construct nets\n"
+        "Usage:\n"
+        "    net_init_benchmark [FLAGS] net_proto_file [net_proto_file ...]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/net_init_benchmark");
+    return 1;
+  }
+  CHECK_GT(FLAGS_iterations, 0);
+  CHECK(FLAGS_phase == "TRAIN" || FLAGS_phase == "TEST")
+      << "Unknown phase " << FLAGS_phase;
+  const Phase phase = (FLAGS_phase == "TRAIN") ? TRAIN : TEST;
+  Caffe::set_mode(Caffe::CPU);
+
+  const int log_level = FLAGS_minloglevel;
+  for (int i = 1; i < argc; ++i) {
+    NetParameter param;
+    ReadNetParamsFromTextFileOrDie(argv[i], &param);
+    param.mutable_state()->set_phase(phase);
+    CPUTimer timer;
+    double total_ms = 0;
+    double min_ms = 0;
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      if (FLAGS_quiet) { FLAGS_minloglevel = google::WARNING; }
+      timer.Start();
+      {
+        Net<float> net(param);
+      }
+      timer.Stop();
+      FLAGS_minloglevel = log_level;
+      const double ms = timer.MilliSeconds();
+      total_ms += ms;
+      min_ms = (j == 0 || ms < min_ms) ? ms : min_ms;
+    }
+    LOG(INFO) << argv[i] << ": " << param.layer_size() << " layers, "
+              << "average " << total_ms / FLAGS_iterations << " ms, "
+              << "min " << min_ms << " ms per net.";
+  }
+  return 0;
+}
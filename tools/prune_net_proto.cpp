@@ -0,0 +1,36 @@
+// This is a script to prune the weights of a trained network: it sets the
+// given share of the weights of every Convolution and InnerProduct layer, those
+// of the smallest magnitudes, to zero, so that the layers multiply by the
+// nonzeros only at inference (see caffe/util/sparse.hpp).
+// Usage:
+//    prune_net_proto net_proto_file_in net_proto_file_out sparsity
+
+#include <cstdlib>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 4) {
+    LOG(ERROR) << "Usage: "
+        << "prune_net_proto net_proto_file_in net_proto_file_out sparsity";
+    return 1;
+  }
+  const float sparsity = atof(argv[3]);
+  CHECK(sparsity >= 0 && sparsity <= 1) << "Sparsity must be in [0, 1].";
+
+  NetParameter net_param;
+  string input_filename(argv[1]);
+  ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+  PruneNetWeights(sparsity, &net_param);
+  WriteProtoToBinaryFile(net_param, argv[2]);
+
+  LOG(ERROR) << "Wrote pruned NetParameter binary proto to " << argv[2];
+  return 0;
+}